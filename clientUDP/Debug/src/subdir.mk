@@ -5,17 +5,29 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
 ../src/checkClient.c \
+../src/clientBench.c \
 ../src/clientESONERO.c \
+../src/clientEngine.c \
+../src/clientScript.c \
+../src/clientTransport.c \
 ../src/support.c 
 
 C_DEPS += \
 ./src/checkClient.d \
+./src/clientBench.d \
 ./src/clientESONERO.d \
+./src/clientEngine.d \
+./src/clientScript.d \
+./src/clientTransport.d \
 ./src/support.d 
 
 OBJS += \
 ./src/checkClient.o \
+./src/clientBench.o \
 ./src/clientESONERO.o \
+./src/clientEngine.o \
+./src/clientScript.o \
+./src/clientTransport.o \
 ./src/support.o 
 
 
@@ -31,7 +43,7 @@ src/%.o: ../src/%.c src/subdir.mk
 clean: clean-src
 
 clean-src:
-	-$(RM) ./src/checkClient.d ./src/checkClient.o ./src/clientESONERO.d ./src/clientESONERO.o ./src/support.d ./src/support.o
+	-$(RM) ./src/checkClient.d ./src/checkClient.o ./src/clientBench.d ./src/clientBench.o ./src/clientESONERO.d ./src/clientESONERO.o ./src/clientEngine.d ./src/clientEngine.o ./src/clientScript.d ./src/clientScript.o ./src/clientTransport.d ./src/clientTransport.o ./src/support.d ./src/support.o
 
 .PHONY: clean-src
 
@@ -14,7 +14,8 @@
 #include <unistd.h>
 #include <stdbool.h>
 #if defined WIN32
-#include <winsock.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #else
 #define closesocket close
 #include <netdb.h>
@@ -24,11 +25,23 @@
 
 #include "checkClient.h" // Header file for client-side functions
 #include "clientData.h" // Header file for client-side data
+#include "clientTransport.h" // Header file for the UDP, Unix socket and shared-memory transports
+#include "clientBench.h" // Header file for the load generator
+#include "clientEngine.h" // Header file for the pipelined client engine
+#include "clientScript.h" // Header file for the scripted client mode
 
 #define BUFFER_SIZE 6	// Define the maximum buffer size for input data
 
 #define PASS_LENGHT 33	// Maximum length of the password
 
-#define port 57015 // The port number used for the server
+#define SERVER_PORT "57015" // Default port of the server (-p)
 
-#define SERVER_ADDR "passwdgen.uniba.it" // Server address
+#define SERVER_ADDR "passwdgen.uniba.it" // Default server host name or address (-s)
+
+#define BENCH_CONCURRENCY 64 // Default number of requests in flight of the closed loop benchmark
+
+#define BENCH_DURATION 10 // Default length of a benchmark run, in seconds
+
+#define BENCH_TIMEOUT_MS 1000 // Default time after which a benchmark request is counted as lost
+
+void errorhandler(char *errorMessage);
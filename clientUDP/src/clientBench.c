@@ -0,0 +1,407 @@
+/*
+ ============================================================================
+ Name        : clientBench.c (CLIENT)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the load generator / benchmark mode
+ ============================================================================
+ */
+
+#include "client.h"
+#include "../../common/aead.h" // Sealed replies
+
+#if !defined WIN32
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+
+#define HIST_HALF (1 << (BENCH_HIST_SUB_BITS - 1))
+#define HIST_BUCKETS ((64 - BENCH_HIST_SUB_BITS + 1) * HIST_HALF + HIST_HALF)
+
+/*
+ * Latency histogram with HdrHistogram bucketing: values below 2^SUB_BITS have
+ * their own bucket, larger values keep their SUB_BITS most significant bits.
+ * Recording is one count increment, whatever the value.
+ */
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} latency_histogram;
+
+// A request waiting for its reply
+typedef struct {
+    uint32_t id;
+    int pending;
+    uint64_t sent;      // Send time (open loop: the time it was due), nanoseconds
+    unsigned int cookie; // Generation of the cookie the request carried, 0 if none
+} bench_slot;
+
+// Address validation cookie of the server (see common/protocol.h)
+typedef struct {
+    unsigned char bytes[PROTO_COOKIE_SIZE];
+    unsigned int generation; // Cookies received so far, 0 until the first one: every request then carries it
+} bench_cookie;
+
+// Counters of a run
+typedef struct {
+    unsigned long long sent;
+    unsigned long long received;
+    unsigned long long lost;         // No reply within the timeout
+    unsigned long long errors;       // Reply with an error status
+    unsigned long long retries;      // Request sent again with a new cookie of the server
+    unsigned long long late;         // Reply to a request already counted as lost, or duplicated
+    unsigned long long invalid;      // Datagram that is not a reply, or a sealed reply that does not open
+    unsigned long long send_errors;  // Request the socket refused to send
+} bench_counters;
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ * @return the current time in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief Returns the histogram bucket of a value.
+ * @param[in] value: the value.
+ * @return the bucket index.
+ */
+static unsigned int hist_bucket(uint64_t value)
+{
+    if (value < 2 * HIST_HALF)
+        return (unsigned int) value;
+    unsigned int shift = 63 - __builtin_clzll(value) - (BENCH_HIST_SUB_BITS - 1);
+    return shift * HIST_HALF + (unsigned int) (value >> shift);
+}
+
+/**
+ * @brief Returns the largest value counted in a histogram bucket.
+ * @param[in] bucket: the bucket index.
+ * @return the upper bound of the bucket.
+ */
+static uint64_t hist_upper(unsigned int bucket)
+{
+    if (bucket < 2 * HIST_HALF)
+        return bucket;
+    unsigned int shift = bucket / HIST_HALF - 1;
+    return ((uint64_t) (bucket - shift * HIST_HALF + 1) << shift) - 1;
+}
+
+/**
+ * @brief Counts a value in a histogram.
+ * @param[in,out] h: the histogram.
+ * @param[in] value: the value.
+ */
+static void hist_record(latency_histogram *h, uint64_t value)
+{
+    h->counts[hist_bucket(value)]++;
+    if (h->total == 0 || value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+    h->total++;
+}
+
+/**
+ * @brief Returns the value below which a percentage of the recorded values fall.
+ * @param[in] h: the histogram.
+ * @param[in] percentile: the percentage, between 0 and 100.
+ * @return the upper bound of the bucket holding the percentile.
+ */
+static uint64_t hist_percentile(const latency_histogram *h, double percentile)
+{
+    uint64_t rank = (uint64_t) (percentile / 100.0 * h->total + 0.5);
+    uint64_t seen = 0;
+
+    if (rank < 1)
+        rank = 1;
+    for (unsigned int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank)
+            return hist_upper(b) < h->max ? hist_upper(b) : h->max;
+    }
+    return h->max;
+}
+
+/**
+ * @brief Sends one request for a password of random type and length.
+ * @param[in,out] t: the transport.
+ * @param[in] opt: the load settings.
+ * @param[in,out] seed: the state of the type/length generator.
+ * @param[in] id: the request ID.
+ * @param[in] cookie: the cookie of the server, sent when it has one.
+ * @return 0 on success, -1 if the transport refused the datagram.
+ */
+static int send_request(client_transport *t, const bench_options *opt, unsigned int *seed, uint32_t id,
+                        const bench_cookie *cookie)
+{
+    unsigned char request[sizeof(proto_request_header) + sizeof(proto_spec) + 1 + PROTO_MAX_POLICY + PROTO_COOKIE_SIZE];
+    proto_request_header *h = (proto_request_header *) request;
+    proto_spec *spec = (proto_spec *) (h + 1);
+    size_t types = strlen(opt->types), size = sizeof(proto_request_header) + sizeof(proto_spec);
+
+    h->magic = PROTO_MAGIC;
+    h->version = PROTO_VERSION;
+    h->flags = opt->key != NULL ? PROTO_FLAG_SEALED : 0;
+    h->spec_count = 1;
+    h->request_id = htonl(id);
+    spec->type = (uint8_t) opt->types[rand_r(seed) % types];
+    if (spec->type == PROTO_TYPE_PASSPHRASE)
+        spec->length = (uint8_t) (PROTO_MIN_WORDS + rand_r(seed) % (PROTO_MAX_WORDS - PROTO_MIN_WORDS + 1));
+    else
+        spec->length = (uint8_t) (opt->min_length + rand_r(seed) % (opt->max_length - opt->min_length + 1));
+    spec->count = htons(1);
+    if (spec->type == PROTO_TYPE_POLICY && opt->policy != NULL) {
+        size_t policy = strlen(opt->policy); // At most PROTO_MAX_POLICY, checked by the caller
+        h->flags |= PROTO_FLAG_POLICY;
+        request[size] = (unsigned char) policy;
+        memcpy(request + size + 1, opt->policy, policy);
+        size += 1 + policy;
+    }
+    if (cookie->generation != 0) {
+        h->flags |= PROTO_FLAG_COOKIE;
+        memcpy(request + size, cookie->bytes, PROTO_COOKIE_SIZE);
+        size += PROTO_COOKIE_SIZE;
+    }
+
+    return transport_send(t, request, size) == (int) size ? 0 : -1;
+}
+
+/**
+ * @brief Reads every reply already received and matches it with its request.
+ *
+ * A request answered with PROTO_STATUS_RETRY is sent again at once with the
+ * cookie of the reply, unless it already carried that cookie.
+ *
+ * @param[in,out] t: the transport.
+ * @param[in] opt: the load settings.
+ * @param[in,out] seed: the state of the type/length generator.
+ * @param[in,out] window: the requests in flight.
+ * @param[in,out] in_flight: the number of requests in flight.
+ * @param[in,out] c: the run counters.
+ * @param[in,out] h: the latency histogram.
+ * @param[in,out] cookie: the cookie of the server.
+ */
+static void drain_replies(client_transport *t, const bench_options *opt, unsigned int *seed, bench_slot *window,
+                          unsigned int *in_flight, bench_counters *c, latency_histogram *h, bench_cookie *cookie)
+{
+    const unsigned char *key = opt->key;
+    unsigned char reply[PROTO_MAX_DATAGRAM];
+    int n;
+
+    while ((n = transport_recv(t, reply, sizeof(reply))) >= 0 || errno == ECONNREFUSED || errno == EINTR) {
+        if (n < 0) {
+            if (errno == ECONNREFUSED)
+                c->send_errors++; // ICMP port unreachable reported for an earlier request
+            continue;
+        }
+        uint64_t now = now_ns();
+        if (key != NULL)
+            n = aead_open_reply(key, reply, (size_t) n);
+        const proto_reply_header *r = n >= 0 ? proto_parse_reply(reply, n) : NULL;
+        if (r == NULL || ((r->flags & PROTO_REPLY_SEALED) && key == NULL)) {
+            c->invalid++;
+            continue;
+        }
+        uint32_t id = ntohl(r->request_id);
+        bench_slot *s = &window[id & (BENCH_WINDOW - 1)];
+        if (!s->pending || s->id != id) {
+            c->late++;
+            continue;
+        }
+        if (r->status == PROTO_STATUS_RETRY && n == (int) (sizeof(*r) + PROTO_COOKIE_SIZE)) {
+            if (cookie->generation == 0 || memcmp(cookie->bytes, r + 1, PROTO_COOKIE_SIZE) != 0) {
+                memcpy(cookie->bytes, r + 1, PROTO_COOKIE_SIZE);
+                cookie->generation++;
+            }
+            if (s->cookie != cookie->generation) {
+                // Sent again under the same ID: the latency counts the round trip of the cookie
+                if (send_request(t, opt, seed, id, cookie) < 0)
+                    c->send_errors++; // Left pending: the timeout counts it as lost
+                s->cookie = cookie->generation;
+                c->retries++;
+                continue;
+            }
+        }
+        s->pending = 0;
+        (*in_flight)--;
+        if (r->status != PROTO_STATUS_OK)
+            c->errors++;
+        else {
+            c->received++;
+            hist_record(h, now - s->sent);
+        }
+    }
+}
+
+/**
+ * @brief Prints the results of a run.
+ * @param[in] opt: the load settings.
+ * @param[in] c: the run counters.
+ * @param[in] h: the latency histogram.
+ * @param[in] elapsed: the length of the run in nanoseconds.
+ */
+static void print_report(const bench_options *opt, const bench_counters *c, const latency_histogram *h,
+                         uint64_t elapsed)
+{
+    static const double percentiles[] = { 50, 75, 90, 99, 99.9, 99.99, 100 };
+    double seconds = elapsed / 1e9;
+
+    if (opt->rate > 0)
+        printf("\nOpen loop, %u requests/s", opt->rate);
+    else
+        printf("\nClosed loop, %u requests in flight", opt->concurrency);
+    printf(", %u s, types %s, lengths %d-%d, timeout %u ms%s\n", opt->duration, opt->types,
+           opt->min_length, opt->max_length, opt->timeout_ms, opt->key != NULL ? ", sealed replies" : "");
+
+    printf("%-12s %12llu\n", "sent", c->sent);
+    printf("%-12s %12llu  (%.1f passwords/s)\n", "received", c->received, c->received / seconds);
+    printf("%-12s %12llu  (%.3f%%)\n", "lost", c->lost, c->sent ? 100.0 * c->lost / c->sent : 0.0);
+    printf("%-12s %12llu\n", "errors", c->errors);
+    printf("%-12s %12llu\n", "retries", c->retries);
+    printf("%-12s %12llu\n", "late", c->late);
+    printf("%-12s %12llu\n", "invalid", c->invalid);
+    printf("%-12s %12llu\n", "send errors", c->send_errors);
+
+    if (h->total == 0)
+        return;
+    printf("\nLatency (us): min %.1f  p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n", h->min / 1e3,
+           hist_percentile(h, 50) / 1e3, hist_percentile(h, 99) / 1e3, hist_percentile(h, 99.9) / 1e3,
+           h->max / 1e3);
+    printf("%12s %12s %12s\n", "value (us)", "percentile", "count");
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        uint64_t value = hist_percentile(h, percentiles[i]);
+        uint64_t count = 0;
+        for (unsigned int b = 0; b <= hist_bucket(value); b++)
+            count += h->counts[b];
+        printf("%12.1f %11.3f%% %12llu\n", value / 1e3, percentiles[i], (unsigned long long) count);
+    }
+}
+
+/**
+ * @brief Loads the server with single password batch requests and reports the results.
+ * @param[in,out] transport: the transport to the server.
+ * @param[in] opt: the load settings.
+ * @return 0 on success, -1 on transport errors.
+ */
+int run_bench(client_transport *transport, const bench_options *opt)
+{
+    bench_slot *window = calloc(BENCH_WINDOW, sizeof(bench_slot));
+    latency_histogram *h = calloc(1, sizeof(latency_histogram));
+    bench_counters c;
+    bench_cookie cookie = { { 0 }, 0 };
+    unsigned int seed = (unsigned int) time(NULL);
+    unsigned int in_flight = 0;
+    uint32_t next_id = 0, oldest = 0;
+    int ret = -1;
+
+    memset(&c, 0, sizeof(c));
+    if (window == NULL || h == NULL) {
+        errorhandler("Error, benchmark buffers allocation failed.\n");
+        goto out;
+    }
+
+    const uint64_t timeout = (uint64_t) opt->timeout_ms * 1000000u;
+    const uint64_t interval = opt->rate > 0 ? 1000000000u / opt->rate : 0;
+    const uint64_t start = now_ns(), end = start + (uint64_t) opt->duration * 1000000000u;
+    uint64_t next_send = start, now;
+
+    for (;;) {
+        now = now_ns();
+
+        // Requests are sent in ID order with the same timeout: the oldest ones expire first
+        while (oldest != next_id) {
+            bench_slot *s = &window[oldest & (BENCH_WINDOW - 1)];
+            if (s->pending) {
+                if (now - s->sent < timeout)
+                    break;
+                s->pending = 0;
+                in_flight--;
+                c.lost++;
+            }
+            oldest++;
+        }
+
+        int sending = now < end;
+        if (!sending && in_flight == 0)
+            break;
+
+        if (sending) {
+            while (opt->rate > 0 ? next_send <= now : in_flight < opt->concurrency) {
+                if (next_id - oldest == BENCH_WINDOW) {
+                    // Window full: give up on the oldest request to make room
+                    bench_slot *s = &window[oldest & (BENCH_WINDOW - 1)];
+                    if (s->pending) {
+                        s->pending = 0;
+                        in_flight--;
+                        c.lost++;
+                    }
+                    oldest++;
+                }
+                uint64_t due = opt->rate > 0 ? next_send : now;
+                next_send += interval;
+                if (send_request(transport, opt, &seed, next_id, &cookie) < 0) {
+                    c.send_errors++;
+                    if (opt->rate == 0)
+                        break; // Retry at the next round instead of spinning
+                    continue;
+                }
+                bench_slot *s = &window[next_id & (BENCH_WINDOW - 1)];
+                s->id = next_id++;
+                s->pending = 1;
+                s->sent = due;
+                s->cookie = cookie.generation;
+                in_flight++;
+                c.sent++;
+            }
+        }
+
+        int wait_ms = BENCH_POLL_MS;
+        if (sending && opt->rate > 0) {
+            uint64_t until_next = next_send > now ? next_send - now : 0;
+            if (until_next / 1000000u < (uint64_t) wait_ms)
+                wait_ms = (int) (until_next / 1000000u);
+        }
+        struct pollfd pfd = { transport_fd(transport), POLLIN, 0 };
+        if (poll(&pfd, 1, wait_ms) < 0 && errno != EINTR) {
+            perror("Error waiting for the replies");
+            goto out;
+        }
+        drain_replies(transport, opt, &seed, window, &in_flight, &c, h, &cookie);
+    }
+
+    print_report(opt, &c, h, (end < now ? end : now) - start);
+    ret = 0;
+
+out:
+    free(window);
+    free(h);
+    return ret;
+}
+
+#else
+
+/**
+ * @brief Loads the server with single password batch requests and reports the results.
+ * @param[in,out] transport: the transport to the server.
+ * @param[in] opt: the load settings.
+ * @return always -1: the benchmark needs poll() and clock_gettime().
+ */
+int run_bench(client_transport *transport, const bench_options *opt)
+{
+    (void) transport;
+    (void) opt;
+    errorhandler("Error, the benchmark mode is not available on Windows.\n");
+    return -1;
+}
+
+#endif /* WIN32 */
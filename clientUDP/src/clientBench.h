@@ -0,0 +1,51 @@
+/*
+ ============================================================================
+ Name        : clientBench.h (CLIENT)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the load generator / benchmark mode
+ ============================================================================
+ */
+#ifndef CLIENT_BENCH_H
+#define CLIENT_BENCH_H
+
+#include "clientTransport.h"
+
+#define BENCH_WINDOW 65536 // Largest number of requests in flight (power of two)
+
+#define BENCH_POLL_MS 10 // Longest wait for replies before timeouts are checked again, in milliseconds
+
+#define BENCH_HIST_SUB_BITS 7 // Latency histogram precision: 2^(BITS-1) sub-buckets per power of two (< 1.6% error)
+
+// Load generator settings
+typedef struct {
+    unsigned int concurrency;   // Closed loop: requests kept in flight (used when rate is 0)
+    unsigned int rate;          // Open loop: requests sent per second, 0 for closed loop
+    unsigned int duration;      // Seconds of sending
+    unsigned int timeout_ms;    // A request without reply after this time is counted as lost
+    const char *types;          // Password types to mix, chosen uniformly
+    int min_length;             // Shortest password asked
+    int max_length;             // Longest password asked (passphrases ask PROTO_MIN_WORDS to PROTO_MAX_WORDS words)
+    const char *policy;         // Policy sent with the PROTO_TYPE_POLICY requests, NULL if none
+    const unsigned char *key;   // Pre-shared key (AEAD_KEY_SIZE bytes) of the sealed replies, NULL for replies in the clear
+} bench_options;
+
+/**
+ * @brief Loads the server with single password batch requests and reports the results.
+ *
+ * Every request is a batch protocol request (see common/protocol.h) asking for
+ * one password of a random type and length, tagged with a sequential request ID
+ * so that replies are matched even out of order. In closed loop `concurrency`
+ * requests are kept in flight; in open loop requests are sent at `rate` per
+ * second whatever the replies, and latency is measured from the time the request
+ * was due, so that a stalled server is not hidden (no coordinated omission).
+ * At the end throughput, loss and an HDR-style latency percentile table are printed.
+ *
+ * @param[in,out] transport: the transport to the server, see transport_open().
+ * @param[in] opt: the load settings.
+ * @return 0 on success, -1 on transport errors.
+ */
+int run_bench(client_transport *transport, const bench_options *opt);
+
+#endif /* CLIENT_BENCH_H */
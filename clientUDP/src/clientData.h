@@ -10,10 +10,6 @@
 #ifndef DATA_H
 #define DATA_H
 
-// Structure representing a message with type and length
-typedef struct {
-    char type;      // Password type, for example: 'a', 'n', 's', 'm'
-    int length;     // Length of the password
-} msg;
+#include "../../common/protocol.h" // Wire format shared with the server
 
 #endif /* DATA_H */
@@ -9,6 +9,8 @@
  */
 
 #include "client.h"
+#include <errno.h>
+#include "../../common/aead.h" // Pre-shared key of the sealed replies
 
 
 /**
@@ -63,7 +65,216 @@ void help_menu()
 }
 
 
-int main(void) {
+/**
+ * @brief Prints a password received for an interactive request.
+ *
+ * @param[in] ctx: unused.
+ * @param[in] index: the position of the password in the request.
+ * @param[in] password: the password.
+ * @param[in] length: the password length.
+ */
+static void print_password(void *ctx, unsigned int index, const char *password, size_t length)
+{
+    (void) ctx;
+    (void) index;
+    (void) length;
+    const char *passRecv = "Password received: ";
+    typewriterEffect(passRecv,15000);
+    printf("%s\n", password);
+}
+
+/**
+ * @brief Reports an interactive request that ended without password.
+ *
+ * @param[in] ctx: unused.
+ * @param[in] status: the final status of the request.
+ */
+static void print_status(void *ctx, int status)
+{
+    (void) ctx;
+    if (status == ENGINE_STATUS_TIMEOUT)
+        printf("Error, no response from the server.\n");
+    else if (status != PROTO_STATUS_OK)
+        printf("Server error: %s\n", proto_status_text(status));
+}
+
+/**
+ * @brief Checks a requested password type: a built-in one, a passphrase, or the policy type when a policy was given.
+ *
+ * @param[in] type: the requested type.
+ * @param[in] policy: the policy given with -y, NULL if none.
+ * @return `true` if the type can be requested.
+ */
+static bool checkType(char type, const char *policy)
+{
+    return (type != 'h' && checkFirst(type)) || type == PROTO_TYPE_PASSPHRASE ||
+           (type == PROTO_TYPE_POLICY && policy != NULL); // h is the help command
+}
+
+/**
+ * @brief Reads the pre-shared key of the sealed replies.
+ *
+ * @param[in] path: the key file, 64 hexadecimal digits (the file given to the server with -K).
+ * @param[out] key: the key.
+ * @return 0 on success, -1 on error (message printed).
+ */
+static int load_key(const char *path, unsigned char key[AEAD_KEY_SIZE])
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot read the key file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char text[4 * AEAD_KEY_SIZE]; // Room for the digits and some blanks
+    size_t n = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[n] = '\0';
+
+    int valid = aead_parse_key(text, key) == 0;
+    memset(text, 0, sizeof(text));
+    if (!valid)
+        fprintf(stderr, "%s is not a key: 64 hexadecimal digits expected\n", path);
+    return valid ? 0 : -1;
+}
+
+/**
+ * @brief Prints the command line usage of the client.
+ *
+ * @param[in] prog: the program name (argv[0]).
+ */
+void usage(const char *prog)
+{
+    printf("Usage: %s [-s ENDPOINT] [-p PORT] [-k FILE] [-B [-c CONCURRENCY | -r RATE] [-d SECONDS] [-t TYPES] [-l MIN-MAX] [-T MS]] [-y SPEC]\n"
+           "       %s [-s ENDPOINT] [-p PORT] [-k FILE] [-y SPEC] [-w WINDOW] [-f FILE] [\"TYPE LENGTH [COUNT]\" ...]\n"
+           "  no option       : interactive mode\n"
+           "  -s ENDPOINT     : server host name, IPv4 or IPv6 address (default %s), udp://HOST[:PORT],\n"
+           "                    unix://PATH (Unix socket of a server on this host, see its -u) or\n"
+           "                    shm://PATH (shared-memory rings, see its -m)\n"
+           "  -p PORT         : server port when the endpoint has none (default %s)\n"
+           "  -k FILE         : ask for replies sealed with XChaCha20-Poly1305 under the pre-shared key of FILE\n"
+           "                    (64 hex digits, the key of the server -K); forged or altered replies are dropped\n"
+           "  -B              : benchmark mode, load the server and report throughput, loss and latency\n"
+           "  -c CONCURRENCY  : closed loop, keep CONCURRENCY requests in flight (default %d)\n"
+           "  -r RATE         : open loop, send RATE requests per second whatever the replies\n"
+           "  -d SECONDS      : length of the run (default %d)\n"
+           "  -t TYPES        : password types to mix (default namsu; w asks passphrases of 3 to 12 words)\n"
+           "  -l MIN-MAX      : range of password lengths to mix (default 6-32)\n"
+           "  -T MS           : time after which a request is counted as lost (default %d)\n"
+           "  -y SPEC         : password policy of the '*' type, e.g. \"base=s upper=2 digit=2 symbol=1\"\n"
+           "                    (chars=SET base=T upper=N lower=N digit=N symbol=N unique)\n"
+           "  -f FILE         : scripted mode, run the request lines of FILE (- for stdin) and print\n"
+           "                    the passwords one per line, in order\n"
+           "  TYPE LENGTH [COUNT] : scripted mode, a request line given on the command line (e.g. \"s 16 100\")\n"
+           "  -w WINDOW       : scripted mode, requests in flight (default %d)\n",
+           prog, prog, SERVER_ADDR, SERVER_PORT, BENCH_CONCURRENCY, BENCH_DURATION, BENCH_TIMEOUT_MS, ENGINE_WINDOW);
+}
+
+int main(int argc, char *argv[]) {
+
+    bench_options bench;
+    bench.concurrency = BENCH_CONCURRENCY;
+    bench.rate = 0;
+    bench.duration = BENCH_DURATION;
+    bench.timeout_ms = BENCH_TIMEOUT_MS;
+    bench.types = "namsu";
+    bench.min_length = 6;
+    bench.max_length = PASS_LENGHT - 1;
+    bench.policy = NULL;
+    bench.key = NULL;
+    unsigned char key[AEAD_KEY_SIZE];
+    bool benchmark = false;
+    const char *host = SERVER_ADDR;
+    const char *service = SERVER_PORT;
+    const char *script = NULL; // -f FILE
+    char **lines = calloc(argc, sizeof(*lines)); // Request lines of the command line
+    int line_count = 0;
+    unsigned int window = ENGINE_WINDOW;
+    if (lines == NULL)
+        return -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-B") == 0) {
+            benchmark = true;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            host = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            service = argv[++i];
+            int value = atoi(service);
+            if (value < 1 || value > 65535) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1 || value > BENCH_WINDOW) {
+                usage(argv[0]);
+                return -1;
+            }
+            bench.concurrency = value;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1) {
+                usage(argv[0]);
+                return -1;
+            }
+            bench.rate = value;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1) {
+                usage(argv[0]);
+                return -1;
+            }
+            bench.duration = value;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            bench.types = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d-%d", &bench.min_length, &bench.max_length) != 2 ||
+                bench.min_length < 6 || bench.max_length > PASS_LENGHT - 1 || bench.min_length > bench.max_length) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1) {
+                usage(argv[0]);
+                return -1;
+            }
+            bench.timeout_ms = value;
+        } else if (strcmp(argv[i], "-y") == 0 && i + 1 < argc) {
+            bench.policy = argv[++i];
+            if (strlen(bench.policy) > PROTO_MAX_POLICY) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            if (load_key(argv[++i], key) < 0)
+                return -1;
+            bench.key = key;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            script = argv[++i];
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1 || value > ENGINE_QUEUE) {
+                usage(argv[0]);
+                return -1;
+            }
+            window = value;
+        } else if (argv[i][0] != '-') {
+            lines[line_count++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    // Checked once every option is known: '*' needs -y
+    bool valid = bench.types[0] != '\0';
+    for (const char *t = bench.types; *t; t++)
+        valid = valid && checkType(*t, bench.policy);
+    if (!valid) {
+        usage(argv[0]);
+        return -1;
+    }
 
     //Winsock inizialization
     #if defined WIN32
@@ -74,37 +285,49 @@ int main(void) {
     }
     #endif
 
-    int client_socket;
-    client_socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP); //socket creation
-    if (client_socket < 0) {
-        errorhandler("socket creation failed.\n");
+    // Resolve the server (IPv4 or IPv6) or attach to its local endpoint
+    client_transport transport;
+    if (transport_open(&transport, host, service) < 0) {
         clearwinsock();
-        return -1;
-    }
-
-    // Resolve server hostname and handle errors if the host is not found.
-    struct hostent *serverAddr;
-    serverAddr = gethostbyname(SERVER_ADDR);
-    	 if (serverAddr == NULL) {
-    		 errorhandler("Error, no such host\n");
 			#if defined WIN32
     	     	system("pause");
 			#endif
-    	     exit(EXIT_FAILURE);
-    	 }
+        exit(EXIT_FAILURE);
+    }
 
-    // Define the server address structure
-    struct sockaddr_in server_addr;  // // Specify IPv4 address family
-    memset(&server_addr, 0, sizeof(server_addr)); // Initialize server_addr
-    server_addr.sin_family = AF_INET;  // Set server IP address
-    server_addr.sin_port = htons(57015); // Set server port in network byte order
+    if (benchmark) {
+        int result = run_bench(&transport, &bench);
+        transport_close(&transport);
+        clearwinsock();
+        return result;
+    }
 
-    memcpy(&server_addr.sin_addr.s_addr, serverAddr->h_addr, serverAddr->h_length);
+    // Pipelined engine: matches the reply to the request and retransmits lost requests
+    engine_options engine_opt;
+    engine_defaults(&engine_opt);
+    engine_opt.policy = bench.policy;
+    engine_opt.key = bench.key;
+    engine_opt.window = window;
+
+    if (script != NULL || line_count > 0) {
+        int result = run_script(&transport, &engine_opt, script, lines, line_count);
+        free(lines);
+        transport_close(&transport);
+        clearwinsock();
+        return result;
+    }
+    free(lines);
 
-    // Define buffers for input and received password
-	char pass[PASS_LENGHT];
+    client_engine engine;
+    if (engine_open(&engine, &transport, &engine_opt) < 0) {
+        errorhandler("Error, client engine initialization failed.\n");
+        transport_close(&transport);
+        clearwinsock();
+        return -1;
+    }
+
+    // Define buffer for input
 	char input[BUFFER_SIZE];
-	unsigned int server_addr_length = sizeof(server_addr);
 
 		while (1)
 	    {
@@ -114,6 +337,7 @@ int main(void) {
 			bool hflag;			// Flag to indicate if help or additional options are requested
 			bool passlength;   // Flag to indicate if the password length matches the required length
 			msg m; // Structure to hold message type and length
+			int length; // Requested length, host byte order
 
              do{
 
@@ -131,6 +355,8 @@ int main(void) {
             	         "\n - m: mixed "
             	         "\n - s: secure "
             			 "\n - u: unambiguous"
+            	         "\n - w: passphrase, followed by the number of words (3 to 12, e.g. w 6)"
+            	         "\n - *: the policy given with -y"
             	         "\n - h: help menu "
             	         "\n - q: quit "
             	         "\n ";
@@ -173,7 +399,7 @@ int main(void) {
 				       	// Handle help flag or validate user input format.
 				       	if(hflag)
 				       	hflag = true;
-				       	else if (sscanf(input, " %c %d", &m.type, &m.length) != 2) {
+				       	else if (sscanf(input, " %c %d", &m.type, &length) != 2) {
 				        	const char *invInp = "Invalid input. Please try again.\n";
 				        	typewriterEffect(invInp,15000);
 				        	flagInput = false;
@@ -184,7 +410,7 @@ int main(void) {
 				        // Ensure the first character is a valid type.
 				        if(hflag)
 				        hflag = true;
-				        else if(!checkFirst(m.type))
+				        else if(!checkType(m.type, bench.policy))
 				        {
 				          printf("Error, %c is not a correct input \n", m.type);
 				          continue;
@@ -193,50 +419,41 @@ int main(void) {
 				        // Handle help flag or validate user input format.
 				        if(hflag)
 				        hflag = true;
-				        else if(!pass_lenght(m.length))
+				        else if(m.type == PROTO_TYPE_PASSPHRASE ? length < PROTO_MIN_WORDS || length > PROTO_MAX_WORDS
+				                                                : !pass_lenght(length))
 				        {
 				        	passlength = false;
-				        	 const char *errMsg = "Enter a length between 6 and 32 \n";
+				        	 const char *errMsg = m.type == PROTO_TYPE_PASSPHRASE ? "Enter between 3 and 12 words \n"
+				        	                                                      : "Enter a length between 6 and 32 \n";
 				        	 typewriterEffect(errMsg,15000);
 				        }
 
-             	 }while(!passlength || !checkFirst(m.type) || !checkSpace(input) || !flagInput	|| hflag ); // Repeat until input is valid
+             	 }while(!passlength || !checkType(m.type, bench.policy) || !checkSpace(input) || !flagInput	|| hflag ); // Repeat until input is valid
 
              	 	 if(closeFlag)
              	      break;		// Exit the loop if the user wants to quit
 
-             	 	 	// Convert message length to network byte order (Big-endian)
-				        m.length = htonl(m.length);
-
-				        if (sendto(client_socket, (void *)&m, sizeof(m), 0,(struct sockaddr*)&server_addr,server_addr_length) < 0) {
-				            perror("Error occurred while sending the message.");
-				            break;
+				        // The engine sends the request again if the reply is lost, and gives up after a few tries
+				        engine_handler handler = { print_password, print_status, NULL };
+				        if (engine_get(&engine, m.type, length, 1, &handler) < 0) {
+				            errorhandler("Error, request not valid.\n");
+				            continue;
 				        }
 
-				        // Convert the length back to host byte order
-				        m.length = ntohl(m.length);
-
 				        const char *reqMsg = "Request sent: ";
 				        typewriterEffect(reqMsg,15000);
-				        printf("type = %c, length = %d\n", m.type, m.length);
+				        printf("type = %c, length = %d\n", m.type, length);
 
 				        // Receive the generated password from the server
-				        int recval = recvfrom(client_socket, pass, PASS_LENGHT, 0 , (struct sockaddr*)&server_addr, &server_addr_length);
-				        if (recval > 0) {
-				        	pass[recval] = '\0';
-				        	const char *passRecv = "Password received: ";
-				        	typewriterEffect(passRecv,15000);
-				            printf("%s\n", pass);
-				        } else {
+				        if (engine_wait(&engine) < 0) {
 				            perror("Error receiving the response from the server.\n");
 				            break;
 				        }
-			   // Clear the password buffer for the next iteration
-			   memset(pass, 0, sizeof(pass));
 			 }
 
 	// Close the socket and cleanup
-    closesocket(client_socket);
+    engine_close(&engine);
+    transport_close(&transport);
     clearwinsock();
 	#if defined WIN32
     system("pause");
@@ -0,0 +1,447 @@
+/*
+ ============================================================================
+ Name        : clientEngine.c (CLIENT)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the pipelined asynchronous client engine
+ ============================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#if defined WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <arpa/inet.h>
+#endif
+#if defined __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "clientEngine.h"
+#include "clientData.h"
+#include "../../common/aead.h" // Sealed replies
+
+// States of a request slot
+#define ENGINE_FREE 0     // Completed, or never used
+#define ENGINE_QUEUED 1   // Waiting for room in the window
+#define ENGINE_SENT 2     // In flight
+
+_Static_assert(PROTO_MAX_FRAGMENTS <= 32, "the fragments of a reply must fit in `received`");
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ * @return the current time in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief Returns the number of passwords in every full fragment of a reply.
+ * @param[in] e: the engine.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length, or the word count of a passphrase.
+ * @return the passwords per fragment.
+ */
+static unsigned int per_fragment(const client_engine *e, char type, int length)
+{
+    // The server fills every fragment but the last one, by the longest entry of the request
+    size_t room = proto_reply_room(e->opt.key != NULL) - sizeof(proto_reply_header);
+    return (unsigned int) (room / proto_entry_size((unsigned char) type, length));
+}
+
+/**
+ * @brief Checks the length of a request.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length, or the word count of a passphrase.
+ * @return non-zero if the server may serve it.
+ */
+static int length_valid(char type, int length)
+{
+    if (type == PROTO_TYPE_PASSPHRASE)
+        return length >= PROTO_MIN_WORDS && length <= PROTO_MAX_WORDS;
+    return length >= PROTO_MIN_LENGTH && length <= PROTO_MAX_LENGTH;
+}
+
+/**
+ * @brief Sends (or sends again) the datagram of a request.
+ * @param[in,out] e: the engine.
+ * @param[in,out] r: the request.
+ * @param[in] now: the current time in nanoseconds.
+ */
+static void send_request(client_engine *e, engine_request *r, uint64_t now)
+{
+    unsigned char request[sizeof(proto_request_header) + sizeof(proto_spec) + 1 + PROTO_MAX_POLICY + PROTO_COOKIE_SIZE];
+    proto_request_header *h = (proto_request_header *) request;
+    proto_spec *spec = (proto_spec *) (h + 1);
+    size_t size = sizeof(proto_request_header) + sizeof(proto_spec);
+
+    h->magic = PROTO_MAGIC;
+    h->version = PROTO_VERSION;
+    h->flags = e->opt.key != NULL ? PROTO_FLAG_SEALED : 0;
+    h->spec_count = 1;
+    h->request_id = htonl(r->id);
+    spec->type = (uint8_t) r->type;
+    spec->length = (uint8_t) r->length;
+    spec->count = htons((uint16_t) r->count);
+    if (r->type == PROTO_TYPE_POLICY && e->opt.policy != NULL) {
+        size_t policy = strlen(e->opt.policy); // Checked by engine_open()
+        h->flags |= PROTO_FLAG_POLICY;
+        request[size] = (unsigned char) policy;
+        memcpy(request + size + 1, e->opt.policy, policy);
+        size += 1 + policy;
+    }
+    if (e->has_cookie) {
+        h->flags |= PROTO_FLAG_COOKIE;
+        memcpy(request + size, e->cookie, PROTO_COOKIE_SIZE);
+        size += PROTO_COOKIE_SIZE;
+    }
+
+    // A datagram the transport refuses is handled like a lost one: the timeout sends it again
+    transport_send(e->transport, request, size);
+    r->attempts++;
+    r->deadline = now + r->timeout;
+}
+
+/**
+ * @brief Ends a request and calls its on_done callback.
+ * @param[in,out] e: the engine.
+ * @param[in,out] r: the request.
+ * @param[in] status: the final status.
+ */
+static void complete(client_engine *e, engine_request *r, int status)
+{
+    engine_handler handler = r->handler; // The callback may queue a new request
+    r->state = ENGINE_FREE;
+    e->in_flight--;
+    if (handler.on_done)
+        handler.on_done(handler.ctx, status);
+}
+
+/**
+ * @brief Delivers the passwords of a reply fragment to its request.
+ * @param[in,out] e: the engine.
+ * @param[in] reply: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ */
+static void handle_reply(client_engine *e, const unsigned char *reply, size_t length)
+{
+    const proto_reply_header *h = proto_parse_reply(reply, length);
+    if (h == NULL || ((h->flags & PROTO_REPLY_SEALED) && e->opt.key == NULL))
+        return; // Sealed replies are only handled once opened
+
+    uint32_t id = ntohl(h->request_id);
+    engine_request *r = &e->requests[id & (ENGINE_QUEUE - 1)];
+    if (r->state != ENGINE_SENT || r->id != id)
+        return; // Late or duplicated reply
+
+    if (h->status == PROTO_STATUS_RETRY && length == sizeof(*h) + PROTO_COOKIE_SIZE && r->attempts <= e->opt.retries) {
+        // The server wants a proof of our address first: its cookie goes with this request and the next ones
+        memcpy(e->cookie, h + 1, PROTO_COOKIE_SIZE);
+        e->has_cookie = 1;
+        send_request(e, r, now_ns());
+        return;
+    }
+    if (h->status != PROTO_STATUS_OK) {
+        complete(e, r, h->status);
+        return;
+    }
+    if (h->fragments != r->fragments || (r->received >> h->fragment) & 1)
+        return; // Not this request's layout, or fragment already delivered
+
+    // Check the whole fragment before delivering anything from it: it holds exactly its share of the request
+    // (a forged `passwords 0` must not complete it), passwords have the requested length, passphrases any length
+    // up to PROTO_MAX_PASSPHRASE
+    unsigned int passwords = ntohs(h->passwords);
+    unsigned int share = per_fragment(e, r->type, r->length), first = h->fragment * share;
+    if (passwords != (r->count - first < share ? r->count - first : share))
+        return;
+    const unsigned char *p = (const unsigned char *) (h + 1), *end = reply + length;
+    for (unsigned int i = 0; i < passwords; i++) {
+        if (p >= end || end - p < 1 + *p || (r->type == PROTO_TYPE_PASSPHRASE ? *p == 0 || *p > PROTO_MAX_PASSPHRASE
+                                                                               : *p != r->length))
+            return;
+        p += 1 + *p;
+    }
+
+    char password[PROTO_MAX_PASSPHRASE + 1];
+    p = (const unsigned char *) (h + 1);
+    for (unsigned int i = 0; i < passwords; i++, p += 1 + *p) {
+        memcpy(password, p + 1, *p);
+        password[*p] = '\0';
+        if (r->handler.on_password)
+            r->handler.on_password(r->handler.ctx, first + i, password, *p);
+    }
+
+    r->received |= (uint32_t) 1 << h->fragment;
+    if (r->received == (uint32_t) ((1ull << r->fragments) - 1))
+        complete(e, r, PROTO_STATUS_OK);
+}
+
+/**
+ * @brief Reads every reply already received.
+ * @param[in,out] e: the engine.
+ * @return 0 on success, -1 on transport errors.
+ */
+static int receive_replies(client_engine *e)
+{
+    unsigned char reply[PROTO_MAX_DATAGRAM];
+
+    for (;;) {
+        int n = transport_recv(e->transport, reply, sizeof(reply));
+        if (n >= 0) {
+            // A forged or damaged sealed reply is dropped like a lost one
+            if (e->opt.key == NULL || (n = aead_open_reply(e->opt.key, reply, (size_t) n)) >= 0)
+                handle_reply(e, reply, n);
+            continue;
+        }
+#if defined WIN32
+        return 0; // WSAEWOULDBLOCK, or an error the timeouts will report
+#else
+        if (errno == EINTR || errno == ECONNREFUSED)
+            continue; // ECONNREFUSED: ICMP error for an earlier datagram, the timeouts handle it
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+#endif
+    }
+}
+
+/**
+ * @brief Retransmits or fails the requests whose reply is late, and fills the window.
+ * @param[in,out] e: the engine.
+ * @param[in] now: the current time in nanoseconds.
+ * @return the time of the next retransmission, 0 if nothing is in flight.
+ */
+static uint64_t send_due(client_engine *e, uint64_t now)
+{
+    const uint64_t max_timeout = (uint64_t) ENGINE_MAX_TIMEOUT_MS * 1000000u;
+    uint64_t next = 0;
+
+    for (uint32_t id = e->oldest; id != e->next_send; id++) {
+        engine_request *r = &e->requests[id & (ENGINE_QUEUE - 1)];
+        if (r->state != ENGINE_SENT)
+            continue;
+        if (r->deadline <= now) {
+            if (r->attempts > e->opt.retries) {
+                complete(e, r, ENGINE_STATUS_TIMEOUT);
+                continue;
+            }
+            r->timeout = r->timeout * 2 < max_timeout ? r->timeout * 2 : max_timeout;
+            send_request(e, r, now);
+            e->retransmissions++;
+        }
+        if (next == 0 || r->deadline < next)
+            next = r->deadline;
+    }
+
+    while (e->in_flight < e->opt.window && e->next_send != e->next_id) {
+        engine_request *r = &e->requests[e->next_send++ & (ENGINE_QUEUE - 1)];
+        r->state = ENGINE_SENT;
+        e->in_flight++;
+        send_request(e, r, now);
+        if (next == 0 || r->deadline < next)
+            next = r->deadline;
+    }
+
+    while (e->oldest != e->next_send && e->requests[e->oldest & (ENGINE_QUEUE - 1)].state == ENGINE_FREE)
+        e->oldest++;
+    return next;
+}
+
+/**
+ * @brief Waits until a reply can be read.
+ * @param[in] e: the engine.
+ * @param[in] timeout_ms: longest wait in milliseconds.
+ * @return 0 on success (reply or timeout), -1 on errors.
+ */
+static int wait_readable(const client_engine *e, int timeout_ms)
+{
+#if defined __linux__
+    struct epoll_event event;
+    if (epoll_wait(e->poll_fd, &event, 1, timeout_ms) < 0 && errno != EINTR)
+        return -1;
+#else
+    fd_set readable;
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    FD_ZERO(&readable);
+    FD_SET(e->poll_fd, &readable);
+    if (select(e->poll_fd + 1, &readable, NULL, NULL, &tv) < 0 && errno != EINTR)
+        return -1;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Fills the engine settings with the defaults.
+ * @param[out] opt: the settings.
+ */
+void engine_defaults(engine_options *opt)
+{
+    opt->window = ENGINE_WINDOW;
+    opt->timeout_ms = ENGINE_TIMEOUT_MS;
+    opt->retries = ENGINE_RETRIES;
+    opt->policy = NULL;
+    opt->key = NULL;
+}
+
+/**
+ * @brief Prepares an engine on an open transport.
+ * @param[out] e: the engine.
+ * @param[in,out] transport: the transport.
+ * @param[in] opt: the settings, NULL for the defaults.
+ * @return 0 on success, -1 on error.
+ */
+int engine_open(client_engine *e, client_transport *transport, const engine_options *opt)
+{
+    memset(e, 0, sizeof(*e));
+    e->transport = transport;
+    e->poll_fd = transport_fd(transport);
+    if (opt)
+        e->opt = *opt;
+    else
+        engine_defaults(&e->opt);
+    if (e->opt.window < 1 || e->opt.window > ENGINE_QUEUE || e->opt.timeout_ms < 1 ||
+        (e->opt.policy != NULL && strlen(e->opt.policy) > PROTO_MAX_POLICY))
+        return -1;
+
+#if defined __linux__
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    e->poll_fd = epoll_create1(0);
+    if (e->poll_fd < 0 || epoll_ctl(e->poll_fd, EPOLL_CTL_ADD, transport_fd(transport), &event) < 0) {
+        engine_close(e);
+        return -1;
+    }
+#endif
+
+    e->requests = calloc(ENGINE_QUEUE, sizeof(engine_request));
+    if (e->requests == NULL) {
+        engine_close(e);
+        return -1;
+    }
+
+    // Start from a random ID so that late replies to a previous run are not taken for ours
+    e->oldest = e->next_send = e->next_id = (uint32_t) now_ns() * 2654435761u;
+    return 0;
+}
+
+/**
+ * @brief Queues a request for passwords of one type and length.
+ * @param[in,out] e: the engine.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length.
+ * @param[in] count: the number of passwords.
+ * @param[in] handler: the callbacks of the request (copied).
+ * @return 0 on success, -1 if the arguments are invalid or ENGINE_QUEUE requests are pending.
+ */
+int engine_get(client_engine *e, char type, int length, unsigned int count, const engine_handler *handler)
+{
+    if (!length_valid(type, length) || count < 1 || count > PROTO_MAX_PASSWORDS ||
+        count > engine_max_count(e, type, length) ||
+        e->next_id - e->oldest == ENGINE_QUEUE)
+        return -1;
+
+    engine_request *r = &e->requests[e->next_id & (ENGINE_QUEUE - 1)];
+    memset(r, 0, sizeof(*r));
+    r->state = ENGINE_QUEUED;
+    r->id = e->next_id++;
+    r->type = type;
+    r->length = length;
+    r->count = count;
+    r->handler = *handler;
+    r->timeout = (uint64_t) e->opt.timeout_ms * 1000000u;
+    r->fragments = (count + per_fragment(e, type, length) - 1) / per_fragment(e, type, length);
+    return 0;
+}
+
+/**
+ * @brief Returns the most passwords one request may ask.
+ * @param[in] e: the engine.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length, or the word count of a passphrase.
+ * @return the largest count accepted by engine_get().
+ */
+unsigned int engine_max_count(const client_engine *e, char type, int length)
+{
+    unsigned int most = PROTO_MAX_FRAGMENTS * per_fragment(e, type, length);
+    return most < PROTO_MAX_PASSWORDS ? most : PROTO_MAX_PASSWORDS;
+}
+
+/**
+ * @brief Sends what the window allows, waits for replies and handles timeouts.
+ * @param[in,out] e: the engine.
+ * @param[in] timeout_ms: longest wait for a reply, 0 to only handle what is ready.
+ * @return the number of requests still pending, -1 on transport errors.
+ */
+int engine_poll(client_engine *e, int timeout_ms)
+{
+    if (receive_replies(e) < 0)
+        return -1;
+
+    uint64_t now = now_ns();
+    uint64_t next = send_due(e, now);
+    if (e->next_id == e->oldest)
+        return 0;
+
+    if (next != 0 && timeout_ms > 0) {
+        uint64_t until = next > now ? (next - now + 999999u) / 1000000u : 0;
+        if (until < (uint64_t) timeout_ms)
+            timeout_ms = (int) until;
+    }
+    if (timeout_ms > 0 && wait_readable(e, timeout_ms) < 0)
+        return -1;
+    if (receive_replies(e) < 0)
+        return -1;
+
+    send_due(e, now_ns());
+    return (int) (e->next_id - e->oldest);
+}
+
+/**
+ * @brief Runs the engine until every queued request is completed.
+ * @param[in,out] e: the engine.
+ * @return 0 on success, -1 on transport errors.
+ */
+int engine_wait(client_engine *e)
+{
+    int pending;
+    while ((pending = engine_poll(e, ENGINE_MAX_TIMEOUT_MS)) > 0)
+        ;
+    return pending < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Returns the descriptor that becomes readable when replies arrive.
+ * @param[in] e: the engine.
+ * @return the descriptor.
+ */
+int engine_fd(const client_engine *e)
+{
+    return e->poll_fd;
+}
+
+/**
+ * @brief Releases the engine; pending requests are dropped without callback.
+ * @param[in,out] e: the engine.
+ */
+void engine_close(client_engine *e)
+{
+#if defined __linux__
+    if (e->poll_fd >= 0 && e->poll_fd != transport_fd(e->transport))
+        close(e->poll_fd);
+#endif
+    e->poll_fd = transport_fd(e->transport);
+    free(e->requests);
+    e->requests = NULL;
+}
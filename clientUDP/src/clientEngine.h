@@ -0,0 +1,168 @@
+/*
+ ============================================================================
+ Name        : clientEngine.h (CLIENT)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the pipelined asynchronous client engine
+ ============================================================================
+ */
+#ifndef CLIENT_ENGINE_H
+#define CLIENT_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "clientTransport.h"
+#include "../../common/protocol.h"
+
+#define ENGINE_WINDOW 64 // Default number of requests in flight
+
+#define ENGINE_QUEUE 4096 // Requests queued or in flight per engine (power of two)
+
+#define ENGINE_TIMEOUT_MS 250 // Default wait for a reply before the first retransmission
+
+#define ENGINE_MAX_TIMEOUT_MS 4000 // Longest wait between two retransmissions (exponential backoff cap)
+
+#define ENGINE_RETRIES 4 // Default number of retransmissions before a request fails
+
+#define ENGINE_STATUS_TIMEOUT 256 // on_done() status of a request that got no reply (PROTO_STATUS_* otherwise)
+
+// Callbacks of one request; `ctx` is passed back to both
+typedef struct {
+    // One password of the request, called as reply fragments arrive (so possibly out of order):
+    // `index` is its position in the request, `password` is NUL-terminated and only valid during the call
+    void (*on_password)(void *ctx, unsigned int index, const char *password, size_t length);
+    // Called once when the request is over: PROTO_STATUS_OK after the last password,
+    // a PROTO_STATUS_* error from the server or ENGINE_STATUS_TIMEOUT
+    void (*on_done)(void *ctx, int status);
+    void *ctx;
+} engine_handler;
+
+// Engine settings
+typedef struct {
+    unsigned int window;        // Requests in flight, between 1 and ENGINE_QUEUE
+    unsigned int timeout_ms;    // Wait for a reply before the first retransmission
+    unsigned int retries;       // Retransmissions before a request fails
+    const char *policy;         // Policy sent with the PROTO_TYPE_POLICY requests, NULL if none
+    const unsigned char *key;   // Pre-shared key (AEAD_KEY_SIZE bytes) of the sealed replies, NULL for replies in the clear
+} engine_options;
+
+// A request owned by the engine
+typedef struct {
+    int state;                  // ENGINE_FREE, ENGINE_QUEUED or ENGINE_SENT (see clientEngine.c)
+    uint32_t id;                // Request ID, echoed by the server
+    char type;                  // Password type
+    int length;                 // Password length
+    unsigned int count;         // Number of passwords
+    engine_handler handler;
+    unsigned int attempts;      // Datagrams sent for the request so far
+    uint64_t timeout;           // Current retransmission timeout, nanoseconds
+    uint64_t deadline;          // Time of the next retransmission, nanoseconds
+    unsigned int fragments;     // Fragments of the reply, 0 until the first one arrives
+    uint32_t received;          // Bit f set when fragment f was delivered
+} engine_request;
+
+/*
+ * Pipelined client: requests are queued with engine_get() and sent as the window
+ * allows; engine_poll()/engine_wait() drive the I/O. Requests are tagged with
+ * sequential IDs, so replies are matched in any order; a request without complete
+ * reply is sent again with exponential backoff, and a request answered with
+ * PROTO_STATUS_RETRY is sent again at once with the server's cookie, which
+ * the next requests carry too. Single-threaded: one engine per thread.
+ */
+typedef struct {
+    client_transport *transport; // The channel to the server (UDP, Unix socket or shared-memory rings)
+    int poll_fd;                // epoll descriptor on Linux, the transport descriptor elsewhere
+    engine_options opt;
+    engine_request *requests;   // ENGINE_QUEUE slots, indexed by ID
+    uint32_t oldest;            // Oldest request not completed
+    uint32_t next_send;         // Oldest request not sent yet
+    uint32_t next_id;           // ID of the next request queued
+    unsigned int in_flight;     // Requests sent and not completed
+    unsigned long long retransmissions; // Datagrams sent again after a timeout
+    unsigned char cookie[PROTO_COOKIE_SIZE]; // Address validation cookie of the server (see common/protocol.h)
+    int has_cookie;             // Non-zero once the server gave a cookie: every request carries it
+} client_engine;
+
+/**
+ * @brief Fills the engine settings with the defaults.
+ *
+ * @param[out] opt: the settings.
+ */
+void engine_defaults(engine_options *opt);
+
+/**
+ * @brief Prepares an engine on an open transport.
+ *
+ * The transport stays owned by the caller and must outlive the engine.
+ *
+ * @param[out] e: the engine.
+ * @param[in,out] transport: the transport, see transport_open().
+ * @param[in] opt: the settings, NULL for the defaults.
+ * @return 0 on success, -1 on error.
+ */
+int engine_open(client_engine *e, client_transport *transport, const engine_options *opt);
+
+/**
+ * @brief Queues a request for passwords of one type and length.
+ *
+ * Nothing is sent until engine_poll() or engine_wait() runs.
+ *
+ * @param[in,out] e: the engine.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length, between PROTO_MIN_LENGTH and PROTO_MAX_LENGTH.
+ * @param[in] count: the number of passwords, between 1 and PROTO_MAX_PASSWORDS.
+ * @param[in] handler: the callbacks of the request (copied).
+ * @return 0 on success, -1 if the arguments are invalid or ENGINE_QUEUE requests are pending.
+ */
+int engine_get(client_engine *e, char type, int length, unsigned int count, const engine_handler *handler);
+
+/**
+ * @brief Returns the most passwords one request may ask.
+ *
+ * Sealed replies carry fewer passwords per fragment (see proto_reply_room()).
+ *
+ * @param[in] e: the engine.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length, or the word count of a passphrase.
+ * @return the largest `count` engine_get() accepts: PROTO_MAX_PASSWORDS, or fewer
+ *         when the reply would need more than PROTO_MAX_FRAGMENTS fragments.
+ */
+unsigned int engine_max_count(const client_engine *e, char type, int length);
+
+/**
+ * @brief Sends what the window allows, waits for replies and handles timeouts.
+ *
+ * @param[in,out] e: the engine.
+ * @param[in] timeout_ms: longest wait for a reply, 0 to only handle what is ready.
+ * @return the number of requests still pending, -1 on transport errors.
+ */
+int engine_poll(client_engine *e, int timeout_ms);
+
+/**
+ * @brief Runs the engine until every queued request is completed.
+ *
+ * @param[in,out] e: the engine.
+ * @return 0 on success, -1 on transport errors.
+ */
+int engine_wait(client_engine *e);
+
+/**
+ * @brief Returns the descriptor that becomes readable when replies arrive.
+ *
+ * Lets callers add the engine to their own event loop and call engine_poll(e, 0)
+ * when it is readable (and at least every ENGINE_TIMEOUT_MS for retransmissions).
+ *
+ * @param[in] e: the engine.
+ * @return the descriptor.
+ */
+int engine_fd(const client_engine *e);
+
+/**
+ * @brief Releases the engine; pending requests are dropped without callback.
+ *
+ * @param[in,out] e: the engine.
+ */
+void engine_close(client_engine *e);
+
+#endif /* CLIENT_ENGINE_H */
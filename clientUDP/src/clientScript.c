@@ -0,0 +1,362 @@
+/*
+ ============================================================================
+ Name        : clientScript.c (CLIENT)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the non-interactive (scripted) client mode
+ ============================================================================
+ */
+
+#include "client.h"
+
+#if !defined WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#define SCRIPT_PENDING -1    // Status of a request still in flight
+#define SCRIPT_INCOMPLETE -2 // Status of a request completed with an entry missing
+
+_Static_assert((SCRIPT_SLOTS & (SCRIPT_SLOTS - 1)) == 0 && SCRIPT_SLOTS <= ENGINE_QUEUE,
+               "SCRIPT_SLOTS must be a power of two within ENGINE_QUEUE");
+
+// One engine request, in the order of the lines
+typedef struct {
+    unsigned int line;      // Input line, for the error messages
+    unsigned int count;     // Passwords asked
+    size_t stride;          // Room of one password in `text`: length(1) characters
+    int status;             // SCRIPT_PENDING, then the on_done() status or SCRIPT_INCOMPLETE
+    unsigned char *text;    // `count` entries of `stride` bytes, filled as fragments arrive
+    size_t capacity;        // Size of `text`, kept for the next request of the slot
+} script_slot;
+
+// The whole run: input, requests read ahead and output position
+typedef struct {
+    client_engine engine;
+    script_slot slots[SCRIPT_SLOTS];
+    uint32_t head;              // Oldest slot not printed yet
+    uint32_t tail;              // Next slot to fill
+    char **args;                // Request lines of the command line
+    int arg_count;
+    int arg_next;               // Next command line request
+    int fd;                     // Input file, -1 when there is none or it is over
+    char buffer[SCRIPT_READ_SIZE];
+    size_t start, end;          // Unparsed input: buffer[start..end)
+    unsigned int line;          // Number of the last line read
+    char type;                  // Line being split into requests: type, length and passwords left
+    int length;
+    unsigned long remaining;
+    int failed;                 // Non-zero once a line or a request failed
+} script_state;
+
+/**
+ * @brief Stores one password of a request at its place, whatever the order of the fragments.
+ * @param[in,out] ctx: the slot of the request.
+ * @param[in] index: the position of the password in the request.
+ * @param[in] password: the password.
+ * @param[in] length: the number of characters.
+ */
+static void store_password(void *ctx, unsigned int index, const char *password, size_t length)
+{
+    script_slot *slot = ctx;
+    if (index >= slot->count || length + 1 > slot->stride)
+        return; // Cannot come from a valid reply
+    unsigned char *entry = slot->text + index * slot->stride;
+    entry[0] = (unsigned char) length;
+    memcpy(entry + 1, password, length);
+}
+
+/**
+ * @brief Records the end of a request.
+ * @param[in,out] ctx: the slot of the request.
+ * @param[in] status: PROTO_STATUS_OK, a PROTO_STATUS_* error or ENGINE_STATUS_TIMEOUT.
+ */
+static void finish_request(void *ctx, int status)
+{
+    ((script_slot *) ctx)->status = status;
+}
+
+/**
+ * @brief Parses a request line in one pass: `TYPE LENGTH [COUNT]`.
+ * @param[in] p: the line.
+ * @param[in] end: the end of the line, newline excluded.
+ * @param[out] type: the password type.
+ * @param[out] length: the password length or word count.
+ * @param[out] count: the number of passwords, 1 when omitted.
+ * @return 1 for a request, 0 for a blank or comment line, -1 if the line is not valid.
+ */
+static int parse_line(const char *p, const char *end, char *type, int *length, unsigned long *count)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        end--;
+    if (p == end || *p == '#')
+        return 0;
+
+    *type = *p++;
+    unsigned long numbers[2] = { 0, 1 };
+    int fields = 0;
+    while (p < end && fields < 2) {
+        if (*p != ' ' && *p != '\t')
+            return -1; // Fields are separated by blanks
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (p == end || *p < '0' || *p > '9')
+            return -1;
+        unsigned long n = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            if ((n = n * 10 + (unsigned long) (*p - '0')) > 1000000000ul)
+                return -1;
+        numbers[fields++] = n;
+    }
+    if (p != end || fields == 0 || numbers[0] > 255 || numbers[1] == 0)
+        return -1;
+    *length = (int) numbers[0];
+    *count = numbers[1];
+    return 1;
+}
+
+/**
+ * @brief Finds the next request line, from the command line first, then from the input.
+ * @param[in,out] s: the run.
+ * @return 1 when a request was found, 0 when more input is needed or the input is over, -1 on a bad line.
+ */
+static int next_line(script_state *s)
+{
+    for (;;) {
+        int found;
+        if (s->arg_next < s->arg_count) {
+            const char *text = s->args[s->arg_next++];
+            s->line++;
+            found = parse_line(text, text + strlen(text), &s->type, &s->length, &s->remaining);
+        } else {
+            if (s->start == s->end && s->fd < 0)
+                return 0;
+            char *begin = s->buffer + s->start;
+            char *newline = memchr(begin, '\n', s->end - s->start);
+            if (newline == NULL && s->fd >= 0) {
+                if (s->end - s->start >= SCRIPT_LINE_MAX) {
+                    fprintf(stderr, "line %u: line too long\n", s->line + 1);
+                    return -1;
+                }
+                return 0; // The rest of the line is not read yet
+            }
+            char *stop = newline != NULL ? newline : s->buffer + s->end; // Last line without newline
+            s->start = stop - s->buffer + (newline != NULL);
+            s->line++;
+            found = parse_line(begin, stop, &s->type, &s->length, &s->remaining);
+        }
+        if (found < 0)
+            fprintf(stderr, "line %u: expected TYPE LENGTH [COUNT]\n", s->line);
+        if (found != 0)
+            return found;
+    }
+}
+
+/**
+ * @brief Reads what the input has, without waiting when nothing is there.
+ * @param[in,out] s: the run.
+ * @return 0 on success, -1 on read errors.
+ */
+static int read_input(script_state *s)
+{
+    if (s->start > 0) {
+        memmove(s->buffer, s->buffer + s->start, s->end - s->start);
+        s->end -= s->start;
+        s->start = 0;
+    }
+    ssize_t n = read(s->fd, s->buffer + s->end, sizeof(s->buffer) - s->end);
+    if (n < 0)
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    if (n == 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+    s->end += n;
+    return 0;
+}
+
+/**
+ * @brief Hands the pending lines to the engine while slots are free.
+ * @param[in,out] s: the run.
+ * @return 0 on success, -1 once the reading stopped on an error.
+ */
+static int queue_requests(script_state *s)
+{
+    while (s->tail - s->head < SCRIPT_SLOTS) {
+        if (s->remaining == 0) {
+            int found = next_line(s);
+            if (found <= 0)
+                return found;
+        }
+
+        unsigned int most = engine_max_count(&s->engine, s->type, s->length);
+        unsigned int count = s->remaining < most ? (unsigned int) s->remaining : most;
+        script_slot *slot = &s->slots[s->tail & (SCRIPT_SLOTS - 1)];
+        size_t stride = proto_entry_size((unsigned char) s->type, s->length);
+        if (count * stride > slot->capacity) {
+            unsigned char *text = realloc(slot->text, count * stride);
+            if (text == NULL)
+                return -1;
+            slot->text = text;
+            slot->capacity = count * stride;
+        }
+        memset(slot->text, 0, count * stride); // An entry no reply fills stays empty, never stale
+        slot->line = s->line;
+        slot->count = count;
+        slot->stride = stride;
+        slot->status = SCRIPT_PENDING;
+
+        engine_handler handler = { store_password, finish_request, slot };
+        if (most == 0 || engine_get(&s->engine, s->type, s->length, count, &handler) < 0) {
+            fprintf(stderr, "line %u: length %d out of range for type %c\n", s->line, s->length, s->type);
+            s->remaining = 0;
+            return -1;
+        }
+        s->tail++;
+        s->remaining -= count;
+    }
+    return 0;
+}
+
+/**
+ * @brief Prints the completed requests that have no earlier request pending.
+ * @param[in,out] s: the run.
+ */
+static void print_completed(script_state *s)
+{
+    for (; s->head != s->tail; s->head++) {
+        script_slot *slot = &s->slots[s->head & (SCRIPT_SLOTS - 1)];
+        if (slot->status == SCRIPT_PENDING)
+            return;
+        // An empty or oversized entry was never delivered: the request failed whatever its status says
+        for (unsigned int i = 0; slot->status == PROTO_STATUS_OK && i < slot->count; i++) {
+            unsigned int length = slot->text[i * slot->stride];
+            if (length == 0 || length >= slot->stride)
+                slot->status = SCRIPT_INCOMPLETE;
+        }
+        if (slot->status != PROTO_STATUS_OK) {
+            fprintf(stderr, "line %u: %s\n", slot->line, slot->status == ENGINE_STATUS_TIMEOUT ?
+                    "no reply from the server" : slot->status == SCRIPT_INCOMPLETE ?
+                    "incomplete reply from the server" : proto_status_text(slot->status));
+            s->failed = 1;
+            continue;
+        }
+        // One pass in place: every entry becomes its characters and a newline, never longer than the entry
+        unsigned char *out = slot->text;
+        for (unsigned int i = 0; i < slot->count; i++) {
+            const unsigned char *entry = slot->text + i * slot->stride;
+            unsigned int length = entry[0];
+            memmove(out, entry + 1, length);
+            out += length;
+            *out++ = '\n';
+        }
+        fwrite(slot->text, 1, out - slot->text, stdout);
+    }
+}
+
+/**
+ * @brief Runs the request lines of a file or of the command line and prints the passwords in order.
+ * @param[in,out] transport: the transport to the server.
+ * @param[in] opt: the engine settings.
+ * @param[in] path: the file of request lines, "-" for stdin, NULL for none.
+ * @param[in] lines: request lines given on the command line.
+ * @param[in] line_count: the number of entries of `lines`.
+ * @return 0 on success, 1 if a line or a request failed, -1 on transport or file errors.
+ */
+int run_script(client_transport *transport, const engine_options *opt, const char *path, char **lines,
+               int line_count)
+{
+    script_state *s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return -1;
+    s->args = lines;
+    s->arg_count = line_count;
+    s->fd = -1;
+    if (path != NULL) {
+        s->fd = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+        if (s->fd < 0) {
+            fprintf(stderr, "Cannot read %s: %s\n", path, strerror(errno));
+            free(s);
+            return -1;
+        }
+    }
+    if (engine_open(&s->engine, transport, opt) < 0) {
+        errorhandler("Error, client engine initialization failed.\n");
+        if (s->fd >= 0)
+            close(s->fd);
+        free(s);
+        return -1;
+    }
+
+    int ret = 0, reading = 1;
+    while (reading || s->head != s->tail) {
+        if (reading && queue_requests(s) < 0) {
+            s->failed = 1;
+            reading = 0; // A bad line stops the input; what was queued before it is still printed
+        }
+        if (reading && s->remaining == 0 && s->fd < 0 && s->start == s->end && s->arg_next == s->arg_count)
+            reading = 0;
+
+        if (engine_poll(&s->engine, 0) < 0) {
+            ret = -1;
+            break;
+        }
+        print_completed(s);
+        if (!reading && s->head == s->tail)
+            break;
+
+        // Wait for replies, and for input when there is room for more requests
+        struct pollfd fds[2] = { { engine_fd(&s->engine), POLLIN, 0 }, { -1, POLLIN, 0 } };
+        int want_input = reading && s->fd >= 0 && s->remaining == 0 && s->tail - s->head < SCRIPT_SLOTS;
+        if (want_input)
+            fds[1].fd = s->fd;
+        if (s->head == s->tail && want_input)
+            fds[0].fd = -1; // Nothing in flight: just wait for the next line
+        poll(fds, 2, s->head == s->tail ? -1 : SCRIPT_POLL_MS);
+        if (want_input && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) && read_input(s) < 0) {
+            fprintf(stderr, "Cannot read %s: %s\n", path, strerror(errno));
+            ret = -1;
+            break;
+        }
+    }
+
+    fflush(stdout);
+    for (unsigned int i = 0; i < SCRIPT_SLOTS; i++)
+        free(s->slots[i].text);
+    if (s->fd >= 0)
+        close(s->fd);
+    engine_close(&s->engine);
+    if (ret == 0 && s->failed)
+        ret = 1;
+    free(s);
+    return ret;
+}
+
+#else
+
+/**
+ * @brief Runs the request lines of a file or of the command line and prints the passwords in order.
+ * @param[in,out] transport: the transport to the server.
+ * @param[in] opt: the engine settings.
+ * @param[in] path: the file of request lines.
+ * @param[in] lines: request lines given on the command line.
+ * @param[in] line_count: the number of entries of `lines`.
+ * @return always -1: the scripted mode needs poll().
+ */
+int run_script(client_transport *transport, const engine_options *opt, const char *path, char **lines,
+               int line_count)
+{
+    (void) transport;
+    (void) opt;
+    (void) path;
+    (void) lines;
+    (void) line_count;
+    errorhandler("Error, the scripted mode is not available on Windows.\n");
+    return -1;
+}
+
+#endif /* WIN32 */
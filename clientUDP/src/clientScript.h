@@ -0,0 +1,47 @@
+/*
+ ============================================================================
+ Name        : clientScript.h (CLIENT)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the non-interactive (scripted) client mode
+ ============================================================================
+ */
+#ifndef CLIENT_SCRIPT_H
+#define CLIENT_SCRIPT_H
+
+#include "clientEngine.h"
+
+#define SCRIPT_SLOTS 256 // Requests read ahead of the output (power of two, at most ENGINE_QUEUE)
+
+#define SCRIPT_READ_SIZE 65536 // Bytes of the input read at once
+
+#define SCRIPT_LINE_MAX 256 // Longest request line
+
+#define SCRIPT_POLL_MS 10 // Longest wait for input or replies before retransmissions are checked again
+
+/**
+ * @brief Runs the request lines of a file or of the command line and prints the passwords in order.
+ *
+ * A request line is `TYPE LENGTH [COUNT]` (for example `s 16` or `w 6 100`,
+ * LENGTH being the word count of a passphrase); blank lines and lines starting
+ * with '#' are skipped. Each line is parsed in a single pass as soon as it is
+ * read, split into requests of at most engine_max_count() passwords and handed
+ * to the pipelined engine, which keeps its window of requests in flight while
+ * the next lines are read. Passwords are written to stdout one per line, in
+ * the order of the lines, as soon as every earlier request is complete.
+ *
+ * A line that cannot be parsed stops the reading; a request that fails is
+ * reported on stderr with its line number and its passwords are left out.
+ *
+ * @param[in,out] transport: the transport to the server, see transport_open().
+ * @param[in] opt: the engine settings.
+ * @param[in] path: the file of request lines, "-" for stdin, NULL to use `lines` only.
+ * @param[in] lines: request lines given on the command line, run before the file.
+ * @param[in] line_count: the number of entries of `lines`.
+ * @return 0 if every password was printed, 1 if a line or a request failed, -1 on transport or file errors.
+ */
+int run_script(client_transport *transport, const engine_options *opt, const char *path, char **lines,
+               int line_count);
+
+#endif /* CLIENT_SCRIPT_H */
@@ -0,0 +1,498 @@
+/*
+ ============================================================================
+ Name        : clientTransport.c (CLIENT)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the transports of the client: UDP, Unix datagram
+               socket and shared-memory rings, chosen by endpoint URI
+ ============================================================================
+ */
+
+#include "client.h"
+
+#include <errno.h>
+#if !defined WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/un.h>
+#endif
+#if defined __linux__
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include "../../common/localRing.h" // Ring layout shared with the server
+#endif
+
+#define TRANSPORT_HOST_SIZE 256 // Longest host name of an endpoint, with its terminator
+
+#define TRANSPORT_PORT_SIZE 8 // Longest port of an endpoint, with its terminator
+
+/**
+ * @brief Makes a socket non-blocking.
+ * @param[in] sock: the socket.
+ * @return 0 on success, -1 on error.
+ */
+static int set_non_blocking(int sock)
+{
+#if defined WIN32
+    u_long non_blocking = 1;
+    return ioctlsocket(sock, FIONBIO, &non_blocking) == 0 ? 0 : -1;
+#else
+    return fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+/**
+ * @brief Resolves the server and connects a UDP socket of the matching address family.
+ *
+ * Every address returned by getaddrinfo is tried in order until a socket can
+ * be created for it, so that a host with IPv6 and IPv4 addresses works on
+ * systems without IPv6.
+ *
+ * @param[in] host: the server host name or numeric address.
+ * @param[in] service: the server port.
+ * @return the connected socket, -1 on error.
+ */
+static int open_udp(const char *host, const char *service)
+{
+    struct addrinfo hints, *list;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+
+    int error = getaddrinfo(host, service, &hints, &list);
+    if (error != 0) {
+        fprintf(stderr, "Error, cannot resolve %s: %s\n", host, gai_strerror(error));
+        return -1;
+    }
+
+    int sock = -1;
+    for (struct addrinfo *a = list; a != NULL && sock < 0; a = a->ai_next) {
+        sock = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (sock >= 0 && connect(sock, a->ai_addr, a->ai_addrlen) < 0) {
+            closesocket(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (sock < 0)
+        errorhandler("socket creation failed.\n");
+    return sock;
+}
+
+/**
+ * @brief Splits "HOST[:PORT]" or "[IPV6][:PORT]".
+ * @param[in] text: the address part of the endpoint.
+ * @param[in] default_port: the port when the text has none.
+ * @param[out] host: the host, TRANSPORT_HOST_SIZE bytes.
+ * @param[out] port: the port, TRANSPORT_PORT_SIZE bytes.
+ * @return 0 on success, -1 if the text is not valid.
+ */
+static int split_host(const char *text, const char *default_port, char *host, char *port)
+{
+    const char *end, *colon;
+    if (text[0] == '[') {
+        text++;
+        end = strchr(text, ']');
+        if (end == NULL || (end[1] != '\0' && end[1] != ':'))
+            return -1;
+        colon = end[1] == ':' ? end + 1 : NULL;
+    } else {
+        colon = strchr(text, ':');
+        if (colon != NULL && strchr(colon + 1, ':') != NULL)
+            colon = NULL; // An IPv6 address without brackets has no port
+        end = colon != NULL ? colon : text + strlen(text);
+    }
+    if (end == text || end - text >= TRANSPORT_HOST_SIZE)
+        return -1;
+    memcpy(host, text, end - text);
+    host[end - text] = '\0';
+
+    const char *service = colon != NULL ? colon + 1 : default_port;
+    int value = atoi(service);
+    if (strlen(service) >= TRANSPORT_PORT_SIZE || value < 1 || value > 65535)
+        return -1;
+    strcpy(port, service);
+    return 0;
+}
+
+#if !defined WIN32
+
+/**
+ * @brief Fills the address of a Unix socket path.
+ * @param[out] sun: the address.
+ * @param[in] path: the path.
+ * @return 0 on success, -1 if the path is empty or too long.
+ */
+static int make_address(struct sockaddr_un *sun, const char *path)
+{
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    if (*path == '\0' || strlen(path) >= sizeof(sun->sun_path))
+        return -1;
+    strcpy(sun->sun_path, path);
+    return 0;
+}
+
+/**
+ * @brief Connects an autobound Unix datagram socket to the server.
+ * @param[in] path: the Unix datagram socket of the server.
+ * @return the connected socket, -1 on error.
+ */
+static int open_unix(const char *path)
+{
+    struct sockaddr_un server, local;
+    if (make_address(&server, path) < 0) {
+        fprintf(stderr, "Error, invalid Unix socket path %s\n", path);
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        errorhandler("socket creation failed.\n");
+        return -1;
+    }
+    // Bound to a name given by the kernel (autobind): the server replies to the sender's name
+    memset(&local, 0, sizeof(local));
+    local.sun_family = AF_UNIX;
+    if (bind(sock, (struct sockaddr *) &local, sizeof(sa_family_t)) < 0 ||
+        connect(sock, (struct sockaddr *) &server, sizeof(server)) < 0) {
+        fprintf(stderr, "Error, cannot connect to %s: %s\n", path, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+#endif
+
+#if defined __linux__
+
+/**
+ * @brief Ends the ring session: unmaps the rings and closes its descriptors.
+ * @param[in,out] t: the transport.
+ */
+static void shm_detach(client_transport *t)
+{
+    if (t->region != NULL)
+        munmap(t->region, sizeof(local_region));
+    t->region = NULL;
+    if (t->sock >= 0) {
+        epoll_ctl(t->poll_fd, EPOLL_CTL_DEL, t->sock, NULL);
+        close(t->sock);
+    }
+    if (t->bell >= 0) {
+        epoll_ctl(t->poll_fd, EPOLL_CTL_DEL, t->bell, NULL);
+        close(t->bell);
+    }
+    if (t->doorbell >= 0)
+        close(t->doorbell);
+    t->sock = t->bell = t->doorbell = -1;
+    t->waiting = 0;
+}
+
+/**
+ * @brief Sets up a ring session: connects to the ring socket and maps the rings it gets.
+ * @param[in,out] t: the transport, without session.
+ * @return 0 on success, -1 on error (errno set).
+ */
+static int shm_attach(client_transport *t)
+{
+    struct sockaddr_un sun;
+    if (make_address(&sun, t->path) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    t->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (t->sock < 0)
+        return -1;
+    struct timeval timeout = { TRANSPORT_HELLO_TIMEOUT_MS / 1000, TRANSPORT_HELLO_TIMEOUT_MS % 1000 * 1000 };
+    setsockopt(t->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(t->sock, (struct sockaddr *) &sun, sizeof(sun)) < 0) {
+        shm_detach(t);
+        return -1;
+    }
+
+    // One message: the local_hello header and the memory file, doorbell and bell
+    local_hello hello;
+    int fds[LOCAL_RING_FDS] = { -1, -1, -1 };
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov = { &hello, sizeof(hello) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    ssize_t n = recvmsg(t->sock, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr *c = n == (ssize_t) sizeof(hello) ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (c != NULL && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS && c->cmsg_len == CMSG_LEN(sizeof(fds)))
+        memcpy(fds, CMSG_DATA(c), sizeof(fds));
+    t->doorbell = fds[1];
+    t->bell = fds[2];
+    if (fds[0] >= 0 && hello.magic == LOCAL_RING_MAGIC && hello.version == LOCAL_RING_VERSION &&
+        hello.size == sizeof(local_region)) {
+        t->region = mmap(NULL, sizeof(local_region), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (t->region == MAP_FAILED)
+            t->region = NULL;
+    }
+    if (fds[0] >= 0)
+        close(fds[0]); // The mapping keeps the memory
+
+    struct epoll_event bell, conn;
+    memset(&bell, 0, sizeof(bell));
+    memset(&conn, 0, sizeof(conn));
+    bell.events = EPOLLIN;
+    conn.events = EPOLLIN | EPOLLRDHUP;
+    if (t->region == NULL || t->doorbell < 0 || t->bell < 0 || t->region->magic != LOCAL_RING_MAGIC ||
+        t->region->slots != LOCAL_RING_SLOTS || t->region->slot_size != sizeof(local_slot) ||
+        set_non_blocking(t->sock) < 0 || epoll_ctl(t->poll_fd, EPOLL_CTL_ADD, t->bell, &bell) < 0 ||
+        epoll_ctl(t->poll_fd, EPOLL_CTL_ADD, t->sock, &conn) < 0) {
+        shm_detach(t);
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Tells whether the server ended the ring session.
+ * @param[in] t: the transport, with a session.
+ * @return non-zero if the session connection is closed.
+ */
+static int shm_lost(const client_transport *t)
+{
+    char byte;
+    ssize_t n = recv(t->sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+/**
+ * @brief Publishes a request in the request ring, waking the server if it sleeps.
+ * @param[in,out] t: the transport.
+ * @param[in] data: the datagram.
+ * @param[in] length: its size in bytes.
+ * @return `length`, -1 with errno set.
+ */
+static int shm_send(client_transport *t, const void *data, size_t length)
+{
+    if (t->region == NULL && shm_attach(t) < 0) {
+        errno = ECONNREFUSED; // Handled like a lost datagram: the server may come back
+        return -1;
+    }
+    if (local_ring_push(&t->region->requests, data, length) < 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (local_ring_asleep(&t->region->requests)) {
+        uint64_t one = 1;
+        if (write(t->doorbell, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            return -1;
+    }
+    return (int) length;
+}
+
+/**
+ * @brief Takes a reply from the reply ring; flags the ring as waited on when it is empty.
+ * @param[in,out] t: the transport.
+ * @param[out] buffer: the datagram.
+ * @param[in] size: the size of `buffer` in bytes.
+ * @return the size of the datagram, -1 with errno EAGAIN if there is none.
+ */
+static int shm_recv(client_transport *t, void *buffer, size_t size)
+{
+    unsigned char datagram[PROTO_MAX_DATAGRAM];
+    void *into = size >= sizeof(datagram) ? buffer : datagram;
+
+    if (t->region == NULL) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (t->waiting) {
+        uint64_t rings;
+        t->waiting = 0;
+        __atomic_store_n(&t->region->replies.sleeping, 0, __ATOMIC_RELAXED);
+        if (read(t->bell, &rings, sizeof(rings)) < 0 && shm_lost(t)) {
+            // Woken by the connection, not by the server: connect again (to the next server after an upgrade)
+            shm_detach(t);
+            shm_attach(t);
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    int n = local_ring_pop(&t->region->replies, into);
+    if (n < 0) {
+        if (local_ring_sleep(&t->region->replies)) {
+            t->waiting = 1; // The server writes the bell for the next reply
+            errno = EAGAIN;
+            return -1;
+        }
+        n = local_ring_pop(&t->region->replies, into); // Published meanwhile
+    }
+    if (into == datagram) {
+        n = (size_t) n < size ? n : (int) size;
+        memcpy(buffer, datagram, n);
+        memset(datagram, 0, sizeof(datagram));
+    }
+    return n;
+}
+
+/**
+ * @brief Prepares the shared-memory transport and sets up its first session.
+ * @param[out] t: the transport.
+ * @param[in] path: the ring socket of the server.
+ * @return 0 on success, -1 on error.
+ */
+static int open_shm(client_transport *t, const char *path)
+{
+    if (*path == '\0' || strlen(path) >= sizeof(t->path)) {
+        fprintf(stderr, "Error, invalid Unix socket path %s\n", path);
+        return -1;
+    }
+    strcpy(t->path, path);
+    t->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (t->poll_fd < 0 || shm_attach(t) < 0) {
+        fprintf(stderr, "Error, cannot set up the rings of %s: %s\n", path, strerror(errno));
+        if (t->poll_fd >= 0)
+            close(t->poll_fd);
+        t->poll_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+#endif
+
+/**
+ * @brief Opens the transport named by an endpoint.
+ * @param[out] t: the transport.
+ * @param[in] endpoint: the endpoint URI, or a bare host.
+ * @param[in] default_port: the UDP port when the endpoint has none.
+ * @return 0 on success, -1 on error.
+ */
+int transport_open(client_transport *t, const char *endpoint, const char *default_port)
+{
+    memset(t, 0, sizeof(*t));
+    t->sock = t->poll_fd = t->bell = t->doorbell = -1;
+
+    if (strncmp(endpoint, "unix://", 7) == 0 || strncmp(endpoint, "shm://", 6) == 0) {
+        int shm = endpoint[0] == 's';
+        const char *path = endpoint + (shm ? 6 : 7);
+        t->kind = shm ? TRANSPORT_SHM : TRANSPORT_UNIX;
+#if defined __linux__
+        if (shm)
+            return open_shm(t, path);
+#endif
+#if !defined WIN32
+        if (!shm) {
+            t->sock = t->poll_fd = open_unix(path);
+            return t->sock >= 0 && set_non_blocking(t->sock) == 0 ? 0 : -1;
+        }
+#endif
+        (void) path;
+        fprintf(stderr, "Error, %s endpoints are not supported on this system\n", shm ? "shm://" : "unix://");
+        return -1;
+    }
+
+    char host[TRANSPORT_HOST_SIZE], port[TRANSPORT_PORT_SIZE];
+    if (strncmp(endpoint, "udp://", 6) == 0) {
+        if (split_host(endpoint + 6, default_port, host, port) < 0) {
+            fprintf(stderr, "Error, invalid endpoint %s\n", endpoint);
+            return -1;
+        }
+    } else if (strlen(endpoint) >= sizeof(host) || strlen(default_port) >= sizeof(port)) {
+        fprintf(stderr, "Error, invalid endpoint %s\n", endpoint);
+        return -1;
+    } else {
+        // A bare endpoint is a host name or address (IPv6 ones too, without brackets): the port is the default
+        strcpy(host, endpoint);
+        strcpy(port, default_port);
+    }
+    t->kind = TRANSPORT_UDP;
+    t->sock = t->poll_fd = open_udp(host, port);
+    if (t->sock < 0)
+        return -1;
+    if (set_non_blocking(t->sock) < 0) {
+        transport_close(t);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sends one datagram without blocking.
+ * @param[in,out] t: the transport.
+ * @param[in] data: the datagram.
+ * @param[in] length: its size in bytes.
+ * @return `length` on success, -1 with errno set.
+ */
+int transport_send(client_transport *t, const void *data, size_t length)
+{
+#if defined __linux__
+    if (t->kind == TRANSPORT_SHM)
+        return shm_send(t, data, length);
+#endif
+    int n = (int) send(t->sock, (const char *) data, length, 0);
+#if !defined WIN32
+    // The kernel holds a few datagrams per Unix socket (net.unix.max_dgram_qlen): wait a little for room
+    if (n < 0 && errno == EAGAIN && t->kind == TRANSPORT_UNIX) {
+        struct pollfd pfd = { t->sock, POLLOUT, 0 };
+        if (poll(&pfd, 1, TRANSPORT_SEND_WAIT_MS) > 0)
+            n = (int) send(t->sock, (const char *) data, length, 0);
+        else
+            errno = EAGAIN;
+    }
+#endif
+    return n;
+}
+
+/**
+ * @brief Receives one datagram without blocking.
+ * @param[in,out] t: the transport.
+ * @param[out] buffer: the datagram.
+ * @param[in] size: the size of `buffer` in bytes.
+ * @return the size of the datagram, -1 with errno set.
+ */
+int transport_recv(client_transport *t, void *buffer, size_t size)
+{
+#if defined __linux__
+    if (t->kind == TRANSPORT_SHM)
+        return shm_recv(t, buffer, size);
+#endif
+    return (int) recv(t->sock, (char *) buffer, size, 0);
+}
+
+/**
+ * @brief Returns the descriptor that becomes readable when transport_recv() may return a datagram.
+ * @param[in] t: the transport.
+ * @return the descriptor.
+ */
+int transport_fd(const client_transport *t)
+{
+    return t->poll_fd;
+}
+
+/**
+ * @brief Closes the transport.
+ * @param[in,out] t: the transport.
+ */
+void transport_close(client_transport *t)
+{
+#if defined __linux__
+    if (t->kind == TRANSPORT_SHM) {
+        shm_detach(t);
+        if (t->poll_fd >= 0)
+            close(t->poll_fd);
+        t->poll_fd = -1;
+        return;
+    }
+#endif
+    if (t->sock >= 0)
+        closesocket(t->sock);
+    t->sock = t->poll_fd = -1;
+}
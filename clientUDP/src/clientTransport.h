@@ -0,0 +1,103 @@
+/*
+ ============================================================================
+ Name        : clientTransport.h (CLIENT)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the transports of the client: UDP, Unix
+               datagram socket and shared-memory rings, chosen by endpoint URI
+ ============================================================================
+ */
+#ifndef CLIENT_TRANSPORT_H
+#define CLIENT_TRANSPORT_H
+
+#include <stddef.h>
+
+#define TRANSPORT_PATH_SIZE 108 // Longest Unix socket path, with its terminator (sun_path)
+
+#define TRANSPORT_HELLO_TIMEOUT_MS 1000 // Longest wait for the ring session of the server
+
+#define TRANSPORT_SEND_WAIT_MS 1 // Longest wait of a Unix datagram for room in the queue of the server
+
+struct local_region;
+
+// How the datagrams reach the server
+typedef enum {
+    TRANSPORT_UDP,    // udp://HOST[:PORT], or a bare host name or address
+    TRANSPORT_UNIX,   // unix://PATH: Unix datagram socket of a server on this host
+    TRANSPORT_SHM     // shm://PATH: shared-memory rings set up on the Unix socket PATH (Linux)
+} transport_kind;
+
+// A datagram channel to the server; single-threaded
+typedef struct {
+    transport_kind kind;
+    int sock;                        // Connected non-blocking socket; shm: the session connection, -1 between sessions
+    int poll_fd;                     // shm: epoll on the client bell and the connection; the socket otherwise
+    int bell;                        // shm: eventfd written by the server when replies wait, -1 otherwise
+    int doorbell;                    // shm: eventfd that wakes the server, -1 otherwise
+    struct local_region *region;     // shm: the rings of the session, NULL between sessions
+    int waiting;                     // shm: the reply ring is flagged as waited on
+    char path[TRANSPORT_PATH_SIZE];  // shm: the ring socket, to set up a new session
+} client_transport;
+
+/**
+ * @brief Opens the transport named by an endpoint.
+ *
+ * The endpoint is "udp://HOST[:PORT]" (IPv6 addresses in brackets), a bare
+ * host name or address (UDP on `default_port`), "unix://PATH" for the Unix
+ * datagram socket of a server of this host (the client socket is autobound,
+ * the server replies to it), or "shm://PATH" for its shared-memory rings.
+ * Every transport carries the datagrams of common/protocol.h unchanged.
+ * A shm session lost because the server stopped or was upgraded is set up
+ * again when the rings are found empty, or at the next send; the requests
+ * it held are lost like dropped datagrams.
+ *
+ * @param[out] t: the transport.
+ * @param[in] endpoint: the endpoint.
+ * @param[in] default_port: the UDP port when the endpoint has none.
+ * @return 0 on success, -1 on error (message printed).
+ */
+int transport_open(client_transport *t, const char *endpoint, const char *default_port);
+
+/**
+ * @brief Sends one datagram without blocking.
+ *
+ * The Unix socket of the server queues only a few datagrams
+ * (net.unix.max_dgram_qlen): a datagram that finds the queue full waits
+ * at most TRANSPORT_SEND_WAIT_MS for room.
+ *
+ * @param[in,out] t: the transport.
+ * @param[in] data: the datagram.
+ * @param[in] length: its size in bytes, at most PROTO_MAX_DATAGRAM.
+ * @return `length` on success, -1 with errno set (EAGAIN when the socket
+ *         buffer or the request ring is full).
+ */
+int transport_send(client_transport *t, const void *data, size_t length);
+
+/**
+ * @brief Receives one datagram without blocking.
+ *
+ * @param[in,out] t: the transport.
+ * @param[out] buffer: the datagram, truncated to `size`.
+ * @param[in] size: the size of `buffer` in bytes.
+ * @return the size of the datagram, -1 with errno set (EAGAIN when nothing
+ *         is ready; ECONNREFUSED for an ICMP error about an earlier UDP datagram).
+ */
+int transport_recv(client_transport *t, void *buffer, size_t size);
+
+/**
+ * @brief Returns the descriptor that becomes readable when transport_recv() may return a datagram.
+ *
+ * @param[in] t: the transport.
+ * @return the descriptor.
+ */
+int transport_fd(const client_transport *t);
+
+/**
+ * @brief Closes the transport.
+ *
+ * @param[in,out] t: the transport.
+ */
+void transport_close(client_transport *t);
+
+#endif /* CLIENT_TRANSPORT_H */
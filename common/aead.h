@@ -0,0 +1,354 @@
+/*
+ ============================================================================
+ Name        : aead.h (SHARED)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : XChaCha20-Poly1305 of the sealed replies (portable C)
+ ============================================================================
+ */
+#ifndef AEAD_H
+#define AEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "protocol.h"
+
+/*
+ * ChaCha20-Poly1305 (RFC 8439) with the 24-byte XChaCha20 nonce
+ * (draft-irtf-cfrg-xchacha): HChaCha20 turns the pre-shared key and the first
+ * 16 bytes of the nonce into a subkey, the last 8 bytes are the ChaCha20 nonce.
+ * The server draws the 16 bytes at random once per worker and counts the
+ * other 8, so it derives one session key per worker and never reuses a nonce,
+ * across workers, restarts and hot upgrades included.
+ *
+ * Only the single-block primitives live here; the server computes the
+ * keystream of many replies at once (serverSeal.c).
+ */
+#define AEAD_KEY_SIZE 32     // Pre-shared key
+#define AEAD_SALT_SIZE 16    // Nonce bytes that select the subkey
+#define AEAD_TAG_SIZE 16     // Poly1305 tag
+#define AEAD_BLOCK 64        // ChaCha20 block
+
+_Static_assert(AEAD_SALT_SIZE + 8 == PROTO_SEAL_NONCE_SIZE && AEAD_TAG_SIZE == PROTO_SEAL_TAG_SIZE,
+               "the sealed reply layout must match the cipher");
+
+#define AEAD_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define AEAD_QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = AEAD_ROTL(d, 16); \
+    c += d; b ^= c; b = AEAD_ROTL(b, 12); \
+    a += b; d ^= a; d = AEAD_ROTL(d, 8);  \
+    c += d; b ^= c; b = AEAD_ROTL(b, 7)
+
+/**
+ * @brief Reads a little endian 32-bit word.
+ *
+ * @param[in] p: the 4 bytes.
+ * @return the word.
+ */
+static inline uint32_t aead_load32(const unsigned char *p)
+{
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+/**
+ * @brief Writes a little endian 32-bit word.
+ *
+ * @param[out] p: the 4 bytes.
+ * @param[in] v: the word.
+ */
+static inline void aead_store32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+    p[2] = (unsigned char) (v >> 16);
+    p[3] = (unsigned char) (v >> 24);
+}
+
+/**
+ * @brief Runs the 20 ChaCha rounds on a state.
+ *
+ * @param[in,out] x: the 16 words of the state.
+ */
+static inline void aead_rounds(uint32_t x[16])
+{
+    for (int i = 0; i < 10; i++) {
+        AEAD_QUARTER_ROUND(x[0], x[4], x[8],  x[12]);
+        AEAD_QUARTER_ROUND(x[1], x[5], x[9],  x[13]);
+        AEAD_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        AEAD_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        AEAD_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        AEAD_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        AEAD_QUARTER_ROUND(x[2], x[7], x[8],  x[13]);
+        AEAD_QUARTER_ROUND(x[3], x[4], x[9],  x[14]);
+    }
+}
+
+/**
+ * @brief Computes one ChaCha20 block (RFC 8439).
+ *
+ * @param[in] key: the 256-bit key.
+ * @param[in] tail: the last four words of the state: block counter and 96-bit nonce.
+ * @param[out] out: the 64 bytes of keystream.
+ */
+static inline void aead_chacha20_block(const uint32_t key[8], const uint32_t tail[4], unsigned char out[AEAD_BLOCK])
+{
+    uint32_t in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, // "expand 32-byte k"
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        tail[0], tail[1], tail[2], tail[3]
+    };
+    uint32_t x[16];
+    memcpy(x, in, sizeof(x));
+    aead_rounds(x);
+    for (int i = 0; i < 16; i++)
+        aead_store32(out + 4 * i, x[i] + in[i]);
+    memset(x, 0, sizeof(x));
+}
+
+/**
+ * @brief Derives the subkey of a salt (HChaCha20).
+ *
+ * @param[in] key: the pre-shared key.
+ * @param[in] salt: the first AEAD_SALT_SIZE bytes of the nonce.
+ * @param[out] subkey: the ChaCha20 key of the replies sealed with this salt.
+ */
+static inline void aead_hchacha20(const unsigned char key[AEAD_KEY_SIZE], const unsigned char salt[AEAD_SALT_SIZE],
+                                  uint32_t subkey[8])
+{
+    uint32_t x[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    for (int i = 0; i < 8; i++)
+        x[4 + i] = aead_load32(key + 4 * i);
+    for (int i = 0; i < 4; i++)
+        x[12 + i] = aead_load32(salt + 4 * i);
+    aead_rounds(x);
+    for (int i = 0; i < 4; i++) {
+        subkey[i] = x[i];
+        subkey[4 + i] = x[12 + i];
+    }
+    memset(x, 0, sizeof(x));
+}
+
+// Poly1305 state, 26-bit limbs
+typedef struct {
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+} aead_poly1305;
+
+/**
+ * @brief Starts a Poly1305 computation.
+ *
+ * @param[out] st: the state.
+ * @param[in] key: the one-time key, the first 32 bytes of ChaCha20 block 0.
+ */
+static inline void aead_poly1305_init(aead_poly1305 *st, const unsigned char key[32])
+{
+    st->r[0] = aead_load32(key) & 0x3ffffff;
+    st->r[1] = (aead_load32(key + 3) >> 2) & 0x3ffff03;
+    st->r[2] = (aead_load32(key + 6) >> 4) & 0x3ffc0ff;
+    st->r[3] = (aead_load32(key + 9) >> 6) & 0x3f03fff;
+    st->r[4] = (aead_load32(key + 12) >> 8) & 0x00fffff;
+    memset(st->h, 0, sizeof(st->h));
+    for (int i = 0; i < 4; i++)
+        st->pad[i] = aead_load32(key + 16 + 4 * i);
+}
+
+/**
+ * @brief Adds data to a Poly1305 computation, zero padded to 16 bytes.
+ *
+ * Every piece of the AEAD input is padded to 16 bytes (RFC 8439, 2.8), so
+ * every block is a whole one.
+ *
+ * @param[in,out] st: the state.
+ * @param[in] m: the data.
+ * @param[in] bytes: its size.
+ */
+static inline void aead_poly1305_update(aead_poly1305 *st, const unsigned char *m, size_t bytes)
+{
+    const uint32_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2], r3 = st->r[3], r4 = st->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3], h4 = st->h[4];
+    unsigned char last[16];
+
+    while (bytes > 0) {
+        const unsigned char *b = m;
+        if (bytes < 16) {
+            memset(last, 0, sizeof(last));
+            memcpy(last, m, bytes);
+            b = last;
+        }
+        h0 += aead_load32(b) & 0x3ffffff;
+        h1 += (aead_load32(b + 3) >> 2) & 0x3ffffff;
+        h2 += (aead_load32(b + 6) >> 4) & 0x3ffffff;
+        h3 += (aead_load32(b + 9) >> 6) & 0x3ffffff;
+        h4 += (aead_load32(b + 12) >> 8) | (1u << 24);
+
+        uint64_t d0 = (uint64_t) h0 * r0 + (uint64_t) h1 * s4 + (uint64_t) h2 * s3 + (uint64_t) h3 * s2 + (uint64_t) h4 * s1;
+        uint64_t d1 = (uint64_t) h0 * r1 + (uint64_t) h1 * r0 + (uint64_t) h2 * s4 + (uint64_t) h3 * s3 + (uint64_t) h4 * s2;
+        uint64_t d2 = (uint64_t) h0 * r2 + (uint64_t) h1 * r1 + (uint64_t) h2 * r0 + (uint64_t) h3 * s4 + (uint64_t) h4 * s3;
+        uint64_t d3 = (uint64_t) h0 * r3 + (uint64_t) h1 * r2 + (uint64_t) h2 * r1 + (uint64_t) h3 * r0 + (uint64_t) h4 * s4;
+        uint64_t d4 = (uint64_t) h0 * r4 + (uint64_t) h1 * r3 + (uint64_t) h2 * r2 + (uint64_t) h3 * r1 + (uint64_t) h4 * r0;
+
+        uint32_t c = (uint32_t) (d0 >> 26);
+        h0 = (uint32_t) d0 & 0x3ffffff;
+        d1 += c; c = (uint32_t) (d1 >> 26); h1 = (uint32_t) d1 & 0x3ffffff;
+        d2 += c; c = (uint32_t) (d2 >> 26); h2 = (uint32_t) d2 & 0x3ffffff;
+        d3 += c; c = (uint32_t) (d3 >> 26); h3 = (uint32_t) d3 & 0x3ffffff;
+        d4 += c; c = (uint32_t) (d4 >> 26); h4 = (uint32_t) d4 & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+
+        size_t step = bytes < 16 ? bytes : 16;
+        m += step;
+        bytes -= step;
+    }
+
+    st->h[0] = h0; st->h[1] = h1; st->h[2] = h2; st->h[3] = h3; st->h[4] = h4;
+}
+
+/**
+ * @brief Ends a Poly1305 computation.
+ *
+ * @param[in,out] st: the state, cleared on return.
+ * @param[out] tag: the AEAD_TAG_SIZE bytes of the tag.
+ */
+static inline void aead_poly1305_finish(aead_poly1305 *st, unsigned char tag[AEAD_TAG_SIZE])
+{
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3], h4 = st->h[4], c;
+
+    c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    // h - p, kept when h >= p (constant time)
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1u << 26);
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    // (h + pad) mod 2^128
+    uint64_t f;
+    f = (uint64_t) (h0 | h1 << 26) + st->pad[0];
+    aead_store32(tag, (uint32_t) f);
+    f = (uint64_t) (h1 >> 6 | h2 << 20) + st->pad[1] + (f >> 32);
+    aead_store32(tag + 4, (uint32_t) f);
+    f = (uint64_t) (h2 >> 12 | h3 << 14) + st->pad[2] + (f >> 32);
+    aead_store32(tag + 8, (uint32_t) f);
+    f = (uint64_t) (h3 >> 18 | h4 << 8) + st->pad[3] + (f >> 32);
+    aead_store32(tag + 12, (uint32_t) f);
+
+    memset(st, 0, sizeof(*st));
+}
+
+/**
+ * @brief Computes the tag of a sealed message (RFC 8439, 2.8).
+ *
+ * @param[in] poly_key: the first 32 bytes of ChaCha20 block 0 of the message.
+ * @param[in] aad: the associated data.
+ * @param[in] aad_length: its size.
+ * @param[in] ciphertext: the encrypted data.
+ * @param[in] length: its size.
+ * @param[out] tag: the tag.
+ */
+static inline void aead_tag(const unsigned char poly_key[32], const unsigned char *aad, size_t aad_length,
+                            const unsigned char *ciphertext, size_t length, unsigned char tag[AEAD_TAG_SIZE])
+{
+    aead_poly1305 st;
+    unsigned char lengths[16];
+    for (int i = 0; i < 8; i++) {
+        lengths[i] = (unsigned char) ((uint64_t) aad_length >> (8 * i));
+        lengths[8 + i] = (unsigned char) ((uint64_t) length >> (8 * i));
+    }
+    aead_poly1305_init(&st, poly_key);
+    aead_poly1305_update(&st, aad, aad_length);
+    aead_poly1305_update(&st, ciphertext, length);
+    aead_poly1305_update(&st, lengths, sizeof(lengths));
+    aead_poly1305_finish(&st, tag);
+}
+
+/**
+ * @brief Checks and decrypts a reply to a PROTO_FLAG_SEALED request in place.
+ *
+ * A reply without PROTO_REPLY_SEALED is only accepted when it carries an
+ * error and no password: it comes from a server that cannot seal, and tells
+ * the client why. On success the entries follow the header again, as in a
+ * reply that was never sealed.
+ *
+ * @param[in] key: the pre-shared key.
+ * @param[in,out] datagram: the received reply.
+ * @param[in] length: its size.
+ * @return the size of the opened reply, -1 if it is forged, damaged or in the clear.
+ */
+static inline int aead_open_reply(const unsigned char key[AEAD_KEY_SIZE], unsigned char *datagram, size_t length)
+{
+    const proto_reply_header *h = (const proto_reply_header *) datagram;
+    if (length < sizeof(*h) || h->magic != PROTO_MAGIC)
+        return -1;
+    if (!(h->flags & PROTO_REPLY_SEALED))
+        return h->status != PROTO_STATUS_OK && h->passwords == 0 ? (int) length : -1;
+    if (length < sizeof(*h) + PROTO_SEAL_OVERHEAD)
+        return -1;
+
+    const unsigned char *nonce = datagram + sizeof(*h);
+    unsigned char *text = datagram + sizeof(*h) + PROTO_SEAL_NONCE_SIZE;
+    size_t text_length = length - sizeof(*h) - PROTO_SEAL_OVERHEAD;
+    uint32_t subkey[8], tail[4] = { 0, 0, aead_load32(nonce + AEAD_SALT_SIZE), aead_load32(nonce + AEAD_SALT_SIZE + 4) };
+    unsigned char block[AEAD_BLOCK], tag[AEAD_TAG_SIZE];
+
+    aead_hchacha20(key, nonce, subkey);
+    aead_chacha20_block(subkey, tail, block);
+    aead_tag(block, datagram, sizeof(*h), text, text_length, tag);
+    unsigned char diff = 0; // Compared in constant time
+    for (int i = 0; i < AEAD_TAG_SIZE; i++)
+        diff |= tag[i] ^ text[text_length + i];
+
+    if (diff == 0) {
+        for (size_t done = 0; done < text_length; done += AEAD_BLOCK) {
+            tail[0]++;
+            aead_chacha20_block(subkey, tail, block);
+            size_t n = text_length - done < AEAD_BLOCK ? text_length - done : AEAD_BLOCK;
+            for (size_t i = 0; i < n; i++)
+                text[done + i] ^= block[i];
+        }
+        memmove(datagram + sizeof(*h), text, text_length);
+    }
+    memset(subkey, 0, sizeof(subkey));
+    memset(block, 0, sizeof(block));
+    return diff == 0 ? (int) (sizeof(*h) + text_length) : -1;
+}
+
+/**
+ * @brief Reads a key written as 64 hexadecimal digits; blanks and line ends around them are ignored.
+ *
+ * @param[in] text: the text, for example the contents of a key file.
+ * @param[out] key: the key.
+ * @return 0 on success, -1 if the text is not a key.
+ */
+static inline int aead_parse_key(const char *text, unsigned char key[AEAD_KEY_SIZE])
+{
+    text += strspn(text, " \t\r\n");
+    for (int i = 0; i < 2 * AEAD_KEY_SIZE; i++) {
+        char c = text[i];
+        int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (v < 0)
+            return -1;
+        key[i / 2] = (unsigned char) (i % 2 ? key[i / 2] | v : v << 4);
+    }
+    text += 2 * AEAD_KEY_SIZE;
+    return text[strspn(text, " \t\r\n")] == '\0' ? 0 : -1;
+}
+
+#endif /* AEAD_H */
@@ -0,0 +1,159 @@
+/*
+ ============================================================================
+ Name        : localRing.h (SHARED)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Shared-memory request/reply rings of the co-located clients
+ ============================================================================
+ */
+#ifndef LOCAL_RING_H
+#define LOCAL_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "protocol.h"
+
+/*
+ * Shared-memory transport, version 1.
+ *
+ * A client connects to the server's ring socket (a Unix SOCK_SEQPACKET socket)
+ * and gets one local_hello message carrying three descriptors as SCM_RIGHTS:
+ * a memory file holding a local_region, the eventfd the client writes to wake
+ * the server (the doorbell) and the eventfd the server writes to wake the
+ * client. The connection stays open for the life of the session: either side
+ * closing it ends the session.
+ *
+ * Each ring has one producer and one consumer. Datagrams are the protocol.h
+ * requests and replies, unchanged. `head` and `tail` only grow and are masked
+ * with LOCAL_RING_SLOTS - 1, so a peer writing garbage in the region can only
+ * garble its own session. A consumer that finds its ring empty sets `sleeping`,
+ * looks at the ring again and only then waits on its eventfd; a producer writes
+ * the eventfd only when it sees `sleeping` after publishing. While both sides
+ * are busy, no system call is made at all.
+ */
+#define LOCAL_RING_MAGIC 0x50475348u   // "PGSH"
+#define LOCAL_RING_VERSION 1
+#define LOCAL_RING_SLOTS 256           // Datagrams per ring (power of two)
+#define LOCAL_RING_FDS 3               // Descriptors of local_hello: region, doorbell, client bell
+
+// First and only message of the server on the ring socket
+typedef struct {
+    uint32_t magic;         // LOCAL_RING_MAGIC
+    uint32_t version;       // LOCAL_RING_VERSION
+    uint64_t size;          // Bytes of the region to map
+} local_hello;
+
+// One datagram
+typedef struct {
+    uint32_t length;
+    unsigned char data[PROTO_MAX_DATAGRAM];
+} local_slot;
+
+// Single-producer single-consumer ring; the indexes live on cache lines of their own
+typedef struct {
+    _Alignas(64) uint32_t head;     // Slots published by the producer
+    _Alignas(64) uint32_t tail;     // Slots released by the consumer
+    uint32_t sleeping;              // Non-zero while the consumer may wait on its eventfd
+    _Alignas(64) local_slot slots[LOCAL_RING_SLOTS];
+} local_ring;
+
+// The shared region of a session
+typedef struct local_region {
+    uint32_t magic;         // LOCAL_RING_MAGIC
+    uint32_t version;       // LOCAL_RING_VERSION
+    uint32_t slots;         // LOCAL_RING_SLOTS
+    uint32_t slot_size;     // sizeof(local_slot)
+    local_ring requests;    // Client to server
+    local_ring replies;     // Server to client
+} local_region;
+
+/**
+ * @brief Publishes a datagram, if the ring has room (producer side).
+ *
+ * @param[in,out] r: the ring.
+ * @param[in] data: the datagram.
+ * @param[in] length: its size in bytes, at most PROTO_MAX_DATAGRAM.
+ * @return 0 on success, -1 if the ring is full or the datagram too long.
+ */
+static inline int local_ring_push(local_ring *r, const void *data, size_t length)
+{
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    if (length > PROTO_MAX_DATAGRAM || head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOCAL_RING_SLOTS)
+        return -1;
+    local_slot *s = &r->slots[head & (LOCAL_RING_SLOTS - 1)];
+    s->length = (uint32_t) length;
+    memcpy(s->data, data, length);
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Copies out the oldest datagram, clears and releases its slot (consumer side).
+ *
+ * @param[in,out] r: the ring.
+ * @param[out] data: the datagram, PROTO_MAX_DATAGRAM bytes.
+ * @return the size of the datagram, -1 if the ring is empty. A slot holding
+ *         a length over PROTO_MAX_DATAGRAM is released and read as empty (0).
+ */
+static inline int local_ring_pop(local_ring *r, void *data)
+{
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+        return -1;
+    local_slot *s = &r->slots[tail & (LOCAL_RING_SLOTS - 1)];
+    uint32_t length = __atomic_load_n(&s->length, __ATOMIC_RELAXED);
+    if (length > PROTO_MAX_DATAGRAM)
+        length = 0;
+    memcpy(data, s->data, length); // Copied before the slot is released: the producer reuses it
+    memset(s->data, 0, length);    // Replies carry passwords: none is left in the shared memory
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return (int) length;
+}
+
+/**
+ * @brief Tells whether the ring holds a datagram (consumer side).
+ *
+ * @param[in] r: the ring.
+ * @return non-zero if local_ring_pop() would return one.
+ */
+static inline int local_ring_ready(const local_ring *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Announces that the consumer is going to wait (consumer side).
+ *
+ * @param[in,out] r: the ring.
+ * @return non-zero if the ring is still empty: the producer will see
+ *         `sleeping` and write the eventfd. Otherwise the flag is cleared
+ *         and the ring must be read first.
+ */
+static inline int local_ring_sleep(local_ring *r)
+{
+    __atomic_store_n(&r->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!local_ring_ready(r))
+        return 1;
+    __atomic_store_n(&r->sleeping, 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * @brief Tells whether the consumer must be woken after a publication (producer side).
+ *
+ * Its fence pairs with the one of local_ring_sleep(): either the consumer
+ * sees the new datagram, or the producer sees `sleeping`.
+ *
+ * @param[in] r: the ring.
+ * @return non-zero if the eventfd of the consumer must be written.
+ */
+static inline int local_ring_asleep(const local_ring *r)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&r->sleeping, __ATOMIC_RELAXED) != 0;
+}
+
+#endif /* LOCAL_RING_H */
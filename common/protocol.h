@@ -0,0 +1,310 @@
+/*
+ ============================================================================
+ Name        : protocol.h (SHARED)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Wire format shared by the client and the server
+ ============================================================================
+ */
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Every structure below is packed and holds its integers in network (big endian)
+ * order: what is in memory is exactly what is on the wire, with no padding, so
+ * requests are parsed in place in the receive buffer and replies are built in
+ * place in the send buffer.
+ */
+
+// Single password request: type(1) length(4)
+typedef struct __attribute__((packed)) {
+    char type;          // Password type, for example: 'a', 'n', 's', 'm'
+    uint32_t length;    // Length of the password, network byte order
+} msg;
+
+#define PROTO_LEGACY_PADDED_SIZE 8  // Size of `msg` before it was packed (3 padding bytes after type)
+
+/*
+ * Batch protocol, version 1.
+ *
+ * Request:  proto_request_header followed by spec_count proto_spec
+ *           (each spec asks for `count` passwords of `type` and `length`).
+ *           With PROTO_FLAG_POLICY, the specs are followed by a policy:
+ *           length(1) text(length), a passgen_policy_compile() specification
+ *           (no terminator) used by the specs of type PROTO_TYPE_POLICY.
+ * Reply:    proto_reply_header followed by `passwords` entries: length(1) characters(length).
+ *
+ * A spec of type PROTO_TYPE_PASSPHRASE asks for passphrases of `length` words
+ * (PROTO_MIN_WORDS to PROTO_MAX_WORDS) joined by PROTO_PASSPHRASE_SEPARATOR;
+ * their entries are at most PROTO_MAX_PASSPHRASE characters long.
+ *
+ * A reply that does not fit in PROTO_MAX_DATAGRAM bytes is split in `fragments`
+ * datagrams numbered from 0; a password never spans two fragments. Fragments
+ * are packed by proto_entry_size(), the longest entry of a spec, so that both
+ * sides know where every password goes before the reply is generated.
+ * A `msg` datagram (its first byte is a password type, never PROTO_MAGIC)
+ * still gets the raw password string as reply.
+ *
+ * Sealed replies. A server started with a pre-shared key only answers batch
+ * requests carrying PROTO_FLAG_SEALED, and a server without key only answers
+ * requests without it: the others get PROTO_STATUS_BAD_SEAL in the clear.
+ * Every fragment of a successful reply to a sealed request has
+ * PROTO_REPLY_SEALED in its header and is laid out as
+ *     proto_reply_header | nonce(PROTO_SEAL_NONCE_SIZE) | entries, encrypted | tag(PROTO_SEAL_TAG_SIZE)
+ * with XChaCha20-Poly1305 (common/aead.h): the header, left in the clear, is
+ * the associated data. Fragments of a sealed reply are packed in
+ * proto_reply_room(1) bytes, so the sealed datagram still fits in PROTO_MAX_DATAGRAM.
+ * Error replies carry no password and are always sent in the clear.
+ *
+ * Address validation. Over UDP the source address of a request can be forged,
+ * so a server sends at most PROTO_AMPLIFICATION times the size of a batch
+ * request (all fragments, headers and seals included) to an address that has
+ * not proven it receives the replies. A request asking for more gets the
+ * status PROTO_STATUS_RETRY: a lone header followed by PROTO_COOKIE_SIZE
+ * bytes of cookie, bound to the client address and port. The client sends the
+ * request again with PROTO_FLAG_COOKIE and the cookie after the specs (and
+ * after the policy), and keeps sending it with the next requests; the server
+ * accepts a cookie for at least a minute and answers PROTO_STATUS_RETRY with a
+ * new one once it is stale. A `msg` has no room for a cookie: its reply is
+ * bounded the same way, so a password or passphrase longer than
+ * PROTO_AMPLIFICATION times the `msg` (15 characters for the packed layout,
+ * 24 for the padded one) gets the error PROTO_STATUS_RETRY and must be asked
+ * with the batch protocol. Unix socket and shared-memory clients cannot be
+ * forged and never need a cookie.
+ */
+#define PROTO_MAGIC 0xA5            // First byte of every batch datagram
+#define PROTO_VERSION 1             // Current protocol version
+#define PROTO_MAX_SPECS 255         // Largest spec_count
+#define PROTO_MAX_DATAGRAM 1400     // Largest datagram sent, below the usual Ethernet MTU
+#define PROTO_MAX_PASSWORDS 1024    // Largest number of passwords asked by one request
+#define PROTO_MIN_LENGTH 6          // Shortest password served
+#define PROTO_MAX_LENGTH 32         // Longest password served
+#define PROTO_MAX_POLICY 255        // Longest policy text of a request
+#define PROTO_MAX_FRAGMENTS 32      // Most fragments of a reply
+#define PROTO_MIN_WORDS 3           // Fewest words of a passphrase
+#define PROTO_MAX_WORDS 12          // Most words of a passphrase
+#define PROTO_MAX_PASSPHRASE 128    // Longest passphrase served, separators included
+#define PROTO_PASSPHRASE_SEPARATOR '-' // Character between two words of a passphrase
+
+#define PROTO_FLAG_POLICY 0x01      // Request flag: a policy follows the specs
+#define PROTO_FLAG_SEALED 0x02      // Request flag: the client holds the key, the replies must be sealed
+#define PROTO_FLAG_COOKIE 0x04      // Request flag: the request ends with the cookie of a PROTO_STATUS_RETRY
+#define PROTO_COOKIE_SIZE 16        // Cookie of the address validation
+#define PROTO_AMPLIFICATION 3       // Largest ratio of reply bytes to request bytes before the address is validated
+#define PROTO_REPLY_SEALED 0x01     // Reply flag: a nonce follows the header, the entries are encrypted
+#define PROTO_SEAL_NONCE_SIZE 24    // Nonce of a sealed reply: 16-byte salt of the server, 8-byte counter
+#define PROTO_SEAL_TAG_SIZE 16      // Poly1305 tag ending a sealed reply
+#define PROTO_SEAL_OVERHEAD (PROTO_SEAL_NONCE_SIZE + PROTO_SEAL_TAG_SIZE) // Bytes a sealed reply adds
+#define PROTO_TYPE_POLICY '*'       // Spec type of the passwords that follow the request's policy
+#define PROTO_TYPE_PASSPHRASE 'w'   // Type of the passphrases, served when the server has a wordlist
+
+/*
+ * Status codes. A rejected batch request gets a lone proto_reply_header carrying
+ * the status (PROTO_STATUS_RETRY adds the cookie); a rejected `msg` gets the PROTO_ERROR_SIZE bytes '\0' status
+ * (a password never starts with '\0'). Datagrams too short or too long to be a
+ * request get no reply at all.
+ */
+#define PROTO_STATUS_OK 0           // Reply carries the passwords
+#define PROTO_STATUS_BAD_REQUEST 1  // Malformed request: size and spec count do not match
+#define PROTO_STATUS_BAD_VERSION 2  // Unsupported protocol version
+#define PROTO_STATUS_BAD_TYPE 3     // Unknown password type
+#define PROTO_STATUS_BAD_LENGTH 4   // Length outside PROTO_MIN_LENGTH..PROTO_MAX_LENGTH (or the word range)
+#define PROTO_STATUS_TOO_MANY 5     // More than PROTO_MAX_PASSWORDS passwords or PROTO_MAX_FRAGMENTS fragments
+#define PROTO_STATUS_BAD_POLICY 6   // Policy missing, not valid, or impossible to follow
+#define PROTO_STATUS_BAD_SEAL 7     // PROTO_FLAG_SEALED given to a server without key, or missing with one
+#define PROTO_STATUS_RETRY 8        // Reply too large for an address not validated: send again with the cookie (batch only)
+
+#define PROTO_ERROR_SIZE 2          // Size of the error reply to a `msg`
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;          // PROTO_MAGIC
+    uint8_t version;        // PROTO_VERSION
+    uint8_t flags;          // PROTO_FLAG_* bits, 0 if none
+    uint8_t spec_count;     // Number of proto_spec that follow
+    uint32_t request_id;    // Chosen by the client, echoed in every reply fragment
+} proto_request_header;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;           // Password type
+    uint8_t length;         // Length of every password of the spec
+    uint16_t count;         // Number of passwords
+} proto_spec;
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;          // PROTO_MAGIC
+    uint8_t version;        // PROTO_VERSION
+    uint8_t status;         // PROTO_STATUS_*
+    uint8_t fragment;       // Index of this fragment, from 0
+    uint8_t fragments;      // Number of fragments of the reply
+    uint8_t flags;          // PROTO_REPLY_* bits, 0 if none
+    uint16_t passwords;     // Number of password entries in this fragment
+    uint32_t request_id;    // Copied from the request
+} proto_reply_header;
+
+_Static_assert(sizeof(msg) == 5, "msg must have no padding");
+_Static_assert(sizeof(proto_request_header) == 8, "proto_request_header must be 8 bytes");
+_Static_assert(sizeof(proto_spec) == 4, "proto_spec must be 4 bytes");
+_Static_assert(sizeof(proto_reply_header) == 12, "proto_reply_header must be 12 bytes");
+_Static_assert(sizeof(proto_request_header) + PROTO_MAX_SPECS * sizeof(proto_spec) + 1 + PROTO_MAX_POLICY <=
+               PROTO_MAX_DATAGRAM,
+               "the largest request must fit in a datagram");
+
+/**
+ * @brief Returns the room a password of a spec takes in a reply fragment.
+ *
+ * @param[in] type: the spec type.
+ * @param[in] length: the spec length.
+ * @return the size of the longest entry of the spec, its length byte included.
+ */
+static inline size_t proto_entry_size(unsigned int type, unsigned int length)
+{
+    return 1 + (type == PROTO_TYPE_PASSPHRASE ? PROTO_MAX_PASSPHRASE : length);
+}
+
+/**
+ * @brief Returns the room of the header and the entries in a reply fragment.
+ *
+ * @param[in] sealed: non-zero for the replies to a PROTO_FLAG_SEALED request.
+ * @return the size of the largest fragment before sealing.
+ */
+static inline size_t proto_reply_room(int sealed)
+{
+    return PROTO_MAX_DATAGRAM - (sealed ? PROTO_SEAL_OVERHEAD : 0);
+}
+
+/**
+ * @brief Validates a batch request in place.
+ *
+ * Checks the magic, the version and that the datagram holds exactly the
+ * announced specs, the policy and the cookie when the request has them.
+ * Nothing is copied: the returned pointers point into `buffer`.
+ *
+ * @param[in] buffer: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ * @param[out] specs: the first spec, inside `buffer`.
+ * @param[out] policy: the policy text inside `buffer` (not terminated), NULL without PROTO_FLAG_POLICY.
+ * @param[out] policy_length: the size of the policy text.
+ * @param[out] cookie: the PROTO_COOKIE_SIZE bytes of cookie inside `buffer`, NULL without PROTO_FLAG_COOKIE.
+ * @return the request header inside `buffer`, or NULL if the datagram is not a valid request.
+ */
+static inline const proto_request_header *proto_parse_request(const void *buffer, size_t length,
+                                                              const proto_spec **specs, const char **policy,
+                                                              size_t *policy_length, const unsigned char **cookie)
+{
+    const proto_request_header *h = (const proto_request_header *) buffer;
+    if (length < sizeof(*h) || h->magic != PROTO_MAGIC || h->version != PROTO_VERSION || h->spec_count == 0 ||
+        (h->flags & ~(PROTO_FLAG_POLICY | PROTO_FLAG_SEALED | PROTO_FLAG_COOKIE)) != 0)
+        return NULL;
+    size_t used = sizeof(*h) + h->spec_count * sizeof(proto_spec);
+    *policy = NULL;
+    *policy_length = 0;
+    if (h->flags & PROTO_FLAG_POLICY) {
+        if (length <= used)
+            return NULL;
+        *policy_length = ((const unsigned char *) buffer)[used];
+        *policy = (const char *) buffer + used + 1;
+        used += 1 + *policy_length;
+    }
+    *cookie = NULL;
+    if (h->flags & PROTO_FLAG_COOKIE) {
+        *cookie = (const unsigned char *) buffer + used;
+        used += PROTO_COOKIE_SIZE;
+    }
+    if (length != used)
+        return NULL;
+    *specs = (const proto_spec *) (h + 1);
+    return h;
+}
+
+/**
+ * @brief Validates a batch reply fragment in place.
+ *
+ * @param[in] buffer: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ * @return the reply header inside `buffer`, or NULL if the datagram is not a reply.
+ */
+static inline const proto_reply_header *proto_parse_reply(const void *buffer, size_t length)
+{
+    const proto_reply_header *h = (const proto_reply_header *) buffer;
+    if (length < sizeof(*h) || h->magic != PROTO_MAGIC || h->version != PROTO_VERSION ||
+        h->fragment >= h->fragments)
+        return NULL;
+    return h;
+}
+
+/**
+ * @brief Recognizes a single password request, packed or in the old padded layout.
+ *
+ * @param[in] buffer: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ * @param[out] type: the requested type.
+ * @param[out] password_length: the requested length, host byte order.
+ * @return 1 if the datagram is a single password request, 0 otherwise.
+ */
+static inline int proto_parse_msg(const void *buffer, size_t length, char *type, uint32_t *password_length)
+{
+    const unsigned char *p = (const unsigned char *) buffer;
+    if (length == 0 || p[0] == PROTO_MAGIC)
+        return 0;
+    if (length == sizeof(msg))
+        p += 1;
+    else if (length == PROTO_LEGACY_PADDED_SIZE)
+        p += 4;
+    else
+        return 0;
+    *type = *(const char *) buffer;
+    *password_length = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+    return 1;
+}
+
+/**
+ * @brief Recognizes the error reply to a single password request.
+ *
+ * @param[in] buffer: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ * @return the PROTO_STATUS_* code, or PROTO_STATUS_OK if the datagram is a password.
+ */
+static inline unsigned int proto_msg_status(const void *buffer, size_t length)
+{
+    const unsigned char *p = (const unsigned char *) buffer;
+    if (length != PROTO_ERROR_SIZE || p[0] != '\0')
+        return PROTO_STATUS_OK;
+    return p[1];
+}
+
+/**
+ * @brief Describes a status code.
+ *
+ * @param[in] status: a PROTO_STATUS_* code.
+ * @return a static string describing the status.
+ */
+static inline const char *proto_status_text(unsigned int status)
+{
+    switch (status) {
+        case PROTO_STATUS_OK:
+            return "ok";
+        case PROTO_STATUS_BAD_REQUEST:
+            return "malformed request";
+        case PROTO_STATUS_BAD_VERSION:
+            return "unsupported protocol version";
+        case PROTO_STATUS_BAD_TYPE:
+            return "unknown password type";
+        case PROTO_STATUS_BAD_LENGTH:
+            return "password length out of range";
+        case PROTO_STATUS_TOO_MANY:
+            return "too many passwords requested";
+        case PROTO_STATUS_BAD_POLICY:
+            return "policy not valid for the request";
+        case PROTO_STATUS_BAD_SEAL:
+            return "reply encryption not set up like the server (see the key options)";
+        case PROTO_STATUS_RETRY:
+            return "address not validated, the request must be sent again with the cookie";
+    }
+    return "unknown error";
+}
+
+#endif /* PROTOCOL_H */
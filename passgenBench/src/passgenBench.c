@@ -0,0 +1,356 @@
+/*
+ ============================================================================
+ Name        : passgenBench.c (BENCHMARK)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Measures the password generators of libpassgen for every
+               random engine, charset kernel, type and length, and checks
+               with chi-square tests that their output stays uniform.
+               Results are written as JSON Lines (one object per line) so
+               that two builds can be compared, see scripts/bench_compare.py.
+ ============================================================================
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "passgenBench.h"
+
+#define ENGINE_COUNT (RNG_LIBC + 1)
+#define KERNEL_COUNT (KERNEL_AVX2 + 1)
+
+static const char *const apis[] = { "password", "bulk" }; // passgen_password() and passgen_bulk()
+
+// Output of every generation, with the slack the kernels may write past the end
+static char output[BENCH_BULK * QUALITY_LENGTH + KERNEL_BLOCK];
+
+// Occurrences of every character index at every position, for the quality tests
+static uint64_t counts[QUALITY_LENGTH][CHARSET_MAX];
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ * @return the current time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Generates `count` passwords of one type and length through one API.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length.
+ * @param[in] bulk: 0 for passgen_password(), 1 for passgen_bulk() with packed passwords.
+ * @param[in] count: the number of passwords.
+ * @param[in,out] rng: the random engine.
+ * @param[in] visit: called with every chunk of passwords generated, or NULL.
+ * @param[in,out] ctx: passed to `visit`.
+ * @return a value derived from the output, so that the generation is not optimized away.
+ */
+static unsigned long generate(char type, int length, int bulk, unsigned int count, rng_engine *rng,
+                              void (*visit)(void *ctx, const char *passwords, unsigned int n, int length),
+                              void *ctx)
+{
+    unsigned long checksum = 0;
+    for (unsigned int done = 0; done < count;) {
+        unsigned int n = 1;
+        if (bulk) {
+            n = count - done < BENCH_BULK ? count - done : BENCH_BULK;
+            passgen_bulk(type, length, n, length, output, rng);
+        } else {
+            passgen_password(type, length, output, rng);
+        }
+        if (visit != NULL)
+            visit(ctx, output, n, length);
+        checksum += (unsigned char) output[done % length];
+        done += n;
+    }
+    return checksum;
+}
+
+/**
+ * @brief Measures one cell: the fastest of `repeats` runs of `passwords` passwords.
+ * @param[in] c: the run settings.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length.
+ * @param[in] bulk: 0 for passgen_password(), 1 for passgen_bulk().
+ * @param[in,out] rng: the random engine.
+ * @param[in,out] checksum: accumulates a value derived from the output.
+ * @return the elapsed time of the fastest run in nanoseconds.
+ */
+static double measure(const bench_config *c, char type, int length, int bulk, rng_engine *rng,
+                      unsigned long *checksum)
+{
+    double best = 0;
+    *checksum += generate(type, length, bulk, c->passwords / 10 + 1, rng, NULL, NULL); // Warm up
+    for (unsigned int r = 0; r < c->repeats; r++) {
+        double start = now_ns();
+        *checksum += generate(type, length, bulk, c->passwords, rng, NULL, NULL);
+        double elapsed = now_ns() - start;
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+// Character index of every byte value for the set under test, -1 outside of it
+static int char_index[256];
+
+/**
+ * @brief Counts the characters of a chunk of packed passwords, position by position.
+ * @param[in,out] ctx: the number of characters outside of the set.
+ * @param[in] passwords: the passwords, packed.
+ * @param[in] n: the number of passwords.
+ * @param[in] length: the password length.
+ */
+static void count_chars(void *ctx, const char *passwords, unsigned int n, int length)
+{
+    for (unsigned int p = 0; p < n; p++)
+        for (int i = 0; i < length; i++) {
+            int index = char_index[(unsigned char) passwords[p * length + i]];
+            if (index < 0)
+                (*(uint64_t *) ctx)++;
+            else
+                counts[i][index]++;
+        }
+}
+
+/**
+ * @brief Returns the probability of a chi-square value at least as large (Wilson-Hilferty approximation).
+ * @param[in] chi2: the statistic.
+ * @param[in] df: the degrees of freedom.
+ * @return the p-value.
+ */
+static double chi2_pvalue(double chi2, double df)
+{
+    double v = 2.0 / (9.0 * df);
+    double z = (cbrt(chi2 / df) - (1.0 - v)) / sqrt(v);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+/**
+ * @brief Writes the result of one chi-square test and tells whether it passed.
+ * @param[in] c: the run settings.
+ * @param[in] prefix: the start of the JSON object, naming the generator tested.
+ * @param[in] scope: "chars" or "positions".
+ * @param[in] chi2: the statistic.
+ * @param[in] df: the degrees of freedom.
+ * @return 1 if the test passed, 0 otherwise.
+ */
+static int report_chi2(const bench_config *c, const char *prefix, const char *scope, double chi2, double df)
+{
+    double p = chi2_pvalue(chi2, df);
+    int pass = p >= c->alpha;
+    fprintf(c->out, "%s,\"scope\":\"%s\",\"chi2\":%.2f,\"df\":%.0f,\"p\":%.3g,\"pass\":%s}\n",
+            prefix, scope, chi2, df, p, pass ? "true" : "false");
+    return pass;
+}
+
+/**
+ * @brief Runs the quality tests of one type through one API.
+ *
+ * Counts every character of `samples` passwords of QUALITY_LENGTH characters
+ * and compares the counts with the uniform distribution twice: over the whole
+ * output (k - 1 degrees of freedom for a set of k characters), and position by
+ * position (QUALITY_LENGTH * (k - 1)), which catches a kernel lane or a tail
+ * path that favours some characters. A character outside of the set fails both.
+ *
+ * @param[in] c: the run settings.
+ * @param[in] engine: the name of the random engine.
+ * @param[in] kernel: the name of the charset kernel.
+ * @param[in] type: the password type.
+ * @param[in] bulk: 0 for passgen_password(), 1 for passgen_bulk().
+ * @param[in,out] rng: the random engine.
+ * @return the number of failed tests.
+ */
+static int run_quality(const bench_config *c, const char *engine, const char *kernel, char type, int bulk,
+                       rng_engine *rng)
+{
+    const char *characters;
+    int k;
+    passgen_characters(type, &characters, &k);
+    for (int b = 0; b < 256; b++)
+        char_index[b] = -1;
+    for (int i = 0; i < k; i++)
+        char_index[(unsigned char) characters[i]] = i;
+    memset(counts, 0, sizeof(counts));
+
+    uint64_t invalid = 0;
+    generate(type, QUALITY_LENGTH, bulk, c->samples, rng, count_chars, &invalid);
+
+    double per_position = (double) c->samples / k;
+    double chi2_chars = 0, chi2_positions = 0;
+    for (int j = 0; j < k; j++) {
+        uint64_t total = 0;
+        for (int i = 0; i < QUALITY_LENGTH; i++) {
+            double d = counts[i][j] - per_position;
+            chi2_positions += d * d / per_position;
+            total += counts[i][j];
+        }
+        double d = total - per_position * QUALITY_LENGTH;
+        chi2_chars += d * d / (per_position * QUALITY_LENGTH);
+    }
+
+    char prefix[256];
+    snprintf(prefix, sizeof(prefix), "{\"test\":\"chi2\",\"engine\":\"%s\",\"kernel\":\"%s\",\"api\":\"%s\","
+             "\"type\":\"%c\",\"length\":%d,\"passwords\":%u,\"invalid\":%llu",
+             engine, kernel, apis[bulk], type, QUALITY_LENGTH, c->samples, (unsigned long long) invalid);
+    if (invalid > 0)
+        chi2_chars = chi2_positions = INFINITY;
+    int failed = !report_chi2(c, prefix, "chars", chi2_chars, k - 1);
+    failed += !report_chi2(c, prefix, "positions", chi2_positions, (double) QUALITY_LENGTH * (k - 1));
+    return failed;
+}
+
+/**
+ * @brief Parses a comma-separated list of engine or kernel names into a bit set.
+ * @param[in] list: the names.
+ * @param[in] engines: non-zero for engine names, zero for kernel names.
+ * @param[out] set: bit (1 << kind) for every name.
+ * @return 0 on success, -1 on an unknown name.
+ */
+static int parse_names(const char *list, int engines, unsigned int *set)
+{
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", list);
+    *set = 0;
+    for (char *name = strtok(copy, ","); name != NULL; name = strtok(NULL, ",")) {
+        rng_kind engine;
+        kernel_kind kernel;
+        if (engines ? rng_parse(name, &engine) < 0 : kernel_parse(name, &kernel) < 0)
+            return -1;
+        *set |= 1u << (engines ? (unsigned int) engine : (unsigned int) kernel);
+    }
+    return *set != 0 ? 0 : -1;
+}
+
+/**
+ * @brief Prints the command line usage of the benchmark.
+ *
+ * @param[in] prog: the program name (argv[0]).
+ */
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n PASSWORDS] [-r REPEATS] [-s SAMPLES] [-a ALPHA] [-t TYPES] [-l MIN-MAX]\n"
+            "          [-e ENGINES] [-k KERNELS] [-S | -Q] [-o FILE]\n"
+            "  -n PASSWORDS : passwords per measurement (default %d)\n"
+            "  -r REPEATS   : measurements per cell, the fastest is kept (default %d)\n"
+            "  -s SAMPLES   : passwords of %d characters per chi-square test (default %d)\n"
+            "  -a ALPHA     : a chi-square test fails below this p-value (default %g)\n"
+            "  -t TYPES     : password types (default %s)\n"
+            "  -l MIN-MAX   : measured lengths (default %d-%d)\n"
+            "  -e ENGINES   : comma-separated random engines (default chacha20,getrandom,libc)\n"
+            "  -k KERNELS   : comma-separated charset kernels (default every kernel the CPU supports)\n"
+            "  -S           : speed measurements only\n"
+            "  -Q           : chi-square tests only\n"
+            "  -o FILE      : write the results to FILE instead of stdout\n"
+            "Results are JSON Lines; the exit status is 1 when a chi-square test fails.\n",
+            prog, BENCH_PASSWORDS, BENCH_REPEATS, QUALITY_LENGTH, QUALITY_PASSWORDS, QUALITY_ALPHA,
+            PASSGEN_TYPES, BENCH_MIN_LENGTH, BENCH_MAX_LENGTH);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_config c = {
+        BENCH_PASSWORDS, BENCH_REPEATS, QUALITY_PASSWORDS, QUALITY_ALPHA, PASSGEN_TYPES,
+        BENCH_MIN_LENGTH, BENCH_MAX_LENGTH, (1u << ENGINE_COUNT) - 1, (1u << KERNEL_COUNT) - 1, 1, 1, stdout
+    };
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+        if (strcmp(argv[i], "-S") == 0) {
+            c.quality = 0;
+            continue;
+        } else if (strcmp(argv[i], "-Q") == 0) {
+            c.speed = 0;
+            continue;
+        } else if (value == NULL) {
+            ok = 0;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            ok = (c.passwords = (unsigned int) atoi(value)) > 0;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            ok = (c.repeats = (unsigned int) atoi(value)) > 0;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            ok = (c.samples = (unsigned int) atoi(value)) > 0;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            c.alpha = atof(value);
+            ok = c.alpha > 0 && c.alpha < 1;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            c.types = value;
+            ok = *value != '\0' && strspn(value, PASSGEN_TYPES) == strlen(value);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            ok = sscanf(value, "%d-%d", &c.min_length, &c.max_length) == 2 && c.min_length >= 1 &&
+                 c.max_length <= QUALITY_LENGTH && c.min_length <= c.max_length;
+        } else if (strcmp(argv[i], "-e") == 0) {
+            ok = parse_names(value, 1, &c.engines) == 0;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            ok = parse_names(value, 0, &c.kernels) == 0;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            path = value;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (path != NULL && (c.out = fopen(path, "w")) == NULL) {
+        perror(path);
+        return 2;
+    }
+
+    // Run description first, so that results of different builds and machines can be told apart
+    fprintf(c.out, "{\"test\":\"run\",\"compiler\":\"%s\",\"best_kernel\":\"%s\",\"passwords\":%u,"
+            "\"repeats\":%u,\"samples\":%u,\"alpha\":%g}\n",
+            __VERSION__, kernel_name(kernel_best()), c.passwords, c.repeats, c.samples, c.alpha);
+
+    unsigned long checksum = 0;
+    unsigned int cells = 0, tests = 0, failed = 0;
+    for (int e = 0; e < ENGINE_COUNT; e++) {
+        rng_engine rng;
+        if (!(c.engines & (1u << e)))
+            continue;
+        if (rng_init(&rng, (rng_kind) e) < 0) {
+            fprintf(stderr, "Error, cannot initialize the %s engine.\n", rng_name((rng_kind) e));
+            return 2;
+        }
+        for (int k = 0; k < KERNEL_COUNT; k++) {
+            if (!(c.kernels & (1u << k)) || kernel_select((kernel_kind) k) < 0)
+                continue; // Not asked, or not supported by this CPU
+            const char *engine = rng_name((rng_kind) e), *kernel = kernel_name((kernel_kind) k);
+
+            for (const char *t = c.types; *t != '\0'; t++)
+                for (int bulk = 0; bulk < 2; bulk++) {
+                    for (int length = c.min_length; c.speed && length <= c.max_length; length++) {
+                        double elapsed = measure(&c, *t, length, bulk, &rng, &checksum);
+                        fprintf(c.out, "{\"test\":\"speed\",\"engine\":\"%s\",\"kernel\":\"%s\",\"api\":\"%s\","
+                                "\"type\":\"%c\",\"length\":%d,\"ns_per_password\":%.2f,\"gb_per_s\":%.4f}\n",
+                                engine, kernel, apis[bulk], *t, length, elapsed / c.passwords,
+                                (double) c.passwords * length / elapsed);
+                        cells++;
+                    }
+                    if (c.quality) {
+                        failed += run_quality(&c, engine, kernel, *t, bulk, &rng);
+                        tests += 2;
+                    }
+                }
+            fflush(c.out);
+        }
+    }
+
+    fprintf(c.out, "{\"test\":\"summary\",\"cells\":%u,\"chi2_tests\":%u,\"failed\":%u,\"checksum\":%lu}\n",
+            cells, tests, failed, checksum);
+    if (c.out != stdout)
+        fclose(c.out);
+    fprintf(stderr, "%u speed cells, %u chi-square tests, %u failed\n", cells, tests, failed);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+/*
+ ============================================================================
+ Name        : passgenBench.h (BENCHMARK)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the password generator benchmark and
+               statistical quality suite
+ ============================================================================
+ */
+#ifndef PASSGEN_BENCH_H
+#define PASSGEN_BENCH_H
+
+#include <stdio.h>
+#include "passgen.h"
+
+#define BENCH_PASSWORDS 20000 // Default passwords generated per measurement
+
+#define BENCH_REPEATS 3 // Default measurements per cell: the fastest one is reported
+
+#define BENCH_BULK 1000 // Passwords per passgen_bulk() call
+
+#define BENCH_MIN_LENGTH 6 // Default range of the measured lengths
+#define BENCH_MAX_LENGTH 32
+
+#define QUALITY_LENGTH 32 // Length of the passwords of the quality tests
+
+#define QUALITY_PASSWORDS 200000 // Default passwords per quality test
+
+#define QUALITY_ALPHA 1e-4 // Default significance level: a test fails when its p-value is lower
+
+// What one run measures, from the command line
+typedef struct {
+    unsigned int passwords;     // Passwords per measurement
+    unsigned int repeats;       // Measurements per cell
+    unsigned int samples;       // Passwords per quality test
+    double alpha;               // Significance level of the quality tests
+    const char *types;          // Password types, among PASSGEN_TYPES
+    int min_length;             // Measured lengths
+    int max_length;
+    unsigned int engines;       // Bit (1 << rng_kind) per random engine
+    unsigned int kernels;       // Bit (1 << kernel_kind) per charset kernel
+    int speed;                  // Non-zero to run the speed measurements
+    int quality;                // Non-zero to run the quality tests
+    FILE *out;                  // Results, one JSON object per line
+} bench_config;
+
+#endif /* PASSGEN_BENCH_H */
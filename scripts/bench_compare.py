@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# ============================================================================
+# Name        : bench_compare.py
+# Author      : Giordano, Aghilar
+# Version     : 1.0
+# Copyright   : Your copyright notice
+# Description : Compares two result files of passgenBench (JSON Lines, see
+#               passgenBench/src/passgenBench.c): prints the speed cells
+#               that got slower than THRESHOLD percent, the geometric mean
+#               of the speed ratios per engine, kernel and API, and every
+#               failed chi-square test of the new run. Exits with 1 when a
+#               cell regressed or a test failed, so that it can gate a build.
+#
+# Usage: scripts/bench_compare.py OLD.jsonl NEW.jsonl [THRESHOLD]
+# ============================================================================
+
+import json
+import math
+import sys
+
+
+def load(path):
+    speed, failed = {}, []
+    with open(path) as f:
+        for line in f:
+            row = json.loads(line)
+            if row["test"] == "speed":
+                key = (row["engine"], row["kernel"], row["api"], row["type"], row["length"])
+                speed[key] = row["ns_per_password"]
+            elif row["test"] == "chi2" and not row["pass"]:
+                failed.append(row)
+    return speed, failed
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        sys.exit(f"Usage: {sys.argv[0]} OLD.jsonl NEW.jsonl [THRESHOLD]")
+    threshold = float(sys.argv[3]) if len(sys.argv) == 4 else 10.0
+    old, _ = load(sys.argv[1])
+    new, failed = load(sys.argv[2])
+
+    regressions, groups = [], {}
+    for key in sorted(old.keys() & new.keys()):
+        ratio = new[key] / old[key]
+        groups.setdefault(key[:3], []).append(math.log(ratio))
+        if ratio > 1 + threshold / 100:
+            regressions.append((key, old[key], new[key], ratio))
+
+    print(f"{'engine':<10} {'kernel':<7} {'api':<9} {'cells':>6} {'new/old time':>13}")
+    for (engine, kernel, api), logs in sorted(groups.items()):
+        print(f"{engine:<10} {kernel:<7} {api:<9} {len(logs):>6} {math.exp(sum(logs) / len(logs)):>13.3f}")
+
+    if regressions:
+        print(f"\n{len(regressions)} cells slower by more than {threshold:g}%:")
+        for (engine, kernel, api, type, length), before, after, ratio in regressions:
+            print(f"  {engine} {kernel} {api} {type} {length:>2}: {before:.2f} -> {after:.2f} ns ({ratio:.2f}x)")
+    for row in failed:
+        print(f"chi-square failed: {row['engine']} {row['kernel']} {row['api']} {row['type']} "
+              f"{row['scope']}: chi2 {row['chi2']} df {row['df']} p {row['p']}")
+    missing = len(old.keys() - new.keys())
+    if missing:
+        print(f"{missing} cells of the old run are missing from the new one")
+    sys.exit(1 if regressions or failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,61 @@
+#!/bin/sh
+# ============================================================================
+# Name        : compare_backends.sh
+# Author      : Giordano, Aghilar
+# Version     : 1.0
+# Copyright   : Your copyright notice
+# Description : Runs the client load generator against the server once per
+#               I/O backend and prints one line per backend, so that the
+#               backend can be chosen for the kernel the server runs on.
+#               Both programs must be built (Debug folders) and the server
+#               port must be free.
+#
+# Usage: scripts/compare_backends.sh [SECONDS] [CONCURRENCY] [BATCH] [WORKERS]
+# ============================================================================
+
+DURATION=${1:-10}
+CONCURRENCY=${2:-64}
+BATCH=${3:-32}
+WORKERS=${4:--1}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SERVER=$ROOT/serverUDP/Debug/serverUDP
+CLIENT=$ROOT/clientUDP/Debug/clientUDP
+
+for prog in "$SERVER" "$CLIENT"; do
+    if [ ! -x "$prog" ]; then
+        echo "Missing $prog: build it first" >&2
+        exit 1
+    fi
+done
+
+WORKER_OPT=
+[ "$WORKERS" -ge 0 ] && WORKER_OPT="-w $WORKERS"
+
+echo "Kernel $(uname -r), $DURATION s per run, $CONCURRENCY requests in flight, batch $BATCH"
+printf "%-14s %14s %10s %12s %12s\n" backend "passwords/s" "lost %" "p50 us" "p99 us"
+
+for backend in blocking mmsg uring uring-sqpoll; do
+    # An io_uring server releases its socket asynchronously after exiting: retry until the port is free
+    LOG=$(mktemp)
+    for attempt in 1 2 3 4 5; do
+        "$SERVER" -q -b "$BATCH" -i "$backend" $WORKER_OPT > "$LOG" 2>&1 &
+        PID=$!
+        sleep 1
+        kill -0 "$PID" 2>/dev/null && break
+    done
+    OUT=$("$CLIENT" -B -c "$CONCURRENCY" -d "$DURATION" 2>&1)
+    kill "$PID" 2>/dev/null
+    wait "$PID" 2>/dev/null
+
+    NOTE=
+    grep -q "not available" "$LOG" && NOTE=" (fell back, see server log)"
+    rm -f "$LOG"
+
+    echo "$OUT" | awk -v name="$backend" -v note="$NOTE" '
+        $1 == "received" { rate = $3; sub(/^\(/, "", rate) }
+        $1 == "lost"     { lost = $3; gsub(/[(%)]/, "", lost) }
+        $2 == "50.000%"  { p50 = $1 }
+        $2 == "99.000%"  { p99 = $1 }
+        END { printf "%-14s %14s %10s %12s %12s%s\n", name, rate, lost, p50, p99, note }'
+done
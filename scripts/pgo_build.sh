@@ -0,0 +1,50 @@
+#!/bin/sh
+# ============================================================================
+# Name        : pgo_build.sh
+# Author      : Giordano, Aghilar
+# Version     : 1.0
+# Copyright   : Your copyright notice
+# Description : Builds the profile-guided Release binaries in build/pgo:
+#               an instrumented build serves the load generator's workload
+#               (the blocking loop, then batched workers), the profile is
+#               recorded, and the same folder is rebuilt with it.
+#               The server port must be free.
+#
+# Usage: scripts/pgo_build.sh [SECONDS] [CONCURRENCY]
+# ============================================================================
+
+DURATION=${1:-10}
+CONCURRENCY=${2:-64}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$ROOT/build/pgo
+SERVER=$BUILD/serverUDP
+CLIENT=$BUILD/clientUDP
+
+set -e
+rm -rf "$BUILD/pgo"
+cmake -S "$ROOT" -B "$BUILD" -DCMAKE_BUILD_TYPE=Release -DPASSGEN_LTO=ON -DPASSGEN_PGO=generate > /dev/null
+cmake --build "$BUILD" -j"$(nproc)"
+set +e
+
+# Training runs: the server options of the deployment should be listed here
+for server_opt in "-q" "-q -b 32 -w 2" "-q -b 32 -w 2 -P 1024"; do
+    echo "Training: serverUDP $server_opt"
+    "$SERVER" $server_opt &
+    PID=$!
+    sleep 1
+    "$CLIENT" -B -c "$CONCURRENCY" -d "$DURATION" > /dev/null
+    kill "$PID"          # The instrumented server writes its profile on SIGTERM
+    wait "$PID" 2>/dev/null
+    sleep 1
+done
+"$SERVER" -B > /dev/null # The microbenchmarks cover every random engine and charset kernel
+
+if cmake -LA -N "$BUILD" 2>/dev/null | grep -q "CMAKE_C_COMPILER:.*clang"; then
+    llvm-profdata merge -o "$BUILD/pgo/default.profdata" "$BUILD"/pgo/*.profraw || exit 1
+fi
+
+set -e
+cmake -S "$ROOT" -B "$BUILD" -DPASSGEN_PGO=use > /dev/null
+cmake --build "$BUILD" -j"$(nproc)" --clean-first
+echo "Profile-guided binaries: $SERVER $CLIENT"
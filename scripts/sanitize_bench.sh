@@ -0,0 +1,57 @@
+#!/bin/sh
+# ============================================================================
+# Name        : sanitize_bench.sh
+# Author      : Giordano, Aghilar
+# Version     : 1.0
+# Copyright   : Your copyright notice
+# Description : Runs the benchmark suite under the sanitizers: for each of
+#               the asan (AddressSanitizer + UndefinedBehaviorSanitizer) and
+#               tsan (ThreadSanitizer) builds, the server microbenchmarks,
+#               then the load generator against a server using the worker
+#               pool, the password pool, the rate limiter and the metrics
+#               endpoint. Stops at the first sanitizer report.
+#               The server port must be free.
+#
+# Usage: scripts/sanitize_bench.sh [SECONDS] [asan|tsan]...
+# ============================================================================
+
+DURATION=${1:-5}
+[ $# -gt 0 ] && shift
+SANITIZERS=${*:-asan tsan}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+export ASAN_OPTIONS=abort_on_error=1:detect_leaks=1
+export UBSAN_OPTIONS=print_stacktrace=1:halt_on_error=1
+export TSAN_OPTIONS=halt_on_error=1:second_deadlock_stack=1
+
+for preset in $SANITIZERS; do
+    case $preset in
+        asan) SANITIZE=address,undefined ;;
+        tsan) SANITIZE=thread ;;
+        *) echo "Unknown sanitizer build $preset" >&2; exit 1 ;;
+    esac
+    BUILD=$ROOT/build/$preset
+    cmake -S "$ROOT" -B "$BUILD" -DCMAKE_BUILD_TYPE=RelWithDebInfo -DPASSGEN_LTO=OFF \
+          -DPASSGEN_SANITIZE=$SANITIZE > /dev/null || exit 1
+    cmake --build "$BUILD" -j"$(nproc)" > /dev/null || exit 1
+
+    echo "== $preset: server microbenchmarks"
+    "$BUILD/serverUDP" -B > /dev/null || { echo "$preset: microbenchmarks failed" >&2; exit 1; }
+
+    echo "== $preset: load generator, $DURATION s"
+    LOG=$(mktemp)
+    "$BUILD/serverUDP" -q -w 2 -b 16 -P 256 -L 100000 -M 9464 > "$LOG" 2>&1 &
+    PID=$!
+    sleep 1
+    "$BUILD/clientUDP" -B -c 32 -d "$DURATION" > /dev/null || { echo "$preset: client failed" >&2; exit 1; }
+    curl -s 127.0.0.1:9464/metrics > /dev/null 2>&1
+    kill -0 "$PID" 2>/dev/null || { cat "$LOG"; echo "$preset: server died" >&2; exit 1; }
+    kill "$PID"
+    wait "$PID" 2>/dev/null
+    if grep -q "Sanitizer" "$LOG"; then
+        cat "$LOG"
+        exit 1
+    fi
+    rm -f "$LOG"
+done
+echo "No sanitizer reports"
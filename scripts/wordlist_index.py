@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# ============================================================================
+# Name        : wordlist_index.py
+# Author      : Giordano, Aghilar
+# Version     : 1.0
+# Copyright   : Your copyright notice
+# Description : Builds the indexed wordlist served by serverUDP -W (layout in
+#               serverUDP/src/wordlist.h): a header, an offset table and the
+#               words, so that the server maps the file and reads no word at
+#               startup. The input has one word per line; diceware lists
+#               ("11111<TAB>abacus", like the EFF lists) keep their last field.
+#               Words must be printable ASCII with no space nor the passphrase
+#               separator '-'; duplicates are dropped, since they would bias
+#               the draws. The index is written to a temporary file next to
+#               the target and renamed over it: a server mapping the old
+#               index keeps its pages, it never sees a half-written file.
+#
+# Usage: scripts/wordlist_index.py WORDS.txt WORDS.pgwl
+# ============================================================================
+
+import os
+import struct
+import sys
+import tempfile
+
+MAGIC = 0x4C574750      # WORDLIST_MAGIC
+VERSION = 1             # WORDLIST_VERSION
+MAX_WORD = 64           # WORDLIST_MAX_WORD
+SEPARATOR = "-"         # PROTO_PASSPHRASE_SEPARATOR
+
+
+def read_words(path):
+    words, seen = [], set()
+    with open(path, encoding="ascii") as f:
+        for number, line in enumerate(f, 1):
+            fields = line.split()
+            if not fields:
+                continue
+            word = fields[-1]
+            if len(word) > MAX_WORD or SEPARATOR in word or not all("!" <= c <= "~" for c in word):
+                sys.exit(f"{path}:{number}: word not valid: {word!r}")
+            if word not in seen:
+                seen.add(word)
+                words.append(word)
+    if len(words) < 2:
+        sys.exit(f"{path}: at least two words are needed")
+    return words
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(f"Usage: {sys.argv[0]} WORDS.txt WORDS.pgwl")
+    words = read_words(sys.argv[1])
+    blob = "".join(words).encode("ascii")
+    offsets, position = [], 0
+    for word in words:
+        offsets.append(position)
+        position += len(word)
+    offsets.append(position)
+
+    # Never truncated in place: the running servers map the old file (see wordlist.h)
+    target = os.path.abspath(sys.argv[2])
+    fd, temporary = tempfile.mkstemp(dir=os.path.dirname(target), prefix=".wordlist-", suffix=".tmp")
+    try:
+        with os.fdopen(fd, "wb") as out:
+            out.write(struct.pack("<4I", MAGIC, VERSION, len(words), max(map(len, words))))
+            out.write(struct.pack(f"<{len(offsets)}I", *offsets))
+            out.write(blob)
+            out.flush()
+            os.fsync(out.fileno())
+        os.chmod(temporary, 0o644)
+        os.replace(temporary, target)
+    except BaseException:
+        os.unlink(temporary)
+        raise
+    print(f"{len(words)} words, longest {max(map(len, words))}, written to {sys.argv[2]}")
+
+
+if __name__ == "__main__":
+    main()
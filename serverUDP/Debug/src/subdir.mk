@@ -4,16 +4,76 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../src/charsetKernel.c \
+../src/passgen.c \
+../src/rng.c \
+../src/serverBench.c \
+../src/serverCache.c \
+../src/serverConfig.c \
 ../src/serverESONERO.c \
-../src/support.c 
+../src/serverIO.c \
+../src/serverLimit.c \
+../src/serverLocal.c \
+../src/serverLog.c \
+../src/serverMetrics.c \
+../src/serverPolicy.c \
+../src/serverPool.c \
+../src/serverRequest.c \
+../src/serverSeal.c \
+../src/serverUpgrade.c \
+../src/serverUring.c \
+../src/serverValidate.c \
+../src/serverWorker.c \
+../src/support.c \
+../src/wordlist.c 
 
 C_DEPS += \
+./src/charsetKernel.d \
+./src/passgen.d \
+./src/rng.d \
+./src/serverBench.d \
+./src/serverCache.d \
+./src/serverConfig.d \
 ./src/serverESONERO.d \
-./src/support.d 
+./src/serverIO.d \
+./src/serverLimit.d \
+./src/serverLocal.d \
+./src/serverLog.d \
+./src/serverMetrics.d \
+./src/serverPolicy.d \
+./src/serverPool.d \
+./src/serverRequest.d \
+./src/serverSeal.d \
+./src/serverUpgrade.d \
+./src/serverUring.d \
+./src/serverValidate.d \
+./src/serverWorker.d \
+./src/support.d \
+./src/wordlist.d 
 
 OBJS += \
+./src/charsetKernel.o \
+./src/passgen.o \
+./src/rng.o \
+./src/serverBench.o \
+./src/serverCache.o \
+./src/serverConfig.o \
 ./src/serverESONERO.o \
-./src/support.o 
+./src/serverIO.o \
+./src/serverLimit.o \
+./src/serverLocal.o \
+./src/serverLog.o \
+./src/serverMetrics.o \
+./src/serverPolicy.o \
+./src/serverPool.o \
+./src/serverRequest.o \
+./src/serverSeal.o \
+./src/serverUpgrade.o \
+./src/serverUring.o \
+./src/serverValidate.o \
+./src/serverWorker.o \
+./src/support.o \
+./src/wordlist.o 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -28,7 +88,7 @@ src/%.o: ../src/%.c src/subdir.mk
 clean: clean-src
 
 clean-src:
-	-$(RM) ./src/serverESONERO.d ./src/serverESONERO.o ./src/support.d ./src/support.o
+	-$(RM) ./src/charsetKernel.d ./src/charsetKernel.o ./src/passgen.d ./src/passgen.o ./src/rng.d ./src/rng.o ./src/serverBench.d ./src/serverBench.o ./src/serverCache.d ./src/serverCache.o ./src/serverConfig.d ./src/serverConfig.o ./src/serverESONERO.d ./src/serverESONERO.o ./src/serverIO.d ./src/serverIO.o ./src/serverLimit.d ./src/serverLimit.o ./src/serverLocal.d ./src/serverLocal.o ./src/serverLog.d ./src/serverLog.o ./src/serverMetrics.d ./src/serverMetrics.o ./src/serverPolicy.d ./src/serverPolicy.o ./src/serverPool.d ./src/serverPool.o ./src/serverRequest.d ./src/serverRequest.o ./src/serverSeal.d ./src/serverSeal.o ./src/serverUpgrade.d ./src/serverUpgrade.o ./src/serverUring.d ./src/serverUring.o ./src/serverValidate.d ./src/serverValidate.o ./src/serverWorker.d ./src/serverWorker.o ./src/support.d ./src/support.o ./src/wordlist.d ./src/wordlist.o
 
 .PHONY: clean-src
 
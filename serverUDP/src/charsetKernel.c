@@ -0,0 +1,292 @@
+/*
+ ============================================================================
+ Name        : charsetKernel.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the bulk random byte to charset mapping kernels
+ ============================================================================
+ */
+
+#include <string.h>
+#include "charsetKernel.h"
+
+#if defined __x86_64__ || defined __i386__
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Portable kernel: maps one byte at a time, branch-free.
+ * @param[in] cs: the prepared set.
+ * @param[in] random: the random bytes.
+ * @param[in] n: the number of random bytes.
+ * @param[out] out: the destination, with room for `n` characters.
+ * @return the number of characters written.
+ */
+static size_t map_scalar(const charset *cs, const unsigned char *random, size_t n, char *out)
+{
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned int product = random[i] * cs->length;
+        out[k] = cs->table[product >> 8];
+        k += (product & 0xFF) >= cs->threshold; // A rejected character is overwritten by the next one
+    }
+    return k;
+}
+
+#if defined KERNEL_X86
+
+// pack_table[m] lists the positions of the bits set in m: a shuffle that left-packs 8 bytes
+static unsigned char pack_table[256][8];
+
+/**
+ * @brief Fills pack_table.
+ */
+static void prepare_pack_table(void)
+{
+    for (int m = 0; m < 256; m++) {
+        int k = 0;
+        for (int j = 0; j < 8; j++)
+            if (m & (1 << j))
+                pack_table[m][k++] = j;
+        while (k < 8)
+            pack_table[m][k++] = 0x80; // vpshufb writes zero
+    }
+}
+
+/**
+ * @brief SSE2 kernel: multiply-shift and rejection on 16 bytes, scalar table lookup (never chosen by default).
+ * @param[in] cs: the prepared set.
+ * @param[in] random: the random bytes.
+ * @param[in] n: the number of random bytes.
+ * @param[out] out: the destination, with room for `n` characters.
+ * @return the number of characters written.
+ */
+__attribute__((target("sse2")))
+static size_t map_sse2(const charset *cs, const unsigned char *random, size_t n, char *out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i length = _mm_set1_epi16((short) cs->length);
+    const __m128i threshold = _mm_set1_epi8((char) cs->threshold);
+    const __m128i low_byte = _mm_set1_epi16(0xFF);
+    unsigned char index[16];
+    size_t i = 0, k = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(random + i));
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(bytes, zero), length);
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(bytes, zero), length);
+        __m128i idx = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+        __m128i rest = _mm_packus_epi16(_mm_and_si128(lo, low_byte), _mm_and_si128(hi, low_byte));
+        // rest >= threshold  <=>  max(rest, threshold) == rest (SSE2 has no unsigned compare)
+        unsigned int accept = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(rest, threshold), rest));
+
+        _mm_storeu_si128((__m128i *) index, idx);
+        if (accept == 0xFFFF) {
+            for (int j = 0; j < 16; j++)
+                out[k + j] = cs->table[index[j]];
+            k += 16;
+        } else {
+            for (int j = 0; j < 16; j++) {
+                out[k] = cs->table[index[j]];
+                k += (accept >> j) & 1;
+            }
+        }
+    }
+
+    return k + map_scalar(cs, random + i, n - i, out + k);
+}
+
+/**
+ * @brief AVX2 kernel: multiply-shift, rejection and table lookup on 32 bytes.
+ *
+ * The set is split in 16-character chunks looked up with vpshufb. Indices of
+ * other chunks are pushed to 0x80 or above with a saturating add, so that
+ * vpshufb returns zero for them and the chunks can be OR-ed together.
+ * Blocks with rejected bytes are left-packed with pack_table.
+ *
+ * @param[in] cs: the prepared set.
+ * @param[in] random: the random bytes.
+ * @param[in] n: the number of random bytes.
+ * @param[out] out: the destination, with room for `n` characters.
+ * @return the number of characters written.
+ */
+__attribute__((target("avx2")))
+static size_t map_avx2(const charset *cs, const unsigned char *random, size_t n, char *out)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i length = _mm256_set1_epi16((short) cs->length);
+    const __m256i threshold = _mm256_set1_epi8((char) cs->threshold);
+    const __m256i low_byte = _mm256_set1_epi16(0xFF);
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    const int chunks = (cs->length + 15) / 16;
+    __m256i table[CHARSET_MAX / 16];
+    unsigned char mapped[32];
+    size_t i = 0, k = 0;
+
+    for (int c = 0; c < chunks; c++)
+        table[c] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(cs->table + 16 * c)));
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(random + i));
+        __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(bytes, zero), length);
+        __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(bytes, zero), length);
+        __m256i idx = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+        __m256i rest = _mm256_packus_epi16(_mm256_and_si256(lo, low_byte), _mm256_and_si256(hi, low_byte));
+        unsigned int accept = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(rest, threshold), rest));
+
+        __m256i chars = zero;
+        for (int c = 0; c < chunks; c++) {
+            __m256i local = _mm256_adds_epu8(_mm256_sub_epi8(idx, _mm256_set1_epi8((char)(16 * c))), bias);
+            chars = _mm256_or_si256(chars, _mm256_shuffle_epi8(table[c], local));
+        }
+
+        if (accept == 0xFFFFFFFFu) {
+            _mm256_storeu_si256((__m256i *)(out + k), chars);
+            k += 32;
+        } else {
+            // Left-pack the accepted characters 8 at a time with a shuffle table
+            _mm256_storeu_si256((__m256i *) mapped, chars);
+            for (int g = 0; g < 4; g++) {
+                unsigned int m = (accept >> (8 * g)) & 0xFF;
+                __m128i group = _mm_loadl_epi64((const __m128i *)(mapped + 8 * g));
+                __m128i shuffle = _mm_loadl_epi64((const __m128i *) pack_table[m]);
+                _mm_storel_epi64((__m128i *)(out + k), _mm_shuffle_epi8(group, shuffle));
+                k += __builtin_popcount(m);
+            }
+        }
+    }
+
+    return k + map_scalar(cs, random + i, n - i, out + k);
+}
+
+#endif /* KERNEL_X86 */
+
+// Kernel used by charset_map(), chosen by kernel_select()
+static size_t (*kernel)(const charset *, const unsigned char *, size_t, char *) = map_scalar;
+static int kernel_chosen; // Non-zero once kernel_select() succeeded
+
+/**
+ * @brief Prepares a character set for the kernels.
+ * @param[out] cs: the prepared set.
+ * @param[in] characters: the characters of the set.
+ * @param[in] length: the number of characters, between 1 and CHARSET_MAX.
+ * @return 0 on success, -1 if the length is out of range.
+ */
+int charset_prepare(charset *cs, const char *characters, int length)
+{
+    if (length < 1 || length > CHARSET_MAX)
+        return -1;
+    memset(cs->table, 0, sizeof(cs->table));
+    memcpy(cs->table, characters, length);
+    cs->length = length;
+    cs->threshold = 256 % length;
+    return 0;
+}
+
+/**
+ * @brief Maps random bytes to characters of a set, without modulo bias.
+ * @param[in] cs: the prepared set.
+ * @param[in] random: the random bytes.
+ * @param[in] n: the number of random bytes.
+ * @param[out] out: the destination, with room for `n` characters.
+ * @return the number of characters written (at most `n`).
+ */
+size_t charset_map(const charset *cs, const unsigned char *random, size_t n, char *out)
+{
+    return kernel(cs, random, n, out);
+}
+
+/**
+ * @brief Returns the fastest kernel supported by the running CPU.
+ * @return the kernel chosen at run time.
+ */
+kernel_kind kernel_best(void)
+{
+#if defined KERNEL_X86
+    // Not SSE2: its lookup stays scalar, and a password costs it no less than the scalar kernel
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return KERNEL_AVX2;
+#endif
+    return KERNEL_SCALAR;
+}
+
+/**
+ * @brief Selects the kernel used by charset_map().
+ * @param[in] kind: the kernel to use.
+ * @return 0 on success, -1 if the CPU does not support it.
+ */
+int kernel_select(kernel_kind kind)
+{
+    switch (kind) {
+        case KERNEL_SCALAR:
+            kernel = map_scalar;
+            break;
+#if defined KERNEL_X86
+        case KERNEL_SSE2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("sse2"))
+                return -1;
+            kernel = map_sse2;
+            break;
+        case KERNEL_AVX2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("avx2"))
+                return -1;
+            prepare_pack_table();
+            kernel = map_avx2;
+            break;
+#endif
+        default:
+            return -1;
+    }
+    kernel_chosen = 1;
+    return 0;
+}
+
+/**
+ * @brief Selects the fastest supported kernel, unless kernel_select() already chose one.
+ */
+void kernel_select_default(void)
+{
+    if (!kernel_chosen)
+        kernel_select(kernel_best());
+}
+
+/**
+ * @brief Parses a kernel name ("scalar", "sse2" or "avx2").
+ * @param[in] name: the kernel name.
+ * @param[out] kind: the matching kernel.
+ * @return 0 if the name is known, -1 otherwise.
+ */
+int kernel_parse(const char *name, kernel_kind *kind)
+{
+    static const kernel_kind kinds[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (strcmp(name, kernel_name(kinds[i])) == 0) {
+            *kind = kinds[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Returns the name of a kernel.
+ * @param[in] kind: the kernel.
+ * @return a static string with the kernel name.
+ */
+const char *kernel_name(kernel_kind kind)
+{
+    switch (kind) {
+        case KERNEL_SCALAR:
+            return "scalar";
+        case KERNEL_SSE2:
+            return "sse2";
+        case KERNEL_AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
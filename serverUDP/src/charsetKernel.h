@@ -0,0 +1,105 @@
+/*
+ ============================================================================
+ Name        : charsetKernel.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the bulk random byte to charset mapping kernels
+ ============================================================================
+ */
+#ifndef CHARSET_KERNEL_H
+#define CHARSET_KERNEL_H
+
+#include <stddef.h>
+
+#define CHARSET_MAX 128 // Largest character set supported by the kernels
+
+#define KERNEL_BLOCK 32 // Random bytes mapped per vector step; output buffers need this much slack
+
+// A character set prepared for the kernels
+typedef struct {
+    unsigned char table[CHARSET_MAX] __attribute__((aligned(32))); // Characters, zero padded
+    unsigned int length;     // Number of characters in the set
+    unsigned int threshold;  // 256 % length: low products below it are rejected
+} charset;
+
+// Available kernel implementations
+typedef enum {
+    KERNEL_SCALAR,  // Portable C, one byte at a time
+    KERNEL_SSE2,    // 16 bytes per step, scalar table lookup: only on request, no faster than scalar
+    KERNEL_AVX2     // 32 bytes per step, vector table lookup
+} kernel_kind;
+
+/**
+ * @brief Prepares a character set for the kernels.
+ *
+ * @param[out] cs: the prepared set.
+ * @param[in] characters: the characters of the set.
+ * @param[in] length: the number of characters, between 1 and CHARSET_MAX.
+ * @return 0 on success, -1 if the length is out of range.
+ */
+int charset_prepare(charset *cs, const char *characters, int length);
+
+/**
+ * @brief Maps random bytes to characters of a set, without modulo bias.
+ *
+ * Each byte b gives the index (b * length) >> 8 and is rejected when the low
+ * byte of the product is below `threshold`: every character of the set is then
+ * produced by exactly the same number of byte values. Accepted characters are
+ * written contiguously to `out`.
+ *
+ * @param[in] cs: the prepared set.
+ * @param[in] random: the random bytes.
+ * @param[in] n: the number of random bytes.
+ * @param[out] out: the destination, with room for `n` characters.
+ * @return the number of characters written (at most `n`).
+ */
+size_t charset_map(const charset *cs, const unsigned char *random, size_t n, char *out);
+
+/**
+ * @brief Returns the fastest kernel supported by the running CPU.
+ *
+ * AVX2 when the CPU has it, scalar otherwise. The SSE2 kernel is never
+ * chosen: its table lookup is scalar, so end to end it does not beat the
+ * scalar kernel.
+ *
+ * @return the kernel chosen at run time.
+ */
+kernel_kind kernel_best(void);
+
+/**
+ * @brief Selects the kernel used by charset_map().
+ *
+ * Must be called before the worker threads start.
+ *
+ * @param[in] kind: the kernel to use.
+ * @return 0 on success, -1 if the CPU does not support it.
+ */
+int kernel_select(kernel_kind kind);
+
+/**
+ * @brief Selects the fastest supported kernel, unless kernel_select() already chose one.
+ *
+ * Called by the password library before its first generation, so that
+ * programs that never pick a kernel do not run the scalar one.
+ */
+void kernel_select_default(void);
+
+/**
+ * @brief Parses a kernel name ("scalar", "sse2" or "avx2").
+ *
+ * @param[in] name: the kernel name.
+ * @param[out] kind: the matching kernel.
+ * @return 0 if the name is known, -1 otherwise.
+ */
+int kernel_parse(const char *name, kernel_kind *kind);
+
+/**
+ * @brief Returns the name of a kernel.
+ *
+ * @param[in] kind: the kernel.
+ * @return a static string with the kernel name.
+ */
+const char *kernel_name(kernel_kind kind);
+
+#endif /* CHARSET_KERNEL_H */
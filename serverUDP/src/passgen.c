@@ -0,0 +1,414 @@
+/*
+ ============================================================================
+ Name        : passgen.c (LIBRARY)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the password generation library (libpassgen)
+ ============================================================================
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "passgen.h"
+
+static const char numeric[] = "0123456789";
+static const char alpha[] = "abcdefghijklmnopqrstuvwxyz";
+static const char mixed[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+static const char secure[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789!@#$%^&*()_+-=,./<>?";
+static const char unambiguous[] = "ACDEFGHJKLMNPQRTUVWXYabcdefghjkmnpqrtuvwxy34679!@#$%^&*()_+-=,./<>?";
+
+static const char *class_names[PASSGEN_CLASSES] = { "upper", "lower", "digit", "symbol" };
+
+// The five built-in types compiled as policies without rules, in PASSGEN_TYPES order
+static passgen_policy builtins[5];
+// 256 % bound for every shuffle bound, so that no draw divides
+static unsigned char thresholds[PASSGEN_POLICY_MAX_LENGTH + 1];
+static pthread_once_t prepare_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Returns the class of a character.
+ * @param[in] c: a printable character.
+ * @return 0 for upper, 1 for lower, 2 for digit, 3 for symbol.
+ */
+static int class_of(unsigned char c)
+{
+    return isupper(c) ? 0 : islower(c) ? 1 : isdigit(c) ? 2 : 3;
+}
+
+/**
+ * @brief Groups a set of characters by class and fills the policy table and class ranges.
+ * @param[out] p: the policy; the rules are left to the caller.
+ * @param[in] present: non-zero for the characters of the set.
+ * @return 0 on success, -1 if the set is empty or too large.
+ */
+static int compile_set(passgen_policy *p, const unsigned char present[256])
+{
+    char table[CHARSET_MAX];
+    int n = 0;
+
+    memset(p, 0, sizeof(*p));
+    for (int c = 0; c < PASSGEN_CLASSES; c++) {
+        p->plan[c].start = (unsigned char) n;
+        for (int ch = 0x21; ch < 0x7F; ch++) {
+            if (present[ch] && class_of(ch) == c) {
+                if (n == CHARSET_MAX)
+                    return -1;
+                table[n++] = (char) ch;
+            }
+        }
+        p->plan[c].size = (unsigned char) (n - p->plan[c].start);
+        p->plan[c].threshold = p->plan[c].size ? (unsigned char) (256 % p->plan[c].size) : 0;
+    }
+    return charset_prepare(&p->all, table, n);
+}
+
+/**
+ * @brief Compiles the built-in types and the shuffle thresholds, once per process.
+ */
+static void prepare(void)
+{
+    kernel_select_default();
+    for (int i = 0; PASSGEN_TYPES[i] != '\0'; i++) {
+        unsigned char present[256] = { 0 };
+        const char *characters;
+        int length;
+        passgen_characters(PASSGEN_TYPES[i], &characters, &length);
+        for (int c = 0; c < length; c++)
+            present[(unsigned char) characters[c]] = 1;
+        compile_set(&builtins[i], present);
+    }
+    for (unsigned int bound = 1; bound <= PASSGEN_POLICY_MAX_LENGTH; bound++)
+        thresholds[bound] = (unsigned char) (256 % bound);
+}
+
+/**
+ * @brief Writes exactly `total` random characters of a set.
+ * @param[in] cs: the prepared set.
+ * @param[out] out: the destination, `total` bytes.
+ * @param[in] total: the number of characters.
+ * @param[in,out] rng: the random engine.
+ */
+static void fill(const charset *cs, char *out, size_t total, rng_engine *rng)
+{
+    char tail[RNG_BUFFER_SIZE];
+    size_t have = 0;
+
+    while (have < total) {
+        // Ask for a few more bytes than characters, so that rejected bytes rarely need a second round
+        size_t need = total - have;
+        size_t n = need + need / 8 + 1;
+        const unsigned char *random = rng_take(rng, &n);
+        if (n <= need) {
+            have += charset_map(cs, random, n, out + have); // Cannot run past the end
+        } else {
+            size_t k = charset_map(cs, random, n, tail);
+            if (k > need)
+                k = need;
+            memcpy(out + have, tail, k);
+            have += k;
+        }
+    }
+}
+
+/**
+ * @brief Writes one password of a policy with rules (no terminator).
+ * @param[in] p: the compiled policy.
+ * @param[out] out: the destination, `length` bytes.
+ * @param[in] length: the password length, accepted by passgen_policy_fits().
+ * @param[in,out] rng: the random engine.
+ */
+static void generate_ruled(const passgen_policy *p, char *out, unsigned int length, rng_engine *rng)
+{
+    const unsigned char *table = p->all.table;
+    unsigned int k = 0;
+
+    if (!p->unique) {
+        // Required characters from their class, the others through the kernels
+        for (int c = 0; c < PASSGEN_CLASSES; c++) {
+            const passgen_draw *d = &p->plan[c];
+            for (unsigned int i = 0; i < d->count; i++)
+                out[k++] = table[d->start + rng_uniform_threshold(rng, d->size, d->threshold)];
+        }
+        fill(&p->all, out + k, length - k, rng);
+    } else {
+        // Partial Fisher-Yates inside each class: the drawn characters move to the front of their range
+        unsigned char left[CHARSET_MAX];
+        unsigned int n = 0;
+        memcpy(left, table, p->all.length);
+        for (int c = 0; c < PASSGEN_CLASSES; c++) {
+            const passgen_draw *d = &p->plan[c];
+            unsigned char *range = left + d->start;
+            for (unsigned int i = 0; i < d->count; i++) {
+                unsigned int j = i + rng_uniform_threshold(rng, d->size - i, thresholds[d->size - i]);
+                unsigned char t = range[j];
+                range[j] = range[i];
+                range[i] = t;
+                out[k++] = (char) t;
+            }
+            // What the class draws left is gathered for the free draws
+            memmove(left + n, range + d->count, d->size - d->count);
+            n += d->size - d->count;
+        }
+        for (unsigned int i = 0; k < length; i++) {
+            unsigned int j = i + rng_uniform_threshold(rng, n - i, thresholds[n - i]);
+            unsigned char t = left[j];
+            left[j] = left[i];
+            left[i] = t;
+            out[k++] = (char) t;
+        }
+    }
+
+    // The required characters were written first: shuffle them into random positions
+    for (unsigned int i = length - 1; i > 0 && p->required > 0; i--) {
+        unsigned int j = rng_uniform_threshold(rng, i + 1, thresholds[i + 1]);
+        char t = out[j];
+        out[j] = out[i];
+        out[i] = t;
+    }
+}
+
+/**
+ * @brief Returns the characters of a password type.
+ * @param[in] type: the password type.
+ * @param[out] characters: the characters of the set.
+ * @param[out] length: the number of characters.
+ * @return 0 on success, -1 if the type is unknown.
+ */
+int passgen_characters(char type, const char **characters, int *length)
+{
+    switch (type) {
+        case 'n':
+            *characters = numeric;
+            *length = sizeof(numeric) - 1;
+            return 0;
+        case 'a':
+            *characters = alpha;
+            *length = sizeof(alpha) - 1;
+            return 0;
+        case 'm':
+            *characters = mixed;
+            *length = sizeof(mixed) - 1;
+            return 0;
+        case 's':
+            *characters = secure;
+            *length = sizeof(secure) - 1;
+            return 0;
+        case 'u':
+            *characters = unambiguous;
+            *length = sizeof(unambiguous) - 1;
+            return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Compiles a policy: a character set and the rules every password must follow.
+ * @param[out] p: the compiled policy.
+ * @param[in] spec: the specification.
+ * @return 0 on success, -1 if the specification is not valid or cannot be followed.
+ */
+int passgen_policy_compile(passgen_policy *p, const char *spec)
+{
+    unsigned char present[256] = { 0 };
+    unsigned long minimum[PASSGEN_CLASSES] = { 0 };
+    int unique = 0;
+
+    for (const char *s = spec + strspn(spec, " \t"); *s != '\0'; s += strspn(s, " \t")) {
+        size_t n = strcspn(s, " \t");
+        const char *value = memchr(s, '=', n);
+        size_t name = value ? (size_t) (value - s) : n;
+        size_t length = value ? n - name - 1 : 0;
+        value = value ? value + 1 : s + n;
+
+        if (name == 6 && !memcmp(s, "unique", 6) && value == s + n) {
+            unique = 1;
+        } else if (name == 5 && !memcmp(s, "chars", 5) && length > 0) {
+            for (size_t i = 0; i < length; i++) {
+                unsigned char first = value[i], last = first;
+                if (i + 2 < length && value[i + 1] == '-') {
+                    last = value[i + 2];
+                    i += 2;
+                }
+                if (first < 0x21 || last > 0x7E || first > last)
+                    return -1;
+                for (unsigned int c = first; c <= last; c++)
+                    present[c] = 1;
+            }
+        } else if (name == 4 && !memcmp(s, "base", 4) && length == 1) {
+            const char *characters;
+            int count;
+            if (passgen_characters(value[0], &characters, &count) < 0)
+                return -1;
+            for (int c = 0; c < count; c++)
+                present[(unsigned char) characters[c]] = 1;
+        } else {
+            int c = 0;
+            while (c < PASSGEN_CLASSES && (strlen(class_names[c]) != name || memcmp(s, class_names[c], name)))
+                c++;
+            char *end;
+            if (c == PASSGEN_CLASSES || length == 0 || !isdigit((unsigned char) value[0]))
+                return -1;
+            minimum[c] = strtoul(value, &end, 10);
+            if (end != value + length || minimum[c] > PASSGEN_POLICY_MAX_LENGTH)
+                return -1;
+        }
+        s += n;
+    }
+
+    if (compile_set(p, present) < 0)
+        return -1;
+    for (int c = 0; c < PASSGEN_CLASSES; c++) {
+        passgen_draw *d = &p->plan[c];
+        if (minimum[c] > 0 && (d->size == 0 || (unique && minimum[c] > d->size) || minimum[c] > 255))
+            return -1;
+        d->count = (unsigned char) minimum[c];
+        p->required += d->count;
+    }
+    p->unique = unique;
+    return p->required <= PASSGEN_POLICY_MAX_LENGTH ? 0 : -1;
+}
+
+/**
+ * @brief Checks that passwords of a length can follow a policy.
+ * @param[in] p: the compiled policy.
+ * @param[in] length: the password length.
+ * @return non-zero if the length fits the policy.
+ */
+int passgen_policy_fits(const passgen_policy *p, int length)
+{
+    if (length < 0 || (unsigned int) length < p->required)
+        return 0;
+    if (p->unique)
+        return (unsigned int) length <= p->all.length;
+    return p->required == 0 || length <= PASSGEN_POLICY_MAX_LENGTH;
+}
+
+/**
+ * @brief Returns the compiled policy of a built-in type.
+ * @param[in] type: the password type.
+ * @return the policy, NULL if the type is unknown.
+ */
+const passgen_policy *passgen_builtin(char type)
+{
+    const char *p = type != '\0' ? strchr(PASSGEN_TYPES, type) : NULL;
+    if (p == NULL)
+        return NULL;
+    pthread_once(&prepare_once, prepare);
+    return &builtins[p - PASSGEN_TYPES];
+}
+
+/**
+ * @brief Generates one password that follows a policy.
+ * @param[in] p: the compiled policy.
+ * @param[in] length: the number of characters.
+ * @param[out] password: the password, NUL-terminated.
+ * @param[in,out] rng: the caller's random engine.
+ * @return 0 on success, -1 if the length does not fit the policy.
+ */
+int passgen_policy_password(const passgen_policy *p, int length, char *password, rng_engine *rng)
+{
+    if (!passgen_policy_fits(p, length))
+        return -1;
+    pthread_once(&prepare_once, prepare);
+    if (p->required == 0 && !p->unique)
+        fill(&p->all, password, length, rng);
+    else if (length > 0)
+        generate_ruled(p, password, length, rng);
+    password[length] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Generates many passwords that follow a policy into one buffer.
+ * @param[in] p: the compiled policy.
+ * @param[in] length: the number of characters of every password.
+ * @param[in] count: the number of passwords.
+ * @param[in] stride: the distance between the starts of two passwords.
+ * @param[out] out: the destination.
+ * @param[in,out] rng: the caller's random engine.
+ * @return 0 on success, -1 if the length or the stride is not valid.
+ */
+int passgen_policy_bulk(const passgen_policy *p, int length, size_t count, size_t stride, char *out,
+                        rng_engine *rng)
+{
+    if (length < 1 || !passgen_policy_fits(p, length) || stride < (size_t) length ||
+        (count > 0 && count - 1 > (SIZE_MAX - length) / stride))
+        return -1;
+    pthread_once(&prepare_once, prepare);
+
+    if (p->required == 0 && !p->unique) {
+        if (stride == (size_t) length) {
+            fill(&p->all, out, count * stride, rng);
+            return 0;
+        }
+        for (size_t i = 0; i < count; i++)
+            fill(&p->all, out + i * stride, length, rng);
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++)
+        generate_ruled(p, out + i * stride, length, rng);
+    return 0;
+}
+
+/**
+ * @brief Generates one password.
+ * @param[in] type: the password type.
+ * @param[in] length: the number of characters.
+ * @param[out] password: the password, NUL-terminated.
+ * @param[in,out] rng: the caller's random engine.
+ * @return 0 on success, -1 if the type or the length is not valid.
+ */
+int passgen_password(char type, int length, char *password, rng_engine *rng)
+{
+    const passgen_policy *p = passgen_builtin(type);
+    return p != NULL ? passgen_policy_password(p, length, password, rng) : -1;
+}
+
+/**
+ * @brief Generates many passwords of one type and length into one buffer.
+ * @param[in] type: the password type.
+ * @param[in] length: the number of characters of every password.
+ * @param[in] count: the number of passwords.
+ * @param[in] stride: the distance between the starts of two passwords.
+ * @param[out] out: the destination.
+ * @param[in,out] rng: the caller's random engine.
+ * @return 0 on success, -1 if the type, the length or the stride is not valid.
+ */
+int passgen_bulk(char type, int length, size_t count, size_t stride, char *out, rng_engine *rng)
+{
+    const passgen_policy *p = passgen_builtin(type);
+    return p != NULL ? passgen_policy_bulk(p, length, count, stride, out, rng) : -1;
+}
+
+/**
+ * @brief Generates one passphrase.
+ * @param[in] wl: the opened wordlist.
+ * @param[in] words: the number of words.
+ * @param[in] separator: the character between two words.
+ * @param[out] passphrase: the passphrase, NUL-terminated.
+ * @param[in] size: the size of `passphrase`.
+ * @param[in,out] rng: the caller's random engine.
+ * @return the length of the passphrase, -1 on error.
+ */
+int passgen_passphrase(const passgen_wordlist *wl, int words, char separator, char *passphrase, size_t size,
+                       rng_engine *rng)
+{
+    if (words < 1 || wordlist_max_phrase(wl, words) >= size)
+        return -1;
+
+    size_t n = 0;
+    for (int i = 0; i < words; i++) {
+        uint32_t w = rng_uniform32(rng, wl->count, wl->threshold);
+        uint32_t length = wl->offsets[w + 1] - wl->offsets[w];
+        if (i > 0)
+            passphrase[n++] = separator;
+        memcpy(passphrase + n, wl->blob + wl->offsets[w], length);
+        n += length;
+    }
+    passphrase[n] = '\0';
+    return (int) n;
+}
@@ -0,0 +1,185 @@
+/*
+ ============================================================================
+ Name        : passgen.h (LIBRARY)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the password generation library (libpassgen)
+ ============================================================================
+ */
+#ifndef PASSGEN_H
+#define PASSGEN_H
+
+#include <stddef.h>
+#include "rng.h"
+#include "charsetKernel.h"
+#include "wordlist.h"
+
+#define PASSGEN_TYPES "namsu" // Password types: numeric, alpha, mixed, secure, unambiguous
+
+#define PASSGEN_CLASSES 4 // Character classes of a policy: upper, lower, digit, symbol
+
+#define PASSGEN_POLICY_MAX_LENGTH 256 // Longest password of a policy with rules: one byte per shuffle draw
+
+// Draws of one character class, precompiled by passgen_policy_compile()
+typedef struct {
+    unsigned char start;      // First character of the class in the policy's table
+    unsigned char size;       // Characters of the class
+    unsigned char threshold;  // 256 % size: rejection threshold of the unbiased draws
+    unsigned char count;      // Characters of the class every password must hold
+} passgen_draw;
+
+// A character set and its rules, compiled once and then shared read-only by every thread
+typedef struct {
+    charset all;                          // Every character, grouped by class: the index table
+    passgen_draw plan[PASSGEN_CLASSES];   // Class ranges of `all.table` and the required draws
+    unsigned int required;                // Characters required by the rules, all classes together
+    int unique;                           // Non-zero when no character may appear twice
+} passgen_policy;
+
+/*
+ * Every function is thread-safe and allocates nothing: the caller owns the
+ * output buffers, the compiled policies and one rng_engine per thread
+ * (rng_init() seeds it). The charset kernel is the fastest one the CPU
+ * supports, unless kernel_select() chose another before the first generation.
+ */
+
+/**
+ * @brief Returns the characters of a password type.
+ *
+ * - 'n': numeric characters only.
+ * - 'a': lowercase alphabetic characters only.
+ * - 'm': lowercase alphanumeric characters.
+ * - 's': secure characters (letters, digits and special characters).
+ * - 'u': secure characters without the visually ambiguous ones ('0' and 'O', '1' and 'l', ...).
+ *
+ * @param[in] type: the password type, one of PASSGEN_TYPES.
+ * @param[out] characters: the characters of the set, a static NUL-terminated string.
+ * @param[out] length: the number of characters.
+ * @return 0 on success, -1 if the type is unknown.
+ */
+int passgen_characters(char type, const char **characters, int *length);
+
+/**
+ * @brief Generates one password.
+ *
+ * @param[in] type: the password type, one of PASSGEN_TYPES.
+ * @param[in] length: the number of characters, 0 or more.
+ * @param[out] password: the password, NUL-terminated (length + 1 bytes).
+ * @param[in,out] rng: the caller's random engine.
+ * @return 0 on success, -1 if the type or the length is not valid (`password` is left untouched).
+ */
+int passgen_password(char type, int length, char *password, rng_engine *rng);
+
+/**
+ * @brief Generates many passwords of one type and length into one buffer.
+ *
+ * Password i takes the `length` bytes at out + i * stride. With `stride`
+ * equal to `length` the passwords are packed with no separator and are
+ * produced as one character stream, which saves the per-password overhead;
+ * a larger stride leaves the bytes between passwords to the caller (a '\0'
+ * or '\n' with stride length + 1, for example). No terminator is written.
+ *
+ * @param[in] type: the password type, one of PASSGEN_TYPES.
+ * @param[in] length: the number of characters of every password, 1 or more.
+ * @param[in] count: the number of passwords.
+ * @param[in] stride: the distance between the starts of two passwords, at least `length`.
+ * @param[out] out: the destination, with room for (count - 1) * stride + length bytes.
+ * @param[in,out] rng: the caller's random engine.
+ * @return 0 on success, -1 if the type, the length or the stride is not valid.
+ */
+int passgen_bulk(char type, int length, size_t count, size_t stride, char *out, rng_engine *rng);
+
+/**
+ * @brief Compiles a policy: a character set and the rules every password must follow.
+ *
+ * The specification is a list of space-separated settings:
+ * - `chars=SET`: characters of the set; `a-z` is a range, '-' is literal first or last.
+ * - `base=T`: the characters of the built-in type T (one of PASSGEN_TYPES).
+ * - `upper=N`, `lower=N`, `digit=N`, `symbol=N`: at least N characters of the class.
+ * - `unique`: no character appears twice.
+ * `chars` and `base` may be repeated, and add up; characters must be printable
+ * ASCII other than space. For example "base=s upper=1 digit=1 symbol=1" or
+ * "chars=a-f0-9 unique".
+ *
+ * Compiling groups the characters by class into the table of the charset
+ * kernels and records, per class, its range and the rejection threshold of
+ * unbiased draws in it. Generation then never retries a whole password: the
+ * required characters are drawn from their class, the others from the whole
+ * set (through the kernels when repetitions are allowed, by a partial
+ * Fisher-Yates shuffle of what is left otherwise), and the password is
+ * shuffled.
+ *
+ * @param[out] p: the compiled policy.
+ * @param[in] spec: the specification, NUL-terminated.
+ * @return 0 on success, -1 on a syntax error, an empty set, or rules that no
+ *         password can follow (a required class with no character, or more
+ *         unique characters required from a class than it has).
+ */
+int passgen_policy_compile(passgen_policy *p, const char *spec);
+
+/**
+ * @brief Checks that passwords of a length can follow a policy.
+ *
+ * @param[in] p: the compiled policy.
+ * @param[in] length: the password length.
+ * @return non-zero if the length leaves room for the required characters, does
+ *         not exceed the set with `unique`, and is within
+ *         PASSGEN_POLICY_MAX_LENGTH for policies with rules.
+ */
+int passgen_policy_fits(const passgen_policy *p, int length);
+
+/**
+ * @brief Returns the compiled policy of a built-in type: its characters and no rule.
+ *
+ * @param[in] type: the password type.
+ * @return the policy, NULL if the type is not one of PASSGEN_TYPES.
+ */
+const passgen_policy *passgen_builtin(char type);
+
+/**
+ * @brief Generates one password that follows a policy.
+ *
+ * @param[in] p: the compiled policy.
+ * @param[in] length: the number of characters, accepted by passgen_policy_fits().
+ * @param[out] password: the password, NUL-terminated (length + 1 bytes).
+ * @param[in,out] rng: the caller's random engine.
+ * @return 0 on success, -1 if the length does not fit the policy.
+ */
+int passgen_policy_password(const passgen_policy *p, int length, char *password, rng_engine *rng);
+
+/**
+ * @brief Generates many passwords that follow a policy into one buffer.
+ *
+ * Same layout as passgen_bulk(); packed passwords of a policy without rules
+ * are one character stream.
+ *
+ * @param[in] p: the compiled policy.
+ * @param[in] length: the number of characters of every password, 1 or more.
+ * @param[in] count: the number of passwords.
+ * @param[in] stride: the distance between the starts of two passwords, at least `length`.
+ * @param[out] out: the destination, with room for (count - 1) * stride + length bytes.
+ * @param[in,out] rng: the caller's random engine.
+ * @return 0 on success, -1 if the length does not fit the policy or the stride is not valid.
+ */
+int passgen_policy_bulk(const passgen_policy *p, int length, size_t count, size_t stride, char *out,
+                        rng_engine *rng);
+
+/**
+ * @brief Generates one passphrase: words drawn uniformly from a list, joined by a separator.
+ *
+ * Every word is drawn independently (words may repeat), so a passphrase of
+ * `words` words from a list of N carries words * log2(N) bits of entropy.
+ *
+ * @param[in] wl: the opened wordlist.
+ * @param[in] words: the number of words, 1 or more.
+ * @param[in] separator: the character between two words.
+ * @param[out] passphrase: the passphrase, NUL-terminated.
+ * @param[in] size: the size of `passphrase`, at least wordlist_max_phrase() + 1.
+ * @param[in,out] rng: the caller's random engine.
+ * @return the length of the passphrase, -1 if `words` is not valid or the longest passphrase does not fit.
+ */
+int passgen_passphrase(const passgen_wordlist *wl, int words, char separator, char *passphrase, size_t size,
+                       rng_engine *rng);
+
+#endif /* PASSGEN_H */
@@ -0,0 +1,244 @@
+/*
+ ============================================================================
+ Name        : rng.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the pluggable random number engines
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "rng.h"
+
+#if defined __linux__
+#include <sys/random.h>
+#endif
+
+/**
+ * @brief Reads seed material from the operating system generator.
+ * @param[out] out: the destination buffer.
+ * @param[in] n: the number of bytes to read.
+ * @return 0 on success, -1 on failure.
+ */
+static int os_random(void *out, size_t n)
+{
+#if defined __linux__
+    unsigned char *p = out;
+    while (n > 0) {
+        ssize_t r = getrandom(p, n, 0);
+        if (r < 0 && errno == EINTR)
+            continue; // A signal (SIGUSR2 of the hot upgrade has no SA_RESTART) is not a failure
+        if (r < 0)
+            return -1;
+        p += r;
+        n -= r;
+    }
+    return 0;
+#else
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (f == NULL)
+        return -1;
+    size_t r = fread(out, 1, n, f);
+    fclose(f);
+    return r == n ? 0 : -1;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - CHACHA20 - - - - - - - - - - - - - - - - - - */
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8);  \
+    c += d; b ^= c; b = ROTL32(b, 7)
+
+/**
+ * @brief Computes one 64-byte ChaCha20 block (RFC 8439, 20 rounds).
+ * @param[in] key: the 256-bit key.
+ * @param[in] counter: the 64-bit block counter (the nonce is zero).
+ * @param[out] out: the 64 bytes of keystream, little endian.
+ */
+static void chacha20_block(const uint32_t key[8], uint64_t counter, unsigned char out[64])
+{
+    uint32_t in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, // "expand 32-byte k"
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        (uint32_t) counter, (uint32_t) (counter >> 32), 0, 0
+    };
+    uint32_t x[16];
+    memcpy(x, in, sizeof(x));
+
+    for (int i = 0; i < 10; i++) {
+        QUARTER_ROUND(x[0], x[4], x[8],  x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9],  x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8],  x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9],  x[14]);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t v = x[i] + in[i];
+        out[4 * i]     = (unsigned char) v;
+        out[4 * i + 1] = (unsigned char) (v >> 8);
+        out[4 * i + 2] = (unsigned char) (v >> 16);
+        out[4 * i + 3] = (unsigned char) (v >> 24);
+    }
+}
+
+/**
+ * @brief Refills the buffer with ChaCha20 keystream.
+ *
+ * The first 32 bytes of every refill become the next key and are never handed
+ * out (fast key erasure): a leaked engine state does not reveal past output.
+ *
+ * @param[in,out] rng: the engine.
+ */
+static void refill_chacha20(rng_engine *rng)
+{
+    unsigned char first[64];
+    chacha20_block(rng->key, rng->counter++, first);
+    for (int i = 0; i < 8; i++)
+        rng->key[i] = (uint32_t) first[4 * i] | (uint32_t) first[4 * i + 1] << 8 |
+                      (uint32_t) first[4 * i + 2] << 16 | (uint32_t) first[4 * i + 3] << 24;
+
+    // The remaining 32 bytes of the first block start the buffer
+    memcpy(rng->buffer, first + 32, 32);
+    size_t filled = 32;
+    while (filled + 64 <= RNG_BUFFER_SIZE) {
+        chacha20_block(rng->key, rng->counter++, rng->buffer + filled);
+        filled += 64;
+    }
+    chacha20_block(rng->key, rng->counter++, first);
+    memcpy(rng->buffer + filled, first, RNG_BUFFER_SIZE - filled);
+    memset(first, 0, sizeof(first));
+    rng->pos = 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - END CHACHA20 - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Refills the buffer straight from the operating system generator.
+ * @param[in,out] rng: the engine.
+ */
+static void refill_getrandom(rng_engine *rng)
+{
+    if (os_random(rng->buffer, RNG_BUFFER_SIZE) < 0) {
+        perror("Error, operating system random generator failed.");
+        abort(); // Never hand out predictable bytes
+    }
+    rng->pos = 0;
+}
+
+/**
+ * @brief Refills the buffer from the legacy rand_r() stream.
+ * @param[in,out] rng: the engine.
+ */
+static void refill_libc(rng_engine *rng)
+{
+    for (size_t i = 0; i < RNG_BUFFER_SIZE; i++)
+        rng->buffer[i] = (unsigned char) (rand_r(&rng->seed) >> 16);
+    rng->pos = 0;
+}
+
+/**
+ * @brief Initializes a random engine and seeds it from the operating system.
+ * @param[out] rng: the engine to initialize.
+ * @param[in] kind: the engine to use.
+ * @return 0 on success, -1 if the operating system generator is not available.
+ */
+int rng_init(rng_engine *rng, rng_kind kind)
+{
+    memset(rng, 0, sizeof(*rng));
+    rng->kind = kind;
+
+    switch (kind) {
+        case RNG_CHACHA20:
+            if (os_random(rng->key, sizeof(rng->key)) < 0)
+                return -1;
+            rng->refill = refill_chacha20;
+            break;
+        case RNG_GETRANDOM:
+            if (os_random(rng->buffer, 1) < 0)
+                return -1;
+            rng->refill = refill_getrandom;
+            break;
+        case RNG_LIBC:
+            if (os_random(&rng->seed, sizeof(rng->seed)) < 0)
+                rng->seed = (unsigned int) time(NULL);
+            rng->refill = refill_libc;
+            break;
+        default:
+            return -1;
+    }
+
+    rng->pos = RNG_BUFFER_SIZE; // Empty: the first draw refills
+    return 0;
+}
+
+/**
+ * @brief Fills a buffer with random bytes.
+ * @param[in,out] rng: the engine.
+ * @param[out] out: the destination buffer.
+ * @param[in] n: the number of bytes to write.
+ */
+void rng_bytes(rng_engine *rng, void *out, size_t n)
+{
+    unsigned char *p = out;
+    while (n > 0) {
+        if (rng->pos == RNG_BUFFER_SIZE)
+            rng->refill(rng);
+        size_t chunk = RNG_BUFFER_SIZE - rng->pos;
+        if (chunk > n)
+            chunk = n;
+        memcpy(p, rng->buffer + rng->pos, chunk);
+        rng->pos += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+/**
+ * @brief Parses an engine name ("chacha20", "getrandom" or "libc").
+ * @param[in] name: the engine name.
+ * @param[out] kind: the matching engine.
+ * @return 0 if the name is known, -1 otherwise.
+ */
+int rng_parse(const char *name, rng_kind *kind)
+{
+    static const rng_kind kinds[] = { RNG_CHACHA20, RNG_GETRANDOM, RNG_LIBC };
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (strcmp(name, rng_name(kinds[i])) == 0) {
+            *kind = kinds[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Returns the name of an engine.
+ * @param[in] kind: the engine.
+ * @return a static string with the engine name.
+ */
+const char *rng_name(rng_kind kind)
+{
+    switch (kind) {
+        case RNG_CHACHA20:
+            return "chacha20";
+        case RNG_GETRANDOM:
+            return "getrandom";
+        case RNG_LIBC:
+            return "libc";
+    }
+    return "unknown";
+}
@@ -0,0 +1,157 @@
+/*
+ ============================================================================
+ Name        : rng.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the pluggable random number engines
+ ============================================================================
+ */
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RNG_BUFFER_SIZE 512 // Bytes of random data buffered per engine (8 ChaCha20 blocks)
+
+// Available random engines
+typedef enum {
+    RNG_CHACHA20,   // ChaCha20 keystream with fast key erasure, seeded from the OS (default)
+    RNG_GETRANDOM,  // Buffered bytes read straight from the OS generator
+    RNG_LIBC        // Legacy rand_r() stream: fast to seed but NOT suitable for real passwords
+} rng_kind;
+
+// Per-thread random engine: never share one between threads
+typedef struct rng_engine {
+    rng_kind kind;
+    void (*refill)(struct rng_engine *rng);  // Refills `buffer` and resets `pos`
+    uint32_t key[8];                         // ChaCha20 key, replaced at every refill
+    uint64_t counter;                        // ChaCha20 block counter
+    unsigned int seed;                       // rand_r() state of the RNG_LIBC engine
+    size_t pos;                              // Next unused byte of `buffer`
+    unsigned char buffer[RNG_BUFFER_SIZE];   // Random bytes not handed out yet
+} rng_engine;
+
+/**
+ * @brief Initializes a random engine and seeds it from the operating system.
+ *
+ * @param[out] rng: the engine to initialize.
+ * @param[in] kind: the engine to use.
+ * @return 0 on success, -1 if the operating system generator is not available.
+ */
+int rng_init(rng_engine *rng, rng_kind kind);
+
+/**
+ * @brief Fills a buffer with random bytes.
+ *
+ * @param[in,out] rng: the engine.
+ * @param[out] out: the destination buffer.
+ * @param[in] n: the number of bytes to write.
+ */
+void rng_bytes(rng_engine *rng, void *out, size_t n);
+
+/**
+ * @brief Hands out up to `*n` contiguous random bytes straight from the buffer.
+ *
+ * No copy is made: the bytes stay valid until the next call on the engine.
+ *
+ * @param[in,out] rng: the engine.
+ * @param[in,out] n: the number of bytes wanted; on return the number handed out
+ *                (less than asked when the buffer end is reached, never 0).
+ * @return a pointer to the random bytes.
+ */
+static inline const unsigned char *rng_take(rng_engine *rng, size_t *n)
+{
+    if (rng->pos == RNG_BUFFER_SIZE)
+        rng->refill(rng);
+    size_t available = RNG_BUFFER_SIZE - rng->pos;
+    if (*n > available)
+        *n = available;
+    const unsigned char *p = rng->buffer + rng->pos;
+    rng->pos += *n;
+    return p;
+}
+
+/**
+ * @brief Returns an unbiased random number in [0, bound), with a precomputed threshold.
+ *
+ * Consumes one byte per attempt and rejects the bytes that would bias the result
+ * (multiply-shift with rejection), so every value has exactly the same probability.
+ * Callers that draw many times with the same bound keep `threshold` instead of
+ * paying for the division of rng_uniform().
+ *
+ * @param[in,out] rng: the engine.
+ * @param[in] bound: the exclusive upper bound, between 1 and 256.
+ * @param[in] threshold: 256 % bound.
+ * @return a value in [0, bound).
+ */
+static inline unsigned int rng_uniform_threshold(rng_engine *rng, unsigned int bound, unsigned int threshold)
+{
+    for (;;) {
+        if (rng->pos == RNG_BUFFER_SIZE)
+            rng->refill(rng);
+        unsigned int product = rng->buffer[rng->pos++] * bound;
+        if ((product & 0xFF) >= threshold) // Low products below it would be over-represented
+            return product >> 8;
+    }
+}
+
+/**
+ * @brief Returns an unbiased random number in [0, bound).
+ *
+ * @param[in,out] rng: the engine.
+ * @param[in] bound: the exclusive upper bound, between 1 and 256.
+ * @return a value in [0, bound).
+ */
+static inline unsigned int rng_uniform(rng_engine *rng, unsigned int bound)
+{
+    return rng_uniform_threshold(rng, bound, 256 % bound);
+}
+
+/**
+ * @brief Returns an unbiased random number in [0, bound) for bounds above 256.
+ *
+ * Same multiply-shift with rejection as rng_uniform_threshold(), on four
+ * bytes per attempt.
+ *
+ * @param[in,out] rng: the engine.
+ * @param[in] bound: the exclusive upper bound, 1 or more.
+ * @param[in] threshold: 2^32 % bound, that is -bound % bound.
+ * @return a value in [0, bound).
+ */
+static inline uint32_t rng_uniform32(rng_engine *rng, uint32_t bound, uint32_t threshold)
+{
+    for (;;) {
+        uint32_t x;
+        size_t n = sizeof(x);
+        const unsigned char *p = rng_take(rng, &n);
+        if (n == sizeof(x))
+            memcpy(&x, p, sizeof(x));
+        else
+            rng_bytes(rng, &x, sizeof(x)); // The buffer end splits the four bytes: the few left are skipped
+        uint64_t product = (uint64_t) x * bound;
+        if ((uint32_t) product >= threshold)
+            return (uint32_t) (product >> 32);
+    }
+}
+
+/**
+ * @brief Parses an engine name ("chacha20", "getrandom" or "libc").
+ *
+ * @param[in] name: the engine name.
+ * @param[out] kind: the matching engine.
+ * @return 0 if the name is known, -1 otherwise.
+ */
+int rng_parse(const char *name, rng_kind *kind);
+
+/**
+ * @brief Returns the name of an engine.
+ *
+ * @param[in] kind: the engine.
+ * @return a static string with the engine name.
+ */
+const char *rng_name(rng_kind kind);
+
+#endif /* RNG_H */
@@ -8,22 +8,46 @@
  ============================================================================
 */
 
+#ifndef SERVER_H
+#define SERVER_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
 #if defined WIN32
-#include <winsock.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #else
 #define closesocket close
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
+#include <netdb.h>
 #endif
 
 #include "serverData.h" // Header file for server-side data
+#include "passgen.h"    // Header file for the password generation library
 #include "support.h"   // Header file for server-side support functions
+#include "serverIO.h"  // Header file for the server I/O loops
+#include "serverWorker.h" // Header file for the multi-core worker pool
+#include "serverBench.h" // Header file for the server microbenchmarks
+#include "serverLog.h"   // Header file for the asynchronous logger
+#include "serverRequest.h" // Header file for request decoding and reply building
+#include "serverValidate.h" // Header file for the request validation stage
+#include "serverPool.h"   // Header file for the pre-generated password pool
+#include "serverUring.h"  // Header file for the io_uring receive/send loop
+#include "serverMetrics.h" // Header file for the per-worker counters and the metrics endpoint
+#include "serverLimit.h"   // Header file for the per-source and global rate limiter
+#include "serverConfig.h"  // Header file for the command line and configuration file settings
+#include "serverPolicy.h"  // Header file for the built-in and configured password types
+#include "serverCache.h"   // Header file for the per-worker reply cache
+#include "serverUpgrade.h" // Header file for the hot upgrade socket handoff
+#include "serverLocal.h"   // Header file for the Unix datagram and shared-memory transports
 
 #define BUFFER_SIZE 6 // Buffer size for sent/received data
 
@@ -31,3 +55,12 @@
 
 #define PORT 57015 // Default port number
 
+#define PASSWORD_TYPES PASSGEN_TYPES // Password types known by passgen_password()
+
+#define BATCH_MAX 1024 // Upper bound for the number of datagrams handled by one recvmmsg/sendmmsg call
+
+#define BATCH_REPORT_INTERVAL 4096 // Number of batches between two batch fill reports
+
+void errorhandler(char *errorMessage);
+
+#endif /* SERVER_H */
@@ -0,0 +1,263 @@
+/*
+ ============================================================================
+ Name        : serverBench.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the server microbenchmarks
+ ============================================================================
+ */
+
+#include "server.h"
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ * @return the current time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Generates the benchmark passwords with the pre-engine `rand() % set_length` loop.
+ * @param[out] checksum: a value derived from the output, so that it is not optimized away.
+ * @return the elapsed time in nanoseconds.
+ */
+static double bench_legacy(unsigned long *checksum)
+{
+    const char *character;
+    int set_length;
+    char password[PASS_SIZE];
+
+    passgen_characters('s', &character, &set_length);
+    srand(time(NULL));
+
+    double start = now_ns();
+    for (int n = 0; n < BENCH_PASSWORDS; n++) {
+        for (int i = 0; i < BENCH_LENGTH; i++)
+            password[i] = character[rand() % set_length];
+        password[BENCH_LENGTH] = '\0';
+        *checksum += (unsigned char) password[n % BENCH_LENGTH];
+    }
+    return now_ns() - start;
+}
+
+/**
+ * @brief Generates the benchmark passwords through passgen_password() with an engine.
+ * @param[in,out] rng: the engine to use.
+ * @param[out] checksum: a value derived from the output, so that it is not optimized away.
+ * @return the elapsed time in nanoseconds.
+ */
+static double bench_engine(rng_engine *rng, unsigned long *checksum)
+{
+    char password[PASS_SIZE];
+
+    double start = now_ns();
+    for (int n = 0; n < BENCH_PASSWORDS; n++) {
+        passgen_password('s', BENCH_LENGTH, password, rng);
+        *checksum += (unsigned char) password[n % BENCH_LENGTH];
+    }
+    return now_ns() - start;
+}
+
+/**
+ * @brief Generates the benchmark passwords BENCH_BULK at a time through passgen_bulk().
+ * @param[in,out] rng: the engine to use.
+ * @param[out] checksum: a value derived from the output, so that it is not optimized away.
+ * @return the elapsed time in nanoseconds.
+ */
+static double bench_bulk(rng_engine *rng, unsigned long *checksum)
+{
+    static char passwords[BENCH_BULK * BENCH_LENGTH];
+
+    double start = now_ns();
+    for (int n = 0; n < BENCH_PASSWORDS; n += BENCH_BULK) {
+        passgen_bulk('s', BENCH_LENGTH, BENCH_BULK, BENCH_LENGTH, passwords, rng);
+        *checksum += (unsigned char) passwords[n % sizeof(passwords)];
+    }
+    return now_ns() - start;
+}
+
+/**
+ * @brief Measures the per-character cost of password generation for every random engine.
+ * @return 0 on success, -1 if an engine could not be initialized.
+ */
+int run_rng_bench(void)
+{
+    static const rng_kind kinds[] = { RNG_CHACHA20, RNG_GETRANDOM, RNG_LIBC };
+    const double chars = (double) BENCH_PASSWORDS * BENCH_LENGTH;
+    unsigned long checksum = 0;
+
+    kernel_select(kernel_best());
+
+    double legacy = bench_legacy(&checksum);
+    printf("%-22s %10s %12s %8s\n", "engine", "ns/char", "Mchar/s", "speedup");
+    printf("%-22s %10.2f %12.1f %8.2f\n", "rand() % n (legacy)",
+           legacy / chars, chars * 1e3 / legacy, 1.0);
+
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        rng_engine rng;
+        if (rng_init(&rng, kinds[k]) < 0) {
+            errorhandler("Error, random engine initialization failed.\n");
+            return -1;
+        }
+        double elapsed = bench_engine(&rng, &checksum);
+        printf("%-22s %10.2f %12.1f %8.2f\n", rng_name(kinds[k]),
+               elapsed / chars, chars * 1e3 / elapsed, legacy / elapsed);
+        if (kinds[k] == RNG_CHACHA20) {
+            elapsed = bench_bulk(&rng, &checksum);
+            printf("%-22s %10.2f %12.1f %8.2f\n", "chacha20 (bulk)",
+                   elapsed / chars, chars * 1e3 / elapsed, legacy / elapsed);
+        }
+    }
+
+    printf("(checksum %lu)\n", checksum);
+    return 0;
+}
+
+/**
+ * @brief Measures every supported charset kernel on the five password types.
+ * @return 0 on success, -1 if the random engine could not be initialized.
+ */
+int run_kernel_bench(void)
+{
+    static const kernel_kind kinds[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+    static const char types[] = PASSGEN_TYPES;
+    static unsigned char random[BENCH_KERNEL_BYTES];
+    static char mapped[BENCH_KERNEL_BYTES];
+    char password[PASS_SIZE];
+    unsigned long checksum = 0;
+    rng_engine rng;
+
+    if (rng_init(&rng, RNG_CHACHA20) < 0) {
+        errorhandler("Error, random engine initialization failed.\n");
+        return -1;
+    }
+    rng_bytes(&rng, random, sizeof(random));
+
+    printf("\n%-8s %-5s %16s %16s\n", "kernel", "type", "map ns/32 chars", "ns/password");
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        if (kernel_select(kinds[k]) < 0)
+            continue; // Not supported by this CPU
+
+        for (int t = 0; types[t] != '\0'; t++) {
+            charset cs;
+            const char *character;
+            int set_length;
+            passgen_characters(types[t], &character, &set_length);
+            charset_prepare(&cs, character, set_length);
+
+            // Kernel alone, on bytes that are already random
+            size_t produced = 0;
+            double start = now_ns();
+            for (int r = 0; r < BENCH_KERNEL_ROUNDS; r++)
+                produced += charset_map(&cs, random, sizeof(random), mapped);
+            double map_ns = (now_ns() - start) / produced * BENCH_LENGTH;
+            checksum += (unsigned char) mapped[produced % 64];
+
+            // Whole passgen_password() call, random engine included
+            start = now_ns();
+            for (int n = 0; n < BENCH_PASSWORDS; n++) {
+                passgen_password(types[t], BENCH_LENGTH, password, &rng);
+                checksum += (unsigned char) password[n % BENCH_LENGTH];
+            }
+            double pass_ns = (now_ns() - start) / BENCH_PASSWORDS;
+
+            printf("%-8s %-5c %16.2f %16.2f\n", kernel_name(kinds[k]), types[t], map_ns, pass_ns);
+        }
+    }
+
+    kernel_select(kernel_best());
+    printf("(checksum %lu)\n", checksum);
+    return 0;
+}
+
+/**
+ * @brief Seals BENCH_SEAL_ROUNDS batches of identical replies.
+ * @param[in,out] s: the session key.
+ * @param[in] length: the size of every reply before sealing.
+ * @param[in] batched: non-zero to seal each batch with one seal_batch() call, zero for one seal_reply() per reply.
+ * @param[out] checksum: a value derived from the output, so that it is not optimized away.
+ * @return the nanoseconds per reply.
+ */
+static double bench_seal(reply_sealer *s, size_t length, int batched, unsigned long *checksum)
+{
+    static unsigned char replies[BENCH_SEAL_BATCH][PROTO_MAX_DATAGRAM];
+    seal_item items[BENCH_SEAL_BATCH];
+    proto_reply_header h;
+
+    memset(&h, 0, sizeof(h));
+    h.magic = PROTO_MAGIC;
+    h.version = PROTO_VERSION;
+    h.fragments = 1;
+    h.flags = PROTO_REPLY_SEALED;
+
+    double start = now_ns();
+    for (int r = 0; r < BENCH_SEAL_ROUNDS; r++) {
+        for (int i = 0; i < BENCH_SEAL_BATCH; i++) {
+            memcpy(replies[i], &h, sizeof(h)); // The entries keep the ciphertext of the previous round
+            items[i].data = replies[i];
+            items[i].length = length;
+        }
+        if (batched)
+            seal_batch(s, items, BENCH_SEAL_BATCH);
+        else
+            for (int i = 0; i < BENCH_SEAL_BATCH; i++)
+                items[i].length = seal_reply(s, items[i].data, items[i].length);
+        *checksum += replies[r % BENCH_SEAL_BATCH][items[0].length - 1];
+    }
+    return (now_ns() - start) / ((double) BENCH_SEAL_ROUNDS * BENCH_SEAL_BATCH);
+}
+
+/**
+ * @brief Checks, then measures, the sealing of the replies with every keystream kernel supported by the CPU.
+ * @return 0 on success, -1 if the self-test fails or the session key could not be set up.
+ */
+int run_seal_bench(void)
+{
+    static const seal_kernel kinds[] = { SEAL_SCALAR, SEAL_AVX2 };
+    const size_t sizes[] = { sizeof(proto_reply_header) + 1 + BENCH_LENGTH, proto_reply_room(1) };
+    unsigned char key[AEAD_KEY_SIZE];
+    unsigned long checksum = 0;
+    reply_sealer s;
+    rng_engine rng;
+
+    // A kernel that seals wrong is not worth timing: -B then fails
+    if (seal_selftest() < 0)
+        return -1;
+    printf("\nSeal self-test passed: XChaCha20-Poly1305 test vector, kernels identical to the scalar one\n");
+
+    if (rng_init(&rng, RNG_CHACHA20) < 0) {
+        errorhandler("Error, random engine initialization failed.\n");
+        return -1;
+    }
+    rng_bytes(&rng, key, sizeof(key));
+    seal_use_key(key);
+    if (sealer_init(&s) < 0) {
+        errorhandler("Error, session key initialization failed.\n");
+        seal_stop();
+        return -1;
+    }
+
+    printf("\n%-8s %12s %16s %16s\n", "seal", "reply bytes", "batched ns/reply", "single ns/reply");
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        if (seal_select(kinds[k]) < 0)
+            continue; // Not supported by this CPU
+        for (size_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++) {
+            double batched = bench_seal(&s, sizes[z], 1, &checksum);
+            double single = bench_seal(&s, sizes[z], 0, &checksum);
+            printf("%-8s %12zu %16.2f %16.2f\n", seal_kernel_name(kinds[k]), sizes[z] + PROTO_SEAL_OVERHEAD,
+                   batched, single);
+        }
+    }
+
+    seal_select(seal_best());
+    seal_stop();
+    secure_wipe(key, sizeof(key));
+    secure_wipe(&s, sizeof(s));
+    printf("(checksum %lu)\n", checksum);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ ============================================================================
+ Name        : serverBench.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the server microbenchmarks
+ ============================================================================
+ */
+#ifndef SERVER_BENCH_H
+#define SERVER_BENCH_H
+
+#define BENCH_PASSWORDS 1000000 // Passwords generated by every benchmark run
+
+#define BENCH_LENGTH 32 // Length of the benchmarked passwords
+
+#define BENCH_BULK 1000 // Passwords per passgen_bulk() call in the bulk run (divides BENCH_PASSWORDS)
+
+#define BENCH_KERNEL_BYTES 65536 // Random bytes mapped by every kernel round
+
+#define BENCH_KERNEL_ROUNDS 2000 // Kernel rounds per kernel and type
+
+#define BENCH_SEAL_BATCH 64 // Replies sealed by every seal_batch() call, as in a full send batch
+
+#define BENCH_SEAL_ROUNDS 20000 // Batches sealed per keystream kernel and reply size
+
+/**
+ * @brief Measures the per-character cost of password generation for every random engine.
+ *
+ * Generates BENCH_PASSWORDS secure passwords of BENCH_LENGTH characters with the
+ * legacy `rand() % set_length` path and with every engine of rng.h, then prints
+ * the nanoseconds per character and the speedup over the legacy path. The
+ * ChaCha20 engine is also measured through passgen_bulk(), BENCH_BULK
+ * passwords per call.
+ *
+ * @return 0 on success, -1 if an engine could not be initialized.
+ */
+int run_rng_bench(void);
+
+/**
+ * @brief Measures every charset kernel supported by the CPU on the five password types.
+ *
+ * For each kernel and type prints the cost of mapping 32 characters out of
+ * random bytes already in memory, and the cost of a whole passgen_password()
+ * call with the ChaCha20 engine.
+ *
+ * @return 0 on success, -1 if the random engine could not be initialized.
+ */
+int run_kernel_bench(void);
+
+/**
+ * @brief Checks, then measures, the sealing of the replies with every keystream kernel supported by the CPU.
+ *
+ * Runs seal_selftest() first: a kernel that fails it makes -B fail. Then,
+ * for a reply of one BENCH_LENGTH password and for a full sealed fragment,
+ * prints the nanoseconds per reply when BENCH_SEAL_BATCH replies are sealed
+ * together (the mmsg and io_uring send paths) and one at a time (the
+ * blocking and ring paths), under a random key. The numbers compare with
+ * the ns/password of run_kernel_bench().
+ *
+ * @return 0 on success, -1 if the self-test fails or the session key could not be set up.
+ */
+int run_seal_bench(void);
+
+#endif /* SERVER_BENCH_H */
@@ -0,0 +1,303 @@
+/*
+ ============================================================================
+ Name        : serverCache.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the per-worker reply cache of retransmitted requests
+ ============================================================================
+ */
+
+#include "server.h"
+
+#if defined CLOCK_MONOTONIC_COARSE
+#define CACHE_CLOCK CLOCK_MONOTONIC_COARSE // Lifetimes of seconds do not need a precise clock
+#else
+#define CACHE_CLOCK CLOCK_MONOTONIC
+#endif
+
+// Largest reply in the arena: every fragment is stored as length(2) and its bytes
+#define CACHE_MAX_REPLY (PROTO_MAX_FRAGMENTS * (2 + PROTO_MAX_DATAGRAM))
+
+_Static_assert(CACHE_MAX_REPLY <= CACHE_MIN_SIZE, "the smallest cache must hold the largest reply");
+
+// What identifies a request: its source and its ID
+typedef struct {
+    uint8_t address[16];    // IPv6 address, IPv4 addresses in their v4-mapped form, hash of a Unix name
+    uint16_t port;          // Network byte order
+    uint16_t family;        // AF_INET, AF_INET6 or AF_UNIX
+    uint32_t request_id;    // Network byte order
+} cache_key;
+
+// One slot of the table
+typedef struct {
+    cache_key key;
+    uint64_t fingerprint;   // Hash of the request bytes: an ID reused for another request does not match
+    uint64_t position;      // Arena position of the reply, see reply_cache.written
+    uint32_t size;          // Bytes of the reply in the arena
+    uint32_t expires;       // now_ms() at which the reply stops matching, 0 = slot never used
+} cache_entry;
+
+struct reply_cache {
+    cache_entry *slots;
+    unsigned int mask;       // Slots - 1 (power of two)
+    unsigned char *arena;    // Replies back to back, wrapping around
+    size_t arena_size;
+    uint64_t written;        // Bytes written to the arena since the start: the position of the next byte
+    uint64_t seed;           // Random: sources cannot aim at one probe window
+    unsigned int ttl_ms;
+    struct timespec epoch;
+    int recording;           // Non-zero between cache_begin() and cache_commit()
+    cache_entry pending;     // The reply being recorded
+};
+
+/**
+ * @brief Returns the milliseconds elapsed since the cache was created, plus one.
+ * @param[in] c: the cache.
+ * @return the time, never 0 (wraps after 49 days, see entry_live()).
+ */
+static uint32_t now_ms(const reply_cache *c)
+{
+    struct timespec ts;
+    clock_gettime(CACHE_CLOCK, &ts);
+    return (uint32_t) ((ts.tv_sec - c->epoch.tv_sec) * 1000 + (ts.tv_nsec - c->epoch.tv_nsec) / 1000000) + 1;
+}
+
+/**
+ * @brief Hashes bytes with a seed (murmur3 finalizer over 8-byte words).
+ * @param[in] seed: the seed.
+ * @param[in] data: the bytes.
+ * @param[in] length: the number of bytes.
+ * @return the hash.
+ */
+static uint64_t hash_bytes(uint64_t seed, const void *data, size_t length)
+{
+    const unsigned char *p = data;
+    uint64_t h = seed ^ (length * 0x9e3779b97f4a7c15ull), v;
+    for (; length >= sizeof(v); p += sizeof(v), length -= sizeof(v)) {
+        memcpy(&v, p, sizeof(v));
+        h = (h ^ v) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    v = 0;
+    memcpy(&v, p, length);
+    h ^= v;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * @brief Builds the key of a request.
+ * @param[out] key: the key.
+ * @param[in] src: the client address.
+ * @param[in] request_id: the request ID, network byte order.
+ */
+static void make_key(cache_key *key, const struct sockaddr_storage *src, uint32_t request_id)
+{
+    memset(key, 0, sizeof(*key));
+    if (src->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) src;
+        memcpy(key->address, a6->sin6_addr.s6_addr, sizeof(key->address));
+        key->port = a6->sin6_port;
+#if !defined WIN32
+    } else if (src->ss_family == AF_UNIX) {
+        // The name is cleared past its end (local_source()): two independent hashes of the whole path
+        const struct sockaddr_un *un = (const struct sockaddr_un *) src;
+        uint64_t name[2] = { hash_bytes(0, un->sun_path, sizeof(un->sun_path)),
+                             hash_bytes(~0ull, un->sun_path, sizeof(un->sun_path)) };
+        memcpy(key->address, name, sizeof(key->address));
+#endif
+    } else {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *) src;
+        key->address[10] = key->address[11] = 0xff;
+        memcpy(&key->address[12], &a4->sin_addr.s_addr, 4);
+        key->port = a4->sin_port;
+    }
+    key->family = src->ss_family;
+    key->request_id = request_id;
+}
+
+/**
+ * @brief Tells whether an entry holds a reply that can still be replayed.
+ * @param[in] c: the cache.
+ * @param[in] e: the entry.
+ * @param[in] now: the current time from now_ms().
+ * @return non-zero if the entry has not expired and its bytes were not overwritten.
+ */
+static int entry_live(const reply_cache *c, const cache_entry *e, uint32_t now)
+{
+    return e->expires != 0 && (int32_t) (e->expires - now) > 0 && c->written - e->position <= c->arena_size;
+}
+
+/**
+ * @brief Allocates the cache of one worker.
+ * @param[in] opt: the cache settings.
+ * @return the cache, NULL if the allocation failed.
+ */
+reply_cache *cache_create(const cache_options *opt)
+{
+    unsigned int slots = CACHE_MIN_SLOTS;
+    while (slots < opt->size / CACHE_BYTES_PER_SLOT)
+        slots *= 2;
+
+    reply_cache *c = calloc(1, sizeof(*c));
+    if (c == NULL)
+        return NULL;
+    c->slots = calloc(slots, sizeof(cache_entry));
+    c->arena = malloc(opt->size);
+    if (c->slots == NULL || c->arena == NULL) {
+        free(c->slots);
+        free(c->arena);
+        free(c);
+        return NULL;
+    }
+    c->mask = slots - 1;
+    c->arena_size = opt->size;
+    c->ttl_ms = opt->ttl_ms;
+    clock_gettime(CACHE_CLOCK, &c->epoch);
+
+    rng_engine rng;
+    if (rng_init(&rng, RNG_GETRANDOM) == 0)
+        rng_bytes(&rng, &c->seed, sizeof(c->seed));
+    secure_wipe(&rng, sizeof(rng));
+    return c;
+}
+
+/**
+ * @brief Wipes and frees a cache.
+ * @param[in] c: the cache, or NULL.
+ */
+void cache_destroy(reply_cache *c)
+{
+    if (c == NULL)
+        return;
+    secure_wipe(c->arena, c->arena_size); // The replies hold passwords
+    free(c->arena);
+    free(c->slots);
+    free(c);
+}
+
+/**
+ * @brief Sends again the reply of a request already answered, if it is still cached.
+ * @param[in,out] c: the cache.
+ * @param[in] src: the client address.
+ * @param[in] request_id: the request ID, network byte order.
+ * @param[in] request: the request datagram.
+ * @param[in] length: the size of the request in bytes.
+ * @param[in] sink: called once per cached reply datagram.
+ * @param[in,out] ctx: passed to `sink`.
+ * @return 1 if the reply was sent again, 0 otherwise.
+ */
+int cache_replay(reply_cache *c, const struct sockaddr_storage *src, uint32_t request_id,
+                 const unsigned char *request, size_t length, reply_sink sink, void *ctx)
+{
+    cache_key key;
+    make_key(&key, src, request_id);
+    uint64_t fingerprint = hash_bytes(~c->seed, request, length);
+    uint32_t now = now_ms(c);
+
+    unsigned int home = (unsigned int) hash_bytes(c->seed, &key, sizeof(key));
+    for (unsigned int i = 0; i < CACHE_PROBES; i++) {
+        const cache_entry *e = &c->slots[(home + i) & c->mask];
+        if (e->expires == 0)
+            return 0; // Entries are only stored before the first never used slot of their window
+        if (e->fingerprint != fingerprint || memcmp(&e->key, &key, sizeof(key)) != 0 || !entry_live(c, e, now))
+            continue;
+
+        const unsigned char *p = c->arena + e->position % c->arena_size, *end = p + e->size;
+        while (p < end) {
+            uint16_t size;
+            memcpy(&size, p, sizeof(size));
+            sink(ctx, p + sizeof(size), size);
+            p += sizeof(size) + size;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Starts recording the reply of a request.
+ * @param[in,out] c: the cache.
+ * @param[in] src: the client address.
+ * @param[in] request_id: the request ID, network byte order.
+ * @param[in] request: the request datagram.
+ * @param[in] length: the size of the request in bytes.
+ * @param[out] recorder: the sink to build the reply with.
+ * @param[in] sink: the sink of the reply datagrams.
+ * @param[in,out] ctx: passed to `sink`.
+ */
+void cache_begin(reply_cache *c, const struct sockaddr_storage *src, uint32_t request_id,
+                 const unsigned char *request, size_t length, cache_recorder *recorder, reply_sink sink, void *ctx)
+{
+    // A reply never wraps around the arena end: skip to the start when the largest one would not fit
+    size_t offset = c->written % c->arena_size;
+    if (c->arena_size - offset < CACHE_MAX_REPLY)
+        c->written += c->arena_size - offset;
+
+    make_key(&c->pending.key, src, request_id);
+    c->pending.fingerprint = hash_bytes(~c->seed, request, length);
+    c->pending.position = c->written;
+    c->pending.size = 0;
+    c->recording = 1;
+
+    recorder->cache = c;
+    recorder->sink = sink;
+    recorder->ctx = ctx;
+}
+
+/**
+ * @brief Records one reply datagram and forwards it.
+ * @param[in,out] recorder: the cache_recorder filled by cache_begin().
+ * @param[in] data: the reply datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ */
+void cache_record(void *recorder, const unsigned char *data, size_t length)
+{
+    cache_recorder *r = recorder;
+    reply_cache *c = r->cache;
+
+    if (c->recording && c->pending.size + sizeof(uint16_t) + length <= CACHE_MAX_REPLY) {
+        unsigned char *p = c->arena + c->pending.position % c->arena_size + c->pending.size;
+        uint16_t size = (uint16_t) length;
+        memcpy(p, &size, sizeof(size));
+        memcpy(p + sizeof(size), data, length);
+        c->pending.size += sizeof(size) + length;
+        c->written = c->pending.position + c->pending.size;
+    } else
+        c->recording = 0; // Larger than any valid reply: served, not cached
+    r->sink(r->ctx, data, length);
+}
+
+/**
+ * @brief Stores the recorded reply in the table.
+ * @param[in,out] c: the cache.
+ */
+void cache_commit(reply_cache *c)
+{
+    if (!c->recording)
+        return;
+    c->recording = 0;
+
+    uint32_t now = now_ms(c);
+    unsigned int home = (unsigned int) hash_bytes(c->seed, &c->pending.key, sizeof(c->pending.key));
+    cache_entry *target = NULL, *oldest = NULL;
+    for (unsigned int i = 0; i < CACHE_PROBES && target == NULL; i++) {
+        cache_entry *e = &c->slots[(home + i) & c->mask];
+        if (!entry_live(c, e, now) || memcmp(&e->key, &c->pending.key, sizeof(e->key)) == 0)
+            target = e; // Never used, stale, or the same key answered again
+        else if (oldest == NULL || (int32_t) (e->expires - oldest->expires) < 0)
+            oldest = e;
+    }
+    if (target == NULL)
+        target = oldest;
+
+    *target = c->pending;
+    target->expires = now + c->ttl_ms;
+    if (target->expires == 0)
+        target->expires = 1; // 0 marks the never used slots
+}
@@ -0,0 +1,128 @@
+/*
+ ============================================================================
+ Name        : serverCache.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the per-worker reply cache of retransmitted requests
+ ============================================================================
+ */
+#ifndef SERVER_CACHE_H
+#define SERVER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "serverRequest.h"
+
+struct sockaddr_storage;
+
+#define CACHE_SIZE (1 << 20) // Default bytes of replies kept per worker
+
+#define CACHE_MIN_SIZE 65536 // Smallest cache: room for the largest reply (PROTO_MAX_FRAGMENTS full datagrams)
+
+#define CACHE_MAX_SIZE (1 << 30) // Largest cache per worker
+
+#define CACHE_TTL_MS 8000 // Default lifetime of a reply: spans the retransmissions of the client engine defaults
+
+#define CACHE_BYTES_PER_SLOT 512 // Bytes of replies per table slot: one slot per small reply
+
+#define CACHE_MIN_SLOTS 256 // Smallest table (power of two)
+
+#define CACHE_PROBES 8 // Slots looked at from the home slot of a key; a full window evicts its oldest entry
+
+// Reply cache settings
+typedef struct {
+    unsigned int size;     // Bytes of replies per worker, 0 disables the cache
+    unsigned int ttl_ms;   // Time a reply can be replayed
+} cache_options;
+
+// The cache of one worker: never shared between threads
+typedef struct reply_cache reply_cache;
+
+// Sink that forwards every reply datagram and records it, see cache_begin()
+typedef struct {
+    reply_cache *cache;
+    reply_sink sink;
+    void *ctx;
+} cache_recorder;
+
+/**
+ * @brief Allocates the cache of one worker.
+ *
+ * Everything is allocated once: an open-addressing table of fixed-size
+ * entries and a byte ring (the arena) holding the replies back to back.
+ * Nothing is allocated or freed per request.
+ *
+ * @param[in] opt: the cache settings, `size` above 0.
+ * @return the cache, NULL if the allocation failed.
+ */
+reply_cache *cache_create(const cache_options *opt);
+
+/**
+ * @brief Wipes and frees a cache.
+ *
+ * @param[in] c: the cache, or NULL.
+ */
+void cache_destroy(reply_cache *c);
+
+/**
+ * @brief Sends again the reply of a request already answered, if it is still cached.
+ *
+ * A request matches when it comes from the same address and port with the
+ * same request ID and the same bytes (a client reusing an ID for another
+ * request gets a fresh reply), and its reply has neither expired nor been
+ * overwritten in the arena by newer replies. The lookup probes at most
+ * CACHE_PROBES consecutive slots.
+ *
+ * @param[in,out] c: the cache.
+ * @param[in] src: the client address.
+ * @param[in] request_id: the request ID, network byte order.
+ * @param[in] request: the request datagram.
+ * @param[in] length: the size of the request in bytes.
+ * @param[in] sink: called once per cached reply datagram, in order.
+ * @param[in,out] ctx: passed to `sink`.
+ * @return 1 if the reply was sent again, 0 if the request must be served.
+ */
+int cache_replay(reply_cache *c, const struct sockaddr_storage *src, uint32_t request_id,
+                 const unsigned char *request, size_t length, reply_sink sink, void *ctx);
+
+/**
+ * @brief Starts recording the reply of a request that cache_replay() did not find.
+ *
+ * The reply datagrams are then passed to cache_record() through `recorder`,
+ * which forwards them to `sink`, and cache_commit() makes the reply visible.
+ * The arena always has room for the largest reply from the recording position;
+ * the replies it overwrites stop matching.
+ *
+ * @param[in,out] c: the cache.
+ * @param[in] src: the client address.
+ * @param[in] request_id: the request ID, network byte order.
+ * @param[in] request: the request datagram.
+ * @param[in] length: the size of the request in bytes.
+ * @param[out] recorder: the sink to build the reply with.
+ * @param[in] sink: the sink of the reply datagrams.
+ * @param[in,out] ctx: passed to `sink`.
+ */
+void cache_begin(reply_cache *c, const struct sockaddr_storage *src, uint32_t request_id,
+                 const unsigned char *request, size_t length, cache_recorder *recorder, reply_sink sink, void *ctx);
+
+/**
+ * @brief Records one reply datagram and forwards it (a reply_sink on a cache_recorder).
+ *
+ * @param[in,out] recorder: the cache_recorder filled by cache_begin().
+ * @param[in] data: the reply datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ */
+void cache_record(void *recorder, const unsigned char *data, size_t length);
+
+/**
+ * @brief Stores the recorded reply in the table, replayable for the configured lifetime.
+ *
+ * The entry takes the first free, expired or overwritten slot of its probe
+ * window, else the slot that expires first.
+ *
+ * @param[in,out] c: the cache.
+ */
+void cache_commit(reply_cache *c);
+
+#endif /* SERVER_CACHE_H */
@@ -0,0 +1,390 @@
+/*
+ ============================================================================
+ Name        : serverConfig.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the command line and configuration file settings
+ ============================================================================
+ */
+
+#include <limits.h>
+#include "server.h"
+
+// A setting, as an option (-x VALUE or --name VALUE) and as a configuration file line (name = VALUE)
+typedef struct {
+    char short_name;
+    const char *long_name;
+    int takes_value;   // 0 for flags: no value on the command line, yes/no in a file
+} config_option;
+
+static const config_option options[] = {
+    { 'a', "bind", 1 },
+    { 'o', "port", 1 },
+    { '6', "ipv6-only", 0 },
+    { 'w', "workers", 1 },
+    { 'b', "batch", 1 },
+    { 'i', "backend", 1 },
+    { 'R', "rcvbuf", 1 },
+    { 'S', "sndbuf", 1 },
+    { 'p', "pin", 0 },
+    { 'r', "rng", 1 },
+    { 'k', "kernel", 1 },
+    { 'q', "quiet", 0 },
+    { 'l', "log-level", 1 },
+    { 's', "log-sample", 1 },
+    { 'P', "pool", 1 },
+    { 'g', "pool-producers", 1 },
+    { 'M', "metrics-port", 1 },
+    { 'L', "limit", 1 },
+    { 'G', "global-limit", 1 },
+    { 'y', "policy", 1 },
+    { 'W', "wordlist", 1 },
+    { 'c', "reply-cache", 1 },
+    { 'T', "reply-ttl", 1 },
+    { 'U', "upgrade-socket", 1 },
+    { 'u', "unix-socket", 1 },
+    { 'm', "shm-socket", 1 },
+    { 'K', "reply-key", 1 },
+    { 'C', "config", 1 },
+    { 'B', "bench", 0 },
+};
+
+static int backend_given;   // Without --backend the backend follows the batch size
+static int depth;           // Configuration files being read
+
+/**
+ * @brief Parses a whole decimal number within bounds.
+ * @param[in] text: the number.
+ * @param[in] min: the smallest accepted value.
+ * @param[in] max: the largest accepted value.
+ * @param[out] value: the number.
+ * @return 0 on success, -1 if the text is not a number within bounds.
+ */
+static int parse_number(const char *text, long min, long max, long *value)
+{
+    char *end;
+    errno = 0;
+    long n = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || n < min || n > max)
+        return -1;
+    *value = n;
+    return 0;
+}
+
+/**
+ * @brief Parses the value of a flag in a configuration file.
+ * @param[in] text: yes, no, true, false, on, off, 1 or 0.
+ * @param[out] value: 1 or 0.
+ * @return 0 on success, -1 otherwise.
+ */
+static int parse_flag(const char *text, int *value)
+{
+    if (strcmp(text, "yes") == 0 || strcmp(text, "true") == 0 || strcmp(text, "on") == 0 || strcmp(text, "1") == 0)
+        *value = 1;
+    else if (strcmp(text, "no") == 0 || strcmp(text, "false") == 0 || strcmp(text, "off") == 0 || strcmp(text, "0") == 0)
+        *value = 0;
+    else
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Parses RATE[:BURST] (BURST defaults to RATE).
+ * @param[in] text: the limit.
+ * @param[out] rate: the rate.
+ * @param[out] burst: the burst.
+ * @return 0 on success, -1 otherwise.
+ */
+static int parse_limit(const char *text, unsigned int *rate, unsigned int *burst)
+{
+    char extra;
+    int fields = sscanf(text, "%u:%u%c", rate, burst, &extra);
+    if (fields == 1)
+        *burst = *rate;
+    // Buckets count thousandths of a token in 32 bits
+    if ((fields != 1 && fields != 2) || *rate < 1 || *burst < 1 || *rate > LIMIT_MAX_RATE || *burst > LIMIT_MAX_RATE)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Applies one setting.
+ * @param[in,out] opt: the settings.
+ * @param[in] name: the short name of the setting.
+ * @param[in] value: the value, "yes" or "no" for flags.
+ * @return 0 on success, CONFIG_BENCH for -B, -1 if the value is not valid.
+ */
+static int apply_option(server_options *opt, char name, const char *value)
+{
+    long n;
+    int flag = 0;
+
+    switch (name) {
+    case 'a':
+        if (opt->bind_count == BIND_MAX || strlen(value) >= BIND_ADDRESS_SIZE)
+            return -1;
+        strcpy(opt->binds[opt->bind_count++], value);
+        return 0;
+    case 'o':
+        if (parse_number(value, 1, 65535, &n) < 0)
+            return -1;
+        opt->port = (int) n;
+        return 0;
+    case '6':
+    case 'p':
+    case 'q':
+    case 'B':
+        if (parse_flag(value, &flag) < 0)
+            return -1;
+        if (name == '6')
+            opt->ipv6_only = flag;
+        else if (name == 'p')
+            opt->pin = flag;
+        else if (name == 'q')
+            opt->quiet = flag;
+        else
+            return flag ? CONFIG_BENCH : 0;
+        return 0;
+    case 'w':
+        if (parse_number(value, 0, INT_MAX, &n) < 0)
+            return -1;
+        opt->workers = (int) n;
+        return 0;
+    case 'b':
+        if (parse_number(value, 1, BATCH_MAX, &n) < 0)
+            return -1;
+        opt->batch_size = (unsigned int) n;
+        return 0;
+    case 'i':
+        if (io_parse(value, &opt->backend) < 0)
+            return -1;
+        backend_given = 1;
+        return 0;
+    case 'R':
+    case 'S':
+        if (parse_number(value, 0, INT_MAX, &n) < 0)
+            return -1;
+        if (name == 'R')
+            opt->rcvbuf = (int) n;
+        else
+            opt->sndbuf = (int) n;
+        return 0;
+    case 'r':
+        return rng_parse(value, &opt->rng);
+    case 'k':
+        return kernel_parse(value, &opt->kernel);
+    case 'l':
+        return log_parse(value, &opt->log_level);
+    case 's':
+        if (parse_number(value, 1, UINT_MAX, &n) < 0)
+            return -1;
+        opt->log_sample = (unsigned int) n;
+        return 0;
+    case 'P': {
+        unsigned int size, low, high;
+        int fields = sscanf(value, "%u:%u:%u", &size, &low, &high);
+        if (fields == 1) {
+            low = size / 2;
+            high = size;
+        }
+        if ((fields != 1 && fields != 3) || size < 2 || (size & (size - 1)) != 0 || low >= high || high > size)
+            return -1;
+        opt->pool.size = size;
+        opt->pool.low = low;
+        opt->pool.high = high;
+        return 0;
+    }
+    case 'g':
+        if (parse_number(value, 1, INT_MAX, &n) < 0)
+            return -1;
+        opt->pool.producers = (unsigned int) n;
+        return 0;
+    case 'M':
+        if (parse_number(value, 1, 65535, &n) < 0)
+            return -1;
+        opt->metrics_port = (int) n;
+        return 0;
+    case 'L':
+        return parse_limit(value, &opt->limit.rate, &opt->limit.burst);
+    case 'G':
+        return parse_limit(value, &opt->limit.global_rate, &opt->limit.global_burst);
+    case 'y':
+        return policy_add(&opt->policy, value);
+    case 'W':
+        if (strlen(value) >= POLICY_PATH_SIZE)
+            return -1;
+        strcpy(opt->policy.wordlist, value);
+        return 0;
+    case 'c':
+        if (parse_number(value, 0, CACHE_MAX_SIZE, &n) < 0 || (n > 0 && n < CACHE_MIN_SIZE))
+            return -1;
+        opt->cache.size = (unsigned int) n;
+        return 0;
+    case 'T':
+        if (parse_number(value, 1, 3600000, &n) < 0)
+            return -1;
+        opt->cache.ttl_ms = (unsigned int) n;
+        return 0;
+    case 'U':
+        if (*value == '\0' || strlen(value) >= UPGRADE_PATH_SIZE)
+            return -1;
+        strcpy(opt->upgrade_path, value);
+        return 0;
+    case 'u':
+        if (*value == '\0' || strlen(value) >= LOCAL_PATH_SIZE)
+            return -1;
+        strcpy(opt->local_path, value);
+        return 0;
+    case 'm':
+        if (*value == '\0' || strlen(value) >= LOCAL_PATH_SIZE)
+            return -1;
+        strcpy(opt->rings_path, value);
+        return 0;
+    case 'K':
+        if (*value == '\0' || strlen(value) >= SEAL_PATH_SIZE)
+            return -1;
+        strcpy(opt->key_path, value);
+        return 0;
+    case 'C':
+        return config_load(value, opt);
+    }
+    return -1;
+}
+
+/**
+ * @brief Finds a setting by its command line spelling (-x or --name) or file name (name).
+ * @param[in] text: the spelling.
+ * @param[in] dashes: non-zero for the command line spellings.
+ * @return the setting, NULL if unknown.
+ */
+static const config_option *find_option(const char *text, int dashes)
+{
+    for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        const config_option *o = &options[i];
+        if (!dashes && strcmp(text, o->long_name) == 0)
+            return o;
+        if (dashes && text[0] == '-' && text[1] == o->short_name && text[2] == '\0')
+            return o;
+        if (dashes && text[0] == '-' && text[1] == '-' && strcmp(text + 2, o->long_name) == 0)
+            return o;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Fills the settings with the defaults of a server started without options.
+ * @param[out] opt: the settings.
+ */
+void config_defaults(server_options *opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->port = PORT;
+    opt->batch_size = 1;     // 1 keeps the classic recvfrom/sendto loop
+    opt->workers = -1;       // -1 keeps the single-socket server
+    opt->rng = RNG_CHACHA20;
+    opt->kernel = kernel_best();
+    opt->log_level = LOG_INFO;
+    opt->log_sample = 1;
+    opt->pool.producers = 1; // pool.size 0 keeps the inline generation only
+    opt->cache.size = CACHE_SIZE;
+    opt->cache.ttl_ms = CACHE_TTL_MS;
+    backend_given = 0;
+}
+
+/**
+ * @brief Applies the command line options in order.
+ * @param[in] argc: the number of arguments.
+ * @param[in] argv: the arguments.
+ * @param[in,out] opt: the settings.
+ * @return 0 on success, CONFIG_BENCH if -B was given, -1 on an invalid option.
+ */
+int config_parse_args(int argc, char *argv[], server_options *opt)
+{
+    int bench = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const config_option *o = find_option(argv[i], 1);
+        if (o == NULL) {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return -1;
+        }
+        if (o->takes_value && i + 1 == argc) {
+            fprintf(stderr, "Option %s needs a value\n", argv[i]);
+            return -1;
+        }
+        const char *value = o->takes_value ? argv[++i] : "yes";
+        int result = apply_option(opt, o->short_name, value);
+        if (result < 0) {
+            if (o->short_name != 'C')
+                fprintf(stderr, "Invalid value for --%s: %s\n", o->long_name, value);
+            return -1;
+        }
+        bench = bench || result == CONFIG_BENCH;
+    }
+
+    if (opt->bind_count == 0) {
+        strcpy(opt->binds[0], "127.0.0.1");
+        opt->bind_count = 1;
+    }
+    if (!backend_given)
+        opt->backend = opt->batch_size > 1 ? IO_MMSG : IO_BLOCKING;
+    return bench ? CONFIG_BENCH : 0;
+}
+
+/**
+ * @brief Applies a configuration file.
+ * @param[in] path: the file.
+ * @param[in,out] opt: the settings.
+ * @return 0 on success, -1 if the file cannot be read or has an invalid line.
+ */
+int config_load(const char *path, server_options *opt)
+{
+    if (depth == CONFIG_MAX_DEPTH) {
+        fprintf(stderr, "%s: configuration files nested too deeply\n", path);
+        return -1;
+    }
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot read %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char line[CONFIG_LINE_SIZE];
+    int number = 0, ret = 0;
+    depth++;
+    while (ret == 0 && fgets(line, sizeof(line), file) != NULL) {
+        number++;
+        if (strchr(line, '\n') == NULL && !feof(file)) {
+            fprintf(stderr, "%s:%d: line too long\n", path, number);
+            ret = -1;
+            break;
+        }
+
+        // name = value, with blanks around both
+        char *name = line + strspn(line, " \t");
+        if (*name == '#' || *name == '\n' || *name == '\r' || *name == '\0')
+            continue;
+        char *end = name + strcspn(name, " \t=\r\n");
+        char *value = end + strspn(end, " \t");
+        if (*value == '=')
+            value += 1 + strspn(value + 1, " \t");
+        *end = '\0';
+        value[strcspn(value, "\r\n")] = '\0';
+        for (char *tail = value + strlen(value); tail > value && (tail[-1] == ' ' || tail[-1] == '\t'); tail--)
+            tail[-1] = '\0';
+
+        const config_option *o = find_option(name, 0);
+        if (o == NULL || o->short_name == 'B') {
+            fprintf(stderr, "%s:%d: unknown setting %s\n", path, number, name);
+            ret = -1;
+        } else if (*value == '\0' || apply_option(opt, o->short_name, value) < 0) {
+            if (o->short_name != 'C')
+                fprintf(stderr, "%s:%d: invalid value for %s: %s\n", path, number, name, value);
+            ret = -1;
+        }
+    }
+    depth--;
+    fclose(file);
+    return ret;
+}
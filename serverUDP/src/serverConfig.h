@@ -0,0 +1,60 @@
+/*
+ ============================================================================
+ Name        : serverConfig.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the command line and configuration file settings
+ ============================================================================
+ */
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include "serverData.h"
+
+#define CONFIG_BENCH 1 // config_parse_args() result when -B asks for the microbenchmarks
+
+#define CONFIG_LINE_SIZE 512 // Longest line of a configuration file
+
+#define CONFIG_MAX_DEPTH 4 // Configuration files including each other through `config`
+
+/**
+ * @brief Fills the settings with the defaults of a server started without options.
+ *
+ * @param[out] opt: the settings.
+ */
+void config_defaults(server_options *opt);
+
+/**
+ * @brief Applies the command line options in order.
+ *
+ * Every setting has a short option and a long one (`-w 4` or `--workers 4`);
+ * `-C FILE` / `--config FILE` applies a configuration file at that point, so
+ * that later options override it. Settings left out keep their defaults:
+ * 127.0.0.1 as the only bind address, PORT, and the mmsg backend when the
+ * batch size is above 1, the blocking loop otherwise.
+ *
+ * @param[in] argc: the number of arguments.
+ * @param[in] argv: the arguments, argv[0] being the program name.
+ * @param[in,out] opt: the settings, filled by config_defaults().
+ * @return 0 on success, CONFIG_BENCH if -B was given, -1 on an invalid option
+ *         (an explanation is printed).
+ */
+int config_parse_args(int argc, char *argv[], server_options *opt);
+
+/**
+ * @brief Applies a configuration file.
+ *
+ * One `name = value` setting per line, names being the long options without
+ * the dashes (`workers = 4`, `bind = ::`, `rcvbuf = 4194304`); flags take
+ * yes or no (`pin = yes`). `bind` may be repeated. Empty lines and lines
+ * starting with '#' are ignored.
+ *
+ * @param[in] path: the file.
+ * @param[in,out] opt: the settings.
+ * @return 0 on success, -1 if the file cannot be read or has an invalid
+ *         line (reported with its line number).
+ */
+int config_load(const char *path, server_options *opt);
+
+#endif /* SERVER_CONFIG_H */
@@ -10,10 +10,48 @@
 #ifndef DATA_H
 #define DATA_H
 
-// Structure representing a message with type and length
+#include "rng.h"
+#include "charsetKernel.h"
+#include "serverLog.h"
+#include "serverPool.h"
+#include "serverIO.h"
+#include "serverLimit.h"
+#include "serverPolicy.h"
+#include "serverCache.h"
+#include "serverUpgrade.h"
+#include "serverLocal.h"
+#include "../../common/protocol.h" // Wire format shared with the client
+
+#define BIND_MAX 16 // Most addresses the server listens on
+
+#define BIND_ADDRESS_SIZE 64 // Longest bind address, with its terminator
+
+// Run-time settings chosen on the command line or in a configuration file
 typedef struct {
-    char type;      // Password type, for example: 'a', 'n', 's', 'm'
-    int length;     // Length of the password
-} msg;
+    char binds[BIND_MAX][BIND_ADDRESS_SIZE]; // Numeric IPv4 or IPv6 addresses to listen on ("::" is dual-stack)
+    unsigned int bind_count;  // Entries of binds
+    int port;                 // UDP port of every bind address
+    int ipv6_only;            // Non-zero to set IPV6_V6ONLY on IPv6 sockets
+    int rcvbuf;               // SO_RCVBUF of every socket in bytes, 0 = system default
+    int sndbuf;               // SO_SNDBUF of every socket in bytes, 0 = system default
+    unsigned int batch_size;  // Datagrams per recvmmsg/sendmmsg call, receives posted on io_uring
+    io_backend backend;       // Receive/send loop of every worker
+    int workers;              // SO_REUSEPORT workers, 0 = one per CPU, -1 = single socket
+    int pin;                  // Non-zero to pin each worker to a CPU
+    rng_kind rng;             // Random engine used by every worker
+    kernel_kind kernel;       // Charset mapping kernel
+    int quiet;                // Non-zero for no interactive console output
+    log_level log_level;      // Least important level written by the logger
+    unsigned int log_sample;  // Log one request out of log_sample
+    pool_options pool;        // Pre-generated password pool, disabled when pool.size is 0
+    int metrics_port;         // TCP port of the Prometheus text endpoint, 0 = disabled
+    limit_options limit;      // Per-source and global rate limits, 0 rates disable them
+    policy_options policy;    // Configured password types, besides the built-in ones
+    cache_options cache;      // Reply cache of every worker, disabled when cache.size is 0
+    char upgrade_path[UPGRADE_PATH_SIZE]; // Unix socket of the hot upgrades, empty = disabled
+    char local_path[LOCAL_PATH_SIZE]; // Unix datagram socket of the local clients, empty = disabled
+    char rings_path[LOCAL_PATH_SIZE]; // Unix socket of the shared-memory ring sessions, empty = disabled
+    char key_path[SEAL_PATH_SIZE];    // File of the pre-shared key of the sealed replies, empty = replies in the clear
+} server_options;
 
 #endif /* DATA_H */
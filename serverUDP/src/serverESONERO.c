@@ -4,12 +4,47 @@
  Author      : Giordano, Aghilar
  Version     : 1.0
  Copyright   : Your copyright notice
- Description : Implements server-side socket communication and password generation
+ Description : Implements the server entry point and socket communication
  ============================================================================
  */
 
 #include "server.h"
 
+#if defined PASSGEN_PROFILE_DUMP
+#include <signal.h>
+
+// Instrumented builds (PASSGEN_PGO=generate): the server never returns from main,
+// so SIGINT and SIGTERM write the profile before exiting. The handlers are installed
+// by a constructor: main must have the same control flow as in the optimized build.
+#if defined __clang__
+int __llvm_profile_write_file(void);
+#define profile_dump() __llvm_profile_write_file()
+#else
+void __gcov_dump(void);
+#define profile_dump() __gcov_dump()
+#endif
+
+/**
+ * @brief Writes the execution profile and exits.
+ * @param[in] sig: the signal received.
+ */
+static void profile_exit(int sig)
+{
+    (void) sig;
+    profile_dump();
+    _exit(0);
+}
+
+/**
+ * @brief Installs profile_exit() for SIGINT and SIGTERM before main runs.
+ */
+__attribute__((constructor)) static void profile_handlers(void)
+{
+    signal(SIGINT, profile_exit);
+    signal(SIGTERM, profile_exit);
+}
+#endif
+
 /**
  * @brief Handles errors by printing the specified error message.
  *
@@ -34,137 +69,173 @@ void clearwinsock() {
 #endif
 }
 
-/* - - - - - - - - - - - - - - - - - - PASSWORD GENERATION - - - - - - - - - - - - - - - - - - */
-
 /**
- * @brief Generates a numeric character set for password creation.
+ * @brief Prints the command line usage of the server.
  *
- * This function initializes a character set containing only numeric digits (0-9)
- * and provides its length to be used for password generation.
- *
- * @param[out] characters: a pointer to the character set.
- * @param[out] length: the length of the character set.
+ * @param[in] prog: the program name (argv[0]).
  */
-void generate_numeric(const char **character, int* length)
+void usage(const char *prog)
 {
-	static const char digits[] = "0123456789";
-	 *character = digits;
-	 *length = sizeof(digits) - 1;
+    printf("Usage: %s [OPTION VALUE]... (every option also has a --long form, listed below)\n"
+           "  -a, --bind ADDRESS    : listen on a numeric IPv4 or IPv6 address, repeatable (default 127.0.0.1);\n"
+           "                          \"::\" also accepts IPv4 clients unless --ipv6-only is given\n"
+           "  -o, --port PORT       : UDP port (default %d)\n"
+           "  -6, --ipv6-only       : set IPV6_V6ONLY on IPv6 sockets\n"
+           "  -b, --batch BATCH     : serve in batches of up to BATCH datagrams per recvmmsg/sendmmsg call (1-%d)\n"
+           "  -i, --backend BACKEND : I/O backend: blocking, mmsg, uring or uring-sqpoll\n"
+           "                          (default: mmsg with -b, blocking otherwise)\n"
+           "  -w, --workers WORKERS : start WORKERS sockets per address sharing the port with SO_REUSEPORT\n"
+           "                          (0 = one per CPU)\n"
+           "  -R, --rcvbuf BYTES    : socket receive buffer size (default: system default)\n"
+           "  -S, --sndbuf BYTES    : socket send buffer size (default: system default)\n"
+           "  -p, --pin             : pin each worker to its own CPU\n"
+           "  -r, --rng ENGINE      : random engine: chacha20 (default), getrandom or libc (testing only)\n"
+           "  -k, --kernel KERNEL   : charset kernel: scalar, sse2 or avx2 (default: fastest supported)\n"
+           "  -q, --quiet           : quiet mode, no interactive console output (requests go to the logger)\n"
+           "  -l, --log-level LEVEL : log level: error, warn, info (default) or debug (one line per request)\n"
+           "  -s, --log-sample N    : log one request out of N at debug level (default 1)\n"
+           "  -P, --pool SIZE[:LOW:HIGH] : keep SIZE pre-generated passwords per type (power of two), refilled\n"
+           "                          when a type falls below LOW up to HIGH (default SIZE/2 and SIZE)\n"
+           "  -g, --pool-producers N : password pool producer threads (default 1)\n"
+           "  -M, --metrics-port PORT : serve counters and latency histograms as Prometheus text on 127.0.0.1:PORT\n"
+           "  -L, --limit RATE[:BURST] : answer each source with at most RATE reply datagrams per second,\n"
+           "                          BURST at once (default BURST = RATE); over the limit requests are dropped\n"
+           "                          (a source is an IPv4 address or an IPv6 /64 prefix)\n"
+           "  -G, --global-limit RATE[:BURST] : global budget of reply datagrams per second shared by every source\n"
+           "  -W, --wordlist FILE   : serve passphrases (type w) from an indexed wordlist, see scripts/wordlist_index.py\n"
+           "  -c, --reply-cache BYTES : bytes of replies each worker keeps to answer retransmitted batch requests\n"
+           "                          with the same passwords (default %d, 0 disables, at least %d)\n"
+           "  -T, --reply-ttl MS    : time a cached reply is replayed (default %d)\n"
+           "  -U, --upgrade-socket PATH : hot upgrades: take over the sockets and pooled passwords of the server\n"
+           "                          listening on the Unix socket PATH, if any (it drains and exits), then\n"
+           "                          listen on PATH for the next one; no datagram is lost\n"
+           "  -u, --unix-socket PATH : also serve the clients of this host on the Unix datagram socket PATH\n"
+           "  -m, --shm-socket PATH : also serve the clients of this host through shared-memory rings,\n"
+           "                          set up on the Unix socket PATH (Linux)\n"
+           "  -K, --reply-key FILE  : seal the batch replies with XChaCha20-Poly1305 under the pre-shared key of\n"
+           "                          FILE (64 hex digits); only clients started with the same key are answered\n"
+           "  -y, --policy X:SPEC   : serve type X with a policy, e.g. \"p:base=s upper=2 digit=2 symbol=1\"\n"
+           "                          (chars=SET base=T upper=N lower=N digit=N symbol=N unique; repeatable)\n"
+           "  -C, --config FILE     : apply the \"name = value\" settings of FILE (names are the long options,\n"
+           "                          flags take yes or no); later options override it\n"
+           "  -B, --bench           : run the random engine, charset kernel and reply sealing microbenchmarks and exit\n",
+           prog, PORT, BATCH_MAX, CACHE_SIZE, CACHE_MIN_SIZE, CACHE_TTL_MS);
 }
 
 /**
- * @brief Generates an alphabetic character set for password creation.
- *
- * This function initializes a character set containing only lowercase alphabetic
- * characters (a-z) and provides its length to be used for password generation.
- *
- * @param[out] characters: a pointer to the character set.
- * @param[out] length: the length of the character set.
- */
-void generate_alpha(const char **character, int* length)
-{
-	static const char lowercase_letters[] = "abcdefghijklmnopqrstuvwxyz";
-	 *character = lowercase_letters;
-	 *length = sizeof(lowercase_letters) - 1;
-}
-/**
- * @brief Generates a mixed alphanumeric character set for password creation.
+ * @brief Tells the user that the server is ready.
  *
- * This function initializes a character set containing both alphabetic characters
- * (a-z) and numeric digits (0-9), and provides its length to be used for password generation.
+ * In interactive mode the message is printed with the typewriter effect
+ * (plainly after a hot upgrade: the datagrams are already queueing),
+ * in quiet mode it goes to the logger.
  *
- * @param[out] characters: a pointer to the character set.
- * @param[out] length: the length of the character set.
+ * @param[in] opt: the server settings.
  */
-void generate_mixed(const char **character, int* length)
+void announce_listening(const server_options *opt)
 {
-	static const char lowercase_letters[] = "abcdefghijklmnopqrstuvwxyz0123456789";
-	 *character = lowercase_letters;
-	 *length = sizeof(lowercase_letters) - 1;
-}
-/**
- * @brief Generates a secure character set for password creation.
- *
- * This function initializes a comprehensive character set containing uppercase
- * letters, lowercase letters, numbers, and special characters. It also provides
- * the length of the set for password generation.
- *
- * @param[out] characters: a pointer to the character set.
- * @param[out] length: the length of the character set.
- */
-void generate_secure(const char **character, int* length)
-{
-	static const char complete_letters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789!@#$%^&*()_+-=,./<>?";
-	 *character = complete_letters;
-	 *length = sizeof(complete_letters) - 1;
+    if (opt->quiet) {
+        for (unsigned int i = 0; i < opt->bind_count; i++)
+            log_write(LOG_INFO, "The server is listening on %s port %d", opt->binds[i], opt->port);
+        if (opt->local_path[0] != '\0')
+            log_write(LOG_INFO, "The server is listening on unix://%s", opt->local_path);
+        if (opt->rings_path[0] != '\0')
+            log_write(LOG_INFO, "The server is listening on shm://%s", opt->rings_path);
+        return;
+    }
+    const char *listenMsg = "\nThe server is listening on the: ";
+    if (upgrade_resumed())
+        printf("%s", listenMsg);
+    else
+        typewriterEffect(listenMsg,15000);
+    printf("%d port (", opt->port);
+    for (unsigned int i = 0; i < opt->bind_count; i++)
+        printf("%s%s", i > 0 ? ", " : "", opt->binds[i]);
+    printf(") . . .\n");
+    if (opt->local_path[0] != '\0')
+        printf("Local clients: unix://%s\n", opt->local_path);
+    if (opt->rings_path[0] != '\0')
+        printf("Local clients: shm://%s\n", opt->rings_path);
 }
 
-/**
- * @brief Generates an unambiguous character set for password creation.
- *
- * This function initializes a character set that excludes visually similar
- * characters to minimize confusion (e.g., '0' and 'O', '1' and 'l'). It provides
- * the character set and its length to be used for generating unambiguous passwords.
- *
- * @param[out] characters: a pointer to the character set.
- * @param[out] length: the length of the character set.
- */
-void generate_unambiguous(const char **character, int* length)
-{
-	static const char unambiguous_letters[] = "ACDEFGHJKLMNPQRTUVWXYabcdefghjkmnpqrtuvwxy34679!@#$%^&*()_+-=,./<>?";
-	 *character = unambiguous_letters;
-	 *length = sizeof(unambiguous_letters) - 1;
-}
+int main(int argc, char *argv[]) {
 
-/**
- * @brief Generates a password based on the specified type and length.
- *
- * This function creates a password using a character set determined by the type parameter.
- * Supported types include:
- * - 'n': numeric characters only.
- * - 'a': alphabetic characters only.
- * - 'm': mixed alphanumeric characters.
- * - 's': secure characters (alphanumeric + special characters).
- *
- * @param[in] type: the type of characters to include in the password.
- * @param[in] length: the length of the password to generate.
- * @param[out] password: the generated password string.
- */
-void generate_password(char type, int lenght, char *password) {
-
-    const char *character;
-    int set_length;
-
-    switch (type) {
-        case 'n':
-        	generate_numeric(&character, &set_length);
-        	break;
-        case 'a':
-        	generate_alpha(&character, &set_length);
-            break;
-        case 'm':
-        	generate_mixed(&character, &set_length);
-            break;
-        case 's':
-        	generate_secure(&character, &set_length);
-            break;
-        case 'u':
-        	generate_unambiguous(&character, &set_length);
-        	break;
-        default:
-            snprintf(password, PASS_SIZE, "Error, password not generated");
-            return;
+    server_options opt;
+    config_defaults(&opt);
+
+    int parsed = config_parse_args(argc, argv, &opt);
+    if (parsed < 0) {
+        usage(argv[0]);
+        return -1;
     }
+    if (parsed == CONFIG_BENCH)
+        return run_rng_bench() < 0 || run_kernel_bench() < 0 || run_seal_bench() < 0 ? -1 : 0;
 
-    for (int i = 0; i < lenght; i++) {
-        password[i] = character[rand() % set_length];
+    if (policy_start(&opt.policy) < 0) {
+        policy_stop();
+        return -1;
     }
-    password[lenght] = '\0';
-}
 
-/* - - - - - - - - - - - - - - - - - - END PASSWORD GENERATION - - - - - - - - - - - - - - - - - - */
+    if (seal_start(opt.key_path) < 0) {
+        policy_stop();
+        return -1;
+    }
 
-int main(void) {
+    if (kernel_select(opt.kernel) < 0) {
+        errorhandler("Error, the charset kernel is not supported by this CPU.\n");
+        seal_stop();
+        policy_stop();
+        return -1;
+    }
+
+    if (log_start(opt.log_level, opt.log_sample) < 0) {
+        errorhandler("Error, logger thread creation failed.\n");
+        seal_stop();
+        policy_stop();
+        return -1;
+    }
+
+    opt.pool.rng = opt.rng;
+    if (opt.pool.size > 0 && pool_start(&opt.pool) < 0) {
+        log_stop();
+        seal_stop();
+        policy_stop();
+        return -1;
+    }
+
+    if (limit_start(&opt.limit) < 0) {
+        pool_stop();
+        log_stop();
+        seal_stop();
+        policy_stop();
+        return -1;
+    }
+
+    // The previous server keeps serving until this one serves too, see upgrade_listen()
+    if (opt.upgrade_path[0] != '\0' && upgrade_takeover(opt.upgrade_path, pool_room()) < 0) {
+        limit_stop();
+        pool_stop();
+        log_stop();
+        seal_stop();
+        policy_stop();
+        return -1;
+    }
+
+    if (opt.metrics_port > 0 && metrics_start(opt.metrics_port, upgrade_metrics_socket(opt.metrics_port)) < 0) {
+        upgrade_release();
+        limit_stop();
+        pool_stop();
+        log_stop();
+        seal_stop();
+        policy_stop();
+        return -1;
+    }
+
+    if (seal_enabled())
+        log_write(LOG_INFO, "Replies sealed with XChaCha20-Poly1305, %s keystream kernel",
+                  seal_kernel_name(seal_best()));
+    if (opt.cache.size > 0)
+        log_write(LOG_INFO, "Reply cache: %u bytes per worker, replies replayed for %u ms", opt.cache.size,
+                  opt.cache.ttl_ms);
 
 	// Inizializzazione di Winsock
      #if defined WIN32
@@ -175,70 +246,82 @@ int main(void) {
 	    }
 	#endif
 
-    srand(time(NULL));
+    // The local endpoints have workers of their own, as have the sockets of a previous server with several workers
+    if (opt.workers >= 0 || opt.bind_count > 1 || opt.local_path[0] != '\0' || opt.rings_path[0] != '\0' ||
+        upgrade_socket_count(opt.binds[0], opt.port) > 1) {
+        announce_listening(&opt);
+        int ret = run_workers(&opt);
+        metrics_stop();
+        limit_stop();
+        pool_stop();
+        log_stop();
+        seal_stop();
+        policy_stop();
+        clearwinsock();
+        return ret;
+    }
 
-	int my_socket; // "welcome" socket
-	my_socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP); // Create socket
+    server_worker worker;
+    memset(&worker, 0, sizeof(worker));
+    worker.cpu = -1;
+    worker.batch_size = opt.batch_size;
+    worker.backend = opt.backend;
+    worker.interactive = !opt.quiet;
+    worker.m = metrics_attach(0);
+    if (opt.cache.size > 0)
+        worker.cache = cache_create(&opt.cache);
+    if (worker.m == NULL || rng_init(&worker.rng, opt.rng) < 0 || (opt.cache.size > 0 && worker.cache == NULL) ||
+        (seal_enabled() && sealer_init(&worker.sealer) < 0)) {
+        errorhandler("Error, worker initialization failed.\n");
+        cache_destroy(worker.cache);
+        metrics_stop();
+        limit_stop();
+        pool_stop();
+        log_stop();
+        seal_stop();
+        policy_stop();
+        clearwinsock();
+        return -1;
+    }
 
-	if (my_socket < 0) {
-	 errorhandler("socket creation failed.\n");
+	int my_socket = upgrade_socket(opt.binds[0], opt.port); // "welcome" socket, from the previous server
+	if (my_socket < 0)
+	 my_socket = open_server_socket(&opt, opt.binds[0], 0);
+	int refused = upgrade_check_claimed() < 0; // A local endpoint of the previous server would be closed
+	upgrade_release();
+	if (my_socket < 0 || refused) {
+	 if (my_socket >= 0)
+	  closesocket(my_socket);
+	 cache_destroy(worker.cache);
+	 metrics_stop();
+	 limit_stop();
+	 pool_stop();
+	 log_stop();
+	 seal_stop();
+	 policy_stop();
 	 clearwinsock();
 	 return -1;
 	}
+    worker.sock = my_socket;
 
-	struct sockaddr_in sad;     // sockaddr_in type variable
-	sad.sin_family = AF_INET;  // Using IPv4 address
-	sad.sin_addr.s_addr = inet_addr( "127.0.0.1" ); // Sets the IP address (localhost in this case) and the inet_addr() function converts the IP address from a dot-decimal string to a network byte order numeric value.
-	sad.sin_port = htons( 57015 ); // The port the socket will listen on, using htons() to convert the port number from host byte order to network byte order
-
-	// Bind call to associate the address and port to the socket (my_socket)
-	if ( bind(my_socket, (struct sockaddr*) &sad, sizeof(sad)) < 0 )
-	{
-	 errorhandler("bind() failed.\n");	// If it fails, it's probably because the port is already in use or there are permission issues.
-	  closesocket(my_socket);	// Close socket
-	  clearwinsock();
-	 return -1;
-	}
+    announce_listening(&opt);
+
+    log_write(LOG_INFO, "I/O backend: %s, batch size %u", io_name(opt.backend), opt.batch_size);
+    pthread_t self = pthread_self();
+    if (opt.upgrade_path[0] != '\0')
+        upgrade_listen(opt.upgrade_path, &worker, &self, 1);
+    serve(&worker);
+    upgrade_stop();
 
-	const char *listenMsg = "\nThe server is listening on the: ";
-	typewriterEffect(listenMsg,15000);
-	printf("%d port . . .\n", PORT);
-
-	    struct sockaddr_in cad;      // Struct to store the client's address
-	    unsigned int client_len = sizeof(cad);
-	    int client_socket;
-
-    msg m;
-    char password[PASS_SIZE];
-
-        while (1)
-        {
-              int bytes_received = recvfrom(my_socket, (void *)&m, sizeof(m), 0,(struct sockaddr*)&cad, &client_len);
-               if(bytes_received>0)
-               {
-            	   const char *connectMsg = "\n\nNew request from ";
-            	           		typewriterEffect(connectMsg,15000);
-            	           		printf("%s:%d\n", inet_ntoa(cad.sin_addr), ntohs(cad.sin_port)); // print IP address and port
-               }
-
-				m.length = ntohl(m.length); // Convert the length from network byte order to host byte order
-				const char *reqMsg = "\n\nRequest from client: ";
-				typewriterEffect(reqMsg,15000);
-				printf("%c %d\n", m.type, m.length);
-
-				generate_password(m.type, m.length, password);  // Generate password
-
-				if (sendto(my_socket, password, strlen(password), 0, (struct sockaddr*)&cad, client_len) < 0)
-				    perror("Error, password send failed.");
-				else {
-					const char *respMsg = "Response sent . . .";
-				    typewriterEffect(respMsg, 15000);
-				}
-
-        }
-
-    closesocket(client_socket);	// Close the client socket
-    closesocket(my_socket);    // Close the server socket
+    closesocket(my_socket);    // Close the server socket (still open in the next server after a hot upgrade)
+    cache_destroy(worker.cache);
+    metrics_stop();
+    limit_stop();
+    pool_stop();
+    log_stop();
+    seal_stop();
+    policy_stop();
+    clearwinsock();
 	#if defined WIN32
     system("pause");
 	#endif
@@ -0,0 +1,395 @@
+/*
+ ============================================================================
+ Name        : serverIO.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the server receive/send loops (classic, batched and backend selection)
+ ============================================================================
+ */
+
+#if defined __linux__
+#define _GNU_SOURCE // recvmmsg/sendmmsg
+#endif
+
+#include "server.h"
+
+#if defined __linux__
+#include <sys/uio.h>
+#endif
+
+// Destination of the replies of the classic loop
+typedef struct {
+    server_worker *w;
+    const struct sockaddr_storage *dest;
+    socklen_t dest_len;
+} blocking_target;
+
+/**
+ * @brief Reply sink of the classic loop: sends the datagram right away.
+ * @param[in,out] ctx: the blocking_target of the request.
+ * @param[in] data: the reply datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ */
+static void send_now(void *ctx, const unsigned char *data, size_t length)
+{
+    blocking_target *t = ctx;
+    unsigned char sealed[PROTO_MAX_DATAGRAM];
+
+    if (seal_wanted(data, length)) {
+        memcpy(sealed, data, length);
+        length = seal_reply(&t->w->sealer, sealed, length);
+        data = sealed;
+        metric_add(&t->w->m->sealed, 1);
+    }
+    int sent = sendto(t->w->sock, (const char *) data, length, 0, (const struct sockaddr*) t->dest, t->dest_len);
+    if (data == sealed)
+        secure_wipe(sealed, sizeof(sealed));
+    if (sent < 0) {
+        metric_add(&t->w->m->send_failures, 1);
+        log_write(LOG_ERROR, "Worker %d: password send failed: %s", t->w->id, strerror(errno));
+        return;
+    }
+    metric_add(&t->w->m->datagrams_out, 1);
+    metric_add(&t->w->m->bytes_out, sent);
+    if (t->w->interactive) {
+        const char *respMsg = "Response sent . . .";
+        typewriterEffect(respMsg, 15000);
+    }
+}
+
+/**
+ * @brief Extracts the kernel receive timestamp of a datagram.
+ * @param[in] msg: the header filled by recvmsg, with a control buffer of ARRIVAL_CONTROL_SIZE bytes.
+ * @return the receive time in CLOCK_REALTIME nanoseconds, 0 if the message carries none.
+ */
+unsigned long long arrival_time(const struct msghdr *msg)
+{
+#if defined SCM_TIMESTAMPNS
+    for (struct cmsghdr *c = CMSG_FIRSTHDR((struct msghdr *) msg); c != NULL; c = CMSG_NXTHDR((struct msghdr *) msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        }
+    }
+#else
+    (void) msg;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Serves requests with one recvfrom/sendto pair per request.
+ * @param[in,out] w: the worker owning the socket.
+ * @return 0 when the socket was handed over, -1 if the loop stops because of a socket error.
+ */
+int serve_blocking(server_worker *w)
+{
+    struct sockaddr_storage cad; // Client address: IPv4 or IPv6
+    socklen_t client_len;
+    unsigned char request[REQUEST_BUFFER_SIZE];
+    blocking_target target = { w, &cad, 0 };
+    unsigned long long arrival = 0;
+#if !defined WIN32
+    // recvmsg instead of recvfrom: the kernel receive timestamp comes as control data
+    unsigned char control[ARRIVAL_CONTROL_SIZE];
+    struct iovec iov = { request, sizeof(request) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &cad;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+#endif
+
+    while (!upgrade_draining())
+    {
+#if defined WIN32
+        client_len = sizeof(cad);
+        int bytes_received = recvfrom(w->sock, (char *) request, sizeof(request), 0, (struct sockaddr*)&cad, &client_len);
+#else
+        msg.msg_namelen = sizeof(cad);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        int bytes_received = recvmsg(w->sock, &msg, 0);
+        client_len = msg.msg_namelen;
+        arrival = arrival_time(&msg);
+#endif
+        if (bytes_received < 0) {
+            // ECONNREFUSED: ICMP error for an earlier reply; anything else would fail again at once
+            if (errno == EINTR || errno == EAGAIN || errno == ECONNREFUSED)
+                continue;
+            log_write(LOG_ERROR, "Worker %d: receive failed: %s", w->id, strerror(errno));
+            return -1;
+        }
+        local_source(&cad, client_len);
+
+        target.dest_len = client_len;
+        handle_datagram(w, &cad, request, bytes_received, arrival, send_now, &target);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Records the fill level of a batch and periodically prints a report.
+ * @param[in,out] w: the worker owning the batch counters.
+ * @param[in] received: number of datagrams handled in the batch.
+ */
+void account_batch(server_worker *w, unsigned int received)
+{
+    w->batches++;
+    w->datagrams += received;
+    if (received == w->batch_size)
+        w->full_batches++;
+
+    if (w->batches == BATCH_REPORT_INTERVAL) {
+        log_write(LOG_INFO, "Worker %d batch fill: avg %.1f/%u datagrams, %.1f%% full batches", w->id,
+               (double) w->datagrams / w->batches, w->batch_size,
+               100.0 * w->full_batches / w->batches);
+        w->batches = 0;
+        w->datagrams = 0;
+        w->full_batches = 0;
+    }
+}
+
+#if defined __linux__
+
+// Replies of a batch waiting for sendmmsg
+typedef struct {
+    server_worker *w;
+    unsigned int capacity;                       // Datagrams that fit in the queue
+    unsigned int count;                          // Datagrams queued
+    unsigned char (*data)[PROTO_MAX_DATAGRAM];   // One buffer per queued datagram
+    struct iovec *iov;
+    struct mmsghdr *msgs;
+    seal_item *seal;                             // The queued datagrams, as seen by seal_batch()
+    struct sockaddr_storage *dest;               // Destination of the replies being queued
+    socklen_t dest_len;
+} tx_queue;
+
+/**
+ * @brief Sends every queued reply with as few sendmmsg calls as possible.
+ * @param[in,out] q: the queue, empty on return.
+ */
+static void flush_replies(tx_queue *q)
+{
+    // The replies of the whole batch are sealed together: the vector kernel fills its lanes across replies
+    if (seal_enabled()) {
+        for (unsigned int i = 0; i < q->count; i++) {
+            q->seal[i].data = q->data[i];
+            q->seal[i].length = q->iov[i].iov_len;
+        }
+        metric_add(&q->w->m->sealed, seal_batch(&q->w->sealer, q->seal, q->count));
+        for (unsigned int i = 0; i < q->count; i++)
+            q->iov[i].iov_len = q->seal[i].length;
+    }
+
+    // sendmmsg may stop early: resume after the sent messages, skip a failing one
+    unsigned int sent = 0;
+    while (sent < q->count) {
+        int r = sendmmsg(q->w->sock, q->msgs + sent, q->count - sent, 0);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            metric_add(&q->w->m->send_failures, 1);
+            log_write(LOG_ERROR, "Worker %d: password send failed: %s", q->w->id, strerror(errno));
+            sent++;
+        } else {
+            unsigned long long bytes = 0;
+            for (int i = 0; i < r; i++)
+                bytes += q->msgs[sent + i].msg_len;
+            metric_add(&q->w->m->datagrams_out, r);
+            metric_add(&q->w->m->bytes_out, bytes);
+            sent += r;
+        }
+    }
+    for (unsigned int i = 0; i < q->count; i++)
+        secure_wipe(q->data[i], q->iov[i].iov_len); // The replies carry passwords
+    q->count = 0;
+}
+
+/**
+ * @brief Reply sink of the batched loop: queues the datagram for sendmmsg.
+ * @param[in,out] ctx: the tx_queue.
+ * @param[in] data: the reply datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ */
+static void queue_reply(void *ctx, const unsigned char *data, size_t length)
+{
+    tx_queue *q = ctx;
+
+    if (q->count == q->capacity)
+        flush_replies(q); // A large batch reply filled the queue
+
+    unsigned int i = q->count++;
+    memcpy(q->data[i], data, length);
+    q->iov[i].iov_base = q->data[i];
+    q->iov[i].iov_len = length;
+    memset(&q->msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+    q->msgs[i].msg_hdr.msg_iov = &q->iov[i];
+    q->msgs[i].msg_hdr.msg_iovlen = 1;
+    q->msgs[i].msg_hdr.msg_name = q->dest;
+    q->msgs[i].msg_hdr.msg_namelen = q->dest_len;
+}
+
+#endif /* __linux__ */
+
+/**
+ * @brief Serves requests in batches with recvmmsg/sendmmsg.
+ * @param[in,out] w: the worker owning the socket.
+ * @return 0 when the socket was handed over, -1 if the loop stops because of a socket or allocation error.
+ */
+int serve_batched(server_worker *w)
+{
+#if defined __linux__
+    unsigned int n = w->batch_size;
+
+    unsigned char (*requests)[REQUEST_BUFFER_SIZE] = calloc(n, REQUEST_BUFFER_SIZE);
+    unsigned char (*controls)[ARRIVAL_CONTROL_SIZE] = calloc(n, ARRIVAL_CONTROL_SIZE);
+    struct sockaddr_storage *addrs = calloc(n, sizeof(struct sockaddr_storage));
+    struct iovec *rx_iov = calloc(n, sizeof(struct iovec));
+    struct mmsghdr *rx = calloc(n, sizeof(struct mmsghdr));
+    tx_queue q;
+    q.w = w;
+    q.capacity = n;
+    q.count = 0;
+    q.data = calloc(n, PROTO_MAX_DATAGRAM);
+    q.iov = calloc(n, sizeof(struct iovec));
+    q.msgs = calloc(n, sizeof(struct mmsghdr));
+    q.seal = calloc(n, sizeof(seal_item));
+    int ret = -1;
+
+    if (!requests || !controls || !addrs || !rx_iov || !rx || !q.data || !q.iov || !q.msgs || !q.seal) {
+        errorhandler("Error, batch buffers allocation failed.\n");
+        goto out;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        rx_iov[i].iov_base = requests[i];
+        rx_iov[i].iov_len = REQUEST_BUFFER_SIZE;
+        rx[i].msg_hdr.msg_iov = &rx_iov[i];
+        rx[i].msg_hdr.msg_iovlen = 1;
+        rx[i].msg_hdr.msg_name = &addrs[i];
+    }
+
+    while (!upgrade_draining())
+    {
+        for (unsigned int i = 0; i < n; i++) {
+            rx[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+            rx[i].msg_hdr.msg_control = controls[i];
+            rx[i].msg_hdr.msg_controllen = ARRIVAL_CONTROL_SIZE;
+        }
+
+        // Block for the first datagram, then take whatever else is already queued
+        int received = recvmmsg(w->sock, rx, n, MSG_WAITFORONE, NULL);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+            log_write(LOG_ERROR, "Worker %d: batch receive failed: %s", w->id, strerror(errno));
+            goto out;
+        }
+
+        for (int i = 0; i < received; i++) {
+            q.dest = &addrs[i];
+            q.dest_len = rx[i].msg_hdr.msg_namelen;
+            local_source(&addrs[i], q.dest_len);
+            handle_datagram(w, &addrs[i], requests[i], rx[i].msg_len, arrival_time(&rx[i].msg_hdr), queue_reply, &q);
+        }
+        flush_replies(&q);
+
+        account_batch(w, received);
+    }
+    ret = 0;
+
+out:
+    free(requests);
+    free(controls);
+    free(addrs);
+    free(rx_iov);
+    free(rx);
+    free(q.data);
+    free(q.iov);
+    free(q.msgs);
+    free(q.seal);
+    return ret;
+#else
+    return serve_blocking(w);
+#endif
+}
+
+// Backend names accepted by io_parse(), in io_backend order
+static const char *const backend_names[] = { "blocking", "mmsg", "uring", "uring-sqpoll" };
+
+/**
+ * @brief Parses a backend name.
+ * @param[in] name: the backend name.
+ * @param[out] backend: the matching backend.
+ * @return 0 if the name is known, -1 otherwise.
+ */
+int io_parse(const char *name, io_backend *backend)
+{
+    for (size_t i = 0; i < sizeof(backend_names) / sizeof(backend_names[0]); i++) {
+        if (strcmp(name, backend_names[i]) == 0) {
+            *backend = (io_backend) i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Returns the name of a backend.
+ * @param[in] backend: the backend.
+ * @return a static string with the backend name.
+ */
+const char *io_name(io_backend backend)
+{
+    return (unsigned int) backend < sizeof(backend_names) / sizeof(backend_names[0]) ? backend_names[backend] : "unknown";
+}
+
+/**
+ * @brief Runs the receive/send loop selected by `w->backend`.
+ * @param[in,out] w: the worker owning the socket.
+ * @return the result of the loop.
+ */
+static int serve_loop(server_worker *w)
+{
+    if (w->rings)
+        return serve_rings(w);
+
+#if defined SO_TIMESTAMPNS
+    // Kernel receive timestamps feed the queueing histogram
+    int one = 1;
+    if (metrics_timing() && setsockopt(w->sock, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0)
+        log_write(LOG_WARN, "Worker %d: no receive timestamps, queueing time not measured: %s", w->id, strerror(errno));
+#endif
+
+    switch (w->backend) {
+    case IO_MMSG:
+        return serve_batched(w);
+    case IO_URING:
+    case IO_URING_SQPOLL: {
+        int ret = serve_uring(w, w->backend == IO_URING_SQPOLL);
+        if (ret != URING_UNSUPPORTED)
+            return ret;
+        log_write(LOG_WARN, "Worker %d: io_uring not available (%s), using the blocking loop", w->id,
+                  strerror(errno));
+        return serve_blocking(w);
+    }
+    default:
+        return serve_blocking(w);
+    }
+}
+
+/**
+ * @brief Runs the receive/send loop selected by `w->backend` and marks the worker stopped.
+ * @param[in,out] w: the worker owning the socket.
+ * @return 0 when the socket was handed over, -1 if the loop stops because of a socket or allocation error.
+ */
+int serve(server_worker *w)
+{
+    int ret = serve_loop(w);
+    __atomic_store_n(&w->stopped, 1, __ATOMIC_RELEASE);
+    return ret;
+}
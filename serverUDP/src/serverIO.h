@@ -0,0 +1,129 @@
+/*
+ ============================================================================
+ Name        : serverIO.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the server receive/send loops
+ ============================================================================
+ */
+#ifndef SERVER_IO_H
+#define SERVER_IO_H
+
+#include "rng.h"
+#include "serverValidate.h"
+#include "serverMetrics.h"
+#include "serverSeal.h"
+
+struct reply_cache;
+
+#define ARRIVAL_CONTROL_SIZE 64 // Control data buffer of a receive: room for one SCM_TIMESTAMPNS message
+
+// Receive/send loop of a worker
+typedef enum {
+    IO_BLOCKING,      // One recvfrom/sendto pair per request
+    IO_MMSG,          // recvmmsg/sendmmsg batches (Linux)
+    IO_URING,         // recvmsg/sendmsg kept posted on an io_uring ring (Linux)
+    IO_URING_SQPOLL   // io_uring with a kernel submission thread: no syscall while busy
+} io_backend;
+
+// State of one serving loop bound to a socket
+typedef struct {
+    int id;                            // Worker index (0 for the single-socket server)
+    int cpu;                           // CPU the worker is pinned to, -1 if not pinned
+    int sock;                          // Bound UDP or Unix datagram socket, or the listener of the ring sessions
+    int rings;                         // Non-zero when `sock` is the ring listener: serve() runs serve_rings()
+    int interactive;                   // Non-zero to echo every request with the typewriter effect
+    io_backend backend;                // Receive/send loop run by serve()
+    rng_engine rng;                    // Private random engine used for password generation
+    unsigned int batch_size;           // Datagrams per recvmmsg/sendmmsg call, receives posted on io_uring
+    unsigned long long batches;        // Batches received since the last report
+    unsigned long long datagrams;      // Datagrams received since the last report
+    unsigned long long full_batches;   // Batches that filled every slot since the last report
+    worker_metrics *m;                 // Counters and histograms, on cache lines of their own
+    struct reply_cache *cache;         // Replies of the recent batch requests, NULL when disabled
+    reply_sealer sealer;               // Session key of the sealed replies, when the server has a key
+    int stopped;                       // Set once serve() returned (read by the hot upgrade thread)
+} server_worker;
+
+/**
+ * @brief Serves requests with one recvfrom call per request.
+ *
+ * Every reply datagram is sent with sendto as soon as it is built. In interactive
+ * mode every request is echoed on the console with the typewriter effect before
+ * the password is sent back; otherwise requests only go to the asynchronous
+ * logger (debug level, sampled).
+ *
+ * @param[in,out] w: the worker owning the socket.
+ * @return 0 when the socket was handed over to a new server, -1 if the loop
+ *         stops because of a socket error.
+ */
+int serve_blocking(server_worker *w);
+
+/**
+ * @brief Serves requests in batches with recvmmsg/sendmmsg.
+ *
+ * Drains up to `w->batch_size` datagrams per recvmmsg call, generates all the
+ * passwords and replies to the whole batch with a single sendmmsg call (more
+ * calls only when batch protocol replies need more than `batch_size` datagrams).
+ * Every BATCH_REPORT_INTERVAL batches a line reporting how full the batches were is printed.
+ * On systems without recvmmsg it falls back to serve_blocking().
+ *
+ * @param[in,out] w: the worker owning the socket.
+ * @return 0 when the socket was handed over to a new server, -1 if the loop
+ *         stops because of a socket or allocation error.
+ */
+int serve_batched(server_worker *w);
+
+/**
+ * @brief Extracts the kernel receive timestamp of a datagram.
+ *
+ * The timestamps are requested with SO_TIMESTAMPNS when the metrics endpoint
+ * is enabled; every receive loop passes a control buffer of ARRIVAL_CONTROL_SIZE bytes.
+ *
+ * @param[in] msg: the header filled by recvmsg.
+ * @return the receive time in CLOCK_REALTIME nanoseconds, 0 if the message carries none.
+ */
+unsigned long long arrival_time(const struct msghdr *msg);
+
+/**
+ * @brief Runs the receive/send loop selected by `w->backend`.
+ *
+ * Backends the system does not provide (recvmmsg outside Linux, io_uring on
+ * kernels without it or where it is disabled) fall back to serve_blocking().
+ * The worker of the shared-memory rings runs serve_rings() whatever the backend.
+ * Every loop stops after the datagrams it already received once the socket
+ * is handed over to a new server (see upgrade_listen()); `w->stopped` is set on return.
+ *
+ * @param[in,out] w: the worker owning the socket.
+ * @return 0 when the socket was handed over to a new server, -1 if the loop
+ *         stops because of a socket or allocation error.
+ */
+int serve(server_worker *w);
+
+/**
+ * @brief Records the fill level of a batch and periodically prints a report.
+ *
+ * @param[in,out] w: the worker owning the batch counters.
+ * @param[in] received: number of datagrams handled in the batch.
+ */
+void account_batch(server_worker *w, unsigned int received);
+
+/**
+ * @brief Parses a backend name ("blocking", "mmsg", "uring" or "uring-sqpoll").
+ *
+ * @param[in] name: the backend name.
+ * @param[out] backend: the matching backend.
+ * @return 0 if the name is known, -1 otherwise.
+ */
+int io_parse(const char *name, io_backend *backend);
+
+/**
+ * @brief Returns the name of a backend.
+ *
+ * @param[in] backend: the backend.
+ * @return a static string with the backend name.
+ */
+const char *io_name(io_backend backend);
+
+#endif /* SERVER_IO_H */
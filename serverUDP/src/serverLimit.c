@@ -0,0 +1,327 @@
+/*
+ ============================================================================
+ Name        : serverLimit.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the per-source and global rate limiter and the address validation
+ ============================================================================
+ */
+
+#include <stdatomic.h>
+#include "server.h"
+#include "../../common/aead.h" // ChaCha20 block of the cookies
+
+#if defined CLOCK_MONOTONIC_COARSE
+#define LIMIT_CLOCK CLOCK_MONOTONIC_COARSE // Millisecond buckets do not need a precise clock
+#else
+#define LIMIT_CLOCK CLOCK_MONOTONIC
+#endif
+
+// Bucket of one source; tokens are counted in thousandths
+typedef struct {
+    uint64_t key;      // Source key, see source_key()
+    uint32_t tokens;   // Thousandths of a token left at `seen`
+    uint32_t seen;     // Milliseconds of the last request (see now_ms()), 0 = free entry
+} limit_entry;
+
+// One set of the source table: exactly one cache line
+typedef struct {
+    _Alignas(64) atomic_flag lock;
+    limit_entry ways[LIMIT_WAYS];
+} limit_set;
+
+_Static_assert(sizeof(limit_set) == 64, "a limiter set must fill one cache line");
+
+static limit_options settings;
+static limit_set *sets;
+static uint64_t hash_seed;             // Random: sources cannot aim at one set
+static struct timespec epoch;
+static _Alignas(64) atomic_ullong global_bucket; // Milliseconds << 32 | thousandths of a token
+static unsigned char cookie_secret[AEAD_KEY_SIZE]; // Random, drawn by limit_start()
+
+/**
+ * @brief Returns the milliseconds elapsed since limit_start(), plus one.
+ * @return the time, never 0 (wraps after 49 days, harmless for buckets).
+ */
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(LIMIT_CLOCK, &ts);
+    return (uint32_t) ((ts.tv_sec - epoch.tv_sec) * 1000 + (ts.tv_nsec - epoch.tv_nsec) / 1000000) + 1;
+}
+
+/**
+ * @brief Returns the key of a source: its IPv4 address, the /64 prefix of its IPv6 address or its Unix name.
+ * @param[in] src: the source address.
+ * @return the key; IPv4 keys have the 32 high bits set and Unix keys start with 0xff00
+ *         (multicast prefixes), which no unicast IPv6 prefix has.
+ */
+static uint64_t source_key(const struct sockaddr_storage *src)
+{
+    uint32_t v4;
+    uint64_t prefix;
+
+#if !defined WIN32
+    if (src->ss_family == AF_UNIX) {
+        // FNV-1a of the whole name, cleared past its end by local_source()
+        const struct sockaddr_un *un = (const struct sockaddr_un *) src;
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < sizeof(un->sun_path); i++)
+            h = (h ^ (unsigned char) un->sun_path[i]) * 0x100000001b3ull;
+        return 0xff00000000000000ull | (h & 0x0000ffffffffffffull);
+    }
+#endif
+    if (src->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) src;
+        if (!IN6_IS_ADDR_V4MAPPED(&a6->sin6_addr)) {
+            memcpy(&prefix, a6->sin6_addr.s6_addr, sizeof(prefix));
+            return prefix;
+        }
+        memcpy(&v4, &a6->sin6_addr.s6_addr[12], sizeof(v4));
+    } else
+        v4 = ((const struct sockaddr_in *) src)->sin_addr.s_addr;
+    return 0xffffffff00000000ull | v4;
+}
+
+/**
+ * @brief Refills a bucket for the time elapsed since it was last seen.
+ * @param[in] tokens: thousandths of a token at `seen`.
+ * @param[in] elapsed: milliseconds since `seen`.
+ * @param[in] rate: tokens per second, i.e. thousandths per millisecond.
+ * @param[in] burst: bucket size in tokens.
+ * @return the thousandths of a token now in the bucket.
+ */
+static uint32_t refill(uint32_t tokens, uint32_t elapsed, unsigned int rate, unsigned int burst)
+{
+    uint64_t full = (uint64_t) tokens + (uint64_t) elapsed * rate;
+    uint64_t cap = (uint64_t) burst * 1000;
+    return (uint32_t) (full < cap ? full : cap);
+}
+
+/**
+ * @brief Allocates the source table and fills the buckets.
+ * @param[in] opt: the limiter settings.
+ * @return 0 on success, -1 if the table could not be allocated.
+ */
+int limit_start(const limit_options *opt)
+{
+    settings = *opt;
+    clock_gettime(LIMIT_CLOCK, &epoch);
+    atomic_store(&global_bucket, (1ull << 32) | (uint32_t) (settings.global_burst * 1000ull));
+
+    rng_engine rng;
+    if (rng_init(&rng, RNG_GETRANDOM) < 0) {
+        errorhandler("Error, no random bytes for the address validation cookies.\n");
+        return -1;
+    }
+    rng_bytes(&rng, cookie_secret, sizeof(cookie_secret));
+    rng_bytes(&rng, &hash_seed, sizeof(hash_seed));
+    secure_wipe(&rng, sizeof(rng));
+
+    if (settings.global_rate != 0)
+        log_write(LOG_INFO, "Rate limiter: global budget %u/s (burst %u)", settings.global_rate, settings.global_burst);
+    if (settings.rate == 0)
+        return 0;
+
+    void *table;
+    if (posix_memalign(&table, 64, LIMIT_SETS * sizeof(limit_set)) != 0) {
+        errorhandler("Error, rate limiter allocation failed.\n");
+        return -1;
+    }
+    sets = table;
+    memset(sets, 0, LIMIT_SETS * sizeof(limit_set));
+    for (unsigned int i = 0; i < LIMIT_SETS; i++)
+        atomic_flag_clear(&sets[i].lock);
+
+    log_write(LOG_INFO, "Rate limiter: %u/s per source (burst %u), %u sources tracked", settings.rate,
+              settings.burst, LIMIT_SETS * LIMIT_WAYS);
+    return 0;
+}
+
+/**
+ * @brief Frees the source table.
+ */
+void limit_stop(void)
+{
+    free(sets);
+    sets = NULL;
+    secure_wipe(cookie_secret, sizeof(cookie_secret));
+    settings.rate = 0;
+    settings.global_rate = 0;
+}
+
+/**
+ * @brief Charges a request to its source bucket.
+ * @param[in] key: the source key.
+ * @param[in] cost: the tokens to take.
+ * @param[in] now: the current time from now_ms().
+ * @return non-zero if the source had the tokens.
+ */
+static int charge_source(uint64_t key, unsigned int cost, uint32_t now)
+{
+    // murmur3 finalizer of the seeded key
+    uint64_t h = key ^ hash_seed;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    limit_set *set = &sets[h & (LIMIT_SETS - 1)];
+    if (cost > settings.burst)
+        cost = settings.burst; // A request larger than the bucket empties it instead of never passing
+
+    while (atomic_flag_test_and_set_explicit(&set->lock, memory_order_acquire))
+        ;
+
+    limit_entry *e = NULL, *oldest = &set->ways[0];
+    for (int i = 0; i < LIMIT_WAYS; i++) {
+        limit_entry *w = &set->ways[i];
+        if (w->seen != 0 && w->key == key) {
+            e = w;
+            break;
+        }
+        // Free entries count as the oldest; otherwise the longest unseen source is evicted
+        if (w->seen == 0 || (oldest->seen != 0 && (uint32_t) (now - w->seen) > (uint32_t) (now - oldest->seen)))
+            oldest = w;
+    }
+    if (e == NULL) {
+        e = oldest;
+        e->key = key;
+        e->tokens = settings.burst * 1000;
+    } else
+        e->tokens = refill(e->tokens, now - e->seen, settings.rate, settings.burst);
+    e->seen = now;
+
+    int allowed = e->tokens >= cost * 1000;
+    if (allowed)
+        e->tokens -= cost * 1000;
+
+    atomic_flag_clear_explicit(&set->lock, memory_order_release);
+    return allowed;
+}
+
+/**
+ * @brief Charges a request to the global budget.
+ * @param[in] cost: the tokens to take.
+ * @param[in] now: the current time from now_ms().
+ * @return non-zero if the budget had the tokens.
+ */
+static int charge_global(unsigned int cost, uint32_t now)
+{
+    unsigned long long old = atomic_load_explicit(&global_bucket, memory_order_relaxed);
+    if (cost > settings.global_burst)
+        cost = settings.global_burst;
+    for (;;) {
+        uint32_t seen = (uint32_t) (old >> 32);
+        uint32_t elapsed = (int32_t) (now - seen) > 0 ? now - seen : 0; // Another worker may have a later time
+        uint32_t tokens = refill((uint32_t) old, elapsed, settings.global_rate, settings.global_burst);
+        if (tokens < cost * 1000)
+            return 0;
+        unsigned long long next = ((unsigned long long) (elapsed ? now : seen) << 32) | (tokens - cost * 1000);
+        if (atomic_compare_exchange_weak_explicit(&global_bucket, &old, next,
+                                                  memory_order_relaxed, memory_order_relaxed))
+            return 1;
+    }
+}
+
+/**
+ * @brief Charges a request to its source and to the global budget.
+ * @param[in] src: the source address.
+ * @param[in] cost: the tokens to take.
+ * @return LIMIT_PASS if the request may be served, the exhausted budget otherwise.
+ */
+limit_result limit_check(const struct sockaddr_storage *src, unsigned int cost)
+{
+    if (settings.rate == 0 && settings.global_rate == 0)
+        return LIMIT_PASS;
+
+    uint32_t now = now_ms();
+    if (settings.rate != 0 && !charge_source(source_key(src), cost, now))
+        return LIMIT_SOURCE;
+    if (settings.global_rate != 0 && !charge_global(cost, now))
+        return LIMIT_GLOBAL;
+    return LIMIT_PASS;
+}
+
+/**
+ * @brief Computes the cookie of a source for one period.
+ * @param[in] src: the source address, IPv4 or IPv6.
+ * @param[in] period: the period, seconds since the epoch divided by LIMIT_COOKIE_PERIOD.
+ * @param[out] cookie: the cookie.
+ */
+static void make_cookie(const struct sockaddr_storage *src, uint32_t period, unsigned char cookie[PROTO_COOKIE_SIZE])
+{
+    unsigned char address[16] = { [10] = 0xff, [11] = 0xff }; // IPv4 as IPv4-mapped: same cookie on both sockets
+    uint32_t port, subkey[8];
+    unsigned char block[AEAD_BLOCK];
+
+    if (src->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) src;
+        memcpy(address, a6->sin6_addr.s6_addr, sizeof(address));
+        port = ntohs(a6->sin6_port);
+    } else {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *) src;
+        memcpy(address + 12, &a4->sin_addr.s_addr, 4);
+        port = ntohs(a4->sin_port);
+    }
+    // Address-keyed subkey, then one block over the port and the period: a PRF of all three
+    uint32_t tail[4] = { period, port, 0, 0 };
+    aead_hchacha20(cookie_secret, address, subkey);
+    aead_chacha20_block(subkey, tail, block);
+    memcpy(cookie, block, PROTO_COOKIE_SIZE);
+    secure_wipe(subkey, sizeof(subkey));
+    secure_wipe(block, sizeof(block));
+}
+
+/**
+ * @brief Makes the cookie of a source for the current period.
+ * @param[in] src: the source address.
+ * @param[out] cookie: the cookie.
+ */
+void limit_cookie(const struct sockaddr_storage *src, unsigned char cookie[PROTO_COOKIE_SIZE])
+{
+    make_cookie(src, (uint32_t) (time(NULL) / LIMIT_COOKIE_PERIOD), cookie);
+}
+
+/**
+ * @brief Tells whether a reply may be sent to the source of its request.
+ * @param[in] src: the source address.
+ * @param[in] request: the size of the request in bytes.
+ * @param[in] reply: the most bytes the reply datagrams take together.
+ * @param[in] cookie: the cookie of the request, NULL if it has none.
+ * @return non-zero if the reply may be sent.
+ */
+int limit_address_ok(const struct sockaddr_storage *src, size_t request, size_t reply, const unsigned char *cookie)
+{
+    if (reply <= PROTO_AMPLIFICATION * request)
+        return 1;
+#if !defined WIN32
+    if (src->ss_family == AF_UNIX)
+        return 1; // Unix socket and shared-memory clients: the kernel gives the real sender
+#endif
+    if (cookie == NULL)
+        return 0;
+
+    uint32_t period = (uint32_t) (time(NULL) / LIMIT_COOKIE_PERIOD);
+    for (uint32_t age = 0; age < 2; age++) { // The current period, then the previous one
+        unsigned char expected[PROTO_COOKIE_SIZE], diff = 0;
+        make_cookie(src, period - age, expected);
+        for (int i = 0; i < PROTO_COOKIE_SIZE; i++) // Compared in constant time
+            diff |= expected[i] ^ cookie[i];
+        if (diff == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the name of a limiter outcome.
+ * @param[in] result: the outcome.
+ * @return a static string.
+ */
+const char *limit_name(limit_result result)
+{
+    static const char *names[LIMIT_KINDS] = { "pass", "source", "global" };
+    return (unsigned int) result < LIMIT_KINDS ? names[result] : "unknown";
+}
@@ -0,0 +1,113 @@
+/*
+ ============================================================================
+ Name        : serverLimit.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the per-source and global rate limiter and the address validation
+ ============================================================================
+ */
+#ifndef SERVER_LIMIT_H
+#define SERVER_LIMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../../common/protocol.h"
+
+struct sockaddr_storage;
+
+#define LIMIT_WAYS 3 // Sources per set: three 16-byte entries and the set lock fill one cache line
+
+#define LIMIT_SETS 32768 // Sets of the source table (power of two): 98304 sources in 2 MiB
+
+#define LIMIT_MAX_RATE 1000000 // Largest rate and burst: buckets hold thousandths of a token in 32 bits
+
+#define LIMIT_REPORT_INTERVAL 4096 // A worker logs a summary every this many dropped requests
+
+#define LIMIT_COOKIE_PERIOD 60 // Seconds between two cookie secrets: a cookie is accepted for 60 to 120 seconds
+
+// Rate limiter settings, rates in reply datagrams per second
+typedef struct {
+    unsigned int rate;          // Per-source refill rate, 0 disables the per-source limit
+    unsigned int burst;         // Per-source bucket size
+    unsigned int global_rate;   // Refill rate shared by every source, 0 disables the global budget
+    unsigned int global_burst;  // Global bucket size
+} limit_options;
+
+// Outcome of limit_check()
+typedef enum {
+    LIMIT_PASS,      // Within both budgets
+    LIMIT_SOURCE,    // The source address used up its bucket
+    LIMIT_GLOBAL,    // The global budget is used up
+    LIMIT_KINDS
+} limit_result;
+
+/**
+ * @brief Allocates the source table and fills the buckets.
+ *
+ * Also draws the cookie secret of limit_address_ok().
+ *
+ * @param[in] opt: the limiter settings; with both rates at 0 nothing is allocated
+ *            and limit_check() always passes.
+ * @return 0 on success, -1 if the table could not be allocated.
+ */
+int limit_start(const limit_options *opt);
+
+/**
+ * @brief Frees the source table.
+ */
+void limit_stop(void);
+
+/**
+ * @brief Charges a request to its source and to the global budget.
+ *
+ * A source is an IPv4 address, or the /64 prefix of an IPv6 address (one
+ * subscriber usually owns a whole /64); IPv4-mapped IPv6 addresses of a
+ * dual-stack socket count as their IPv4 address. The source table is
+ * set-associative: the source hashes to one set of LIMIT_WAYS entries, looked
+ * up under the set's spinlock; an unknown source replaces the least recently
+ * seen entry of its set. The memory is fixed and every check touches one cache
+ * line, whatever the number of sources. A source is charged before the global
+ * budget, so that a noisy client cannot drain the budget of the others.
+ *
+ * @param[in] src: the source address.
+ * @param[in] cost: the tokens to take, one per reply datagram the request asks for.
+ * @return LIMIT_PASS if the request may be served, the exhausted budget otherwise.
+ */
+limit_result limit_check(const struct sockaddr_storage *src, unsigned int cost);
+
+/**
+ * @brief Tells whether a reply may be sent to the source of its request.
+ *
+ * The anti-amplification rule of common/protocol.h: a reply of at most
+ * PROTO_AMPLIFICATION times the request is always sent; a larger one only to a
+ * Unix source, or when the request carries a cookie limit_cookie() gave this
+ * address and port in the current or the previous LIMIT_COOKIE_PERIOD. Cookies
+ * are the first bytes of a ChaCha20 block keyed by the address under a secret
+ * drawn by limit_start(), so they cost no state and cannot be guessed.
+ *
+ * @param[in] src: the source address.
+ * @param[in] request: the size of the request in bytes.
+ * @param[in] reply: the most bytes the reply datagrams take together.
+ * @param[in] cookie: the cookie of the request, NULL if it has none.
+ * @return non-zero if the reply may be sent, 0 if the source must get a cookie first.
+ */
+int limit_address_ok(const struct sockaddr_storage *src, size_t request, size_t reply, const unsigned char *cookie);
+
+/**
+ * @brief Makes the cookie of a source for the current period.
+ *
+ * @param[in] src: the source address, IPv4 or IPv6.
+ * @param[out] cookie: the cookie.
+ */
+void limit_cookie(const struct sockaddr_storage *src, unsigned char cookie[PROTO_COOKIE_SIZE]);
+
+/**
+ * @brief Returns the name of a limiter outcome ("pass", "source" or "global").
+ *
+ * @param[in] result: the outcome.
+ * @return a static string.
+ */
+const char *limit_name(limit_result result);
+
+#endif /* SERVER_LIMIT_H */
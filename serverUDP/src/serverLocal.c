@@ -0,0 +1,498 @@
+/*
+ ============================================================================
+ Name        : serverLocal.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the local transports: a Unix datagram socket
+               and shared-memory rings for the clients of the same host
+ ============================================================================
+ */
+
+#if defined __linux__
+#define _GNU_SOURCE // accept4, memfd_create, struct ucred
+#endif
+
+#include "server.h"
+#include "../../common/localRing.h" // Ring layout shared with the client
+
+#if !defined WIN32
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if !defined SOCK_CLOEXEC
+#define SOCK_CLOEXEC 0
+#endif
+
+/**
+ * @brief Makes the source address of a datagram usable as a key.
+ * @param[in,out] src: the source address.
+ * @param[in] length: the length returned by the receive call.
+ */
+void local_source(struct sockaddr_storage *src, socklen_t length)
+{
+    if (length < sizeof(sa_family_t))
+        src->ss_family = AF_UNSPEC;
+    else if (src->ss_family == AF_UNIX && length < sizeof(*src))
+        memset((char *) src + length, 0, sizeof(*src) - length);
+}
+
+/**
+ * @brief Binds a Unix socket to a path, replacing a stale socket left there.
+ * @param[in] sock: the socket.
+ * @param[in] path: the path.
+ * @param[in] type: the type of the socket, used to probe the path.
+ * @return 0 on success, -1 with errno set (EADDRINUSE if a server answers on the path).
+ */
+static int bind_path(int sock, const char *path, int type)
+{
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+
+    // Only a socket nobody answers on is removed: never a live endpoint or another kind of file
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr *) &sun, sizeof(sun)) == 0;
+        if (probe >= 0)
+            close(probe);
+        if (live) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+        unlink(path);
+    }
+    return bind(sock, (struct sockaddr *) &sun, sizeof(sun));
+}
+
+/**
+ * @brief Opens the Unix datagram endpoint of the local clients.
+ * @param[in] path: the path of the socket.
+ * @return the socket, -1 on error.
+ */
+int local_open_datagram(const char *path)
+{
+    int sock = upgrade_local_socket(path, SOCK_DGRAM); // Still receiving in the previous server
+    if (sock >= 0)
+        return sock;
+
+    sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        errorhandler("socket creation failed.\n");
+        return -1;
+    }
+    if (bind_path(sock, path, SOCK_DGRAM) < 0) {
+        log_write(LOG_ERROR, "Cannot bind the local socket %s: %s", path, strerror(errno));
+        errorhandler("bind() failed.\n");
+        close(sock);
+        return -1;
+    }
+
+    // A client that stops reading fills its receive queue: its replies are dropped instead of stalling the worker
+    struct timeval timeout = { 0, LOCAL_SEND_TIMEOUT_MS * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    log_write(LOG_INFO, "Local datagram socket: %s", path);
+    return sock;
+}
+
+#else
+
+/**
+ * @brief Makes the source address of a datagram usable as a key: nothing to do without Unix sockets.
+ * @param[in,out] src: the source address.
+ * @param[in] length: the length returned by the receive call.
+ */
+void local_source(struct sockaddr_storage *src, socklen_t length)
+{
+    (void) src;
+    (void) length;
+}
+
+/**
+ * @brief Opens the Unix datagram endpoint of the local clients.
+ * @param[in] path: the path of the socket.
+ * @return always -1: Unix sockets are not available.
+ */
+int local_open_datagram(const char *path)
+{
+    (void) path;
+    errorhandler("Error, local sockets are not supported on this system.\n");
+    return -1;
+}
+
+#endif
+
+#if defined __linux__
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#define LOCAL_EVENTS 64 // Events taken by one epoll_wait call
+
+#define LOCAL_POLL_ROUNDS 64 // Busy rounds over the rings between two looks at new and closed sessions
+
+// One client of the shared-memory rings
+typedef struct {
+    server_worker *w;
+    int conn;                        // Connection of the client: closing it ends the session
+    int bell;                        // eventfd written to wake the client
+    local_region *region;            // Mapped memory file shared with the client
+    struct sockaddr_storage source;  // Abstract name "ring-PID-N": the client address of handle_datagram()
+    int published;                   // Replies pushed since the client was last checked for sleep
+    int closed;                      // The connection is gone: freed after the current events
+} ring_session;
+
+// State of serve_rings()
+typedef struct {
+    server_worker *w;
+    int epoll_fd;
+    int doorbell;                    // eventfd shared by every client to wake the worker
+    ring_session *sessions[LOCAL_MAX_SESSIONS];
+    unsigned int count;
+    unsigned int serial;             // Sessions opened so far, names them
+} ring_server;
+
+/**
+ * @brief Opens the Unix socket on which the clients set up their shared-memory rings.
+ * @param[in] path: the path of the socket.
+ * @return the listening socket, -1 on error.
+ */
+int local_open_rings(const char *path)
+{
+    int sock = upgrade_local_socket(path, SOCK_SEQPACKET);
+    if (sock >= 0)
+        return sock;
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        errorhandler("socket creation failed.\n");
+        return -1;
+    }
+    if (bind_path(sock, path, SOCK_SEQPACKET) < 0 || listen(sock, SOMAXCONN) < 0) {
+        log_write(LOG_ERROR, "Cannot listen on the ring socket %s: %s", path, strerror(errno));
+        errorhandler("bind() failed.\n");
+        close(sock);
+        return -1;
+    }
+    log_write(LOG_INFO, "Shared-memory rings: sessions set up on %s", path);
+    return sock;
+}
+
+/**
+ * @brief Reply sink of the rings: publishes the datagram in the reply ring of the session.
+ * @param[in,out] ctx: the ring_session of the request.
+ * @param[in] data: the reply datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ */
+static void ring_reply(void *ctx, const unsigned char *data, size_t length)
+{
+    ring_session *s = ctx;
+    unsigned char sealed[PROTO_MAX_DATAGRAM];
+
+    if (seal_wanted(data, length)) {
+        memcpy(sealed, data, length);
+        length = seal_reply(&s->w->sealer, sealed, length);
+        data = sealed;
+        metric_add(&s->w->m->sealed, 1);
+    }
+    // A client that does not read its replies loses the new ones, as with a full socket buffer
+    int pushed = local_ring_push(&s->region->replies, data, length);
+    if (data == sealed)
+        secure_wipe(sealed, sizeof(sealed));
+    if (pushed < 0) {
+        metric_add(&s->w->m->send_failures, 1);
+        return;
+    }
+    metric_add(&s->w->m->datagrams_out, 1);
+    metric_add(&s->w->m->bytes_out, length);
+    s->published = 1;
+}
+
+/**
+ * @brief Wakes the client of a session if it waits for the replies just published.
+ * @param[in,out] s: the session.
+ */
+static void ring_wake(ring_session *s)
+{
+    if (!s->published)
+        return;
+    s->published = 0;
+    if (local_ring_asleep(&s->region->replies)) {
+        uint64_t one = 1;
+        if (write(s->bell, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            log_write(LOG_WARN, "Worker %d: ring client wake-up failed: %s", s->w->id, strerror(errno));
+    }
+}
+
+/**
+ * @brief Ends a session: unmaps its region and closes its descriptors.
+ * @param[in] rs: the ring server.
+ * @param[in,out] s: the session, freed.
+ */
+static void free_session(ring_server *rs, ring_session *s)
+{
+    epoll_ctl(rs->epoll_fd, EPOLL_CTL_DEL, s->conn, NULL);
+    close(s->conn);
+    close(s->bell);
+    secure_wipe(&s->region->replies, sizeof(s->region->replies)); // The replies left carry passwords
+    munmap(s->region, sizeof(local_region));
+    free(s);
+}
+
+/**
+ * @brief Accepts a client of the rings and sends it its memory file and eventfds.
+ * @param[in,out] rs: the ring server.
+ */
+static void open_session(ring_server *rs)
+{
+    int conn = accept4(rs->w->sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (conn < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+            log_write(LOG_ERROR, "Worker %d: ring session accept failed: %s", rs->w->id, strerror(errno));
+        return;
+    }
+    if (rs->count == LOCAL_MAX_SESSIONS) {
+        log_write(LOG_WARN, "Worker %d: %d ring sessions open, new client refused", rs->w->id, LOCAL_MAX_SESSIONS);
+        close(conn);
+        return;
+    }
+
+    struct ucred peer;
+    socklen_t peer_len = sizeof(peer);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) < 0)
+        peer.pid = 0;
+
+    ring_session *s = calloc(1, sizeof(*s));
+    // Sealed at its size: a client holding the descriptor cannot shrink the region under the server (SIGBUS)
+    int memfd = memfd_create("passgen-rings", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (s == NULL || memfd < 0 || ftruncate(memfd, sizeof(local_region)) < 0 ||
+        fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        log_write(LOG_ERROR, "Worker %d: ring session memory failed: %s", rs->w->id, strerror(errno));
+        goto fail;
+    }
+    s->w = rs->w;
+    s->conn = conn;
+    s->bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s->region = mmap(NULL, sizeof(local_region), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (s->bell < 0 || s->region == MAP_FAILED) {
+        log_write(LOG_ERROR, "Worker %d: ring session setup failed: %s", rs->w->id, strerror(errno));
+        if (s->bell >= 0)
+            close(s->bell);
+        goto fail;
+    }
+    s->region->magic = LOCAL_RING_MAGIC;
+    s->region->version = LOCAL_RING_VERSION;
+    s->region->slots = LOCAL_RING_SLOTS;
+    s->region->slot_size = sizeof(local_slot);
+
+    // One message: the header and the three descriptors
+    local_hello hello = { LOCAL_RING_MAGIC, LOCAL_RING_VERSION, sizeof(local_region) };
+    int fds[LOCAL_RING_FDS] = { memfd, rs->doorbell, s->bell };
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov = { &hello, sizeof(hello) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = s;
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) < 0 || epoll_ctl(rs->epoll_fd, EPOLL_CTL_ADD, conn, &event) < 0) {
+        log_write(LOG_WARN, "Worker %d: ring session setup failed: %s", rs->w->id, strerror(errno));
+        close(s->bell);
+        munmap(s->region, sizeof(local_region));
+        goto fail;
+    }
+    close(memfd); // The mappings keep the memory
+
+    struct sockaddr_un *name = (struct sockaddr_un *) &s->source;
+    name->sun_family = AF_UNIX;
+    snprintf(name->sun_path + 1, sizeof(name->sun_path) - 1, "ring-%d-%u", (int) peer.pid, ++rs->serial);
+    rs->sessions[rs->count++] = s;
+    log_write(LOG_INFO, "Worker %d: ring session of process %d opened (%u open)", rs->w->id, (int) peer.pid, rs->count);
+    return;
+
+fail:
+    if (memfd >= 0)
+        close(memfd);
+    free(s);
+    close(conn);
+}
+
+/**
+ * @brief Handles the events of one epoll_wait call.
+ * @param[in,out] rs: the ring server.
+ * @param[in] events: the events.
+ * @param[in] n: the number of events.
+ */
+static void handle_events(ring_server *rs, const struct epoll_event *events, int n)
+{
+    int opened = 0;
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.ptr == rs) {
+            opened = 1; // Accepted after the other events: the new sessions cannot be in this batch
+        } else if (events[i].data.ptr == &rs->doorbell) {
+            uint64_t rings;
+            if (read(rs->doorbell, &rings, sizeof(rings)) < 0 && errno != EAGAIN)
+                log_write(LOG_WARN, "Worker %d: ring doorbell read failed: %s", rs->w->id, strerror(errno));
+        } else {
+            ((ring_session *) events[i].data.ptr)->closed = 1; // The client sends nothing: any event is its end
+        }
+    }
+
+    for (unsigned int i = 0; i < rs->count; ) {
+        ring_session *s = rs->sessions[i];
+        if (s->closed) {
+            free_session(rs, s);
+            rs->sessions[i] = rs->sessions[--rs->count];
+            log_write(LOG_INFO, "Worker %d: ring session closed (%u open)", rs->w->id, rs->count);
+        } else
+            i++;
+    }
+    if (opened)
+        open_session(rs);
+}
+
+/**
+ * @brief Takes the requests of every ring, LOCAL_SESSION_BURST at a time.
+ * @param[in,out] rs: the ring server.
+ * @return the number of requests handled.
+ */
+static unsigned int serve_sessions(ring_server *rs)
+{
+    unsigned char request[PROTO_MAX_DATAGRAM];
+    unsigned int served = 0;
+
+    for (unsigned int i = 0; i < rs->count; i++) {
+        ring_session *s = rs->sessions[i];
+        unsigned int n;
+        for (n = 0; n < LOCAL_SESSION_BURST; n++) {
+            // Copied out of the ring first: the client cannot change the request while it is read
+            int length = local_ring_pop(&s->region->requests, request);
+            if (length < 0)
+                break;
+            handle_datagram(rs->w, &s->source, request, length, 0, ring_reply, s);
+        }
+        ring_wake(s);
+        served += n;
+    }
+    secure_wipe(request, sizeof(request));
+    return served;
+}
+
+/**
+ * @brief Serves the shared-memory ring sessions of the co-located clients.
+ * @param[in,out] w: the worker owning the listening socket.
+ * @return 0 when the socket was handed over, -1 on errors.
+ */
+int serve_rings(server_worker *w)
+{
+    ring_server *rs = calloc(1, sizeof(*rs));
+    if (rs == NULL) {
+        errorhandler("Error, ring sessions allocation failed.\n");
+        return -1;
+    }
+    rs->w = w;
+    rs->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    rs->doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int ret = -1;
+
+    // Non-blocking: after a hot upgrade both servers watch the listener until this one drains
+    struct epoll_event listener = { EPOLLIN, { .ptr = rs } }, doorbell = { EPOLLIN, { .ptr = &rs->doorbell } };
+    if (rs->epoll_fd < 0 || rs->doorbell < 0 ||
+        fcntl(w->sock, F_SETFL, fcntl(w->sock, F_GETFL) | O_NONBLOCK) < 0 ||
+        epoll_ctl(rs->epoll_fd, EPOLL_CTL_ADD, w->sock, &listener) < 0 ||
+        epoll_ctl(rs->epoll_fd, EPOLL_CTL_ADD, rs->doorbell, &doorbell) < 0) {
+        log_write(LOG_ERROR, "Worker %d: ring sessions setup failed: %s", w->id, strerror(errno));
+        goto out;
+    }
+
+    struct epoll_event events[LOCAL_EVENTS];
+    unsigned int busy_rounds = 0;
+    while (!upgrade_draining()) {
+        if (serve_sessions(rs) > 0) {
+            // Busy: no system call, but new and closed sessions are still looked at now and then
+            if (++busy_rounds == LOCAL_POLL_ROUNDS) {
+                busy_rounds = 0;
+                int n = epoll_wait(rs->epoll_fd, events, LOCAL_EVENTS, 0);
+                if (n > 0)
+                    handle_events(rs, events, n);
+            }
+            continue;
+        }
+
+        // Every ring is empty: sleep unless a client published after it was looked at
+        int ready = 0;
+        for (unsigned int i = 0; i < rs->count; i++)
+            ready |= !local_ring_sleep(&rs->sessions[i]->region->requests);
+        if (!ready) {
+            int n = epoll_wait(rs->epoll_fd, events, LOCAL_EVENTS, -1);
+            if (n < 0 && errno != EINTR) {
+                log_write(LOG_ERROR, "Worker %d: ring wait failed: %s", w->id, strerror(errno));
+                goto out;
+            }
+            if (n > 0)
+                handle_events(rs, events, n);
+        }
+        for (unsigned int i = 0; i < rs->count; i++)
+            __atomic_store_n(&rs->sessions[i]->region->requests.sleeping, 0, __ATOMIC_RELAXED);
+        busy_rounds = 0;
+    }
+    ret = 0;
+
+out:
+    // The sessions belong to this process: their clients connect again, to the next server after a hot upgrade
+    while (rs->count > 0)
+        free_session(rs, rs->sessions[--rs->count]);
+    if (rs->doorbell >= 0)
+        close(rs->doorbell);
+    if (rs->epoll_fd >= 0)
+        close(rs->epoll_fd);
+    free(rs);
+    return ret;
+}
+
+#else
+
+/**
+ * @brief Opens the Unix socket of the ring sessions.
+ * @param[in] path: the path of the socket.
+ * @return always -1: the rings need Linux (memfd_create, eventfd and epoll).
+ */
+int local_open_rings(const char *path)
+{
+    (void) path;
+    errorhandler("Error, shared-memory rings are only supported on Linux.\n");
+    return -1;
+}
+
+/**
+ * @brief Serves the shared-memory ring sessions.
+ * @param[in,out] w: the worker.
+ * @return always -1.
+ */
+int serve_rings(server_worker *w)
+{
+    (void) w;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ ============================================================================
+ Name        : serverLocal.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the local transports: a Unix datagram socket
+               and shared-memory rings for the clients of the same host
+ ============================================================================
+ */
+#ifndef SERVER_LOCAL_H
+#define SERVER_LOCAL_H
+
+#include "serverIO.h"
+
+struct sockaddr_storage;
+
+#define LOCAL_PATH_SIZE 108 // Longest local socket path, with its terminator (sun_path)
+
+#define LOCAL_SEND_TIMEOUT_MS 1 // Longest wait of a reply to a Unix client whose receive queue is full
+
+#define LOCAL_MAX_SESSIONS 256 // Shared-memory ring sessions served at once (about 720 KiB of rings each)
+
+#define LOCAL_SESSION_BURST 64 // Requests taken from one ring before the next ring is looked at
+
+/**
+ * @brief Opens the Unix datagram endpoint of the local clients.
+ *
+ * The socket speaks the UDP protocol unchanged and is served by a worker of
+ * its own, with the configured backend. Clients must bind their socket
+ * (an autobind is enough) to get replies. A reply to a client whose receive
+ * queue is full waits at most LOCAL_SEND_TIMEOUT_MS, then is dropped like a
+ * lost datagram. A socket taken over by a hot upgrade is reused; a stale path
+ * is replaced, a path another server listens on is an error.
+ *
+ * @param[in] path: the path of the socket.
+ * @return the socket, -1 on error.
+ */
+int local_open_datagram(const char *path);
+
+/**
+ * @brief Opens the Unix socket on which the clients set up their shared-memory rings.
+ *
+ * See common/localRing.h for the session setup and the ring layout.
+ * Same path rules as local_open_datagram().
+ *
+ * @param[in] path: the path of the socket.
+ * @return the listening socket, -1 on error (or on systems without memfd and eventfd).
+ */
+int local_open_rings(const char *path);
+
+/**
+ * @brief Serves the shared-memory ring sessions of the co-located clients.
+ *
+ * `w->sock` is the socket of local_open_rings(). Every session gets a memory
+ * file with a request and a reply ring (common/localRing.h); the loop takes the
+ * requests of every ring, LOCAL_SESSION_BURST at a time, through
+ * handle_datagram() and writes the replies to the reply ring of the session.
+ * When every ring is empty it sleeps in epoll on the doorbells, the listening
+ * socket and the session connections. A full reply ring drops the reply like
+ * a lost datagram. Sessions end when the client closes its connection, and
+ * all of them when the loop stops (the clients connect again).
+ *
+ * @param[in,out] w: the worker owning the listening socket.
+ * @return 0 when the socket was handed over to a new server, -1 on errors.
+ */
+int serve_rings(server_worker *w);
+
+/**
+ * @brief Makes the source address of a datagram usable as a key.
+ *
+ * Unix source addresses are as long as the sender's name and the receive loops
+ * reuse their address buffers: the bytes past the name are cleared, so that
+ * the reply cache and the rate limiter can hash the whole address. A sender
+ * without name gets the family AF_UNSPEC and no reply.
+ *
+ * @param[in,out] src: the source address.
+ * @param[in] length: the length returned by the receive call.
+ */
+void local_source(struct sockaddr_storage *src, socklen_t length);
+
+#endif /* SERVER_LOCAL_H */
@@ -0,0 +1,203 @@
+/*
+ ============================================================================
+ Name        : serverLog.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the asynchronous lock-free logger
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "serverLog.h"
+
+// One line of the ring; `sequence` tells producers and the consumer whose turn it is
+typedef struct {
+    atomic_size_t sequence;
+    log_level level;
+    char line[LOG_LINE_SIZE];
+} log_slot;
+
+static log_slot ring[LOG_RING_SIZE];
+static atomic_size_t head;          // Next slot claimed by a producer
+static size_t tail;                 // Next slot read by the log thread (only it touches tail)
+static atomic_ullong dropped;       // Lines lost because the ring was full
+static atomic_int running;
+static atomic_int stopping;
+static pthread_t log_thread;
+static log_level max_level = LOG_INFO;
+static unsigned int sample_every = 1;
+static __thread unsigned int sample_counter;
+
+static const char *level_names[] = { "error", "warn", "info", "debug" };
+
+/**
+ * @brief Writes every line currently in the ring to stdout.
+ * @return the number of lines written.
+ */
+static size_t drain(void)
+{
+    size_t written = 0;
+    for (;;) {
+        log_slot *slot = &ring[tail & (LOG_RING_SIZE - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != tail + 1)
+            break; // Empty, or the producer is still writing the line
+        printf("[%s] %s\n", level_names[slot->level], slot->line);
+        atomic_store_explicit(&slot->sequence, tail + LOG_RING_SIZE, memory_order_release);
+        tail++;
+        written++;
+    }
+    return written;
+}
+
+/**
+ * @brief Log thread: drains the ring and flushes stdout, pausing while it is empty.
+ * @param[in] arg: unused.
+ * @return always NULL.
+ */
+static void *log_main(void *arg)
+{
+    (void) arg;
+    unsigned long long reported = 0;
+
+    while (!atomic_load(&stopping)) {
+        if (drain() > 0)
+            fflush(stdout);
+        else
+            usleep(LOG_IDLE_US);
+
+        unsigned long long lost = atomic_load_explicit(&dropped, memory_order_relaxed);
+        if (lost != reported) {
+            printf("[warn] %llu log lines dropped (ring full)\n", lost - reported);
+            reported = lost;
+        }
+    }
+    drain();
+    fflush(stdout);
+    return NULL;
+}
+
+/**
+ * @brief Starts the background thread that writes the log lines to stdout.
+ * @param[in] level: lines less important than this level are discarded.
+ * @param[in] sample: log one request out of `sample`, 1 logs all.
+ * @return 0 on success, -1 if the thread could not be started.
+ */
+int log_start(log_level level, unsigned int sample)
+{
+    max_level = level;
+    sample_every = sample > 0 ? sample : 1;
+    for (size_t i = 0; i < LOG_RING_SIZE; i++)
+        atomic_init(&ring[i].sequence, i);
+    atomic_store(&head, 0);
+    tail = 0;
+    atomic_store(&stopping, 0);
+
+    if (pthread_create(&log_thread, NULL, log_main, NULL) != 0)
+        return -1;
+    atomic_store(&running, 1);
+    return 0;
+}
+
+/**
+ * @brief Writes the pending lines, reports the dropped ones and stops the log thread.
+ */
+void log_stop(void)
+{
+    if (!atomic_exchange(&running, 0))
+        return;
+    atomic_store(&stopping, 1);
+    pthread_join(log_thread, NULL);
+}
+
+/**
+ * @brief Checks whether lines of a level are currently written.
+ * @param[in] level: the level to check.
+ * @return non-zero if the level is enabled.
+ */
+int log_enabled(log_level level)
+{
+    return level <= max_level;
+}
+
+/**
+ * @brief Decides whether the current request should be logged.
+ * @return non-zero if the request should be logged.
+ */
+int log_sample(void)
+{
+    if (++sample_counter < sample_every)
+        return 0;
+    sample_counter = 0;
+    return 1;
+}
+
+/**
+ * @brief Queues a formatted line for the log thread.
+ * @param[in] level: the level of the line.
+ * @param[in] format: printf-style format, without the trailing newline.
+ */
+void log_write(log_level level, const char *format, ...)
+{
+    va_list args;
+
+    if (level > max_level)
+        return;
+
+    if (!atomic_load_explicit(&running, memory_order_relaxed)) {
+        // No log thread (startup, benchmarks): write directly
+        va_start(args, format);
+        printf("[%s] ", level_names[level]);
+        vprintf(format, args);
+        printf("\n");
+        va_end(args);
+        return;
+    }
+
+    // Claim a slot (bounded MPMC ring with per-slot sequence numbers)
+    size_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+    log_slot *slot;
+    for (;;) {
+        slot = &ring[pos & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed); // Full: never wait
+            return;
+        } else
+            pos = atomic_load_explicit(&head, memory_order_relaxed);
+    }
+
+    slot->level = level;
+    va_start(args, format);
+    vsnprintf(slot->line, LOG_LINE_SIZE, format, args);
+    va_end(args);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+/**
+ * @brief Parses a level name ("error", "warn", "info" or "debug").
+ * @param[in] name: the level name.
+ * @param[out] level: the matching level.
+ * @return 0 if the name is known, -1 otherwise.
+ */
+int log_parse(const char *name, log_level *level)
+{
+    for (int i = LOG_ERROR; i <= LOG_DEBUG; i++) {
+        if (strcmp(name, level_names[i]) == 0) {
+            *level = (log_level) i;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,79 @@
+/*
+ ============================================================================
+ Name        : serverLog.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the asynchronous lock-free logger
+ ============================================================================
+ */
+#ifndef SERVER_LOG_H
+#define SERVER_LOG_H
+
+#define LOG_RING_SIZE 4096 // Lines buffered between the workers and the log thread (power of two)
+
+#define LOG_LINE_SIZE 160 // Maximum length of a log line, longer lines are truncated
+
+#define LOG_IDLE_US 2000 // Pause of the log thread when the ring is empty, in microseconds
+
+// Log levels, from the most to the least important
+typedef enum {
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+} log_level;
+
+/**
+ * @brief Starts the background thread that writes the log lines to stdout.
+ *
+ * @param[in] level: lines less important than this level are discarded.
+ * @param[in] sample: log one request out of `sample` (see log_sample()), 1 logs all.
+ * @return 0 on success, -1 if the thread could not be started.
+ */
+int log_start(log_level level, unsigned int sample);
+
+/**
+ * @brief Writes the pending lines, reports the dropped ones and stops the log thread.
+ */
+void log_stop(void);
+
+/**
+ * @brief Checks whether lines of a level are currently written.
+ *
+ * @param[in] level: the level to check.
+ * @return non-zero if the level is enabled.
+ */
+int log_enabled(log_level level);
+
+/**
+ * @brief Decides whether the current request should be logged.
+ *
+ * Counts the calls per thread and returns true once every `sample` calls,
+ * so that per-request logging costs nothing for the skipped requests.
+ *
+ * @return non-zero if the request should be logged.
+ */
+int log_sample(void);
+
+/**
+ * @brief Queues a formatted line for the log thread.
+ *
+ * Never blocks: the line is formatted by the caller and pushed on a lock-free
+ * ring; if the ring is full the line is dropped and counted.
+ *
+ * @param[in] level: the level of the line.
+ * @param[in] format: printf-style format, without the trailing newline.
+ */
+void log_write(log_level level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Parses a level name ("error", "warn", "info" or "debug").
+ *
+ * @param[in] name: the level name.
+ * @param[out] level: the matching level.
+ * @return 0 if the name is known, -1 otherwise.
+ */
+int log_parse(const char *name, log_level *level);
+
+#endif /* SERVER_LOG_H */
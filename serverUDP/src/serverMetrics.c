@@ -0,0 +1,368 @@
+/*
+ ============================================================================
+ Name        : serverMetrics.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the per-worker counters and the Prometheus text endpoint
+ ============================================================================
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "server.h"
+
+#if !defined WIN32
+#include <sys/select.h>
+#endif
+
+#if !defined MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // Windows sockets never raise SIGPIPE
+#endif
+
+// Text of one response, grown as needed
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} text_buffer;
+
+static worker_metrics **blocks;   // Registered workers, in attach order
+static int *block_ids;
+static unsigned int block_count;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t endpoint_thread;
+static int endpoint_sock = -1;
+static atomic_int endpoint_running;
+static atomic_int stopping;
+static atomic_int timing;
+
+/**
+ * @brief Allocates the counters of a worker and registers them with the endpoint.
+ * @param[in] id: the worker index.
+ * @return the zeroed counters, NULL if the memory could not be obtained.
+ */
+worker_metrics *metrics_attach(int id)
+{
+    void *block;
+    if (posix_memalign(&block, METRICS_LINE, sizeof(worker_metrics)) != 0)
+        return NULL;
+    memset(block, 0, sizeof(worker_metrics));
+
+    pthread_mutex_lock(&blocks_lock);
+    worker_metrics **grown = realloc(blocks, (block_count + 1) * sizeof(*blocks));
+    int *grown_ids = grown ? realloc(block_ids, (block_count + 1) * sizeof(*block_ids)) : NULL;
+    if (grown)
+        blocks = grown;
+    if (grown_ids)
+        block_ids = grown_ids;
+    if (!grown || !grown_ids) {
+        pthread_mutex_unlock(&blocks_lock);
+        free(block);
+        return NULL;
+    }
+    blocks[block_count] = block;
+    block_ids[block_count] = id;
+    block_count++;
+    pthread_mutex_unlock(&blocks_lock);
+    return block;
+}
+
+/**
+ * @brief Checks whether the latency histograms are recorded.
+ * @return non-zero once metrics_start() succeeded.
+ */
+int metrics_timing(void)
+{
+    return atomic_load_explicit(&timing, memory_order_relaxed);
+}
+
+/**
+ * @brief Appends formatted text to a buffer.
+ * @param[in,out] b: the buffer.
+ * @param[in] format: printf-style format.
+ * @return 0 on success, -1 if the buffer could not grow.
+ */
+static int appendf(text_buffer *b, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static int appendf(text_buffer *b, const char *format, ...)
+{
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(b->data + b->length, b->capacity - b->length, format, args);
+        va_end(args);
+        if (n < 0)
+            return -1;
+        if ((size_t) n < b->capacity - b->length) {
+            b->length += n;
+            return 0;
+        }
+        size_t capacity = b->capacity * 2 + n;
+        char *grown = realloc(b->data, capacity);
+        if (grown == NULL)
+            return -1;
+        b->data = grown;
+        b->capacity = capacity;
+    }
+}
+
+/**
+ * @brief Reads a counter written by another thread.
+ * @param[in] c: the counter.
+ * @return its current value.
+ */
+static unsigned long long get(const metric_counter *c)
+{
+    return atomic_load_explicit((metric_counter *) c, memory_order_relaxed);
+}
+
+/**
+ * @brief Appends the HELP and TYPE lines of a metric.
+ * @param[in,out] b: the buffer.
+ * @param[in] name: the metric name.
+ * @param[in] type: "counter" or "histogram".
+ * @param[in] help: the description.
+ */
+static void header(text_buffer *b, const char *name, const char *type, const char *help)
+{
+    appendf(b, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief Appends one counter per worker, read at the same offset of every block.
+ * @param[in,out] b: the buffer.
+ * @param[in] name: the metric name.
+ * @param[in] help: the description.
+ * @param[in] offset: the offset of the counter in worker_metrics.
+ */
+static void per_worker(text_buffer *b, const char *name, const char *help, size_t offset)
+{
+    header(b, name, "counter", help);
+    for (unsigned int i = 0; i < block_count; i++)
+        appendf(b, "%s{worker=\"%d\"} %llu\n", name, block_ids[i],
+                get((const metric_counter *) ((const char *) blocks[i] + offset)));
+}
+
+/**
+ * @brief Appends a histogram per worker, with cumulative buckets in seconds.
+ * @param[in,out] b: the buffer.
+ * @param[in] name: the metric name.
+ * @param[in] help: the description.
+ * @param[in] offset: the offset of the histogram in worker_metrics.
+ */
+static void histogram(text_buffer *b, const char *name, const char *help, size_t offset)
+{
+    header(b, name, "histogram", help);
+    for (unsigned int i = 0; i < block_count; i++) {
+        const metric_histogram *h = (const metric_histogram *) ((const char *) blocks[i] + offset);
+        unsigned long long total = 0;
+        for (int k = 0; k < METRICS_BUCKETS - 1; k++) {
+            total += get(&h->buckets[k]);
+            appendf(b, "%s_bucket{worker=\"%d\",le=\"%g\"} %llu\n", name, block_ids[i],
+                    (double) (1ull << (METRICS_MIN_SHIFT + k)) / 1e9, total);
+        }
+        total += get(&h->buckets[METRICS_BUCKETS - 1]);
+        // _count repeats the +Inf bucket: the buckets were not read atomically with the count
+        appendf(b, "%s_bucket{worker=\"%d\",le=\"+Inf\"} %llu\n", name, block_ids[i], total);
+        appendf(b, "%s_sum{worker=\"%d\"} %.9f\n", name, block_ids[i], get(&h->sum_ns) / 1e9);
+        appendf(b, "%s_count{worker=\"%d\"} %llu\n", name, block_ids[i], total);
+    }
+}
+
+/**
+ * @brief Renders every registered block as Prometheus text.
+ * @param[in,out] b: the buffer.
+ */
+static void render(text_buffer *b)
+{
+    pthread_mutex_lock(&blocks_lock);
+
+    header(b, "passgen_requests_total", "counter", "Request datagrams by validation outcome.");
+    for (unsigned int i = 0; i < block_count; i++)
+        for (int r = 0; r < REJECT_KINDS; r++)
+            appendf(b, "passgen_requests_total{worker=\"%d\",outcome=\"%s\"} %llu\n", block_ids[i],
+                    r == REJECT_NONE ? "accepted" : reject_name(r), get(&blocks[i]->requests[r]));
+
+    header(b, "passgen_dropped_total", "counter", "Datagrams dropped without reply by the rate limiter.");
+    for (unsigned int i = 0; i < block_count; i++)
+        for (int r = LIMIT_SOURCE; r < LIMIT_KINDS; r++)
+            appendf(b, "passgen_dropped_total{worker=\"%d\",budget=\"%s\"} %llu\n", block_ids[i],
+                    limit_name(r), get(&blocks[i]->dropped[r]));
+
+    header(b, "passgen_passwords_by_type_total", "counter", "Passwords requested, by type.");
+    for (unsigned int i = 0; i < block_count; i++) {
+        for (int t = 0; t < METRICS_CUSTOM_TYPE; t++)
+            appendf(b, "passgen_passwords_by_type_total{worker=\"%d\",type=\"%c\"} %llu\n", block_ids[i],
+                    PASSWORD_TYPES[t], get(&blocks[i]->by_type[t]));
+        appendf(b, "passgen_passwords_by_type_total{worker=\"%d\",type=\"custom\"} %llu\n", block_ids[i],
+                get(&blocks[i]->by_type[METRICS_CUSTOM_TYPE]));
+        appendf(b, "passgen_passwords_by_type_total{worker=\"%d\",type=\"%c\"} %llu\n", block_ids[i],
+                PROTO_TYPE_PASSPHRASE, get(&blocks[i]->by_type[METRICS_PASSPHRASE_TYPE]));
+    }
+
+    header(b, "passgen_passwords_by_length_total", "counter", "Passwords requested, by length.");
+    for (unsigned int i = 0; i < block_count; i++)
+        for (int l = 0; l <= PROTO_MAX_LENGTH; l++)
+            if (get(&blocks[i]->by_length[l]) > 0)
+                appendf(b, "passgen_passwords_by_length_total{worker=\"%d\",length=\"%d\"} %llu\n", block_ids[i],
+                        l, get(&blocks[i]->by_length[l]));
+
+    per_worker(b, "passgen_received_datagrams_total", "Datagrams received.",
+               offsetof(worker_metrics, datagrams_in));
+    per_worker(b, "passgen_received_bytes_total", "Bytes received.", offsetof(worker_metrics, bytes_in));
+    per_worker(b, "passgen_sent_datagrams_total", "Reply datagrams sent.", offsetof(worker_metrics, datagrams_out));
+    per_worker(b, "passgen_sent_bytes_total", "Reply bytes sent.", offsetof(worker_metrics, bytes_out));
+    per_worker(b, "passgen_send_failures_total", "Reply datagrams the kernel refused.",
+               offsetof(worker_metrics, send_failures));
+    per_worker(b, "passgen_pool_hits_total", "Passwords taken from the pre-generated pool.",
+               offsetof(worker_metrics, pool_hits));
+    per_worker(b, "passgen_pool_misses_total", "Passwords generated inline.", offsetof(worker_metrics, pool_misses));
+    per_worker(b, "passgen_replays_total", "Retransmitted batch requests answered from the reply cache.",
+               offsetof(worker_metrics, replays));
+    per_worker(b, "passgen_address_retries_total", "Requests answered PROTO_STATUS_RETRY to validate their address.",
+               offsetof(worker_metrics, retries));
+    per_worker(b, "passgen_sealed_replies_total", "Reply datagrams sealed with the pre-shared key.",
+               offsetof(worker_metrics, sealed));
+    histogram(b, "passgen_generation_seconds", "Time spent generating the passwords of a request.",
+              offsetof(worker_metrics, generation));
+    histogram(b, "passgen_queueing_seconds", "Time between the kernel receiving a request and its handling.",
+              offsetof(worker_metrics, queueing));
+
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+/**
+ * @brief Answers one scrape connection and closes it.
+ * @param[in] client: the accepted connection.
+ */
+static void answer(int client)
+{
+    char request[1024];
+    text_buffer body = { malloc(16384), 0, 16384 };
+
+    // A scraper that connects and stays silent, or stops reading, only delays the next one
+#if defined WIN32
+    DWORD limit = METRICS_IO_TIMEOUT_MS;
+#else
+    struct timeval limit = { METRICS_IO_TIMEOUT_MS / 1000, (METRICS_IO_TIMEOUT_MS % 1000) * 1000 };
+#endif
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char *) &limit, sizeof(limit));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char *) &limit, sizeof(limit));
+
+    recv(client, request, sizeof(request), 0); // Any request gets the metrics
+    if (body.data != NULL) {
+        render(&body);
+        char head[128];
+        int n = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %zu\r\n\r\n", body.length);
+        send(client, head, n, MSG_NOSIGNAL); // A reset connection must not raise SIGPIPE
+        for (size_t sent = 0; sent < body.length;) {
+            int r = send(client, body.data + sent, body.length - sent, MSG_NOSIGNAL);
+            if (r <= 0)
+                break;
+            sent += r;
+        }
+    }
+    free(body.data);
+    closesocket(client);
+}
+
+/**
+ * @brief Endpoint thread: accepts scrape connections until metrics_stop().
+ * @param[in] arg: unused.
+ * @return always NULL.
+ */
+static void *endpoint_main(void *arg)
+{
+    (void) arg;
+    while (!atomic_load(&stopping)) {
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(endpoint_sock, &ready);
+        struct timeval wait = { 0, METRICS_POLL_MS * 1000 };
+        if (select(endpoint_sock + 1, &ready, NULL, NULL, &wait) <= 0)
+            continue;
+        int client = accept(endpoint_sock, NULL, NULL);
+        if (client >= 0)
+            answer(client);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Starts the thread that serves the counters as Prometheus text.
+ * @param[in] port: the TCP port of the endpoint.
+ * @param[in] sock: a socket already listening on the port, -1 to create one.
+ * @return 0 on success, -1 if the socket or the thread could not be created.
+ */
+int metrics_start(int port, int sock)
+{
+    endpoint_sock = sock;
+    if (endpoint_sock < 0) {
+        endpoint_sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (endpoint_sock < 0) {
+            errorhandler("Error, metrics socket creation failed.\n");
+            return -1;
+        }
+        int one = 1;
+        setsockopt(endpoint_sock, SOL_SOCKET, SO_REUSEADDR, (const char *) &one, sizeof(one));
+
+        struct sockaddr_in sad;
+        memset(&sad, 0, sizeof(sad));
+        sad.sin_family = AF_INET;
+        sad.sin_addr.s_addr = inet_addr("127.0.0.1"); // Local scrapers only
+        sad.sin_port = htons(port);
+        if (bind(endpoint_sock, (struct sockaddr *) &sad, sizeof(sad)) < 0 || listen(endpoint_sock, 16) < 0) {
+            errorhandler("Error, metrics endpoint bind() failed.\n");
+            closesocket(endpoint_sock);
+            endpoint_sock = -1;
+            return -1;
+        }
+    }
+
+    atomic_store(&stopping, 0);
+    if (pthread_create(&endpoint_thread, NULL, endpoint_main, NULL) != 0) {
+        errorhandler("Error, metrics thread creation failed.\n");
+        closesocket(endpoint_sock);
+        endpoint_sock = -1;
+        return -1;
+    }
+    atomic_store(&endpoint_running, 1);
+    atomic_store(&timing, 1);
+    log_write(LOG_INFO, "Metrics endpoint: http://127.0.0.1:%d/metrics", port);
+    return 0;
+}
+
+/**
+ * @brief Returns the listening socket of the endpoint.
+ * @return the socket, -1 when the endpoint is not running.
+ */
+int metrics_listener(void)
+{
+    return atomic_load(&endpoint_running) ? endpoint_sock : -1;
+}
+
+/**
+ * @brief Stops the endpoint thread and frees every registered block.
+ */
+void metrics_stop(void)
+{
+    if (atomic_exchange(&endpoint_running, 0)) {
+        atomic_store(&stopping, 1);
+        pthread_join(endpoint_thread, NULL);
+        closesocket(endpoint_sock);
+        endpoint_sock = -1;
+    }
+    atomic_store(&timing, 0);
+
+    pthread_mutex_lock(&blocks_lock);
+    for (unsigned int i = 0; i < block_count; i++)
+        free(blocks[i]);
+    free(blocks);
+    free(block_ids);
+    blocks = NULL;
+    block_ids = NULL;
+    block_count = 0;
+    pthread_mutex_unlock(&blocks_lock);
+}
@@ -0,0 +1,156 @@
+/*
+ ============================================================================
+ Name        : serverMetrics.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the per-worker counters and the metrics endpoint
+ ============================================================================
+ */
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <stdatomic.h>
+#include <time.h>
+#include "serverValidate.h"
+#include "serverLimit.h"
+#include "../../common/protocol.h"
+
+#define METRICS_LINE 64 // Cache line size: every worker's block starts on its own line
+
+#define METRICS_TYPES 7 // One counter per password type of PASSWORD_TYPES, then the custom and passphrase ones
+
+#define METRICS_CUSTOM_TYPE 5 // Counter of the configured types and request policies
+
+#define METRICS_PASSPHRASE_TYPE 6 // Counter of the passphrases
+
+#define METRICS_MIN_SHIFT 8 // Upper bound of the first histogram bucket: 2^8 ns
+
+#define METRICS_BUCKETS 24 // Histogram buckets: powers of two from 256 ns to 1 s, then +Inf
+
+#define METRICS_POLL_MS 200 // Longest wait of the endpoint thread before it checks for shutdown
+
+#define METRICS_IO_TIMEOUT_MS 1000 // Longest wait of a scrape connection for its request or for room to send
+
+// A counter written by one worker only and read by the endpoint thread
+typedef atomic_ullong metric_counter;
+
+// Latency histogram with power-of-two buckets (bucket i counts values up to 2^(METRICS_MIN_SHIFT + i) ns)
+typedef struct {
+    metric_counter buckets[METRICS_BUCKETS];
+    metric_counter sum_ns;
+    metric_counter count;
+} metric_histogram;
+
+// Counters of one worker, aligned and padded to whole cache lines
+typedef struct {
+    _Alignas(METRICS_LINE) metric_counter requests[REJECT_KINDS]; // Datagrams by validation outcome ([REJECT_NONE]: accepted)
+    metric_counter rejected;                         // Datagrams rejected, all reasons
+    metric_counter dropped[LIMIT_KINDS];             // Datagrams dropped by the rate limiter, by budget ([LIMIT_PASS] unused)
+    metric_counter by_type[METRICS_TYPES];           // Passwords requested, by type
+    metric_counter by_length[PROTO_MAX_LENGTH + 1];  // Passwords requested, by length
+    metric_counter datagrams_in;                     // Datagrams received
+    metric_counter bytes_in;                         // Bytes received
+    metric_counter datagrams_out;                    // Reply datagrams sent
+    metric_counter bytes_out;                        // Reply bytes sent
+    metric_counter send_failures;                    // Reply datagrams the kernel refused
+    metric_counter pool_hits;                        // Passwords taken from the pre-generated pool
+    metric_counter pool_misses;                      // Passwords generated inline because the pool was empty or disabled
+    metric_counter replays;                          // Batch requests answered again from the reply cache
+    metric_counter retries;                          // Requests answered PROTO_STATUS_RETRY to validate their address
+    metric_counter sealed;                           // Reply datagrams sealed with the pre-shared key
+    metric_histogram generation;                     // Time spent generating the passwords of a request
+    metric_histogram queueing;                       // Time between the kernel receiving a datagram and its handling
+} worker_metrics;
+
+/**
+ * @brief Adds to a counter.
+ *
+ * Only the owning worker writes its counters, so a relaxed load and store
+ * replace the locked read-modify-write: on x86-64 this is a plain add to memory.
+ *
+ * @param[in,out] c: the counter.
+ * @param[in] n: the amount to add.
+ */
+static inline void metric_add(metric_counter *c, unsigned long long n)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/**
+ * @brief Records a duration in a histogram.
+ *
+ * @param[in,out] h: the histogram, written by its owning worker only.
+ * @param[in] ns: the duration in nanoseconds.
+ */
+static inline void metric_observe(metric_histogram *h, unsigned long long ns)
+{
+    unsigned int i = 0;
+    if (ns > (1ull << METRICS_MIN_SHIFT)) {
+        i = 64 - __builtin_clzll(ns - 1) - METRICS_MIN_SHIFT;
+        if (i > METRICS_BUCKETS - 1)
+            i = METRICS_BUCKETS - 1;
+    }
+    metric_add(&h->buckets[i], 1);
+    metric_add(&h->sum_ns, ns);
+    metric_add(&h->count, 1);
+}
+
+/**
+ * @brief Reads a clock in nanoseconds.
+ *
+ * @param[in] clock: CLOCK_MONOTONIC for durations, CLOCK_REALTIME to compare with kernel timestamps.
+ * @return the time in nanoseconds.
+ */
+static inline unsigned long long metrics_clock(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Allocates the counters of a worker and registers them with the endpoint.
+ *
+ * The block is cache-line aligned, so that no two workers ever write the
+ * same line. It stays valid until metrics_stop().
+ *
+ * @param[in] id: the worker index, used as the `worker` label.
+ * @return the zeroed counters, NULL if the memory could not be obtained.
+ */
+worker_metrics *metrics_attach(int id);
+
+/**
+ * @brief Starts the thread that serves the counters as Prometheus text.
+ *
+ * The endpoint listens on 127.0.0.1 only and answers every connection with
+ * an HTTP/1.0 response, whatever the request path. Starting it also enables
+ * the two histograms, which cost two clock reads per request.
+ *
+ * @param[in] port: the TCP port of the endpoint.
+ * @param[in] sock: a socket already listening on the port (taken over from
+ *            a previous server), -1 to create one.
+ * @return 0 on success, -1 if the socket or the thread could not be created.
+ */
+int metrics_start(int port, int sock);
+
+/**
+ * @brief Stops the endpoint thread and frees every registered block.
+ */
+void metrics_stop(void);
+
+/**
+ * @brief Returns the listening socket of the endpoint, to hand it over to a new server.
+ *
+ * @return the socket, -1 when the endpoint is not running.
+ */
+int metrics_listener(void);
+
+/**
+ * @brief Checks whether the latency histograms are recorded.
+ *
+ * @return non-zero once metrics_start() succeeded.
+ */
+int metrics_timing(void);
+
+#endif /* SERVER_METRICS_H */
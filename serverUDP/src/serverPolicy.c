@@ -0,0 +1,99 @@
+/*
+ ============================================================================
+ Name        : serverPolicy.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the password types served: built-in and configured policies
+ ============================================================================
+ */
+
+#include "server.h"
+
+static passgen_policy configured[POLICY_MAX];     // Compiled configured types
+static const passgen_policy *types[256];          // Policy of every type letter, NULL if not served
+static passgen_wordlist words;                    // Wordlist of the passphrases
+static int words_open;                            // Non-zero once `words` is mapped
+
+/**
+ * @brief Checks a configured password type and adds it to the settings.
+ * @param[in,out] opt: the settings.
+ * @param[in] value: the setting, "X:SPEC".
+ * @return 0 on success, -1 if the setting is not valid or POLICY_MAX types are configured.
+ */
+int policy_add(policy_options *opt, const char *value)
+{
+    passgen_policy p;
+    unsigned char type = (unsigned char) value[0];
+
+    if (type == '\0' || value[1] != ':' || strlen(value) >= POLICY_SPEC_SIZE ||
+        !isgraph(type) || strchr(PASSWORD_TYPES, type) != NULL || type == PROTO_TYPE_POLICY ||
+        type == PROTO_TYPE_PASSPHRASE || type == PROTO_MAGIC || passgen_policy_compile(&p, value + 2) < 0)
+        return -1;
+
+    unsigned int i = 0;
+    while (i < opt->count && opt->specs[i][0] != (char) type)
+        i++;
+    if (i == POLICY_MAX)
+        return -1;
+    strcpy(opt->specs[i], value);
+    if (i == opt->count)
+        opt->count++;
+    return 0;
+}
+
+/**
+ * @brief Compiles the configured types and maps the wordlist.
+ * @param[in] opt: the settings.
+ * @return 0 on success, -1 on error.
+ */
+int policy_start(const policy_options *opt)
+{
+    for (int i = 0; PASSWORD_TYPES[i] != '\0'; i++)
+        types[(unsigned char) PASSWORD_TYPES[i]] = passgen_builtin(PASSWORD_TYPES[i]);
+    for (unsigned int i = 0; i < opt->count; i++) {
+        if (passgen_policy_compile(&configured[i], opt->specs[i] + 2) < 0) {
+            fprintf(stderr, "Invalid policy %s\n", opt->specs[i]);
+            return -1;
+        }
+        types[(unsigned char) opt->specs[i][0]] = &configured[i];
+    }
+    if (opt->wordlist[0] != '\0') {
+        if (wordlist_open(&words, opt->wordlist) < 0) {
+            fprintf(stderr, "Cannot load the wordlist %s: %s\n", opt->wordlist,
+                    errno == EINVAL ? "not an indexed wordlist (see scripts/wordlist_index.py)" : strerror(errno));
+            return -1;
+        }
+        words_open = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Unmaps the wordlist.
+ */
+void policy_stop(void)
+{
+    if (words_open)
+        wordlist_close(&words);
+    words_open = 0;
+}
+
+/**
+ * @brief Returns the policy of a password type.
+ * @param[in] type: the requested type.
+ * @return the policy, NULL if the type is not served.
+ */
+const passgen_policy *policy_find(unsigned char type)
+{
+    return types[type];
+}
+
+/**
+ * @brief Returns the wordlist of the passphrases.
+ * @return the list, NULL if none.
+ */
+const passgen_wordlist *policy_wordlist(void)
+{
+    return words_open ? &words : NULL;
+}
@@ -0,0 +1,72 @@
+/*
+ ============================================================================
+ Name        : serverPolicy.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the password types served: built-in and configured policies
+ ============================================================================
+ */
+#ifndef SERVER_POLICY_H
+#define SERVER_POLICY_H
+
+#include "passgen.h"
+
+#define POLICY_MAX 16 // Most configured password types
+
+#define POLICY_SPEC_SIZE 256 // Longest configured "X:SPEC" setting, with its terminator
+
+#define POLICY_PATH_SIZE 256 // Longest wordlist path, with its terminator
+
+// Configured password types, each a letter and a passgen_policy_compile() specification, and the passphrase wordlist
+typedef struct {
+    char specs[POLICY_MAX][POLICY_SPEC_SIZE]; // "X:SPEC", checked by policy_add()
+    unsigned int count;                       // Entries of specs
+    char wordlist[POLICY_PATH_SIZE];          // Indexed wordlist of the passphrases, "" if none
+} policy_options;
+
+/**
+ * @brief Checks a configured password type and adds it to the settings.
+ *
+ * The setting is "X:SPEC": requests of type X get passwords following the
+ * policy SPEC, for example "p:base=s upper=2 digit=2 symbol=1". X must not be
+ * a built-in type, PROTO_TYPE_POLICY, PROTO_TYPE_PASSPHRASE or PROTO_MAGIC; configuring X again
+ * replaces its policy.
+ *
+ * @param[in,out] opt: the settings.
+ * @param[in] value: the setting.
+ * @return 0 on success, -1 if the setting is not valid or POLICY_MAX types are configured.
+ */
+int policy_add(policy_options *opt, const char *value);
+
+/**
+ * @brief Compiles the configured types into the table read by policy_find() and maps the wordlist.
+ *
+ * Must be called once, before the workers start; the table and the list are then only read.
+ *
+ * @param[in] opt: the settings, checked by policy_add().
+ * @return 0 on success, -1 if a policy does not compile or the wordlist cannot be opened (reported on stderr).
+ */
+int policy_start(const policy_options *opt);
+
+/**
+ * @brief Unmaps the wordlist.
+ */
+void policy_stop(void);
+
+/**
+ * @brief Returns the policy of a password type: one lookup in a 256-entry table.
+ *
+ * @param[in] type: the requested type.
+ * @return the built-in or configured policy, NULL if the type is not served.
+ */
+const passgen_policy *policy_find(unsigned char type);
+
+/**
+ * @brief Returns the wordlist of the passphrases.
+ *
+ * @return the list, NULL if no wordlist is configured (PROTO_TYPE_PASSPHRASE is not served).
+ */
+const passgen_wordlist *policy_wordlist(void);
+
+#endif /* SERVER_POLICY_H */
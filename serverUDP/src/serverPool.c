@@ -0,0 +1,301 @@
+/*
+ ============================================================================
+ Name        : serverPool.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the pre-generated password pool
+ ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "server.h"
+
+// One pre-generated password; `sequence` tells producers and consumers whose turn it is
+typedef struct {
+    atomic_size_t sequence;
+    char password[POOL_ENTRY];
+} pool_slot;
+
+// Bounded MPMC ring of one password type (same scheme as the logger ring)
+typedef struct {
+    pool_slot *slots;
+    size_t mask;
+    _Alignas(64) atomic_size_t enqueue_pos;   // Producers and consumers on separate cache lines
+    _Alignas(64) atomic_size_t dequeue_pos;
+} pool_ring;
+
+static pool_ring rings[POOL_TYPES];
+static pool_options settings;
+static pthread_t *producers;
+static unsigned int started;
+static atomic_int enabled;
+static atomic_int stopping;
+static atomic_int refill_wanted;
+static pthread_mutex_t refill_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refill_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Returns the ring of a password type.
+ * @param[in] type: the password type.
+ * @return the ring index, -1 for an unknown type.
+ */
+static int ring_index(char type)
+{
+    const char *p = type != '\0' ? strchr(PASSWORD_TYPES, type) : NULL;
+    return p ? (int) (p - PASSWORD_TYPES) : -1;
+}
+
+/**
+ * @brief Returns the number of entries in a ring (approximate while it changes).
+ * @param[in] r: the ring.
+ * @return the number of entries.
+ */
+static size_t ring_fill(pool_ring *r)
+{
+    size_t in = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+    size_t out = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+    return in > out ? in - out : 0;
+}
+
+/**
+ * @brief Adds an entry to a ring.
+ * @param[in,out] r: the ring.
+ * @param[in] password: POOL_ENTRY characters.
+ * @return 0 on success, -1 if the ring is full.
+ */
+static int ring_push(pool_ring *r, const char *password)
+{
+    size_t pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+    pool_slot *slot;
+    for (;;) {
+        slot = &r->slots[pos & r->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0)
+            return -1;
+        else
+            pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+    }
+    memcpy(slot->password, password, POOL_ENTRY);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief Wakes the producers up, once per low watermark crossing.
+ */
+static void request_refill(void)
+{
+    if (atomic_load_explicit(&refill_wanted, memory_order_relaxed) ||
+        atomic_exchange_explicit(&refill_wanted, 1, memory_order_relaxed))
+        return; // Already asked
+    pthread_mutex_lock(&refill_lock);
+    pthread_cond_broadcast(&refill_cond);
+    pthread_mutex_unlock(&refill_lock);
+}
+
+/**
+ * @brief Producer thread: keeps every ring between the watermarks.
+ * @param[in] arg: unused.
+ * @return always NULL.
+ */
+static void *producer_main(void *arg)
+{
+    (void) arg;
+    rng_engine rng;
+    char passwords[POOL_BURST * POOL_ENTRY];
+
+    if (rng_init(&rng, settings.rng) < 0) {
+        log_write(LOG_ERROR, "Password pool: random engine initialization failed, producer stopped");
+        return NULL;
+    }
+
+    while (!atomic_load(&stopping)) {
+        unsigned int produced = 0;
+        for (int t = 0; t < POOL_TYPES; t++) {
+            size_t fill = ring_fill(&rings[t]);
+            if (fill >= settings.high)
+                continue;
+            size_t want = settings.high - fill < POOL_BURST ? settings.high - fill : POOL_BURST;
+            // The whole burst is one character stream, cut into entries
+            passgen_bulk(PASSWORD_TYPES[t], POOL_ENTRY, want, POOL_ENTRY, passwords, &rng);
+            for (size_t n = 0; n < want && ring_push(&rings[t], passwords + n * POOL_ENTRY) == 0; n++)
+                produced++;
+            secure_wipe(passwords, want * POOL_ENTRY); // The ring holds the copies; none stays on the stack
+        }
+        if (produced > 0)
+            continue;
+
+        // Every ring is at the high watermark: sleep until one falls below the low watermark
+        atomic_store(&refill_wanted, 0);
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += POOL_IDLE_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&refill_lock);
+        if (!atomic_load(&refill_wanted) && !atomic_load(&stopping))
+            pthread_cond_timedwait(&refill_cond, &refill_lock, &until);
+        pthread_mutex_unlock(&refill_lock);
+    }
+
+    secure_wipe(passwords, sizeof(passwords));
+    secure_wipe(&rng, sizeof(rng));
+    return NULL;
+}
+
+/**
+ * @brief Allocates the rings and starts the producer threads.
+ * @param[in] opt: the pool settings.
+ * @return 0 on success, -1 if the memory or the threads could not be obtained.
+ */
+int pool_start(const pool_options *opt)
+{
+    settings = *opt;
+    atomic_store(&stopping, 0);
+
+    for (int t = 0; t < POOL_TYPES; t++) {
+        pool_ring *r = &rings[t];
+        r->slots = calloc(opt->size, sizeof(pool_slot));
+        if (r->slots == NULL) {
+            errorhandler("Error, password pool allocation failed.\n");
+            pool_stop();
+            return -1;
+        }
+        // Keep the passwords out of the swap; not fatal when the limit is too low
+        if (mlock(r->slots, opt->size * sizeof(pool_slot)) < 0 && t == 0)
+            log_write(LOG_WARN, "Password pool: memory not locked in RAM: %s", strerror(errno));
+        r->mask = opt->size - 1;
+        for (size_t i = 0; i < opt->size; i++)
+            atomic_init(&r->slots[i].sequence, i);
+        atomic_store(&r->enqueue_pos, 0);
+        atomic_store(&r->dequeue_pos, 0);
+    }
+
+    producers = calloc(opt->producers, sizeof(pthread_t));
+    if (producers == NULL) {
+        errorhandler("Error, password pool allocation failed.\n");
+        pool_stop();
+        return -1;
+    }
+    for (started = 0; started < opt->producers; started++) {
+        if (pthread_create(&producers[started], NULL, producer_main, NULL) != 0) {
+            errorhandler("Error, password pool thread creation failed.\n");
+            pool_stop();
+            return -1;
+        }
+    }
+
+    atomic_store(&enabled, 1);
+    log_write(LOG_INFO, "Password pool: %u entries per type, watermarks %u/%u, %u producers",
+              opt->size, opt->low, opt->high, opt->producers);
+    return 0;
+}
+
+/**
+ * @brief Stops the producers, wipes and frees the rings.
+ */
+void pool_stop(void)
+{
+    atomic_store(&enabled, 0);
+    atomic_store(&stopping, 1);
+    pthread_mutex_lock(&refill_lock);
+    pthread_cond_broadcast(&refill_cond);
+    pthread_mutex_unlock(&refill_lock);
+    for (unsigned int i = 0; i < started; i++)
+        pthread_join(producers[i], NULL);
+    started = 0;
+    free(producers);
+    producers = NULL;
+
+    for (int t = 0; t < POOL_TYPES; t++) {
+        pool_ring *r = &rings[t];
+        if (r->slots == NULL)
+            continue;
+        secure_wipe(r->slots, settings.size * sizeof(pool_slot));
+        munlock(r->slots, settings.size * sizeof(pool_slot));
+        free(r->slots);
+        r->slots = NULL;
+    }
+}
+
+/**
+ * @brief Takes a pre-generated password out of the pool.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length, at most POOL_ENTRY.
+ * @param[out] password: the password, NUL-terminated (length + 1 bytes).
+ * @return 0 on success, -1 if the pool is disabled or empty for this type.
+ */
+int pool_take(char type, int length, char *password)
+{
+    int t = ring_index(type);
+    if (!atomic_load_explicit(&enabled, memory_order_relaxed) || t < 0 || length < 0 || length > POOL_ENTRY)
+        return -1;
+
+    pool_ring *r = &rings[t];
+    size_t pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+    pool_slot *slot;
+    for (;;) {
+        slot = &r->slots[pos & r->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            request_refill();
+            return -1; // Empty: the caller generates inline
+        } else
+            pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+    }
+
+    memcpy(password, slot->password, length);
+    password[length] = '\0';
+    secure_wipe(slot->password, POOL_ENTRY); // Handed out once: never left behind in the ring
+    atomic_store_explicit(&slot->sequence, pos + r->mask + 1, memory_order_release);
+
+    if (ring_fill(r) < settings.low)
+        request_refill();
+    return 0;
+}
+
+/**
+ * @brief Returns the room left in the pool.
+ * @return the most entries one type can still take, 0 when the pool is disabled.
+ */
+unsigned int pool_room(void)
+{
+    size_t room = 0;
+    if (!atomic_load_explicit(&enabled, memory_order_relaxed))
+        return 0;
+    for (int t = 0; t < POOL_TYPES; t++) {
+        size_t fill = ring_fill(&rings[t]);
+        if (fill < settings.size && settings.size - fill > room)
+            room = settings.size - fill;
+    }
+    return (unsigned int) room;
+}
+
+/**
+ * @brief Adds a password generated elsewhere to the pool.
+ * @param[in] type: the password type.
+ * @param[in] password: POOL_ENTRY random characters of the type.
+ * @return 0 on success, -1 if the pool is disabled or the ring of the type is full.
+ */
+int pool_give(char type, const char *password)
+{
+    int t = ring_index(type);
+    if (!atomic_load_explicit(&enabled, memory_order_relaxed) || t < 0)
+        return -1;
+    return ring_push(&rings[t], password);
+}
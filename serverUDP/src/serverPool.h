@@ -0,0 +1,84 @@
+/*
+ ============================================================================
+ Name        : serverPool.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the pre-generated password pool
+ ============================================================================
+ */
+#ifndef SERVER_POOL_H
+#define SERVER_POOL_H
+
+#include "rng.h"
+#include "../../common/protocol.h"
+
+#define POOL_TYPES 5 // One ring per password type of PASSWORD_TYPES
+
+#define POOL_ENTRY PROTO_MAX_LENGTH // Characters per entry: the longest password, truncated on use
+
+#define POOL_BURST 256 // Entries a producer generates for a type before looking at the other types
+
+#define POOL_IDLE_MS 100 // Longest sleep of a producer between two fill checks, in milliseconds
+
+// Pool settings
+typedef struct {
+    unsigned int size;        // Entries per type (power of two), 0 disables the pool
+    unsigned int low;         // Producers are woken up when a type falls below `low` entries
+    unsigned int high;        // Producers stop filling a type at `high` entries
+    unsigned int producers;   // Background generator threads
+    rng_kind rng;             // Random engine of the producers
+} pool_options;
+
+/**
+ * @brief Allocates the rings and starts the producer threads.
+ *
+ * Each ring holds entries of POOL_ENTRY random characters of one type; a password
+ * of any length is the prefix of an entry, which is as random as a password
+ * generated at that length. The memory is locked in RAM when the system allows it.
+ *
+ * @param[in] opt: the pool settings.
+ * @return 0 on success, -1 if the memory or the threads could not be obtained.
+ */
+int pool_start(const pool_options *opt);
+
+/**
+ * @brief Stops the producers, wipes and frees the rings.
+ */
+void pool_stop(void);
+
+/**
+ * @brief Takes a pre-generated password out of the pool.
+ *
+ * Lock-free and safe from any number of threads: every entry is handed out
+ * exactly once and wiped before its slot is given back to the producers.
+ * Wakes the producers up when the ring falls below the low watermark.
+ *
+ * @param[in] type: the password type.
+ * @param[in] length: the password length, at most POOL_ENTRY.
+ * @param[out] password: the password, NUL-terminated (length + 1 bytes).
+ * @return 0 on success, -1 if the pool is disabled or empty for this type.
+ */
+int pool_take(char type, int length, char *password);
+
+/**
+ * @brief Returns the room left in the pool.
+ *
+ * @return the most entries one type can still take, 0 when the pool is disabled.
+ */
+unsigned int pool_room(void);
+
+/**
+ * @brief Adds a password generated elsewhere to the pool.
+ *
+ * Used by the hot upgrade: the passwords left in the pool of the previous
+ * server are served by the new one instead of being generated again.
+ * Safe from any number of threads, like the producers.
+ *
+ * @param[in] type: the password type.
+ * @param[in] password: POOL_ENTRY random characters of the type.
+ * @return 0 on success, -1 if the pool is disabled or the ring of the type is full.
+ */
+int pool_give(char type, const char *password);
+
+#endif /* SERVER_POOL_H */
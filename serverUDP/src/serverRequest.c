@@ -0,0 +1,347 @@
+/*
+ ============================================================================
+ Name        : serverRequest.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements request decoding and reply building
+ ============================================================================
+ */
+
+#include "server.h"
+
+/**
+ * @brief Logs a request at debug level, for the sampled requests only.
+ * @param[in] w: the worker that received the request.
+ * @param[in] src: the client address.
+ * @param[in] what: a short description of the request.
+ */
+static void log_request(const server_worker *w, const struct sockaddr_storage *src, const char *what)
+{
+    if (!log_enabled(LOG_DEBUG) || !log_sample())
+        return;
+
+    char address[ADDRESS_TEXT_SIZE];
+    format_address(src, address, sizeof(address));
+    log_write(LOG_DEBUG, "Worker %d: request %s from %s", w->id, what, address);
+}
+
+/**
+ * @brief Produces one password: built-in types from the pool when it has one, generated inline otherwise.
+ * @param[in,out] w: the worker that needs the password.
+ * @param[in] type: the password type.
+ * @param[in] policy: the policy of the type, or the request policy; unused for passphrases.
+ * @param[in] length: the password length, or the word count of a passphrase.
+ * @param[out] password: the password, NUL-terminated (proto_entry_size() bytes).
+ * @return the number of characters written.
+ */
+static int next_password(server_worker *w, char type, const passgen_policy *policy, int length, char *password)
+{
+    if (type == PROTO_TYPE_PASSPHRASE)
+        return passgen_passphrase(policy_wordlist(), length, PROTO_PASSPHRASE_SEPARATOR, password,
+                                  PROTO_MAX_PASSPHRASE + 1, &w->rng);
+    if (policy == passgen_builtin(type)) {
+        if (pool_take(type, length, password) == 0) {
+            metric_add(&w->m->pool_hits, 1);
+            return length;
+        }
+        metric_add(&w->m->pool_misses, 1);
+    }
+    passgen_policy_password(policy, length, password, &w->rng);
+    return length;
+}
+
+/**
+ * @brief Counts the passwords of a request by type and length.
+ * @param[in,out] w: the worker that received the request.
+ * @param[in] type: the requested type, already validated; configured types and request policies count as custom.
+ * @param[in] length: the requested length, already validated (passphrases are not counted by length).
+ * @param[in] count: the number of passwords.
+ */
+static void count_passwords(server_worker *w, char type, int length, unsigned int count)
+{
+    if (type == PROTO_TYPE_PASSPHRASE) {
+        metric_add(&w->m->by_type[METRICS_PASSPHRASE_TYPE], count);
+        return;
+    }
+    const char *p = type != '\0' ? strchr(PASSWORD_TYPES, type) : NULL;
+    metric_add(&w->m->by_type[p != NULL ? p - PASSWORD_TYPES : METRICS_CUSTOM_TYPE], count);
+    metric_add(&w->m->by_length[length], count);
+}
+
+/**
+ * @brief Answers a validated single password request with the raw password string.
+ * @param[in,out] w: the worker that received the request.
+ * @param[in] src: the client address.
+ * @param[in] req: the validated request.
+ * @param[in] sink: the reply sink.
+ * @param[in,out] ctx: passed to `sink`.
+ */
+static void handle_msg(server_worker *w, const struct sockaddr_storage *src, const request_view *req,
+                       reply_sink sink, void *ctx)
+{
+    char type = req->type;
+    int length = req->length;
+    char password[PROTO_MAX_PASSPHRASE + 1]; // Room for a password or a passphrase
+
+    if (w->interactive) {
+        const char *reqMsg = "\n\nRequest from client: ";
+        typewriterEffect(reqMsg, 15000);
+        printf("%c %d\n", type, length);
+    } else if (log_enabled(LOG_DEBUG)) {
+        char what[32];
+        snprintf(what, sizeof(what), "%c %d", type, length);
+        log_request(w, src, what);
+    }
+
+    count_passwords(w, type, length, 1);
+    int timed = metrics_timing();
+    unsigned long long started = timed ? metrics_clock(CLOCK_MONOTONIC) : 0;
+    int written = next_password(w, type, req->policy, length, password);  // Generate password
+    if (timed)
+        metric_observe(&w->m->generation, metrics_clock(CLOCK_MONOTONIC) - started);
+    sink(ctx, (const unsigned char *) password, written);
+    secure_wipe(password, sizeof(password));
+}
+
+/**
+ * @brief Fills a batch reply header in place.
+ * @param[out] out: the datagram.
+ * @param[in] status: the reply status.
+ * @param[in] fragment: the index of this fragment.
+ * @param[in] fragments: the number of fragments of the reply.
+ * @param[in] passwords: the number of passwords in this fragment.
+ * @param[in] request_id: the request ID echoed back, network byte order.
+ * @param[in] flags: the PROTO_REPLY_* bits.
+ */
+static void put_reply_header(unsigned char *out, unsigned int status, unsigned int fragment,
+                             unsigned int fragments, unsigned int passwords, uint32_t request_id, unsigned int flags)
+{
+    proto_reply_header *h = (proto_reply_header *) out;
+    h->magic = PROTO_MAGIC;
+    h->version = PROTO_VERSION;
+    h->status = (uint8_t) status;
+    h->fragment = (uint8_t) fragment;
+    h->fragments = (uint8_t) fragments;
+    h->flags = (uint8_t) flags;
+    h->passwords = htons((uint16_t) passwords);
+    h->request_id = request_id;
+}
+
+/**
+ * @brief Counts a rejected request, answers it with a compact error and periodically reports the rejections.
+ * @param[in,out] w: the worker that received the request.
+ * @param[in] src: the client address.
+ * @param[in] req: the request, as far as it was decoded.
+ * @param[in] reason: the reason of the rejection.
+ * @param[in] sink: the reply sink.
+ * @param[in,out] ctx: passed to `sink`.
+ */
+static void reject_request(server_worker *w, const struct sockaddr_storage *src, const request_view *req,
+                           reject_reason reason, reply_sink sink, void *ctx)
+{
+    worker_metrics *m = w->m;
+    metric_add(&m->requests[reason], 1);
+    metric_add(&m->rejected, 1);
+    if (m->rejected % REJECT_REPORT_INTERVAL == 0)
+        log_write(LOG_WARN, "Worker %d rejected %llu requests: %llu short, %llu oversized, %llu malformed, "
+                  "%llu version, %llu type, %llu length, %llu too-many, %llu policy, %llu seal", w->id, m->rejected,
+                  m->requests[REJECT_SHORT], m->requests[REJECT_OVERSIZED], m->requests[REJECT_MALFORMED],
+                  m->requests[REJECT_VERSION], m->requests[REJECT_TYPE], m->requests[REJECT_LENGTH],
+                  m->requests[REJECT_TOO_MANY], m->requests[REJECT_POLICY], m->requests[REJECT_SEAL]);
+
+    if (log_enabled(LOG_DEBUG)) {
+        char what[32];
+        snprintf(what, sizeof(what), "rejected (%s)", reject_name(reason));
+        log_request(w, src, what);
+    }
+
+    if (req->kind == REQUEST_BATCH) {
+        unsigned char out[sizeof(proto_reply_header)];
+        put_reply_header(out, reject_status(reason), 0, 1, 0, req->request_id, 0); // Errors are never sealed
+        sink(ctx, out, sizeof(out));
+    } else if (req->kind == REQUEST_MSG) {
+        unsigned char out[PROTO_ERROR_SIZE] = { '\0', (unsigned char) reject_status(reason) };
+        sink(ctx, out, sizeof(out));
+    }
+    // Anything else is not a request: no reply
+}
+
+_Static_assert(sizeof(proto_reply_header) + PROTO_COOKIE_SIZE <=
+               PROTO_AMPLIFICATION * (sizeof(proto_request_header) + sizeof(proto_spec)),
+               "the cookie reply must not amplify the smallest batch request");
+
+/**
+ * @brief Answers a request too large for its unvalidated address: a cookie for a batch, the error for a `msg`.
+ * @param[in,out] w: the worker that received the request.
+ * @param[in] src: the client address.
+ * @param[in] req: the validated request.
+ * @param[in] sink: the reply sink.
+ * @param[in,out] ctx: passed to `sink`.
+ */
+static void ask_cookie(server_worker *w, const struct sockaddr_storage *src, const request_view *req,
+                       reply_sink sink, void *ctx)
+{
+    unsigned char out[sizeof(proto_reply_header) + PROTO_COOKIE_SIZE];
+
+    metric_add(&w->m->retries, 1);
+    log_request(w, src, "asked to validate its address");
+    if (req->kind == REQUEST_MSG) {
+        unsigned char error[PROTO_ERROR_SIZE] = { '\0', PROTO_STATUS_RETRY };
+        sink(ctx, error, sizeof(error));
+        return;
+    }
+    put_reply_header(out, PROTO_STATUS_RETRY, 0, 1, 0, req->request_id, 0);
+    limit_cookie(src, out + sizeof(proto_reply_header));
+    sink(ctx, out, sizeof(out));
+}
+
+/**
+ * @brief Counts a request dropped by the rate limiter and periodically reports the drops.
+ * @param[in,out] w: the worker that received the request.
+ * @param[in] src: the client address.
+ * @param[in] limited: the exhausted budget.
+ */
+static void drop_request(server_worker *w, const struct sockaddr_storage *src, limit_result limited)
+{
+    worker_metrics *m = w->m;
+    metric_add(&m->dropped[limited], 1);
+    if ((m->dropped[LIMIT_SOURCE] + m->dropped[LIMIT_GLOBAL]) % LIMIT_REPORT_INTERVAL == 0)
+        log_write(LOG_WARN, "Worker %d dropped %llu requests over the source limit, %llu over the global budget",
+                  w->id, m->dropped[LIMIT_SOURCE], m->dropped[LIMIT_GLOBAL]);
+
+    if (log_enabled(LOG_DEBUG)) {
+        char what[32];
+        snprintf(what, sizeof(what), "dropped (%s limit)", limit_name(limited));
+        log_request(w, src, what);
+    }
+}
+
+/**
+ * @brief Answers a validated batch protocol request with one or more reply fragments.
+ * @param[in,out] w: the worker that received the request.
+ * @param[in] src: the client address.
+ * @param[in] req: the validated request.
+ * @param[in] sink: the reply sink.
+ * @param[in,out] ctx: passed to `sink`.
+ */
+static void handle_batch(server_worker *w, const struct sockaddr_storage *src, const request_view *req,
+                         reply_sink sink, void *ctx)
+{
+    unsigned char out[PROTO_MAX_DATAGRAM + 1]; // +1: passgen_password() ends every password with '\0'
+
+    if (log_enabled(LOG_DEBUG)) {
+        char what[48];
+        snprintf(what, sizeof(what), "batch #%u, %u passwords", (unsigned int) ntohl(req->request_id), req->total);
+        log_request(w, src, what);
+    }
+
+    // Passwords are generated straight into the reply datagram; the sends are left out of the generation time
+    int timed = metrics_timing();
+    unsigned long long started = timed ? metrics_clock(CLOCK_MONOTONIC) : 0, spent = 0;
+    unsigned int fragment = 0, in_fragment = 0;
+    size_t used = sizeof(proto_reply_header), reserved = used; // Fragments are packed by `reserved`, not `used`
+    size_t room = proto_reply_room(req->sealed);                // Sealing adds its nonce and tag when sent
+    unsigned int flags = req->sealed ? PROTO_REPLY_SEALED : 0;
+    for (unsigned int s = 0; s < req->header->spec_count; s++) {
+        unsigned int len = req->specs[s].length, count = ntohs(req->specs[s].count);
+        size_t entry = proto_entry_size(req->specs[s].type, len); // Packing of validate_request()
+        const passgen_policy *policy = spec_policy(req, &req->specs[s]);
+        count_passwords(w, (char) req->specs[s].type, len, count);
+        for (unsigned int c = 0; c < count; c++) {
+            if (reserved + entry > room) {
+                put_reply_header(out, PROTO_STATUS_OK, fragment++, req->fragments, in_fragment, req->request_id, flags);
+                if (timed)
+                    spent += metrics_clock(CLOCK_MONOTONIC) - started;
+                sink(ctx, out, used);
+                if (timed)
+                    started = metrics_clock(CLOCK_MONOTONIC);
+                used = reserved = sizeof(proto_reply_header);
+                in_fragment = 0;
+            }
+            int written = next_password(w, (char) req->specs[s].type, policy, len, (char *) out + used + 1);
+            out[used] = (unsigned char) written;
+            used += 1 + written;
+            reserved += entry;
+            in_fragment++;
+        }
+    }
+    put_reply_header(out, PROTO_STATUS_OK, fragment, req->fragments, in_fragment, req->request_id, flags);
+    if (timed)
+        metric_observe(&w->m->generation, spent + metrics_clock(CLOCK_MONOTONIC) - started);
+    sink(ctx, out, used);
+    secure_wipe(out, sizeof(out));
+}
+
+/**
+ * @brief Validates a request datagram, generates the passwords and emits the replies.
+ * @param[in,out] w: the worker that received the datagram.
+ * @param[in] src: the client address.
+ * @param[in] in: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ * @param[in] arrival: kernel receive time in CLOCK_REALTIME nanoseconds, 0 if unknown.
+ * @param[in] sink: called once per reply datagram, in order.
+ * @param[in,out] ctx: passed to `sink`.
+ */
+void handle_datagram(server_worker *w, const struct sockaddr_storage *src, const unsigned char *in, size_t length,
+                     unsigned long long arrival, reply_sink sink, void *ctx)
+{
+    request_view req;
+
+    metric_add(&w->m->datagrams_in, 1);
+    metric_add(&w->m->bytes_in, length);
+    if (arrival != 0 && metrics_timing()) {
+        unsigned long long now = metrics_clock(CLOCK_REALTIME);
+        metric_observe(&w->m->queueing, now > arrival ? now - arrival : 0);
+    }
+
+    if (src->ss_family == AF_UNSPEC)
+        return; // A Unix client without name (see local_source()): no reply can reach it
+
+    reject_reason reason = validate_request(in, length, &req);
+    // Anti-amplification, `msg` included: its cookie is always NULL
+    int retry = reason == REJECT_NONE && !limit_address_ok(src, length, req.reply_size, req.cookie);
+
+    // Charged before any reply: one token per reply datagram, so large batches cost more
+    int served = reason == REJECT_NONE && req.kind == REQUEST_BATCH && !retry;
+    limit_result limited = limit_check(src, served ? req.fragments : 1);
+    if (limited != LIMIT_PASS) {
+        drop_request(w, src, limited);
+        return;
+    }
+
+    if (reason != REJECT_NONE) {
+        reject_request(w, src, &req, reason, sink, ctx);
+        return;
+    }
+    if (retry) {
+        ask_cookie(w, src, &req, sink, ctx);
+        return;
+    }
+    metric_add(&w->m->requests[REJECT_NONE], 1);
+
+    if (w->interactive)
+    {
+        const char *connectMsg = "\n\nNew request from ";
+        typewriterEffect(connectMsg, 15000);
+        char address[ADDRESS_TEXT_SIZE];
+        format_address(src, address, sizeof(address));
+        printf("%s\n", address); // print IP address and port
+    }
+
+    if (req.kind == REQUEST_BATCH && w->cache != NULL) {
+        // A retransmission gets the passwords it was first sent; anything else is recorded while it is built
+        if (cache_replay(w->cache, src, req.request_id, in, length, sink, ctx)) {
+            metric_add(&w->m->replays, 1);
+            log_request(w, src, "replayed from the reply cache");
+            return;
+        }
+        cache_recorder recorder;
+        cache_begin(w->cache, src, req.request_id, in, length, &recorder, sink, ctx);
+        handle_batch(w, src, &req, cache_record, &recorder);
+        cache_commit(w->cache);
+    } else if (req.kind == REQUEST_BATCH)
+        handle_batch(w, src, &req, sink, ctx);
+    else
+        handle_msg(w, src, &req, sink, ctx);
+}
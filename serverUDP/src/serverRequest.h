@@ -0,0 +1,58 @@
+/*
+ ============================================================================
+ Name        : serverRequest.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for request decoding and reply building
+ ============================================================================
+ */
+#ifndef SERVER_REQUEST_H
+#define SERVER_REQUEST_H
+
+#include <stddef.h>
+#include "serverIO.h"
+
+/**
+ * @brief Receives every reply datagram built for a request.
+ *
+ * @param[in,out] ctx: the context given to handle_datagram().
+ * @param[in] data: the reply datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ */
+typedef void (*reply_sink)(void *ctx, const unsigned char *data, size_t length);
+
+/**
+ * @brief Validates a request datagram, generates the passwords and emits the replies.
+ *
+ * Every datagram first goes through validate_request(), limit_address_ok() and
+ * limit_check(). A request whose reply would exceed PROTO_AMPLIFICATION times
+ * its size gets PROTO_STATUS_RETRY instead of the passwords (with a cookie
+ * for a batch request), unless it carries a valid cookie for its address or
+ * comes from a Unix socket: a forged source address never draws more than
+ * PROTO_AMPLIFICATION times the bytes sent, `msg` included. Requests over
+ * the rate limit of their source or over the global budget (both off by
+ * default, counted in reply datagrams) are dropped without reply. Other rejected requests are counted per reason in the worker and
+ * answered with a compact status code (see common/protocol.h), or dropped
+ * without reply when they are not recognizable as requests. Valid single
+ * password `msg` datagrams (packed, or in the old 8-byte padded layout) get
+ * the raw password string;
+ * valid batch protocol requests get one or more reply fragments. With the
+ * worker's reply cache, a batch request seen again (a client retransmission)
+ * gets the fragments it was first answered with instead of new passwords.
+ * Every datagram is counted in the worker metrics.
+ *
+ * @param[in,out] w: the worker that received the datagram.
+ * @param[in] src: the client address (IPv4, IPv6, IPv4-mapped IPv6 or a Unix name,
+ *            see local_source(); AF_UNSPEC sources are dropped).
+ * @param[in] in: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ * @param[in] arrival: time the kernel received the datagram, in CLOCK_REALTIME
+ *            nanoseconds (SO_TIMESTAMPNS), 0 if unknown; feeds the queueing histogram.
+ * @param[in] sink: called once per reply datagram, in order.
+ * @param[in,out] ctx: passed to `sink`.
+ */
+void handle_datagram(server_worker *w, const struct sockaddr_storage *src, const unsigned char *in, size_t length,
+                     unsigned long long arrival, reply_sink sink, void *ctx);
+
+#endif /* SERVER_REQUEST_H */
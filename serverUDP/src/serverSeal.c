@@ -0,0 +1,497 @@
+/*
+ ============================================================================
+ Name        : serverSeal.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the sealing of the replies with a pre-shared key
+ ============================================================================
+ */
+
+#include "server.h"
+
+#if defined __x86_64__ || defined __i386__
+#define SEAL_X86
+#include <immintrin.h>
+#endif
+
+static unsigned char psk[AEAD_KEY_SIZE];   // Pre-shared key
+static int enabled;                         // Non-zero once a key is loaded
+
+// Where a block computed by the kernel goes
+typedef struct {
+    unsigned int item;      // Reply of the batch
+    unsigned int block;     // ChaCha20 block counter: 0 is the Poly1305 key, then the entries
+    int last;               // Non-zero for the last block of the reply: its tag follows
+} lane_job;
+
+/**
+ * @brief Portable kernel: computes the blocks one at a time.
+ * @param[in] key: the subkey.
+ * @param[in] tail: words 12 to 15 of the state of every lane.
+ * @param[in] lanes: the number of blocks to compute.
+ * @param[out] out: the keystream of every lane.
+ */
+static void blocks_scalar(const uint32_t key[8], const uint32_t tail[4][SEAL_LANES], unsigned int lanes,
+                          unsigned char out[SEAL_LANES][AEAD_BLOCK])
+{
+    for (unsigned int j = 0; j < lanes; j++) {
+        uint32_t t[4] = { tail[0][j], tail[1][j], tail[2][j], tail[3][j] };
+        aead_chacha20_block(key, t, out[j]);
+    }
+}
+
+#if defined SEAL_X86
+
+#define ROTL_AVX2(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+#define QUARTER_ROUND_AVX2(a, b, c, d) \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+    c = _mm256_add_epi32(c, d); b = ROTL_AVX2(_mm256_xor_si256(b, c), 12); \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+    c = _mm256_add_epi32(c, d); b = ROTL_AVX2(_mm256_xor_si256(b, c), 7)
+
+/**
+ * @brief AVX2 kernel: one state word of SEAL_LANES blocks per register.
+ * @param[in] key: the subkey.
+ * @param[in] tail: words 12 to 15 of the state of every lane.
+ * @param[in] lanes: the number of blocks wanted (all SEAL_LANES are computed).
+ * @param[out] out: the keystream of every lane.
+ */
+__attribute__((target("avx2")))
+static void blocks_avx2(const uint32_t key[8], const uint32_t tail[4][SEAL_LANES], unsigned int lanes,
+                        unsigned char out[SEAL_LANES][AEAD_BLOCK])
+{
+    static const uint32_t sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                          3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    __m256i in[16], x[16];
+    uint32_t words[16][SEAL_LANES];
+
+    for (int i = 0; i < 4; i++)
+        in[i] = _mm256_set1_epi32((int) sigma[i]);
+    for (int i = 0; i < 8; i++)
+        in[4 + i] = _mm256_set1_epi32((int) key[i]);
+    for (int i = 0; i < 4; i++)
+        in[12 + i] = _mm256_loadu_si256((const __m256i *) tail[i]);
+    for (int i = 0; i < 16; i++)
+        x[i] = in[i];
+
+    for (int r = 0; r < 10; r++) {
+        QUARTER_ROUND_AVX2(x[0], x[4], x[8],  x[12]);
+        QUARTER_ROUND_AVX2(x[1], x[5], x[9],  x[13]);
+        QUARTER_ROUND_AVX2(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND_AVX2(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND_AVX2(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND_AVX2(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND_AVX2(x[2], x[7], x[8],  x[13]);
+        QUARTER_ROUND_AVX2(x[3], x[4], x[9],  x[14]);
+    }
+
+    // Word i of lane j is words[i][j]: written out block by block
+    for (int i = 0; i < 16; i++)
+        _mm256_storeu_si256((__m256i *) words[i], _mm256_add_epi32(x[i], in[i]));
+    for (unsigned int j = 0; j < lanes; j++)
+        for (int i = 0; i < 16; i++)
+            aead_store32(out[j] + 4 * i, words[i][j]);
+    secure_wipe(words, sizeof(words));
+}
+
+#endif /* SEAL_X86 */
+
+static void (*blocks)(const uint32_t *, const uint32_t (*)[SEAL_LANES], unsigned int,
+                      unsigned char (*)[AEAD_BLOCK]) = blocks_scalar;
+
+/**
+ * @brief Uses the blocks of a kernel run: Poly1305 keys, encryption and the tags of the finished replies.
+ * @param[in,out] items: the replies of the batch.
+ * @param[in] jobs: the destination of every block.
+ * @param[in] lanes: the number of blocks.
+ * @param[in] stream: the blocks.
+ * @param[in,out] poly_key: the Poly1305 key of the reply being sealed.
+ */
+static void apply_blocks(seal_item *items, const lane_job *jobs, unsigned int lanes,
+                         unsigned char stream[SEAL_LANES][AEAD_BLOCK], unsigned char poly_key[32])
+{
+    for (unsigned int j = 0; j < lanes; j++) {
+        seal_item *item = &items[jobs[j].item];
+        unsigned char *text = item->data + sizeof(proto_reply_header) + PROTO_SEAL_NONCE_SIZE;
+        size_t length = item->length - sizeof(proto_reply_header) - PROTO_SEAL_OVERHEAD;
+
+        if (jobs[j].block == 0)
+            memcpy(poly_key, stream[j], 32); // The blocks of a reply come in order, after the ones of the previous reply
+        else {
+            size_t offset = (size_t) (jobs[j].block - 1) * AEAD_BLOCK;
+            size_t n = length - offset < AEAD_BLOCK ? length - offset : AEAD_BLOCK, i = 0;
+            for (; i + 8 <= n; i += 8) { // Word at a time: the entries have no alignment
+                uint64_t word, key;
+                memcpy(&word, text + offset + i, 8);
+                memcpy(&key, stream[j] + i, 8);
+                word ^= key;
+                memcpy(text + offset + i, &word, 8);
+            }
+            for (; i < n; i++)
+                text[offset + i] ^= stream[j][i];
+        }
+        if (jobs[j].last)
+            aead_tag(poly_key, item->data, sizeof(proto_reply_header), text, length, text + length);
+    }
+}
+
+/**
+ * @brief Seals in place the replies of a send batch that need it.
+ * @param[in,out] s: the session key of the worker.
+ * @param[in,out] items: the replies.
+ * @param[in] count: the number of replies.
+ * @return the number of replies sealed.
+ */
+unsigned int seal_batch(reply_sealer *s, seal_item *items, unsigned int count)
+{
+    uint32_t tail[4][SEAL_LANES];
+    unsigned char stream[SEAL_LANES][AEAD_BLOCK], poly_key[32];
+    lane_job jobs[SEAL_LANES];
+    unsigned int lanes = 0, sealed = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned char *nonce = items[i].data + sizeof(proto_reply_header);
+        if (!seal_wanted(items[i].data, items[i].length))
+            continue;
+        if (items[i].length > proto_reply_room(1))
+            items[i].length = sizeof(proto_reply_header); // Never happens (fragments are packed for sealing): no password in the clear
+
+        // header | nonce | entries | tag
+        size_t length = items[i].length - sizeof(proto_reply_header);
+        memmove(nonce + PROTO_SEAL_NONCE_SIZE, nonce, length);
+        memcpy(nonce, s->salt, AEAD_SALT_SIZE);
+        aead_store32(nonce + AEAD_SALT_SIZE, (uint32_t) s->counter);
+        aead_store32(nonce + AEAD_SALT_SIZE + 4, (uint32_t) (s->counter >> 32));
+        s->counter++;
+        items[i].length += PROTO_SEAL_OVERHEAD;
+        sealed++;
+
+        unsigned int last = (unsigned int) ((length + AEAD_BLOCK - 1) / AEAD_BLOCK);
+        for (unsigned int b = 0; b <= last; b++) {
+            tail[0][lanes] = b;
+            tail[1][lanes] = 0;
+            tail[2][lanes] = aead_load32(nonce + AEAD_SALT_SIZE);
+            tail[3][lanes] = aead_load32(nonce + AEAD_SALT_SIZE + 4);
+            jobs[lanes].item = i;
+            jobs[lanes].block = b;
+            jobs[lanes].last = b == last;
+            if (++lanes == SEAL_LANES) {
+                blocks(s->key, tail, lanes, stream);
+                apply_blocks(items, jobs, lanes, stream, poly_key);
+                lanes = 0;
+            }
+        }
+    }
+    if (lanes > 0) {
+        blocks(s->key, tail, lanes, stream);
+        apply_blocks(items, jobs, lanes, stream, poly_key);
+    }
+
+    secure_wipe(stream, sizeof(stream));
+    secure_wipe(poly_key, sizeof(poly_key));
+    return sealed;
+}
+
+/**
+ * @brief Seals one reply in place if it needs it.
+ * @param[in,out] s: the session key of the worker.
+ * @param[in,out] data: the reply datagram.
+ * @param[in] length: its size in bytes.
+ * @return the size of the datagram to send.
+ */
+size_t seal_reply(reply_sealer *s, unsigned char *data, size_t length)
+{
+    seal_item item = { data, length };
+    seal_batch(s, &item, 1);
+    return item.length;
+}
+
+/**
+ * @brief Starts a session key.
+ * @param[out] s: the session key of a worker.
+ * @return 0 on success, -1 if the operating system generator is not available.
+ */
+int sealer_init(reply_sealer *s)
+{
+    rng_engine os;
+
+    memset(s, 0, sizeof(*s));
+    if (rng_init(&os, RNG_GETRANDOM) < 0)
+        return -1;
+    rng_bytes(&os, s->salt, sizeof(s->salt)); // Straight from the OS: unique whatever engine the worker uses
+    secure_wipe(&os, sizeof(os));
+    aead_hchacha20(psk, s->salt, s->key);
+    return 0;
+}
+
+/**
+ * @brief Uses a key given in memory.
+ * @param[in] key: the pre-shared key.
+ */
+void seal_use_key(const unsigned char key[AEAD_KEY_SIZE])
+{
+    memcpy(psk, key, sizeof(psk));
+    enabled = 1;
+}
+
+/**
+ * @brief Loads the pre-shared key and picks the fastest kernel.
+ * @param[in] path: the key file, "" for none.
+ * @return 0 on success, -1 on error.
+ */
+int seal_start(const char *path)
+{
+    if (path[0] == '\0')
+        return 0;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot read the key file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char text[4 * AEAD_KEY_SIZE]; // Room for the digits and some blanks
+    size_t n = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[n] = '\0';
+
+    unsigned char key[AEAD_KEY_SIZE];
+    int valid = aead_parse_key(text, key) == 0;
+    secure_wipe(text, sizeof(text));
+    if (!valid) {
+        fprintf(stderr, "%s is not a key: 64 hexadecimal digits expected\n", path);
+        return -1;
+    }
+    seal_use_key(key);
+    secure_wipe(key, sizeof(key));
+    if (seal_select(seal_best()) < 0 || seal_selftest() < 0) {
+        seal_stop();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Erases the pre-shared key.
+ */
+void seal_stop(void)
+{
+    secure_wipe(psk, sizeof(psk));
+    enabled = 0;
+}
+
+/**
+ * @brief Tells whether the server seals its replies.
+ * @return non-zero once a key is loaded.
+ */
+int seal_enabled(void)
+{
+    return enabled;
+}
+
+/**
+ * @brief Returns the fastest keystream kernel supported by the running CPU.
+ * @return the kernel.
+ */
+seal_kernel seal_best(void)
+{
+#if defined SEAL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SEAL_AVX2;
+#endif
+    return SEAL_SCALAR;
+}
+
+/**
+ * @brief Selects the keystream kernel.
+ * @param[in] kind: the kernel to use.
+ * @return 0 on success, -1 if the CPU does not support it.
+ */
+int seal_select(seal_kernel kind)
+{
+    switch (kind) {
+        case SEAL_SCALAR:
+            blocks = blocks_scalar;
+            return 0;
+        case SEAL_AVX2:
+#if defined SEAL_X86
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("avx2"))
+                return -1;
+            blocks = blocks_avx2;
+            return 0;
+#else
+            return -1;
+#endif
+    }
+    return -1;
+}
+
+/**
+ * @brief Encrypts the draft-irtf-cfrg-xchacha-03 test vector with the selected kernel and checks the result.
+ * @return non-zero if the ciphertext and the tag match the vector.
+ */
+static int known_answer(void)
+{
+    static const unsigned char aad[12] = { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7 };
+    static const char plaintext[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip "
+                                    "for the future, sunscreen would be it.";
+    static const unsigned char ciphertext[sizeof(plaintext) - 1] = {
+        0xbd, 0x6d, 0x17, 0x9d, 0x3e, 0x83, 0xd4, 0x3b, 0x95, 0x76, 0x57, 0x94, 0x93, 0xc0, 0xe9, 0x39,
+        0x57, 0x2a, 0x17, 0x00, 0x25, 0x2b, 0xfa, 0xcc, 0xbe, 0xd2, 0x90, 0x2c, 0x21, 0x39, 0x6c, 0xbb,
+        0x73, 0x1c, 0x7f, 0x1b, 0x0b, 0x4a, 0xa6, 0x44, 0x0b, 0xf3, 0xa8, 0x2f, 0x4e, 0xda, 0x7e, 0x39,
+        0xae, 0x64, 0xc6, 0x70, 0x8c, 0x54, 0xc2, 0x16, 0xcb, 0x96, 0xb7, 0x2e, 0x12, 0x13, 0xb4, 0x52,
+        0x2f, 0x8c, 0x9b, 0xa4, 0x0d, 0xb5, 0xd9, 0x45, 0xb1, 0x1b, 0x69, 0xb9, 0x82, 0xc1, 0xbb, 0x9e,
+        0x3f, 0x3f, 0xac, 0x2b, 0xc3, 0x69, 0x48, 0x8f, 0x76, 0xb2, 0x38, 0x35, 0x65, 0xd3, 0xff, 0xf9,
+        0x21, 0xf9, 0x66, 0x4c, 0x97, 0x63, 0x7d, 0xa9, 0x76, 0x88, 0x12, 0xf6, 0x15, 0xc6, 0x8b, 0x13,
+        0xb5, 0x2e
+    };
+    static const unsigned char tag[AEAD_TAG_SIZE] = {
+        0xc0, 0x87, 0x59, 0x24, 0xc1, 0xc7, 0x98, 0x79, 0x47, 0xde, 0xaf, 0xd8, 0x78, 0x0a, 0xcf, 0x49
+    };
+    const size_t length = sizeof(ciphertext);
+    unsigned char key[AEAD_KEY_SIZE], nonce[PROTO_SEAL_NONCE_SIZE], text[sizeof(ciphertext)], computed[AEAD_TAG_SIZE];
+    unsigned char stream[SEAL_LANES][AEAD_BLOCK];
+    uint32_t subkey[8], tail[4][SEAL_LANES];
+    unsigned int lanes = (unsigned int) (1 + (length + AEAD_BLOCK - 1) / AEAD_BLOCK); // Poly1305 key, then the text
+
+    for (int i = 0; i < AEAD_KEY_SIZE; i++)
+        key[i] = (unsigned char) (0x80 + i);
+    for (int i = 0; i < PROTO_SEAL_NONCE_SIZE; i++)
+        nonce[i] = (unsigned char) (0x40 + i);
+    aead_hchacha20(key, nonce, subkey);
+    for (unsigned int b = 0; b < lanes; b++) {
+        tail[0][b] = b;
+        tail[1][b] = 0;
+        tail[2][b] = aead_load32(nonce + AEAD_SALT_SIZE);
+        tail[3][b] = aead_load32(nonce + AEAD_SALT_SIZE + 4);
+    }
+    blocks(subkey, tail, lanes, stream);
+    for (size_t i = 0; i < length; i++)
+        text[i] = (unsigned char) plaintext[i] ^ stream[1 + i / AEAD_BLOCK][i % AEAD_BLOCK];
+    aead_tag(stream[0], aad, sizeof(aad), text, length, computed);
+    return memcmp(text, ciphertext, length) == 0 && memcmp(computed, tag, sizeof(tag)) == 0;
+}
+
+/**
+ * @brief Returns a byte of a self-test reply, so that an opened reply can be checked.
+ * @param[in] reply: the index of the reply.
+ * @param[in] offset: the offset of the byte after the header.
+ * @return a printable character.
+ */
+static unsigned char test_byte(unsigned int reply, size_t offset)
+{
+    return (unsigned char) ('!' + (offset * 7 + reply) % 94);
+}
+
+/**
+ * @brief Seals the replies of the self-test with the selected kernel.
+ * @param[in] key: the pre-shared key of the test.
+ * @param[out] out: the sealed replies.
+ * @param[out] lengths: their sizes.
+ */
+static void seal_test_replies(const unsigned char key[AEAD_KEY_SIZE],
+                              unsigned char out[SEAL_SELFTEST_REPLIES][PROTO_MAX_DATAGRAM],
+                              size_t lengths[SEAL_SELFTEST_REPLIES])
+{
+    reply_sealer s;
+    seal_item items[SEAL_SELFTEST_REPLIES];
+
+    memset(&s, 0, sizeof(s));
+    memset(s.salt, 0x5a, sizeof(s.salt)); // Fixed session: every kernel gets the same nonces
+    aead_hchacha20(key, s.salt, s.key);
+    for (unsigned int r = 0; r < SEAL_SELFTEST_REPLIES; r++) {
+        // From a lone header to a full fragment, so that the batch spans lanes and partial blocks
+        size_t length = sizeof(proto_reply_header) +
+                        (proto_reply_room(1) - sizeof(proto_reply_header)) * r / (SEAL_SELFTEST_REPLIES - 1);
+        proto_reply_header *h = (proto_reply_header *) out[r];
+        memset(out[r], 0, PROTO_MAX_DATAGRAM);
+        h->magic = PROTO_MAGIC;
+        h->version = PROTO_VERSION;
+        h->fragments = 1;
+        h->flags = PROTO_REPLY_SEALED;
+        h->passwords = htons((uint16_t) r);
+        for (size_t i = sizeof(*h); i < length; i++)
+            out[r][i] = test_byte(r, i - sizeof(*h));
+        items[r].data = out[r];
+        items[r].length = length;
+    }
+    seal_batch(&s, items, SEAL_SELFTEST_REPLIES);
+    for (unsigned int r = 0; r < SEAL_SELFTEST_REPLIES; r++)
+        lengths[r] = items[r].length;
+}
+
+/**
+ * @brief Checks every keystream kernel supported by the CPU.
+ * @return 0 if every kernel passes, -1 otherwise.
+ */
+int seal_selftest(void)
+{
+    static const seal_kernel kinds[] = { SEAL_SCALAR, SEAL_AVX2 };
+    static unsigned char reference[SEAL_SELFTEST_REPLIES][PROTO_MAX_DATAGRAM], sealed[SEAL_SELFTEST_REPLIES][PROTO_MAX_DATAGRAM];
+    size_t reference_lengths[SEAL_SELFTEST_REPLIES], lengths[SEAL_SELFTEST_REPLIES];
+    unsigned char key[AEAD_KEY_SIZE];
+    void (*selected)(const uint32_t *, const uint32_t (*)[SEAL_LANES], unsigned int,
+                     unsigned char (*)[AEAD_BLOCK]) = blocks;
+    int failed = 0;
+
+    for (int i = 0; i < AEAD_KEY_SIZE; i++)
+        key[i] = (unsigned char) (i * 29 + 3);
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        if (seal_select(kinds[k]) < 0)
+            continue; // Not supported by this CPU
+        if (!known_answer()) {
+            fprintf(stderr, "Seal self-test: the %s kernel does not match the XChaCha20-Poly1305 test vector\n",
+                    seal_kernel_name(kinds[k]));
+            failed = 1;
+            continue;
+        }
+        seal_test_replies(key, kinds[k] == SEAL_SCALAR ? reference : sealed,
+                          kinds[k] == SEAL_SCALAR ? reference_lengths : lengths);
+        if (kinds[k] == SEAL_SCALAR) {
+            // The client opens what the server seals, back to the same entries
+            for (unsigned int r = 0; r < SEAL_SELFTEST_REPLIES && !failed; r++) {
+                memcpy(sealed[r], reference[r], reference_lengths[r]);
+                int opened = aead_open_reply(key, sealed[r], reference_lengths[r]);
+                int same = opened == (int) (reference_lengths[r] - PROTO_SEAL_OVERHEAD);
+                for (int i = sizeof(proto_reply_header); same && i < opened; i++)
+                    same = sealed[r][i] == test_byte(r, i - sizeof(proto_reply_header));
+                if (!same) {
+                    fprintf(stderr, "Seal self-test: sealed reply %u does not open back\n", r);
+                    failed = 1;
+                }
+            }
+            continue;
+        }
+        for (unsigned int r = 0; r < SEAL_SELFTEST_REPLIES; r++)
+            if (lengths[r] != reference_lengths[r] || memcmp(sealed[r], reference[r], lengths[r]) != 0) {
+                fprintf(stderr, "Seal self-test: the %s kernel seals reply %u unlike the scalar one\n",
+                        seal_kernel_name(kinds[k]), r);
+                failed = 1;
+                break;
+            }
+    }
+    blocks = selected;
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Returns the name of a keystream kernel.
+ * @param[in] kind: the kernel.
+ * @return a static string with the kernel name.
+ */
+const char *seal_kernel_name(seal_kernel kind)
+{
+    switch (kind) {
+        case SEAL_SCALAR:
+            return "scalar";
+        case SEAL_AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
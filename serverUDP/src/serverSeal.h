@@ -0,0 +1,162 @@
+/*
+ ============================================================================
+ Name        : serverSeal.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the sealing of the replies with a pre-shared key
+ ============================================================================
+ */
+#ifndef SERVER_SEAL_H
+#define SERVER_SEAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../../common/aead.h" // Cipher shared with the client
+
+#define SEAL_PATH_SIZE 256 // Longest key file path, with its terminator
+
+#define SEAL_LANES 8 // ChaCha20 blocks computed at once by the vector kernel
+
+#define SEAL_SELFTEST_REPLIES 12 // Replies of different sizes sealed by every kernel in seal_selftest()
+
+// Available keystream kernels
+typedef enum {
+    SEAL_SCALAR,  // Portable C, one block at a time
+    SEAL_AVX2     // SEAL_LANES blocks per step, of one reply or of several
+} seal_kernel;
+
+// Session key of one worker: the subkey of the pre-shared key and a random salt
+typedef struct {
+    uint32_t key[8];                      // HChaCha20 subkey
+    unsigned char salt[AEAD_SALT_SIZE];   // First bytes of every nonce
+    uint64_t counter;                     // Last bytes of the next nonce
+} reply_sealer;
+
+// A reply datagram to seal in place
+typedef struct {
+    unsigned char *data;    // The datagram, in a buffer of PROTO_MAX_DATAGRAM bytes
+    size_t length;          // Its size, updated by seal_batch()
+} seal_item;
+
+/**
+ * @brief Loads the pre-shared key of the sealed replies and picks the fastest kernel.
+ *
+ * The file holds the key as 64 hexadecimal digits, for example the output of
+ * `head -c 32 /dev/urandom | xxd -p -c 32`. Must be called once, before the
+ * workers start; without a key (empty path) the server does not seal. With a
+ * key, seal_selftest() must pass before any reply is sealed.
+ *
+ * @param[in] path: the key file, "" for none.
+ * @return 0 on success, -1 if the file cannot be read, is not a key or the
+ *         self-test fails (reported on stderr).
+ */
+int seal_start(const char *path);
+
+/**
+ * @brief Erases the pre-shared key.
+ */
+void seal_stop(void);
+
+/**
+ * @brief Uses a key given in memory, as seal_start() does with the key of its file.
+ *
+ * @param[in] key: the pre-shared key.
+ */
+void seal_use_key(const unsigned char key[AEAD_KEY_SIZE]);
+
+/**
+ * @brief Tells whether the server seals its replies.
+ *
+ * @return non-zero once a key is loaded: only PROTO_FLAG_SEALED requests are answered.
+ */
+int seal_enabled(void);
+
+/**
+ * @brief Starts a session key: draws a salt from the operating system and derives its subkey.
+ *
+ * @param[out] s: the session key of a worker.
+ * @return 0 on success, -1 if the operating system generator is not available.
+ */
+int sealer_init(reply_sealer *s);
+
+/**
+ * @brief Tells whether a reply must be sealed before it is sent.
+ *
+ * The reply builder sets PROTO_REPLY_SEALED in the header of the replies to
+ * sealed requests and leaves them in the clear: the reply cache keeps them so
+ * and every send is sealed again, under a new nonce.
+ *
+ * @param[in] data: the reply datagram.
+ * @param[in] length: its size in bytes.
+ * @return non-zero for a batch reply header flagged PROTO_REPLY_SEALED.
+ */
+static inline int seal_wanted(const unsigned char *data, size_t length)
+{
+    return length >= sizeof(proto_reply_header) && data[0] == PROTO_MAGIC &&
+           (((const proto_reply_header *) data)->flags & PROTO_REPLY_SEALED) != 0;
+}
+
+/**
+ * @brief Seals in place the replies of a send batch that need it.
+ *
+ * Each reply gets the next nonce of the session; the ChaCha20 blocks of
+ * every reply of the batch, the Poly1305 key blocks included, go through the
+ * kernel SEAL_LANES at a time, then the tags are computed. The other replies
+ * are left as they are.
+ *
+ * @param[in,out] s: the session key of the worker.
+ * @param[in,out] items: the replies, each grown by PROTO_SEAL_OVERHEAD bytes when sealed.
+ * @param[in] count: the number of replies.
+ * @return the number of replies sealed.
+ */
+unsigned int seal_batch(reply_sealer *s, seal_item *items, unsigned int count);
+
+/**
+ * @brief Seals one reply in place if it needs it, see seal_batch().
+ *
+ * @param[in,out] s: the session key of the worker.
+ * @param[in,out] data: the reply datagram, in a buffer of PROTO_MAX_DATAGRAM bytes.
+ * @param[in] length: its size in bytes.
+ * @return the size of the datagram to send.
+ */
+size_t seal_reply(reply_sealer *s, unsigned char *data, size_t length);
+
+/**
+ * @brief Returns the fastest keystream kernel supported by the running CPU.
+ *
+ * @return the kernel chosen at run time.
+ */
+seal_kernel seal_best(void);
+
+/**
+ * @brief Selects the keystream kernel; must be called before the worker threads start.
+ *
+ * @param[in] kind: the kernel to use.
+ * @return 0 on success, -1 if the CPU does not support it.
+ */
+int seal_select(seal_kernel kind);
+
+/**
+ * @brief Checks every keystream kernel supported by the CPU before it seals a reply.
+ *
+ * Each kernel encrypts the XChaCha20-Poly1305 test vector of
+ * draft-irtf-cfrg-xchacha-03 (A.3.1), then seals SEAL_SELFTEST_REPLIES replies
+ * of sizes up to a full fragment in one batch: the ciphertext and the tag must
+ * match the vector, every kernel must seal the replies byte for byte like
+ * the scalar one, and aead_open_reply() (the client side) must open them back.
+ * The kernel selected before the call is selected again after it.
+ *
+ * @return 0 if every kernel passes, -1 otherwise (the failing kernel is reported on stderr).
+ */
+int seal_selftest(void);
+
+/**
+ * @brief Returns the name of a keystream kernel.
+ *
+ * @param[in] kind: the kernel.
+ * @return a static string with the kernel name.
+ */
+const char *seal_kernel_name(seal_kernel kind);
+
+#endif /* SERVER_SEAL_H */
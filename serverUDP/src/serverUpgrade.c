@@ -0,0 +1,875 @@
+/*
+ ============================================================================
+ Name        : serverUpgrade.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the hot upgrade: bound sockets and pooled passwords
+               handed over to a new server process through a Unix socket
+ ============================================================================
+ */
+
+#if defined __linux__
+#define _GNU_SOURCE // accept4, struct ucred
+#endif
+
+#include "server.h"
+
+#if defined __linux__
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define UPGRADE_MAGIC 0x50475550u // "PGUP"
+
+#define UPGRADE_VERSION 1
+
+#define UPGRADE_SIGNAL SIGUSR2 // Interrupts the blocking calls of the workers being drained
+
+// Handoff messages, in the order they are exchanged
+enum {
+    UPGRADE_HELLO,    // New server: pooled passwords it takes per type
+    UPGRADE_OFFER,    // Previous server: number of sockets that follow
+    UPGRADE_SOCKET,   // Previous server: one socket, as SCM_RIGHTS
+    UPGRADE_POOL,     // Previous server: pooled passwords of one type
+    UPGRADE_READY,    // Previous server: everything passed, still serving
+    UPGRADE_ACK       // New server: serving, stop and exit
+};
+
+#define UPGRADE_UDP 0     // Kinds of the UPGRADE_SOCKET sockets
+#define UPGRADE_METRICS 1
+
+// Header of every message (SOCK_SEQPACKET keeps the messages apart)
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t kind;
+    uint8_t type;       // SOCKET: UPGRADE_UDP or UPGRADE_METRICS, POOL: password type
+    uint8_t reserved;
+    uint32_t count;     // HELLO: passwords per type, OFFER: sockets, POOL: passwords
+    uint32_t pid;       // Process ID of the sender
+} upgrade_header;
+
+// Largest message: a chunk of pooled passwords
+typedef struct {
+    upgrade_header h;
+    char passwords[UPGRADE_POOL_CHUNK][POOL_ENTRY];
+} upgrade_message;
+
+// New server: the sockets taken over
+static int inherited[UPGRADE_MAX_SOCKETS];   // -1 once claimed
+static unsigned int inherited_count;
+static int inherited_metrics = -1;
+static int resumed;
+static int takeover_sock = -1;               // Connection to the previous server until upgrade_listen() acknowledges
+static unsigned int takeover_pid;
+
+// Previous server: the workers to hand over
+static server_worker *served;
+static const pthread_t *serving_threads;
+static unsigned int served_count;
+static int listen_sock = -1;
+static char listen_path[UPGRADE_PATH_SIZE];
+static pthread_t handoff_thread;
+static int handoff_running;
+static atomic_int handoff_conn = -1;         // Connection of the next server during a handoff
+static atomic_int stopping;
+static atomic_int draining;
+static atomic_int handed_over;
+
+/**
+ * @brief Returns the milliseconds elapsed since a time.
+ * @param[in] start: a CLOCK_MONOTONIC time.
+ * @return the elapsed time.
+ */
+static double ms_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * @brief Bounds the waits for the other process.
+ * @param[in] sock: the handoff connection.
+ */
+static void set_timeouts(int sock)
+{
+    struct timeval t = { UPGRADE_TIMEOUT_MS / 1000, (UPGRADE_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &t, sizeof(t));
+}
+
+/**
+ * @brief Fills the address of the upgrade socket.
+ * @param[out] sun: the address.
+ * @param[in] path: the socket path, shorter than UPGRADE_PATH_SIZE.
+ */
+static void make_address(struct sockaddr_un *sun, const char *path)
+{
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    strncpy(sun->sun_path, path, sizeof(sun->sun_path) - 1);
+}
+
+/**
+ * @brief Sends one message, optionally with a socket.
+ * @param[in] sock: the handoff connection.
+ * @param[in,out] h: the message, its magic, version and pid are filled here.
+ * @param[in] length: the size of the message in bytes.
+ * @param[in] fd: the socket to pass, -1 for none.
+ * @return 0 on success, -1 otherwise.
+ */
+static int send_message(int sock, upgrade_header *h, size_t length, int fd)
+{
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { h, length };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(c), &fd, sizeof(int));
+    }
+
+    h->magic = UPGRADE_MAGIC;
+    h->version = UPGRADE_VERSION;
+    h->pid = (uint32_t) getpid();
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t) length ? 0 : -1;
+}
+
+/**
+ * @brief Receives one message and the socket it carries.
+ * @param[in] sock: the handoff connection.
+ * @param[out] m: the message.
+ * @param[out] fd: the socket passed with it, -1 for none; NULL when no socket is expected.
+ * @return the message kind, -1 if the connection failed or the message is not valid.
+ */
+static int receive_message(int sock, upgrade_message *m, int *fd)
+{
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { m, sizeof(*m) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    int received = -1;
+    if (n > 0) {
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS && c->cmsg_len == CMSG_LEN(sizeof(int)))
+                memcpy(&received, CMSG_DATA(c), sizeof(int));
+        }
+    }
+    if (fd != NULL)
+        *fd = received;
+    else if (received >= 0)
+        close(received); // Not expected here
+
+    if (n < (ssize_t) sizeof(m->h) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+        m->h.magic != UPGRADE_MAGIC || m->h.version != UPGRADE_VERSION)
+        return -1;
+    if (m->h.kind == UPGRADE_POOL &&
+        (m->h.count > UPGRADE_POOL_CHUNK || (size_t) n != sizeof(m->h) + m->h.count * POOL_ENTRY))
+        return -1;
+    return m->h.kind;
+}
+
+/**
+ * @brief Takes over the sockets of the server listening on an upgrade socket, if any.
+ * @param[in] path: the upgrade socket.
+ * @param[in] pool_room: pooled passwords to receive per type, 0 for none.
+ * @return 1 if sockets were taken over, 0 if no server listens on `path`, -1 if the handoff failed.
+ */
+int upgrade_takeover(const char *path, unsigned int pool_room)
+{
+    struct sockaddr_un sun;
+    make_address(&sun, path);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        errorhandler("Error, upgrade socket creation failed.\n");
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *) &sun, sizeof(sun)) < 0) {
+        int error = errno;
+        close(sock);
+        if (error == ENOENT || error == ECONNREFUSED)
+            return 0; // No previous server, or the path it left behind
+        log_write(LOG_ERROR, "Cannot connect to the upgrade socket %s: %s", path, strerror(error));
+        errorhandler("Error, hot upgrade failed.\n");
+        return -1;
+    }
+    set_timeouts(sock);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    upgrade_message m;
+    memset(&m.h, 0, sizeof(m.h));
+    m.h.kind = UPGRADE_HELLO;
+    m.h.count = pool_room;
+    if (send_message(sock, &m.h, sizeof(m.h), -1) < 0 || receive_message(sock, &m, NULL) != UPGRADE_OFFER ||
+        m.h.count > UPGRADE_MAX_SOCKETS + 1)
+        goto fail;
+    unsigned int pid = m.h.pid, offered = m.h.count;
+
+    for (unsigned int i = 0; i < offered; i++) {
+        int fd;
+        int kind = receive_message(sock, &m, &fd);
+        if (kind != UPGRADE_SOCKET || fd < 0) {
+            if (fd >= 0)
+                close(fd);
+            goto fail;
+        }
+        if (m.h.type == UPGRADE_UDP && inherited_count < UPGRADE_MAX_SOCKETS)
+            inherited[inherited_count++] = fd;
+        else if (m.h.type == UPGRADE_METRICS && inherited_metrics < 0)
+            inherited_metrics = fd;
+        else
+            close(fd);
+    }
+
+    unsigned int pooled = 0, dropped = 0;
+    int kind;
+    while ((kind = receive_message(sock, &m, NULL)) == UPGRADE_POOL) {
+        for (unsigned int i = 0; i < m.h.count; i++) {
+            if (pool_give((char) m.h.type, m.passwords[i]) == 0)
+                pooled++;
+            else
+                dropped++;
+        }
+    }
+    secure_wipe(&m, sizeof(m)); // The chunks hold passwords
+    if (kind != UPGRADE_READY)
+        goto fail;
+
+    // The previous server keeps serving until upgrade_listen() acknowledges
+    takeover_sock = sock;
+    takeover_pid = pid;
+    resumed = 1;
+    log_write(LOG_INFO, "Hot upgrade: took over %u sockets%s and %u pooled passwords (%u did not fit) "
+              "from process %u in %.1f ms", inherited_count, inherited_metrics >= 0 ? " and the metrics listener" : "",
+              pooled, dropped, pid, ms_since(&start));
+    return 1;
+
+fail:
+    log_write(LOG_ERROR, "Hot upgrade through %s failed: the previous server did not hand its sockets over", path);
+    errorhandler("Error, hot upgrade failed.\n");
+    close(sock);
+    upgrade_release();
+    return -1;
+}
+
+/**
+ * @brief Tells whether two addresses are the same address and port.
+ * @param[in] a: the first address.
+ * @param[in] b: the second address.
+ * @return non-zero if they are equal.
+ */
+static int same_endpoint(const struct sockaddr *a, const struct sockaddr *b)
+{
+    if (a->sa_family != b->sa_family)
+        return 0;
+    if (a->sa_family == AF_INET) {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *) a, *b4 = (const struct sockaddr_in *) b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    if (a->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) a, *b6 = (const struct sockaddr_in6 *) b;
+        return a6->sin6_port == b6->sin6_port &&
+               memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Finds the unclaimed sockets taken over that are bound to an address and port.
+ * @param[in] address: the numeric IPv4 or IPv6 address.
+ * @param[in] port: the UDP port.
+ * @param[in] claim: non-zero to claim and return the first one, zero to count them.
+ * @return the socket (claim), the number of sockets (count), -1 if `claim` finds none.
+ */
+static int find_sockets(const char *address, int port, int claim)
+{
+    struct addrinfo hints, *res;
+    char service[8];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+    snprintf(service, sizeof(service), "%d", port);
+    if (inherited_count == 0 || getaddrinfo(address, service, &hints, &res) != 0)
+        return claim ? -1 : 0;
+
+    int found = claim ? -1 : 0;
+    for (unsigned int i = 0; i < inherited_count && (!claim || found < 0); i++) {
+        struct sockaddr_storage bound;
+        socklen_t len = sizeof(bound);
+        if (inherited[i] >= 0 && getsockname(inherited[i], (struct sockaddr *) &bound, &len) == 0 &&
+            same_endpoint((struct sockaddr *) &bound, res->ai_addr)) {
+            if (claim) {
+                found = inherited[i];
+                inherited[i] = -1;
+            } else
+                found++;
+        }
+    }
+    freeaddrinfo(res);
+    return found;
+}
+
+/**
+ * @brief Returns a socket taken over that is bound to an address and port.
+ * @param[in] address: the numeric IPv4 or IPv6 address.
+ * @param[in] port: the UDP port.
+ * @return the socket, -1 if none is left for this address.
+ */
+int upgrade_socket(const char *address, int port)
+{
+    return find_sockets(address, port, 1);
+}
+
+/**
+ * @brief Counts the sockets taken over that are bound to an address and port and not claimed yet.
+ * @param[in] address: the numeric IPv4 or IPv6 address.
+ * @param[in] port: the UDP port.
+ * @return the number of sockets.
+ */
+unsigned int upgrade_socket_count(const char *address, int port)
+{
+    return (unsigned int) find_sockets(address, port, 0);
+}
+
+/**
+ * @brief Returns a socket taken over that is bound to a Unix socket path.
+ * @param[in] path: the path of the socket.
+ * @param[in] type: SOCK_DGRAM or SOCK_SEQPACKET.
+ * @return the socket, -1 if none of this path and type was taken over.
+ */
+int upgrade_local_socket(const char *path, int type)
+{
+    for (unsigned int i = 0; i < inherited_count; i++) {
+        struct sockaddr_un bound;
+        socklen_t len = sizeof(bound);
+        int kind;
+        socklen_t kind_len = sizeof(kind);
+        memset(&bound, 0, sizeof(bound));
+        if (inherited[i] >= 0 && getsockname(inherited[i], (struct sockaddr *) &bound, &len) == 0 &&
+            bound.sun_family == AF_UNIX && strncmp(bound.sun_path, path, sizeof(bound.sun_path)) == 0 &&
+            getsockopt(inherited[i], SOL_SOCKET, SO_TYPE, &kind, &kind_len) == 0 && kind == type) {
+            int sock = inherited[i];
+            inherited[i] = -1;
+            return sock;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Returns the metrics listener taken over, if it listens on a port.
+ * @param[in] port: the TCP port of the metrics endpoint.
+ * @return the listening socket, -1 if none was taken over on this port.
+ */
+int upgrade_metrics_socket(int port)
+{
+    struct sockaddr_in bound;
+    socklen_t len = sizeof(bound);
+    if (inherited_metrics < 0 || getsockname(inherited_metrics, (struct sockaddr *) &bound, &len) < 0 ||
+        bound.sin_family != AF_INET || bound.sin_port != htons(port))
+        return -1;
+    int sock = inherited_metrics;
+    inherited_metrics = -1;
+    return sock;
+}
+
+/**
+ * @brief Refuses the handoff if a socket taken over has no worker.
+ * @return 0 if every socket taken over was claimed, -1 otherwise (reported).
+ */
+int upgrade_check_claimed(void)
+{
+    unsigned int unclaimed = 0;
+    for (unsigned int i = 0; i < inherited_count; i++)
+        unclaimed += inherited[i] >= 0;
+    if (unclaimed == 0)
+        return 0;
+    log_write(LOG_ERROR, "Hot upgrade refused: %u sockets of process %u match no address or local endpoint "
+              "of this server, which would drop their queued datagrams; the previous server keeps serving",
+              unclaimed, takeover_pid);
+    errorhandler("Error, hot upgrade refused: serve every address and local endpoint of the previous server.\n");
+    return -1;
+}
+
+/**
+ * @brief Closes the sockets taken over that no worker claimed.
+ */
+void upgrade_release(void)
+{
+    unsigned int unused = 0;
+    for (unsigned int i = 0; i < inherited_count; i++) {
+        if (inherited[i] >= 0) {
+            close(inherited[i]);
+            unused++;
+        }
+    }
+    inherited_count = 0;
+    if (inherited_metrics >= 0)
+        close(inherited_metrics);
+    inherited_metrics = -1;
+    if (unused > 0)
+        log_write(LOG_WARN, "Hot upgrade: %u sockets taken over match no worker and were closed", unused);
+}
+
+/**
+ * @brief Tells whether this process took the sockets over from a previous server.
+ * @return non-zero after a successful upgrade_takeover().
+ */
+int upgrade_resumed(void)
+{
+    return resumed;
+}
+
+/**
+ * @brief Handler of UPGRADE_SIGNAL: only there to interrupt the blocking calls.
+ * @param[in] sig: the signal received.
+ */
+static void kick(int sig)
+{
+    (void) sig;
+}
+
+/**
+ * @brief Makes UPGRADE_SIGNAL interrupt the blocking calls of the workers.
+ */
+static void catch_kick(void)
+{
+    // No SA_RESTART: the signal makes the blocking calls of the workers return EINTR
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = kick;
+    sigemptyset(&sa.sa_mask);
+    sigaction(UPGRADE_SIGNAL, &sa, NULL);
+}
+
+/**
+ * @brief Stops the workers: signals them until each one has left serve().
+ */
+static void drain_workers(void)
+{
+    atomic_store(&draining, 1);
+    for (;;) {
+        unsigned int serving = 0;
+        for (unsigned int i = 0; i < served_count; i++) {
+            if (!__atomic_load_n(&served[i].stopped, __ATOMIC_ACQUIRE)) {
+                pthread_kill(serving_threads[i], UPGRADE_SIGNAL);
+                serving++;
+            }
+        }
+        if (serving == 0)
+            return;
+        struct timespec pause = { 0, UPGRADE_KICK_MS * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+/**
+ * @brief Passes the pooled passwords to the next server.
+ * @param[in] conn: the handoff connection.
+ * @param[in] per_type: the most passwords to pass per type.
+ * @return the number of passwords passed.
+ */
+static unsigned int pass_pool(int conn, unsigned int per_type)
+{
+    upgrade_message m;
+    char password[POOL_ENTRY + 1];
+    unsigned int passed = 0;
+
+    for (const char *type = PASSWORD_TYPES; *type != '\0'; type++) {
+        unsigned int taken = 0, n;
+        do {
+            n = 0;
+            while (n < UPGRADE_POOL_CHUNK && taken < per_type && pool_take(*type, POOL_ENTRY, password) == 0) {
+                memcpy(m.passwords[n++], password, POOL_ENTRY);
+                taken++;
+            }
+            if (n == 0)
+                break;
+            memset(&m.h, 0, sizeof(m.h));
+            m.h.kind = UPGRADE_POOL;
+            m.h.type = (uint8_t) *type;
+            m.h.count = n;
+            if (send_message(conn, &m.h, sizeof(m.h) + n * POOL_ENTRY, -1) < 0)
+                goto out;
+            passed += n;
+        } while (n == UPGRADE_POOL_CHUNK);
+    }
+
+out:
+    secure_wipe(&m, sizeof(m)); // The chunks hold passwords
+    secure_wipe(password, sizeof(password));
+    return passed;
+}
+
+/**
+ * @brief Hands the sockets over to the server that connected, then drains the workers.
+ * @param[in] conn: the handoff connection.
+ * @return 0 once the sockets are handed over, -1 if this server keeps serving.
+ */
+static int handoff(int conn)
+{
+    struct ucred peer;
+    socklen_t len = sizeof(peer);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &peer, &len) < 0 || peer.uid != geteuid()) {
+        log_write(LOG_WARN, "Hot upgrade: connection of another user refused");
+        return -1;
+    }
+    set_timeouts(conn);
+
+    upgrade_message m;
+    if (receive_message(conn, &m, NULL) != UPGRADE_HELLO) {
+        log_write(LOG_WARN, "Hot upgrade: invalid request on the upgrade socket");
+        return -1;
+    }
+    unsigned int pid = m.h.pid, pool_room = m.h.count;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int metrics = metrics_listener();
+    memset(&m.h, 0, sizeof(m.h));
+    m.h.kind = UPGRADE_OFFER;
+    m.h.count = served_count + (metrics >= 0);
+    int failed = send_message(conn, &m.h, sizeof(m.h), -1) < 0;
+    for (unsigned int i = 0; i < served_count && !failed; i++) {
+        memset(&m.h, 0, sizeof(m.h));
+        m.h.kind = UPGRADE_SOCKET;
+        m.h.type = UPGRADE_UDP;
+        failed = send_message(conn, &m.h, sizeof(m.h), served[i].sock) < 0;
+    }
+    if (metrics >= 0 && !failed) {
+        memset(&m.h, 0, sizeof(m.h));
+        m.h.kind = UPGRADE_SOCKET;
+        m.h.type = UPGRADE_METRICS;
+        failed = send_message(conn, &m.h, sizeof(m.h), metrics) < 0;
+    }
+    // The workers take inline passwords for the few requests they serve meanwhile
+    unsigned int passed = pool_room > 0 && !failed ? pass_pool(conn, pool_room) : 0;
+    if (!failed) {
+        memset(&m.h, 0, sizeof(m.h));
+        m.h.kind = UPGRADE_READY;
+        failed = send_message(conn, &m.h, sizeof(m.h), -1) < 0;
+    }
+
+    // Both servers read the sockets until the new one acknowledges: it is serving then
+    struct timeval forever = { 0, 0 };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &forever, sizeof(forever));
+    if (failed || receive_message(conn, &m, NULL) != UPGRADE_ACK) {
+        log_write(LOG_WARN, "Hot upgrade: process %u did not take the sockets over, still serving", pid);
+        return -1;
+    }
+
+    struct timespec drain_start;
+    clock_gettime(CLOCK_MONOTONIC, &drain_start);
+    drain_workers();
+    log_write(LOG_INFO, "Hot upgrade: %u sockets and %u pooled passwords handed over to process %u in %.1f ms, "
+              "workers drained in %.1f ms", served_count, passed, pid, ms_since(&start), ms_since(&drain_start));
+    return 0;
+}
+
+/**
+ * @brief Handoff thread: serves the upgrade socket until a handoff succeeds or upgrade_stop().
+ * @param[in] arg: unused.
+ * @return always NULL.
+ */
+static void *handoff_main(void *arg)
+{
+    (void) arg;
+    while (!atomic_load(&stopping)) {
+        int conn = accept4(listen_sock, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break; // upgrade_stop() shut the socket down
+        }
+        atomic_store(&handoff_conn, conn);
+        int done = handoff(conn) == 0;
+        atomic_store(&handoff_conn, -1);
+        close(conn);
+        if (done) {
+            atomic_store(&handed_over, 1);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Listens on the upgrade socket for the next server.
+ * @param[in] path: the upgrade socket.
+ * @param[in,out] workers: the serving workers.
+ * @param[in] threads: the thread running each worker.
+ * @param[in] count: the number of workers.
+ * @return 0 on success, -1 if the socket or the thread could not be created.
+ */
+int upgrade_listen(const char *path, server_worker *workers, const pthread_t *threads, unsigned int count)
+{
+    if (takeover_sock >= 0) {
+        // Serving: the previous server can stop
+        upgrade_message m;
+        memset(&m.h, 0, sizeof(m.h));
+        m.h.kind = UPGRADE_ACK;
+        if (send_message(takeover_sock, &m.h, sizeof(m.h), -1) < 0)
+            log_write(LOG_WARN, "Hot upgrade: process %u did not get the acknowledgement: %s", takeover_pid,
+                      strerror(errno));
+        close(takeover_sock);
+        takeover_sock = -1;
+    }
+
+    if (count > UPGRADE_MAX_SOCKETS) {
+        log_write(LOG_ERROR, "Hot upgrade: more than %d sockets, upgrades disabled", UPGRADE_MAX_SOCKETS);
+        return -1;
+    }
+    struct sockaddr_un sun;
+    make_address(&sun, path);
+    listen_sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_sock < 0) {
+        log_write(LOG_ERROR, "Hot upgrade: socket creation failed: %s", strerror(errno));
+        return -1;
+    }
+
+    unlink(path); // Left by a stopped server, or by the previous one, which has handed over
+    mode_t mask = umask(0077); // Only the user of the server can take its sockets
+    int bound = bind(listen_sock, (struct sockaddr *) &sun, sizeof(sun));
+    umask(mask);
+    if (bound < 0 || listen(listen_sock, 1) < 0) {
+        log_write(LOG_ERROR, "Cannot listen on the upgrade socket %s: %s", path, strerror(errno));
+        close(listen_sock);
+        listen_sock = -1;
+        return -1;
+    }
+
+    catch_kick();
+    served = workers;
+    serving_threads = threads;
+    served_count = count;
+    strcpy(listen_path, path);
+    atomic_store(&stopping, 0);
+    if (pthread_create(&handoff_thread, NULL, handoff_main, NULL) != 0) {
+        log_write(LOG_ERROR, "Hot upgrade: thread creation failed");
+        close(listen_sock);
+        listen_sock = -1;
+        unlink(path);
+        return -1;
+    }
+    handoff_running = 1;
+    log_write(LOG_INFO, "Hot upgrade: listening on %s", path);
+    return 0;
+}
+
+/**
+ * @brief Stops listening for a next server.
+ */
+void upgrade_stop(void)
+{
+    if (handoff_running) {
+        atomic_store(&stopping, 1);
+        shutdown(listen_sock, SHUT_RDWR); // Wakes accept() up
+        int conn = atomic_load(&handoff_conn);
+        if (conn >= 0)
+            shutdown(conn, SHUT_RDWR); // A next server that has not acknowledged yet
+        pthread_join(handoff_thread, NULL);
+        handoff_running = 0;
+        close(listen_sock);
+        listen_sock = -1;
+        if (!atomic_load(&handed_over))
+            unlink(listen_path); // Once handed over, the path belongs to the next server
+    }
+    upgrade_release();
+}
+
+/**
+ * @brief Stops workers that serve without any handoff.
+ * @param[in] workers: the serving workers.
+ * @param[in] threads: the thread running each worker.
+ * @param[in] count: the number of workers.
+ */
+void upgrade_drain(server_worker *workers, const pthread_t *threads, unsigned int count)
+{
+    catch_kick();
+    served = workers;
+    serving_threads = threads;
+    served_count = count;
+    drain_workers();
+}
+
+/**
+ * @brief Tells the serving loops to stop.
+ * @return non-zero once the handoff started draining the workers.
+ */
+int upgrade_draining(void)
+{
+    return atomic_load_explicit(&draining, memory_order_relaxed);
+}
+
+#else
+
+/**
+ * @brief Takes over the sockets of a previous server.
+ * @param[in] path: the upgrade socket.
+ * @param[in] pool_room: pooled passwords to receive per type.
+ * @return always -1: hot upgrades need Linux (SOCK_SEQPACKET Unix sockets).
+ */
+int upgrade_takeover(const char *path, unsigned int pool_room)
+{
+    (void) path;
+    (void) pool_room;
+    errorhandler("Error, hot upgrades are only supported on Linux.\n");
+    return -1;
+}
+
+/**
+ * @brief Returns a socket taken over.
+ * @param[in] address: the numeric address.
+ * @param[in] port: the UDP port.
+ * @return always -1.
+ */
+int upgrade_socket(const char *address, int port)
+{
+    (void) address;
+    (void) port;
+    return -1;
+}
+
+/**
+ * @brief Returns a socket taken over bound to a path.
+ * @param[in] path: the path of the socket.
+ * @param[in] type: the socket type.
+ * @return always -1.
+ */
+int upgrade_local_socket(const char *path, int type)
+{
+    (void) path;
+    (void) type;
+    return -1;
+}
+
+/**
+ * @brief Returns the metrics listener taken over.
+ * @param[in] port: the TCP port of the metrics endpoint.
+ * @return always -1.
+ */
+int upgrade_metrics_socket(int port)
+{
+    (void) port;
+    return -1;
+}
+
+/**
+ * @brief Counts the sockets taken over bound to an address.
+ * @param[in] address: the numeric address.
+ * @param[in] port: the UDP port.
+ * @return always 0.
+ */
+unsigned int upgrade_socket_count(const char *address, int port)
+{
+    (void) address;
+    (void) port;
+    return 0;
+}
+
+/**
+ * @brief Refuses the handoff if a socket taken over has no worker: there are none.
+ * @return always 0.
+ */
+int upgrade_check_claimed(void)
+{
+    return 0;
+}
+
+/**
+ * @brief Closes the sockets taken over: there are none.
+ */
+void upgrade_release(void)
+{
+}
+
+/**
+ * @brief Tells whether this process took the sockets over.
+ * @return always 0.
+ */
+int upgrade_resumed(void)
+{
+    return 0;
+}
+
+/**
+ * @brief Listens on the upgrade socket.
+ * @param[in] path: the upgrade socket.
+ * @param[in,out] workers: the serving workers.
+ * @param[in] threads: the thread running each worker.
+ * @param[in] count: the number of workers.
+ * @return always -1.
+ */
+int upgrade_listen(const char *path, server_worker *workers, const pthread_t *threads, unsigned int count)
+{
+    (void) path;
+    (void) workers;
+    (void) threads;
+    (void) count;
+    return -1;
+}
+
+/**
+ * @brief Stops listening for a next server: nothing to stop.
+ */
+void upgrade_stop(void)
+{
+}
+
+static int drained; // Set by upgrade_drain(): there is no signal to interrupt the workers here
+
+/**
+ * @brief Stops workers that serve without any handoff: shuts their sockets down to wake them.
+ * @param[in] workers: the serving workers.
+ * @param[in] threads: the thread running each worker.
+ * @param[in] count: the number of workers.
+ */
+void upgrade_drain(server_worker *workers, const pthread_t *threads, unsigned int count)
+{
+    (void) threads;
+    drained = 1;
+    for (unsigned int i = 0; i < count; i++)
+#if defined WIN32
+        shutdown(workers[i].sock, SD_BOTH);
+#else
+        shutdown(workers[i].sock, SHUT_RDWR);
+#endif
+}
+
+/**
+ * @brief Tells the serving loops to stop.
+ * @return non-zero once upgrade_drain() was called.
+ */
+int upgrade_draining(void)
+{
+    return drained;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,167 @@
+/*
+ ============================================================================
+ Name        : serverUpgrade.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the hot upgrade: bound sockets and pooled passwords
+               handed over to a new server process through a Unix socket
+ ============================================================================
+ */
+#ifndef SERVER_UPGRADE_H
+#define SERVER_UPGRADE_H
+
+#include <pthread.h>
+#include "serverIO.h"
+
+#define UPGRADE_PATH_SIZE 108 // Longest upgrade socket path, with its terminator (sun_path)
+
+#define UPGRADE_MAX_SOCKETS 1024 // Most sockets handed over at once
+
+#define UPGRADE_TIMEOUT_MS 5000 // Longest wait for a message of the other process
+
+#define UPGRADE_KICK_MS 1 // Interval between two wake-up signals to a worker that is still serving
+
+#define UPGRADE_POOL_CHUNK 64 // Pooled passwords per handoff message
+
+/**
+ * @brief Takes over the sockets of the server listening on an upgrade socket, if any.
+ *
+ * Connects to `path`; when a previous server answers it passes every bound
+ * UDP socket and its metrics listener with SCM_RIGHTS and, if `pool_room`
+ * is not 0, the passwords left in its pool, which go to this process's pool.
+ * The previous server keeps serving until upgrade_listen() tells it that
+ * this process serves too; it then stops reading the sockets, answers the
+ * requests it had received and exits. The sockets are never closed, so no
+ * datagram is lost. If this process fails before, the previous server goes
+ * on serving. A missing or stale path is not an error.
+ *
+ * @param[in] path: the upgrade socket.
+ * @param[in] pool_room: pooled passwords to receive per type (room left in
+ *            this process's started pool), 0 for none.
+ * @return 1 if sockets were taken over, 0 if no server listens on `path`,
+ *         -1 if the handoff failed.
+ */
+int upgrade_takeover(const char *path, unsigned int pool_room);
+
+/**
+ * @brief Returns a socket taken over that is bound to an address and port.
+ *
+ * Every socket is returned at most once, so the workers of an address get
+ * the sockets of the previous workers of that address one by one.
+ *
+ * @param[in] address: the numeric IPv4 or IPv6 address.
+ * @param[in] port: the UDP port.
+ * @return the socket, -1 if none is left for this address (bind a new one).
+ */
+int upgrade_socket(const char *address, int port);
+
+/**
+ * @brief Counts the sockets taken over that are bound to an address and port and not claimed yet.
+ *
+ * The worker pool starts at least this many workers per address, so a
+ * server started with fewer workers than the previous one still serves
+ * every inherited socket: closing one would drop the datagrams it queues.
+ *
+ * @param[in] address: the numeric IPv4 or IPv6 address.
+ * @param[in] port: the UDP port.
+ * @return the number of sockets.
+ */
+unsigned int upgrade_socket_count(const char *address, int port);
+
+/**
+ * @brief Returns a socket taken over that is bound to a Unix socket path.
+ *
+ * Used for the local endpoints (see serverLocal.h), which are handed over
+ * like the UDP sockets.
+ *
+ * @param[in] path: the path of the socket.
+ * @param[in] type: SOCK_DGRAM or SOCK_SEQPACKET.
+ * @return the socket, -1 if none of this path and type was taken over.
+ */
+int upgrade_local_socket(const char *path, int type);
+
+/**
+ * @brief Returns the metrics listener taken over, if it listens on a port.
+ *
+ * @param[in] port: the TCP port of the metrics endpoint.
+ * @return the listening socket, -1 if none was taken over on this port.
+ */
+int upgrade_metrics_socket(int port);
+
+/**
+ * @brief Refuses the handoff if a socket taken over has no worker.
+ *
+ * Called once the workers claimed their sockets, before they serve. A
+ * server that does not serve an address or local endpoint of the previous
+ * one must not start: the previous server only drops its sockets after the
+ * acknowledgement of upgrade_listen(), so failing here leaves it serving
+ * and loses nothing.
+ *
+ * @return 0 if every socket taken over was claimed, -1 otherwise (reported).
+ */
+int upgrade_check_claimed(void);
+
+/**
+ * @brief Closes the sockets taken over that no worker claimed.
+ *
+ * Only the error paths leave sockets unclaimed (see upgrade_check_claimed()),
+ * so the previous server still holds them.
+ */
+void upgrade_release(void);
+
+/**
+ * @brief Tells whether this process took the sockets over from a previous server.
+ *
+ * @return non-zero after a successful upgrade_takeover().
+ */
+int upgrade_resumed(void);
+
+/**
+ * @brief Listens on the upgrade socket for the next server.
+ *
+ * Called once the workers are serving. After a takeover it first tells the
+ * previous server to stop. It then replaces `path` with a socket only the
+ * user of the server can connect to and starts a thread that hands the
+ * worker sockets over to the first server that connects. Once that server
+ * serves too, the workers are stopped: a signal interrupts their blocking
+ * calls until each one has left serve(), after answering the datagrams it
+ * had received.
+ *
+ * @param[in] path: the upgrade socket.
+ * @param[in,out] workers: the serving workers, their `sock` in hand-over order.
+ * @param[in] threads: the thread running each worker.
+ * @param[in] count: the number of workers.
+ * @return 0 on success, -1 if the socket or the thread could not be created
+ *         (the server keeps serving, without hot upgrades).
+ */
+int upgrade_listen(const char *path, server_worker *workers, const pthread_t *threads, unsigned int count);
+
+/**
+ * @brief Stops listening for a next server.
+ *
+ * Waits for a handoff in progress to finish. The upgrade socket is removed
+ * unless the sockets were handed over: the next server owns the path then.
+ */
+void upgrade_stop(void);
+
+/**
+ * @brief Stops workers that serve, without handing anything over.
+ *
+ * Used when the worker pool cannot start every worker: the ones already
+ * serving are stopped as in a handoff, and return once they left serve().
+ *
+ * @param[in] workers: the serving workers.
+ * @param[in] threads: the thread running each worker.
+ * @param[in] count: the number of workers.
+ */
+void upgrade_drain(server_worker *workers, const pthread_t *threads, unsigned int count);
+
+/**
+ * @brief Tells the serving loops to stop: the sockets belong to the next server.
+ *
+ * @return non-zero once the handoff started draining the workers.
+ */
+int upgrade_draining(void);
+
+#endif /* SERVER_UPGRADE_H */
@@ -0,0 +1,584 @@
+/*
+ ============================================================================
+ Name        : serverUring.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the io_uring receive/send loop (raw system calls, no liburing)
+ ============================================================================
+ */
+
+#include "server.h"
+
+#if defined __linux__ && defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#define URING_AVAILABLE
+#endif
+#endif
+
+#if defined URING_AVAILABLE
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#define URING_TX_TAG (1ull << 32) // user_data bit of the send operations (receives carry their slot index)
+
+#define URING_CANCEL_TAG (1ull << 33) // user_data bit of the cancellations of the receives, see drain_receives()
+
+#define URING_TIMEOUT_TAG (1ull << 34) // user_data bit of the timeouts of uring_quiesce()
+
+#define URING_QUIESCE_STEP_MS 100 // Each wait of uring_quiesce(), a fraction of URING_QUIESCE_MS
+
+// The rings shared with the kernel
+typedef struct {
+    int fd;
+    int fixed_file;                // Non-zero when the socket is registered (sqe->fd is then index 0)
+    int sqpoll;                    // Non-zero when a kernel thread consumes the submissions
+    int sock;
+    unsigned int sq_entries;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned int sq_local_tail;    // Submissions prepared, published at the next submit
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+} uring;
+
+// A posted receive
+typedef struct {
+    unsigned char data[REQUEST_BUFFER_SIZE];
+    unsigned char control[ARRIVAL_CONTROL_SIZE];
+    struct sockaddr_storage addr;
+    struct iovec iov;
+    struct msghdr msg;
+} rx_slot;
+
+// A queued reply
+typedef struct {
+    unsigned char data[PROTO_MAX_DATAGRAM];
+    struct sockaddr_storage addr;
+    struct iovec iov;
+    struct msghdr msg;
+} tx_slot;
+
+// Everything the reply sink needs
+typedef struct {
+    server_worker *w;
+    uring *u;
+    tx_slot *tx;
+    unsigned int *free_tx;         // Stack of free send slots
+    unsigned int free_count;
+    unsigned int *sealing;         // Send slots holding a reply to seal before its sendmsg is queued
+    seal_item *seal;               // The replies of `sealing`, as seen by seal_batch()
+    unsigned int sealing_count;
+    unsigned int sending;          // Sendmsg operations in flight
+    const struct sockaddr_storage *dest;
+    socklen_t dest_len;
+    unsigned long long sync_sends; // Replies sent with sendto because every send slot was busy
+} uring_ctx;
+
+/**
+ * @brief Maps the rings of a new io_uring instance.
+ * @param[out] u: the rings.
+ * @param[in] entries: the submission queue size.
+ * @param[in] sqpoll: non-zero to ask for a kernel submission thread.
+ * @return 0 on success, -1 with errno set otherwise.
+ */
+static int uring_setup(uring *u, unsigned int entries, int sqpoll)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if (sqpoll) {
+        p.flags = IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = URING_SQPOLL_IDLE_MS;
+    }
+
+    u->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0)
+        return -1;
+    u->sqpoll = sqpoll;
+    u->sq_entries = p.sq_entries;
+
+    u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_map_len > u->sq_map_len)
+            u->sq_map_len = u->cq_map_len;
+        u->cq_map_len = u->sq_map_len;
+    }
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                     IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED)
+        return -1;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        u->cq_map = u->sq_map;
+    else {
+        u->cq_map = mmap(NULL, u->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                         IORING_OFF_CQ_RING);
+        if (u->cq_map == MAP_FAILED)
+            return -1;
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+        return -1;
+
+    unsigned char *sq = u->sq_map, *cq = u->cq_map;
+    u->sq_head = (unsigned int *) (sq + p.sq_off.head);
+    u->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+    u->sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+    u->sq_flags = (unsigned int *) (sq + p.sq_off.flags);
+    u->sq_array = (unsigned int *) (sq + p.sq_off.array);
+    u->cq_head = (unsigned int *) (cq + p.cq_off.head);
+    u->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+    u->cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    u->sq_local_tail = *u->sq_tail;
+    return 0;
+}
+
+/**
+ * @brief Unmaps the rings and closes the instance.
+ * @param[in,out] u: the rings.
+ */
+static void uring_close(uring *u)
+{
+    if (u->sqes && u->sqes != MAP_FAILED)
+        munmap(u->sqes, u->sqes_len);
+    if (u->cq_map && u->cq_map != MAP_FAILED && u->cq_map != u->sq_map)
+        munmap(u->cq_map, u->cq_map_len);
+    if (u->sq_map && u->sq_map != MAP_FAILED)
+        munmap(u->sq_map, u->sq_map_len);
+    if (u->fd >= 0)
+        close(u->fd);
+}
+
+/**
+ * @brief Publishes the prepared submissions and optionally waits for completions.
+ * @param[in,out] u: the rings.
+ * @param[in] wait: number of completions to wait for (0 to only submit).
+ * @return 0 on success, -1 with errno set otherwise.
+ */
+static int uring_submit(uring *u, unsigned int wait)
+{
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned int flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    unsigned int to_submit = 0;
+    if (u->sqpoll) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); // Read sq_flags after the tail is visible
+        if (__atomic_load_n(u->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        if (flags == 0)
+            return 0; // The kernel thread is awake and nothing to wait for: no system call
+    } else
+        to_submit = u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+    if (to_submit == 0 && flags == 0)
+        return 0;
+    return syscall(__NR_io_uring_enter, u->fd, to_submit, wait, flags, NULL, 0) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Returns a cleared submission entry, submitting the queue first if it is full.
+ * @param[in,out] u: the rings.
+ * @return the entry.
+ */
+static struct io_uring_sqe *uring_sqe(uring *u)
+{
+    while (u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) == u->sq_entries) {
+        if (u->sqpoll) {
+            __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+            syscall(__NR_io_uring_enter, u->fd, 0, 0, IORING_ENTER_SQ_WAKEUP | IORING_ENTER_SQ_WAIT, NULL, 0);
+        } else
+            uring_submit(u, 0);
+    }
+    unsigned int index = u->sq_local_tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[index] = index;
+    u->sq_local_tail++;
+    return sqe;
+}
+
+/**
+ * @brief Queues a recvmsg or sendmsg operation on the server socket.
+ * @param[in,out] u: the rings.
+ * @param[in] opcode: IORING_OP_RECVMSG or IORING_OP_SENDMSG.
+ * @param[in] msg: the message header, valid until the completion.
+ * @param[in] user_data: the tag returned with the completion.
+ */
+static void uring_msg(uring *u, int opcode, struct msghdr *msg, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    sqe->opcode = (uint8_t) opcode;
+    sqe->fd = u->fixed_file ? 0 : u->sock;
+    sqe->flags = u->fixed_file ? IOSQE_FIXED_FILE : 0;
+    sqe->addr = (uint64_t) (uintptr_t) msg;
+    sqe->len = 1;
+    sqe->user_data = user_data;
+}
+
+/**
+ * @brief Posts the receive of a slot again.
+ * @param[in,out] u: the rings.
+ * @param[in,out] rx: the receive slots.
+ * @param[in] i: the slot to post.
+ */
+static void post_receive(uring *u, rx_slot *rx, unsigned int i)
+{
+    rx[i].msg.msg_namelen = sizeof(rx[i].addr); // The kernel overwrote it with the source length
+    rx[i].msg.msg_controllen = ARRIVAL_CONTROL_SIZE;
+    uring_msg(u, IORING_OP_RECVMSG, &rx[i].msg, i);
+}
+
+/**
+ * @brief Cancels every posted receive: the socket is being handed over to a new server.
+ *
+ * A receive that completed before its cancellation still delivers its
+ * datagram, which is answered; the others complete with -ECANCELED
+ * without taking a datagram off the socket.
+ *
+ * @param[in,out] u: the rings.
+ * @param[in] depth: the number of receive slots.
+ */
+static void drain_receives(uring *u, unsigned int depth)
+{
+    for (unsigned int i = 0; i < depth; i++) {
+        struct io_uring_sqe *sqe = uring_sqe(u);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = i; // The user_data of the receive
+        sqe->user_data = URING_CANCEL_TAG;
+    }
+}
+
+/**
+ * @brief Cancels what is still posted and reaps the completions, so that the buffers can be freed.
+ *
+ * Closing the ring does not stop its operations at once: the kernel tears it
+ * down asynchronously, and a recvmsg or sendmsg still in flight would use its
+ * slot after free(). The receives are cancelled (unless the drain already did),
+ * the sends complete on their own; every wait is bounded by a timeout
+ * operation, up to URING_QUIESCE_MS in all.
+ *
+ * @param[in,out] u: the rings.
+ * @param[in,out] c: the reply context, its send slots are returned as they complete.
+ * @param[in] depth: the number of receive slots.
+ * @param[in,out] posted: the receives in flight.
+ * @param[in] cancelled: non-zero if drain_receives() already ran.
+ * @return 0 once nothing is in flight, -1 if some operation may still use its buffer.
+ */
+static int uring_quiesce(uring *u, uring_ctx *c, unsigned int depth, unsigned int *posted, int cancelled)
+{
+    static const struct __kernel_timespec step = { 0, URING_QUIESCE_STEP_MS * 1000000ll };
+    unsigned int waits = 0, uncancelled = 0;
+
+    for (unsigned int k = 0; k < c->sealing_count; k++) // Held back for sealing, never posted
+        secure_wipe(c->tx[c->sealing[k]].data, sizeof(c->tx[0].data));
+    c->sealing_count = 0;
+    if (*posted > 0 && !cancelled)
+        drain_receives(u, depth);
+    while (*posted > uncancelled || c->sending > 0) {
+        unsigned int head = *u->cq_head;
+        unsigned int tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (waits++ == URING_QUIESCE_MS / URING_QUIESCE_STEP_MS)
+                return -1;
+            struct io_uring_sqe *sqe = uring_sqe(u); // Wakes the wait below if nothing else completes
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = (uint64_t) (uintptr_t) &step;
+            sqe->len = 1;
+            sqe->user_data = URING_TIMEOUT_TAG;
+            if (uring_submit(u, 1) < 0 && errno != EINTR)
+                return -1;
+            continue;
+        }
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+            if (cqe->user_data & URING_TX_TAG) {
+                unsigned int i = (unsigned int) (cqe->user_data & ~URING_TX_TAG);
+                secure_wipe(c->tx[i].data, c->tx[i].iov.iov_len); // The replies carry passwords
+                c->free_tx[c->free_count++] = i;
+                c->sending--;
+            } else if (cqe->user_data & URING_CANCEL_TAG) {
+                if (cqe->res < 0 && cqe->res != -ENOENT && cqe->res != -EALREADY)
+                    uncancelled++; // Still posted: only a datagram ends it
+            } else if (!(cqe->user_data & URING_TIMEOUT_TAG) && *posted > 0)
+                (*posted)--; // A receive: cancelled, or its datagram is dropped with the loop
+        }
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return uncancelled > 0 ? -1 : 0;
+}
+
+/**
+ * @brief Reply sink of the io_uring loop: queues a sendmsg from a free send slot.
+ * @param[in,out] ctx: the uring_ctx.
+ * @param[in] data: the reply datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ */
+static void uring_reply(void *ctx, const unsigned char *data, size_t length)
+{
+    uring_ctx *c = ctx;
+
+    if (c->free_count == 0) {
+        // Every send slot is still in flight: send this one synchronously
+        unsigned char sealed[PROTO_MAX_DATAGRAM];
+        if (seal_wanted(data, length)) {
+            memcpy(sealed, data, length);
+            length = seal_reply(&c->w->sealer, sealed, length);
+            data = sealed;
+            metric_add(&c->w->m->sealed, 1);
+        }
+        int sent = sendto(c->w->sock, (const char *) data, length, 0, (const struct sockaddr *) c->dest, c->dest_len);
+        if (data == sealed)
+            secure_wipe(sealed, sizeof(sealed));
+        if (sent < 0) {
+            metric_add(&c->w->m->send_failures, 1);
+            log_write(LOG_ERROR, "Worker %d: password send failed: %s", c->w->id, strerror(errno));
+        } else {
+            metric_add(&c->w->m->datagrams_out, 1);
+            metric_add(&c->w->m->bytes_out, sent);
+        }
+        if (c->sync_sends++ == 0)
+            log_write(LOG_WARN, "Worker %d: io_uring send slots exhausted, sending synchronously", c->w->id);
+        return;
+    }
+
+    unsigned int i = c->free_tx[--c->free_count];
+    tx_slot *t = &c->tx[i];
+    memcpy(t->data, data, length);
+    memcpy(&t->addr, c->dest, c->dest_len);
+    t->iov.iov_len = length;
+    t->msg.msg_namelen = c->dest_len;
+    if (seal_wanted(data, length)) {
+        c->sealing[c->sealing_count++] = i; // Sealed with the other replies of the batch by seal_pending()
+    } else {
+        uring_msg(c->u, IORING_OP_SENDMSG, &t->msg, URING_TX_TAG | i);
+        c->sending++;
+    }
+}
+
+/**
+ * @brief Seals together the replies held back by uring_reply() and queues their sendmsg.
+ * @param[in,out] c: the uring_ctx.
+ */
+static void seal_pending(uring_ctx *c)
+{
+    if (c->sealing_count == 0)
+        return;
+    for (unsigned int k = 0; k < c->sealing_count; k++) {
+        tx_slot *t = &c->tx[c->sealing[k]];
+        c->seal[k].data = t->data;
+        c->seal[k].length = t->iov.iov_len;
+    }
+    metric_add(&c->w->m->sealed, seal_batch(&c->w->sealer, c->seal, c->sealing_count));
+    for (unsigned int k = 0; k < c->sealing_count; k++) {
+        unsigned int i = c->sealing[k];
+        c->tx[i].iov.iov_len = c->seal[k].length;
+        uring_msg(c->u, IORING_OP_SENDMSG, &c->tx[i].msg, URING_TX_TAG | i);
+    }
+    c->sending += c->sealing_count;
+    c->sealing_count = 0;
+}
+
+/**
+ * @brief Serves requests with recvmsg/sendmsg operations kept posted on an io_uring ring.
+ * @param[in,out] w: the worker owning the socket.
+ * @param[in] sqpoll: non-zero to ask for a kernel submission thread.
+ * @return URING_UNSUPPORTED if io_uring is not available, 0 when the socket was handed over,
+ *         -1 if the loop stops because of an error.
+ */
+int serve_uring(server_worker *w, int sqpoll)
+{
+    unsigned int depth = w->batch_size > 1 ? w->batch_size : URING_DEPTH;
+    unsigned int tx_count = 2 * depth;
+    unsigned int posted = 0;       // Receives in flight
+    int draining = 0, stuck = 0;
+    uring u;
+    uring_ctx c;
+    rx_slot *rx = NULL;
+    int ret = -1;
+
+    memset(&u, 0, sizeof(u));
+    memset(&c, 0, sizeof(c));
+    u.fd = -1;
+    u.sock = w->sock;
+
+    // Every posted operation fits in the submission queue, and the completion queue is twice as large
+    if (uring_setup(&u, depth + tx_count, sqpoll) < 0) {
+        int error = errno;
+        uring_close(&u);
+        if (!sqpoll) {
+            errno = error; // Tells serve() why
+            return URING_UNSUPPORTED;
+        }
+        log_write(LOG_WARN, "Worker %d: io_uring SQPOLL not available (%s), using plain submission",
+                  w->id, strerror(error));
+        memset(&u, 0, sizeof(u));
+        u.fd = -1;
+        u.sock = w->sock;
+        if (uring_setup(&u, depth + tx_count, 0) < 0) {
+            error = errno;
+            uring_close(&u);
+            errno = error; // Tells serve() why
+            return URING_UNSUPPORTED;
+        }
+    }
+    u.fixed_file = syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_FILES, &w->sock, 1) == 0;
+
+    rx = calloc(depth, sizeof(rx_slot));
+    c.tx = calloc(tx_count, sizeof(tx_slot));
+    c.free_tx = calloc(tx_count, sizeof(unsigned int));
+    c.sealing = calloc(tx_count, sizeof(unsigned int));
+    c.seal = calloc(tx_count, sizeof(seal_item));
+    if (!rx || !c.tx || !c.free_tx || !c.sealing || !c.seal) {
+        errorhandler("Error, io_uring buffers allocation failed.\n");
+        goto out;
+    }
+    c.w = w;
+    c.u = &u;
+    for (unsigned int i = 0; i < tx_count; i++) {
+        c.tx[i].iov.iov_base = c.tx[i].data;
+        c.tx[i].msg.msg_iov = &c.tx[i].iov;
+        c.tx[i].msg.msg_iovlen = 1;
+        c.tx[i].msg.msg_name = &c.tx[i].addr;
+        c.free_tx[c.free_count++] = i;
+    }
+    for (unsigned int i = 0; i < depth; i++) {
+        rx[i].iov.iov_base = rx[i].data;
+        rx[i].iov.iov_len = REQUEST_BUFFER_SIZE;
+        rx[i].msg.msg_iov = &rx[i].iov;
+        rx[i].msg.msg_iovlen = 1;
+        rx[i].msg.msg_name = &rx[i].addr;
+        rx[i].msg.msg_control = rx[i].control;
+        post_receive(&u, rx, i);
+        posted++;
+    }
+    log_write(LOG_INFO, "Worker %d: io_uring with %u posted receives%s%s", w->id, depth,
+              u.sqpoll ? ", SQPOLL" : "", u.fixed_file ? ", fixed file" : "");
+
+    for (;;) {
+        if (!draining && upgrade_draining()) {
+            drain_receives(&u, depth);
+            draining = 1;
+        }
+        // Handed over: leave once every receive and send has completed, nothing is lost in the ring
+        if (draining && posted == 0 && c.free_count == tx_count) {
+            ret = 0;
+            break;
+        }
+
+        unsigned int head = *u.cq_head;
+        unsigned int tail = __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (uring_submit(&u, 1) < 0 && errno != EINTR) {
+                log_write(LOG_ERROR, "Worker %d: io_uring wait failed: %s", w->id, strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        unsigned int received = 0;
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &u.cqes[head & *u.cq_mask];
+            uint64_t tag = cqe->user_data;
+            int res = cqe->res;
+
+            if (tag & URING_TX_TAG) {
+                unsigned int i = (unsigned int) (tag & ~URING_TX_TAG);
+                if (res < 0) {
+                    metric_add(&w->m->send_failures, 1);
+                    log_write(LOG_ERROR, "Worker %d: password send failed: %s", w->id, strerror(-res));
+                } else {
+                    metric_add(&w->m->datagrams_out, 1);
+                    metric_add(&w->m->bytes_out, res);
+                }
+                secure_wipe(c.tx[i].data, c.tx[i].iov.iov_len); // The replies carry passwords
+                c.free_tx[c.free_count++] = i;
+                c.sending--;
+                continue;
+            }
+            if (tag & URING_CANCEL_TAG) {
+                // -ENOENT and -EALREADY: the receive completes on its own; anything else: it cannot be cancelled
+                if (res < 0 && res != -ENOENT && res != -EALREADY) {
+                    log_write(LOG_WARN, "Worker %d: io_uring receive not cancelled: %s", w->id, strerror(-res));
+                    posted = 0;
+                    stuck = 1; // Its slot stays in use until a datagram arrives
+                }
+                continue;
+            }
+
+            unsigned int i = (unsigned int) tag;
+            if (res >= 0) {
+                c.dest = &rx[i].addr;
+                c.dest_len = rx[i].msg.msg_namelen;
+                local_source(&rx[i].addr, c.dest_len);
+                handle_datagram(w, &rx[i].addr, rx[i].data, res, arrival_time(&rx[i].msg), uring_reply, &c);
+                received++;
+            } else if (res != -EINTR && res != -EAGAIN && res != -ECANCELED) {
+                log_write(LOG_ERROR, "Worker %d: receive failed: %s", w->id, strerror(-res));
+                if (res == -EBADF || res == -ENOTSOCK || res == -EFAULT || res == -EINVAL) {
+                    // Not posted again, and its completion is consumed: uring_quiesce() waits for the others
+                    if (posted > 0)
+                        posted--;
+                    __atomic_store_n(u.cq_head, head + 1, __ATOMIC_RELEASE);
+                    goto out;
+                }
+            }
+            if (draining) {
+                if (posted > 0)
+                    posted--;
+            } else
+                post_receive(&u, rx, i);
+        }
+        __atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+
+        if (received > 0)
+            account_batch(w, received);
+        seal_pending(&c);
+        if (uring_submit(&u, 0) < 0 && errno != EINTR && errno != EBUSY) {
+            log_write(LOG_ERROR, "Worker %d: io_uring submit failed: %s", w->id, strerror(errno));
+            break;
+        }
+    }
+
+out:
+    // The ring is torn down asynchronously: nothing may be in flight when its buffers are freed
+    if (uring_quiesce(&u, &c, depth, &posted, draining) < 0 || stuck) {
+        log_write(LOG_WARN, "Worker %d: io_uring operations still posted, their buffers are not freed", w->id);
+        rx = NULL;
+        c.tx = NULL;
+    }
+    uring_close(&u);
+    free(rx);
+    free(c.tx);
+    free(c.free_tx);
+    free(c.sealing);
+    free(c.seal);
+    return ret;
+}
+
+#else
+
+/**
+ * @brief Serves requests with recvmsg/sendmsg operations kept posted on an io_uring ring.
+ * @param[in,out] w: the worker owning the socket.
+ * @param[in] sqpoll: non-zero to ask for a kernel submission thread.
+ * @return always URING_UNSUPPORTED: io_uring needs Linux.
+ */
+int serve_uring(server_worker *w, int sqpoll)
+{
+    (void) w;
+    (void) sqpoll;
+    errno = ENOSYS;
+    return URING_UNSUPPORTED;
+}
+
+#endif /* URING_AVAILABLE */
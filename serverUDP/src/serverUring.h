@@ -0,0 +1,48 @@
+/*
+ ============================================================================
+ Name        : serverUring.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the io_uring receive/send loop
+ ============================================================================
+ */
+#ifndef SERVER_URING_H
+#define SERVER_URING_H
+
+#include "serverIO.h"
+
+#define URING_DEPTH 64 // Receives kept posted when the batch size is 1
+
+#define URING_SQPOLL_IDLE_MS 1000 // Idle time after which the kernel submission thread sleeps
+
+#define URING_QUIESCE_MS 2000 // Longest wait for the operations still posted when the loop stops on an error
+
+#define URING_UNSUPPORTED -2 // serve_uring() result when the kernel has no usable io_uring
+
+/**
+ * @brief Serves requests with recvmsg/sendmsg operations kept posted on an io_uring ring.
+ *
+ * `w->batch_size` receives (URING_DEPTH when it is 1) stay posted at all times,
+ * each with its own buffer and address allocated once; the socket is registered
+ * with the ring as a fixed file. Replies are copied into a pool of send buffers
+ * and queued as sendmsg operations. One io_uring_enter call submits everything
+ * queued and waits for the next completions; with `sqpoll` a kernel thread
+ * picks up the submissions, so a busy server makes no system call at all.
+ * When the socket is handed over to a new server the posted receives are
+ * cancelled and the loop returns once every receive and send has completed:
+ * a datagram taken off the socket is always answered. A loop stopped by an
+ * error cancels its receives and waits up to URING_QUIESCE_MS for every
+ * operation to complete before freeing the buffers, which it leaks instead
+ * when the ring cannot confirm it: the kernel never writes to freed memory.
+ *
+ * @param[in,out] w: the worker owning the socket.
+ * @param[in] sqpoll: non-zero to ask for a kernel submission thread (falls
+ *            back to plain submission when it is not allowed).
+ * @return URING_UNSUPPORTED before serving anything if io_uring is not
+ *         available, 0 when the socket was handed over, -1 if the loop stops
+ *         because of an error.
+ */
+int serve_uring(server_worker *w, int sqpoll);
+
+#endif /* SERVER_URING_H */
@@ -0,0 +1,208 @@
+/*
+ ============================================================================
+ Name        : serverValidate.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the request validation stage
+ ============================================================================
+ */
+
+#include <string.h>
+#include "serverValidate.h"
+#include "serverPolicy.h"
+#include "serverSeal.h"
+
+#if defined WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+/**
+ * @brief Checks a password length against the served range.
+ * @param[in] length: the requested length.
+ * @return non-zero if the length is served.
+ */
+static inline int length_ok(uint32_t length)
+{
+    return length - PROTO_MIN_LENGTH <= PROTO_MAX_LENGTH - PROTO_MIN_LENGTH; // One unsigned compare
+}
+
+/**
+ * @brief Checks the type and length of a password, or the word count of a passphrase.
+ * @param[in] type: the requested type.
+ * @param[in] policy: the policy of the type, NULL if none.
+ * @param[in] length: the requested length or word count.
+ * @return REJECT_NONE if the password can be served, REJECT_TYPE or REJECT_LENGTH otherwise.
+ */
+static reject_reason check_password(unsigned char type, const passgen_policy *policy, uint32_t length)
+{
+    if (type == PROTO_TYPE_PASSPHRASE) {
+        const passgen_wordlist *wl = policy_wordlist();
+        if (wl == NULL)
+            return REJECT_TYPE;
+        if (length < PROTO_MIN_WORDS || length > PROTO_MAX_WORDS || wordlist_max_phrase(wl, length) > PROTO_MAX_PASSPHRASE)
+            return REJECT_LENGTH;
+        return REJECT_NONE;
+    }
+    if (policy == NULL)
+        return REJECT_TYPE;
+    if (!length_ok(length) || !passgen_policy_fits(policy, (int) length))
+        return REJECT_LENGTH;
+    return REJECT_NONE;
+}
+
+/**
+ * @brief Returns the policy of a validated batch spec.
+ * @param[in] req: the validated batch request.
+ * @param[in] spec: one of its specs.
+ * @return the policy of the spec.
+ */
+const passgen_policy *spec_policy(const request_view *req, const proto_spec *spec)
+{
+    return spec->type == PROTO_TYPE_POLICY ? &req->request_policy : policy_find(spec->type);
+}
+
+/**
+ * @brief Checks the specs of a batch request and counts its reply fragments.
+ * @param[in,out] req: the batch request, `total`, `fragments` and `reply_size` are filled.
+ * @param[in] has_policy: non-zero if `req->request_policy` holds the request policy.
+ * @return REJECT_NONE if every spec is valid, the reason of the rejection otherwise.
+ */
+static reject_reason validate_specs(request_view *req, int has_policy)
+{
+    unsigned int total = 0, fragments = 1;
+    size_t used = sizeof(proto_reply_header), room = proto_reply_room(req->sealed), entries = 0;
+
+    for (unsigned int s = 0; s < req->header->spec_count; s++) {
+        const proto_spec *spec = &req->specs[s];
+        unsigned int count = ntohs(spec->count);
+        if (spec->type == PROTO_TYPE_POLICY && !has_policy)
+            return REJECT_POLICY;
+        reject_reason reason = check_password(spec->type, spec_policy(req, spec), spec->length);
+        if (reason != REJECT_NONE)
+            return reason;
+        if (count > PROTO_MAX_PASSWORDS - total)
+            return REJECT_TOO_MANY;
+        total += count;
+
+        // One step per fragment (not per password): the same packing as the reply builder
+        size_t entry = proto_entry_size(spec->type, spec->length);
+        while (count > 0) {
+            unsigned int fit = (room - used) / entry;
+            if (fit == 0) {
+                fragments++;
+                used = sizeof(proto_reply_header);
+                continue;
+            }
+            if (fit > count)
+                fit = count;
+            used += fit * entry;
+            entries += fit * entry;
+            count -= fit;
+        }
+    }
+
+    if (fragments > PROTO_MAX_FRAGMENTS)
+        return REJECT_TOO_MANY;
+    req->total = total;
+    req->fragments = fragments;
+    req->reply_size = entries + fragments * (sizeof(proto_reply_header) + (req->sealed ? PROTO_SEAL_OVERHEAD : 0));
+    return REJECT_NONE;
+}
+
+/**
+ * @brief Checks a received datagram before any work is done for it.
+ * @param[in] in: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ * @param[out] req: the decoded request.
+ * @return REJECT_NONE if the request is valid, the reason of the rejection otherwise.
+ */
+reject_reason validate_request(const unsigned char *in, size_t length, request_view *req)
+{
+    req->kind = REQUEST_NONE;
+    req->sealed = 0;
+    req->cookie = NULL;
+
+    if (length > REQUEST_MAX_SIZE)
+        return REJECT_OVERSIZED;
+    if (length < sizeof(msg))
+        return REJECT_SHORT;
+
+    if (in[0] == PROTO_MAGIC) {
+        if (length < sizeof(proto_request_header))
+            return REJECT_SHORT;
+        req->kind = REQUEST_BATCH;
+        req->header = (const proto_request_header *) in;
+        req->request_id = req->header->request_id;
+        if (req->header->version != PROTO_VERSION)
+            return REJECT_VERSION;
+        const char *policy;
+        size_t policy_length;
+        if (proto_parse_request(in, length, &req->specs, &policy, &policy_length, &req->cookie) == NULL)
+            return REJECT_MALFORMED;
+        req->sealed = (req->header->flags & PROTO_FLAG_SEALED) != 0;
+        if (req->sealed != seal_enabled())
+            return REJECT_SEAL;
+        if (policy != NULL) {
+            char spec[PROTO_MAX_POLICY + 1];
+            memcpy(spec, policy, policy_length);
+            spec[policy_length] = '\0';
+            if (memchr(spec, '\0', policy_length) != NULL || passgen_policy_compile(&req->request_policy, spec) < 0)
+                return REJECT_POLICY;
+        }
+        return validate_specs(req, policy != NULL);
+    }
+
+    uint32_t password_length;
+    if (!proto_parse_msg(in, length, &req->type, &password_length))
+        return REJECT_MALFORMED;
+    req->kind = REQUEST_MSG;
+    if (seal_enabled())
+        return REJECT_SEAL; // `msg` replies cannot be sealed
+    req->policy = policy_find((unsigned char) req->type);
+    reject_reason reason = check_password((unsigned char) req->type, req->policy, password_length);
+    if (reason != REJECT_NONE)
+        return reason;
+    req->length = (int) password_length;
+    req->reply_size = req->type == PROTO_TYPE_PASSPHRASE ? wordlist_max_phrase(policy_wordlist(), req->length)
+                                                         : password_length;
+    return REJECT_NONE;
+}
+
+/**
+ * @brief Returns the status code sent back for a rejection.
+ * @param[in] reason: the reason of the rejection.
+ * @return a PROTO_STATUS_* code.
+ */
+unsigned int reject_status(reject_reason reason)
+{
+    static const unsigned char status[REJECT_KINDS] = {
+        [REJECT_NONE] = PROTO_STATUS_OK,
+        [REJECT_SHORT] = PROTO_STATUS_BAD_REQUEST,
+        [REJECT_OVERSIZED] = PROTO_STATUS_BAD_REQUEST,
+        [REJECT_MALFORMED] = PROTO_STATUS_BAD_REQUEST,
+        [REJECT_VERSION] = PROTO_STATUS_BAD_VERSION,
+        [REJECT_TYPE] = PROTO_STATUS_BAD_TYPE,
+        [REJECT_LENGTH] = PROTO_STATUS_BAD_LENGTH,
+        [REJECT_TOO_MANY] = PROTO_STATUS_TOO_MANY,
+        [REJECT_POLICY] = PROTO_STATUS_BAD_POLICY,
+        [REJECT_SEAL] = PROTO_STATUS_BAD_SEAL
+    };
+    return status[reason];
+}
+
+/**
+ * @brief Returns the name of a rejection reason.
+ * @param[in] reason: the reason of the rejection.
+ * @return a static string with the reason name.
+ */
+const char *reject_name(reject_reason reason)
+{
+    static const char *names[REJECT_KINDS] = {
+        "none", "short", "oversized", "malformed", "version", "type", "length", "too-many", "policy", "seal"
+    };
+    return names[reason];
+}
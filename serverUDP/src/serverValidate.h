@@ -0,0 +1,108 @@
+/*
+ ============================================================================
+ Name        : serverValidate.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the request validation stage
+ ============================================================================
+ */
+#ifndef SERVER_VALIDATE_H
+#define SERVER_VALIDATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "passgen.h"
+#include "../../common/protocol.h"
+
+// Largest valid request: a batch header with PROTO_MAX_SPECS specs, the longest policy and a cookie
+#define REQUEST_MAX_SIZE (sizeof(proto_request_header) + PROTO_MAX_SPECS * sizeof(proto_spec) + 1 + PROTO_MAX_POLICY + \
+                          PROTO_COOKIE_SIZE)
+
+// Receive buffer size: one byte more than REQUEST_MAX_SIZE, so longer (truncated) datagrams are seen as oversized
+#define REQUEST_BUFFER_SIZE (REQUEST_MAX_SIZE + 1)
+
+#define REJECT_REPORT_INTERVAL 4096 // Rejected requests between two reject reports of a worker
+
+// Outcome of the validation of a datagram
+typedef enum {
+    REJECT_NONE,       // Valid request
+    REJECT_SHORT,      // Too short to be a request
+    REJECT_OVERSIZED,  // Longer than REQUEST_MAX_SIZE
+    REJECT_MALFORMED,  // Size does not match any request layout
+    REJECT_VERSION,    // Batch request of an unsupported version
+    REJECT_TYPE,       // Unknown password type
+    REJECT_LENGTH,     // Length outside PROTO_MIN_LENGTH..PROTO_MAX_LENGTH, or word count not served
+    REJECT_TOO_MANY,   // More than PROTO_MAX_PASSWORDS passwords or PROTO_MAX_FRAGMENTS fragments
+    REJECT_POLICY,     // Policy missing, not valid, or impossible to follow
+    REJECT_SEAL,       // Sealed replies asked from a server without key, or clear replies from one with a key
+    REJECT_KINDS
+} reject_reason;
+
+// Kind of request recognized in a datagram
+typedef enum {
+    REQUEST_NONE,   // Not a request: dropped without reply
+    REQUEST_MSG,    // Single password `msg`
+    REQUEST_BATCH   // Batch protocol request
+} request_kind;
+
+// A datagram decoded in place by validate_request()
+typedef struct {
+    request_kind kind;
+    char type;                            // REQUEST_MSG: the password type
+    const passgen_policy *policy;         // REQUEST_MSG: the policy of the type, NULL for passphrases
+    int length;                           // REQUEST_MSG: the password length, or the word count
+    const proto_request_header *header;   // REQUEST_BATCH: the header, inside the datagram
+    const proto_spec *specs;              // REQUEST_BATCH: the specs, inside the datagram
+    uint32_t request_id;                  // REQUEST_BATCH: the request ID, network byte order
+    unsigned int total;                   // REQUEST_BATCH: the number of passwords asked
+    unsigned int fragments;               // REQUEST_BATCH: the number of reply fragments
+    size_t reply_size;                    // The most bytes the reply takes, all its fragments together
+    const unsigned char *cookie;          // REQUEST_BATCH with PROTO_FLAG_COOKIE: the cookie inside the datagram, NULL otherwise
+    passgen_policy request_policy;        // REQUEST_BATCH with PROTO_FLAG_POLICY: the compiled policy
+    int sealed;                           // REQUEST_BATCH: non-zero if the replies are sealed (PROTO_FLAG_SEALED)
+} request_view;
+
+/**
+ * @brief Checks a received datagram before any work is done for it.
+ *
+ * Only reads the datagram: sizes are checked first, types with a lookup table
+ * and lengths with a range compare, so the cost does not depend on the
+ * requested lengths or counts and nothing is generated for a rejected request.
+ * A request policy is compiled once here, whatever the number of passwords.
+ * `req->kind` tells whether the datagram was recognized, even when it is rejected.
+ *
+ * @param[in] in: the received datagram.
+ * @param[in] length: the size of the datagram in bytes.
+ * @param[out] req: the decoded request.
+ * @return REJECT_NONE if the request is valid, the reason of the rejection otherwise.
+ */
+reject_reason validate_request(const unsigned char *in, size_t length, request_view *req);
+
+/**
+ * @brief Returns the status code sent back for a rejection.
+ *
+ * @param[in] reason: the reason of the rejection.
+ * @return a PROTO_STATUS_* code.
+ */
+unsigned int reject_status(reject_reason reason);
+
+/**
+ * @brief Returns the name of a rejection reason.
+ *
+ * @param[in] reason: the reason of the rejection.
+ * @return a static string with the reason name.
+ */
+const char *reject_name(reject_reason reason);
+
+/**
+ * @brief Returns the policy of a validated batch spec.
+ *
+ * @param[in] req: the validated batch request.
+ * @param[in] spec: one of its specs.
+ * @return the request policy for PROTO_TYPE_POLICY, the policy of the type otherwise
+ *         (NULL for PROTO_TYPE_PASSPHRASE).
+ */
+const passgen_policy *spec_policy(const request_view *req, const proto_spec *spec);
+
+#endif /* SERVER_VALIDATE_H */
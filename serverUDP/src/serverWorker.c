@@ -0,0 +1,253 @@
+/*
+ ============================================================================
+ Name        : serverWorker.c (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the server sockets and the multi-core worker pool (one SO_REUSEPORT socket per worker)
+ ============================================================================
+ */
+
+#if defined __linux__
+#define _GNU_SOURCE // pthread_setaffinity_np
+#endif
+
+#include <pthread.h>
+#include "server.h"
+
+#if defined __linux__
+#include <sched.h>
+#endif
+
+/**
+ * @brief Sets a socket buffer size and warns if the kernel granted less.
+ * @param[in] sock: the socket.
+ * @param[in] name: SO_RCVBUF or SO_SNDBUF.
+ * @param[in] force: SO_RCVBUFFORCE or SO_SNDBUFFORCE, -1 if unavailable.
+ * @param[in] size: the requested size in bytes.
+ * @param[in] sysctl: the system limit to raise when the size is capped.
+ */
+static void set_buffer(int sock, int name, int force, int size, const char *sysctl)
+{
+    // The FORCE variants ignore the system limit but need CAP_NET_ADMIN
+    if (force < 0 || setsockopt(sock, SOL_SOCKET, force, (const char *)&size, sizeof(size)) < 0)
+        setsockopt(sock, SOL_SOCKET, name, (const char *)&size, sizeof(size));
+
+    int granted = 0;
+    socklen_t len = sizeof(granted);
+    getsockopt(sock, SOL_SOCKET, name, (char *)&granted, &len);
+#if defined __linux__
+    granted /= 2; // Linux doubles the request to account for its bookkeeping
+#endif
+    if (granted < size)
+        log_write(LOG_WARN, "Socket buffer of %d bytes capped to %d: raise %s", size, granted, sysctl);
+}
+
+/**
+ * @brief Creates a server UDP socket and binds it to an address and the configured port.
+ * @param[in] opt: the server settings.
+ * @param[in] address: the numeric address to bind.
+ * @param[in] reuse_port: non-zero to set SO_REUSEPORT before binding.
+ * @return the bound socket, or -1 if creation or bind failed.
+ */
+int open_server_socket(const server_options *opt, const char *address, int reuse_port)
+{
+    struct addrinfo hints, *res;
+    char service[8];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+    snprintf(service, sizeof(service), "%d", opt->port);
+    if (getaddrinfo(address, service, &hints, &res) != 0) {
+        log_write(LOG_ERROR, "Invalid bind address %s", address);
+        errorhandler("Error, invalid bind address.\n");
+        return -1;
+    }
+
+    int my_socket = socket(res->ai_family, res->ai_socktype, res->ai_protocol); // Create socket
+    if (my_socket < 0) {
+        errorhandler("socket creation failed.\n");
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    if (res->ai_family == AF_INET6) {
+        // Off by default: "::" then also receives IPv4 datagrams as v4-mapped addresses
+        int v6only = opt->ipv6_only != 0;
+        setsockopt(my_socket, IPPROTO_IPV6, IPV6_V6ONLY, (const char *)&v6only, sizeof(v6only));
+    }
+
+#if defined SO_REUSEPORT
+    int one = 1;
+    if (reuse_port && setsockopt(my_socket, SOL_SOCKET, SO_REUSEPORT, (const char *)&one, sizeof(one)) < 0) {
+        errorhandler("setsockopt(SO_REUSEPORT) failed.\n");
+        closesocket(my_socket);
+        freeaddrinfo(res);
+        return -1;
+    }
+#else
+    if (reuse_port) {
+        errorhandler("SO_REUSEPORT is not supported on this system.\n");
+        closesocket(my_socket);
+        freeaddrinfo(res);
+        return -1;
+    }
+#endif
+
+#if defined SO_RCVBUFFORCE
+    if (opt->rcvbuf > 0)
+        set_buffer(my_socket, SO_RCVBUF, SO_RCVBUFFORCE, opt->rcvbuf, "net.core.rmem_max");
+    if (opt->sndbuf > 0)
+        set_buffer(my_socket, SO_SNDBUF, SO_SNDBUFFORCE, opt->sndbuf, "net.core.wmem_max");
+#else
+    if (opt->rcvbuf > 0)
+        set_buffer(my_socket, SO_RCVBUF, -1, opt->rcvbuf, "the receive buffer limit");
+    if (opt->sndbuf > 0)
+        set_buffer(my_socket, SO_SNDBUF, -1, opt->sndbuf, "the send buffer limit");
+#endif
+
+    // Bind call to associate the address and port to the socket (my_socket)
+    if (bind(my_socket, res->ai_addr, res->ai_addrlen) < 0) {
+        log_write(LOG_ERROR, "Cannot bind %s port %d: %s", address, opt->port, strerror(errno));
+        errorhandler("bind() failed.\n"); // If it fails, it's probably because the port is already in use or there are permission issues.
+        closesocket(my_socket);
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    freeaddrinfo(res);
+    return my_socket;
+}
+
+/**
+ * @brief Thread entry point of a worker: pins it if requested and runs its loop.
+ * @param[in,out] arg: the server_worker owned by the thread.
+ * @return always NULL.
+ */
+static void *worker_main(void *arg)
+{
+    server_worker *w = arg;
+
+#if defined __linux__
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            log_write(LOG_WARN, "Worker %d: pinning to CPU %d failed", w->id, w->cpu);
+    }
+#endif
+
+    serve(w);
+    return NULL;
+}
+
+/**
+ * @brief Runs a pool of workers that share the server port.
+ * @param[in] opt: the server settings.
+ * @return 0 when the workers stopped, -1 if the pool could not be started.
+ */
+int run_workers(const server_options *opt)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+
+    // Every bind address gets the same number of sockets: one without -w, else WORKERS (0 = one per CPU)
+    unsigned int per_address = opt->workers < 0 ? 1 : (opt->workers == 0 ? (unsigned int) cpus : (unsigned int) opt->workers);
+    // After a hot upgrade, at least as many as the previous server: each of its sockets is served, none is closed
+    unsigned int wanted = per_address;
+    for (unsigned int b = 0; b < opt->bind_count; b++) {
+        unsigned int inherited = upgrade_socket_count(opt->binds[b], opt->port);
+        if (inherited > per_address)
+            per_address = inherited;
+    }
+    if (per_address > wanted)
+        log_write(LOG_INFO, "Hot upgrade: %u workers per address instead of %u, one per socket taken over",
+                  per_address, wanted);
+    unsigned int udp_count = per_address * opt->bind_count;
+    // One more worker per local endpoint, after the UDP ones
+    unsigned int count = udp_count + (opt->local_path[0] != '\0') + (opt->rings_path[0] != '\0');
+
+    server_worker *workers = calloc(count, sizeof(server_worker));
+    pthread_t *threads = calloc(count, sizeof(pthread_t));
+    if (!workers || !threads) {
+        errorhandler("Error, worker pool allocation failed.\n");
+        free(workers);
+        free(threads);
+        return -1;
+    }
+
+    // Bind every socket before starting the threads: a failure leaves nothing running
+    unsigned int opened;
+    for (opened = 0; opened < count; opened++) {
+        server_worker *w = &workers[opened];
+        w->id = opened;
+        w->cpu = opt->pin ? (int)(opened % cpus) : -1;
+        w->batch_size = opt->batch_size;
+        w->backend = opt->backend;
+        w->interactive = !opt->quiet;
+        if (rng_init(&w->rng, opt->rng) < 0) {
+            errorhandler("Error, random engine initialization failed.\n");
+            break;
+        }
+        w->m = metrics_attach(w->id);
+        if (w->m == NULL) {
+            errorhandler("Error, worker metrics allocation failed.\n");
+            break;
+        }
+        if (opt->cache.size > 0 && (w->cache = cache_create(&opt->cache)) == NULL) {
+            errorhandler("Error, reply cache allocation failed.\n");
+            break;
+        }
+        if (seal_enabled() && sealer_init(&w->sealer) < 0) {
+            errorhandler("Error, session key initialization failed.\n");
+            break;
+        }
+        if (opened >= udp_count) {
+            w->rings = opened > udp_count || opt->local_path[0] == '\0';
+            w->sock = w->rings ? local_open_rings(opt->rings_path) : local_open_datagram(opt->local_path);
+            if (w->sock < 0)
+                break;
+            continue;
+        }
+        // After a hot upgrade the sockets of the previous server come first: they never stop receiving
+        w->sock = upgrade_socket(opt->binds[opened / per_address], opt->port);
+        if (w->sock < 0)
+            w->sock = open_server_socket(opt, opt->binds[opened / per_address], opt->workers >= 0 || per_address > 1);
+        if (w->sock < 0)
+            break;
+    }
+    int refused = opened == count && upgrade_check_claimed() < 0;
+    upgrade_release();
+
+    unsigned int started = 0;
+    if (opened == count && !refused) {
+        for (started = 0; started < count; started++) {
+            if (pthread_create(&threads[started], NULL, worker_main, &workers[started]) != 0) {
+                errorhandler("Error, worker thread creation failed.\n");
+                break;
+            }
+        }
+        log_write(LOG_INFO, "Worker pool: %u workers on %u addresses%s", started, opt->bind_count,
+                  opt->pin ? " pinned to CPUs" : "");
+        if (started < count)
+            upgrade_drain(workers, threads, started); // A partial pool never stops by itself
+        else if (opt->upgrade_path[0] != '\0')
+            upgrade_listen(opt->upgrade_path, workers, threads, count);
+    }
+
+    for (unsigned int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    upgrade_stop(); // Before the workers are freed: a handoff in progress reads them
+    for (unsigned int i = 0; i < opened; i++)
+        closesocket(workers[i].sock);
+    for (unsigned int i = 0; i <= opened && i < count; i++)
+        cache_destroy(workers[i].cache); // The worker that failed may have its cache
+
+    free(workers);
+    free(threads);
+    return started == count ? 0 : -1;
+}
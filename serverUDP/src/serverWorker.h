@@ -0,0 +1,52 @@
+/*
+ ============================================================================
+ Name        : serverWorker.h (SERVER)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the multi-core worker pool
+ ============================================================================
+ */
+#ifndef SERVER_WORKER_H
+#define SERVER_WORKER_H
+
+#include "serverData.h"
+
+/**
+ * @brief Creates a server UDP socket and binds it to an address and the configured port.
+ *
+ * The family follows the address. IPv6 sockets get IPV6_V6ONLY from
+ * `ipv6_only`, so that "::" accepts IPv4 clients too unless asked otherwise.
+ * The `rcvbuf` and `sndbuf` sizes are requested with the FORCE variants when
+ * the process may exceed the system limits, and a warning is logged when the
+ * kernel grants less than asked (net.core.rmem_max and wmem_max on Linux).
+ *
+ * @param[in] opt: the server settings (port, IPv6 and buffer settings).
+ * @param[in] address: the numeric IPv4 or IPv6 address to bind.
+ * @param[in] reuse_port: non-zero to set SO_REUSEPORT before binding, so that
+ *            several sockets can share the same address and port.
+ * @return the bound socket, or -1 if the address is invalid or creation or bind failed.
+ */
+int open_server_socket(const server_options *opt, const char *address, int reuse_port);
+
+/**
+ * @brief Runs a pool of workers that share the server port.
+ *
+ * Every worker owns a socket bound with SO_REUSEPORT, so the kernel spreads the
+ * incoming datagrams across them, a thread and its own random state:
+ * workers never share a lock. Every bind address gets its own set of workers;
+ * the Unix datagram socket (`local_path`) and the shared-memory rings
+ * (`rings_path`) get one worker each, after them.
+ * The function returns when every worker has stopped. With `upgrade_path`
+ * the sockets taken over from a previous server are used before new ones
+ * are bound, and the workers stop once a next server takes them over.
+ *
+ * @param[in] opt: the server settings; `workers` is the number of workers per
+ *            bind address, 0 for one per online CPU, -1 for a single socket
+ *            without SO_REUSEPORT, and `pin` pins worker i to CPU i
+ *            (modulo the number of CPUs).
+ * @return 0 when the workers stopped, -1 if the pool could not be started.
+ */
+int run_workers(const server_options *opt);
+
+#endif /* SERVER_WORKER_H */
@@ -1,6 +1,16 @@
 #include "support.h"
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
+#if defined WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
 
 /**
  * @brief Simulates a typewriter effect.
@@ -23,3 +33,54 @@ void typewriterEffect(const char *text, int delayMicroseconds) {
         usleep(delayMicroseconds);  // Wait for the specified delay
     }
 }
+
+/**
+ * @brief Overwrites memory with zeros in a way the compiler cannot optimize away.
+ *
+ * @param data The memory to wipe.
+ * @param length The number of bytes to wipe.
+ */
+void secure_wipe(void *data, size_t length) {
+#if defined __GLIBC__
+    explicit_bzero(data, length);
+#else
+    volatile unsigned char *p = data;
+    while (length--)
+        *p++ = 0;
+#endif
+}
+
+/**
+ * @brief Formats a socket address as "a.b.c.d:port" or "[v6 address]:port".
+ *
+ * @param addr The address, AF_INET, AF_INET6 or AF_UNIX.
+ * @param out The text, at least ADDRESS_TEXT_SIZE bytes.
+ * @param size The size of `out` in bytes.
+ */
+void format_address(const struct sockaddr_storage *addr, char *out, size_t size) {
+    char text[INET6_ADDRSTRLEN];
+
+    if (addr->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) addr;
+        if (IN6_IS_ADDR_V4MAPPED(&a6->sin6_addr)) {
+            inet_ntop(AF_INET, &a6->sin6_addr.s6_addr[12], text, sizeof(text));
+            snprintf(out, size, "%s:%d", text, ntohs(a6->sin6_port));
+        } else {
+            inet_ntop(AF_INET6, &a6->sin6_addr, text, sizeof(text));
+            snprintf(out, size, "[%s]:%d", text, ntohs(a6->sin6_port));
+        }
+    } else if (addr->ss_family == AF_INET) {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *) addr;
+        inet_ntop(AF_INET, &a4->sin_addr, text, sizeof(text));
+        snprintf(out, size, "%s:%d", text, ntohs(a4->sin_port));
+#if !defined WIN32
+    } else if (addr->ss_family == AF_UNIX) {
+        // Abstract names start with a NUL byte: printed with a leading '@', like ss(8) does
+        const struct sockaddr_un *un = (const struct sockaddr_un *) addr;
+        int abstract = un->sun_path[0] == '\0';
+        snprintf(out, size, "%s%.*s", abstract ? "@" : "unix:", (int) (sizeof(un->sun_path) - abstract),
+                 un->sun_path + abstract);
+#endif
+    } else
+        snprintf(out, size, "(family %d)", addr->ss_family);
+}
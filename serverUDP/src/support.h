@@ -2,6 +2,7 @@
 #define SUPPORT_H
 
 #include <stdio.h>
+#include <stddef.h>
 #include <unistd.h>
 
 /**
@@ -20,4 +21,31 @@
  */
 void typewriterEffect(const char *text, int delayMicroseconds);
 
+/**
+ * @brief Overwrites memory with zeros in a way the compiler cannot optimize away.
+ *
+ * Used for buffers that held passwords, just before they are released or reused.
+ *
+ * @param data The memory to wipe.
+ * @param length The number of bytes to wipe.
+ */
+void secure_wipe(void *data, size_t length);
+
+#define ADDRESS_TEXT_SIZE 56 // "[IPv6 address]:port" with the terminator
+
+struct sockaddr_storage;
+
+/**
+ * @brief Formats a socket address as "a.b.c.d:port" or "[v6 address]:port".
+ *
+ * IPv4 clients of a dual-stack socket arrive as IPv4-mapped IPv6 addresses
+ * and are printed in the IPv4 form. Local clients are printed as "unix:PATH",
+ * or "@NAME" for abstract names, truncated to `size`.
+ *
+ * @param addr The address, AF_INET, AF_INET6 or AF_UNIX (cleared past its name).
+ * @param out The text, at least ADDRESS_TEXT_SIZE bytes.
+ * @param size The size of `out` in bytes.
+ */
+void format_address(const struct sockaddr_storage *addr, char *out, size_t size);
+
 #endif // SUPPORT_H
@@ -0,0 +1,97 @@
+/*
+ ============================================================================
+ Name        : wordlist.c (LIBRARY)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Implements the memory-mapped passphrase wordlists
+ ============================================================================
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wordlist.h"
+
+/**
+ * @brief Checks the header and the offset table of a mapped list.
+ * @param[in,out] wl: the list, `map` and `map_size` set; the other fields are filled.
+ * @return 0 if the list is valid, -1 otherwise.
+ */
+static int check_list(passgen_wordlist *wl)
+{
+    const wordlist_header *h = wl->map;
+    if (wl->map_size < sizeof(*h) || h->magic != WORDLIST_MAGIC || h->version != WORDLIST_VERSION ||
+        h->count < 2 || h->max_length < 1 || h->max_length > WORDLIST_MAX_WORD ||
+        (uint64_t) h->count + 1 > (wl->map_size - sizeof(*h)) / sizeof(uint32_t))
+        return -1;
+
+    wl->offsets = (const uint32_t *) (h + 1);
+    wl->blob = (const char *) (wl->offsets + h->count + 1);
+    size_t blob_size = wl->map_size - ((const char *) wl->blob - (const char *) wl->map);
+    if (wl->offsets[0] != 0 || wl->offsets[h->count] > blob_size)
+        return -1;
+    unsigned int longest = 0;
+    for (uint32_t i = 0; i < h->count; i++) {
+        uint32_t length = wl->offsets[i + 1] - wl->offsets[i]; // Wraps when the offsets decrease
+        if (length < 1 || length > h->max_length)
+            return -1;
+        if (length > longest)
+            longest = length;
+    }
+    if (longest != h->max_length)
+        return -1;
+
+    wl->count = h->count;
+    wl->threshold = -h->count % h->count;
+    wl->max_length = h->max_length;
+    return 0;
+}
+
+/**
+ * @brief Maps an indexed wordlist file.
+ * @param[out] wl: the opened list.
+ * @param[in] path: the indexed file.
+ * @return 0 on success, -1 on error.
+ */
+int wordlist_open(passgen_wordlist *wl, const char *path)
+{
+    struct stat st;
+
+    memset(wl, 0, sizeof(*wl));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file
+    if (map == MAP_FAILED)
+        return -1;
+
+    wl->map = map;
+    wl->map_size = (size_t) st.st_size;
+    if (check_list(wl) < 0) {
+        wordlist_close(wl);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Unmaps a wordlist.
+ * @param[in,out] wl: the list.
+ */
+void wordlist_close(passgen_wordlist *wl)
+{
+    if (wl->map != NULL)
+        munmap((void *) wl->map, wl->map_size);
+    memset(wl, 0, sizeof(*wl));
+}
@@ -0,0 +1,87 @@
+/*
+ ============================================================================
+ Name        : wordlist.h (LIBRARY)
+ Author      : Giordano, Aghilar
+ Version     : 1.0
+ Copyright   : Your copyright notice
+ Description : Header file for the memory-mapped passphrase wordlists
+ ============================================================================
+ */
+#ifndef WORDLIST_H
+#define WORDLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORDLIST_MAGIC 0x4C574750u // "PGWL" in a little-endian file: a byte-swapped file does not match
+
+#define WORDLIST_VERSION 1 // Current file layout
+
+#define WORDLIST_MAX_WORD 64 // Longest word of a list
+
+/*
+ * Indexed wordlist file, written by scripts/wordlist_index.py, integers in
+ * host (little-endian) byte order:
+ *
+ *   wordlist_header
+ *   uint32_t offsets[count + 1]   word i is blob[offsets[i] .. offsets[i + 1])
+ *   char blob[offsets[count]]     the words, with no separator
+ *
+ * The file is mapped read-only and used in place: opening it reads no word,
+ * and every process serving the same list shares its pages. A list must
+ * therefore never be modified in place while a server may have it mapped:
+ * a truncated or rewritten file changes the words under the server, or
+ * kills it with SIGBUS. Write the new list to another file of the same
+ * directory and rename() it over the old one, as wordlist_index.py does;
+ * the servers keep the old list until they open the file again.
+ */
+typedef struct {
+    uint32_t magic;       // WORDLIST_MAGIC
+    uint32_t version;     // WORDLIST_VERSION
+    uint32_t count;       // Number of words
+    uint32_t max_length;  // Longest word, at most WORDLIST_MAX_WORD
+} wordlist_header;
+
+// An opened wordlist, read-only once opened: share it between threads
+typedef struct {
+    const void *map;          // The mapped file
+    size_t map_size;          // Size of the mapping
+    const uint32_t *offsets;  // count + 1 offsets into blob
+    const char *blob;         // The words
+    uint32_t count;           // Number of words
+    uint32_t threshold;       // 2^32 % count: rejection threshold of the word draws
+    unsigned int max_length;  // Longest word
+} passgen_wordlist;
+
+/**
+ * @brief Maps an indexed wordlist file.
+ *
+ * Checks the header and the offset table (offsets increasing, words of 1 to
+ * max_length characters, blob inside the file), not the words themselves.
+ *
+ * @param[out] wl: the opened list.
+ * @param[in] path: the indexed file.
+ * @return 0 on success, -1 if the file cannot be mapped or is not a valid list (errno is set).
+ */
+int wordlist_open(passgen_wordlist *wl, const char *path);
+
+/**
+ * @brief Unmaps a wordlist.
+ *
+ * @param[in,out] wl: a list opened by wordlist_open().
+ */
+void wordlist_close(passgen_wordlist *wl);
+
+/**
+ * @brief Returns the longest passphrase of a number of words.
+ *
+ * @param[in] wl: the list.
+ * @param[in] words: the number of words, 1 or more.
+ * @return the size of the longest passphrase, separators included, without terminator.
+ */
+static inline size_t wordlist_max_phrase(const passgen_wordlist *wl, unsigned int words)
+{
+    return (size_t) words * (wl->max_length + 1) - 1;
+}
+
+#endif /* WORDLIST_H */